@@ -21,16 +21,116 @@
 #ifndef CONFIG_LOG_INVARIANTS
 #define CONFIG_LOG_INVARIANTS 0
 #endif
-// Enable consistency checks and cache statistics in this file.
+// Enable consistency checks in log.c.
 
 #ifndef CONFIG_LOG_BUILTIN_CHECKS
 #define CONFIG_LOG_BUILTIN_CHECKS 0
 #endif
 
+// Hash slots of a statically allocated tag table, 0 allocates the table with malloc.
+// Must be 2**n, at most half of the slots can hold tags. Two tables are reserved.
+#ifndef CONFIG_LOG_TAG_TABLE_STATIC_SLOTS
+#define CONFIG_LOG_TAG_TABLE_STATIC_SLOTS 0
+#endif
+
+// Bytes reserved for tag names, including terminators, in each static tag table
+#ifndef CONFIG_LOG_TAG_TABLE_STATIC_STRINGS
+#define CONFIG_LOG_TAG_TABLE_STATIC_STRINGS 512
+#endif
 
-// Number of tags to be cached. Must be 2**n - 1, n >= 2.
+// Number of tag pointers to be cached, 0 disables the cache. Must be 2**n * CONFIG_LOG_TAG_CACHE_WAYS.
 #ifndef CONFIG_LOG_TAG_CACHE_SIZE
-#define CONFIG_LOG_TAG_CACHE_SIZE 15
+#define CONFIG_LOG_TAG_CACHE_SIZE 16
+#endif
+
+// Entries per cache set, 1 for a direct mapped cache, at most 8.
+#ifndef CONFIG_LOG_TAG_CACHE_WAYS
+#define CONFIG_LOG_TAG_CACHE_WAYS 2
+#endif
+
+// Tags of LOG_TAG_DEFINE collected in the log_tags linker section, the LOGx_TAG macros read their level
+// directly. Needs a GNU linker, 0 makes them plain string tags.
+#ifndef CONFIG_LOG_TAG_REGISTRY
+#define CONFIG_LOG_TAG_REGISTRY 0
+#endif
+
+// Sampling of messages per tag and level with log_sample_set, adds a word to every callsite.
+#ifndef CONFIG_LOG_SAMPLING
+#define CONFIG_LOG_SAMPLING 0
+#endif
+
+// Messages sampled out by a thread before they are added to log_sampled_out.
+#ifndef CONFIG_LOG_SAMPLING_BATCH
+#define CONFIG_LOG_SAMPLING_BATCH 64
+#endif
+
+// Suppression of repeated messages with log_dedup_set.
+#ifndef CONFIG_LOG_DEDUP
+#define CONFIG_LOG_DEDUP 0
+#endif
+
+// Size in bytes of the flight recorder ring in persistent memory, a power of two, 0 to disable it.
+#ifndef CONFIG_LOG_RECORDER_SIZE
+#define CONFIG_LOG_RECORDER_SIZE 0
+#endif
+
+// File mapped as the persistent memory of the flight recorder on Linux.
+#ifndef CONFIG_LOG_RECORDER_PATH
+#define CONFIG_LOG_RECORDER_PATH "/tmp/chiplogger.recorder"
+#endif
+
+// Largest binary record, in bytes, encoded on the stack when a binary writer is set.
+#ifndef CONFIG_LOG_BINARY_RECORD_SIZE
+#define CONFIG_LOG_BINARY_RECORD_SIZE 256
+#endif
+
+// Bytes of the async ring shared by all producers, 0 disables async mode. Must be 2**n.
+#ifndef CONFIG_LOG_ASYNC_BUFFER_SIZE
+#define CONFIG_LOG_ASYNC_BUFFER_SIZE 0
+#endif
+
+// Longest message written by the async writer, longer messages are truncated.
+#ifndef CONFIG_LOG_ASYNC_TEXT_SIZE
+#define CONFIG_LOG_ASYNC_TEXT_SIZE 512
+#endif
+
+// Stack size and priority of the async writer task on FreeRTOS
+#ifndef CONFIG_LOG_ASYNC_TASK_STACK_SIZE
+#define CONFIG_LOG_ASYNC_TASK_STACK_SIZE 3072
+#endif
+
+#ifndef CONFIG_LOG_ASYNC_TASK_PRIORITY
+#define CONFIG_LOG_ASYNC_TASK_PRIORITY 1
+#endif
+
+// Convert 16 bytes at a time with SSE2 or NEON in the buffer and hexdump formatters, when available.
+#ifndef CONFIG_LOG_BUFFER_SIMD
+#define CONFIG_LOG_BUFFER_SIMD 1
+#endif
+
+// Characters of a buffer dump written as one message, longer dumps are split between lines.
+#ifndef CONFIG_LOG_BUFFER_BLOCK_SIZE
+#define CONFIG_LOG_BUFFER_BLOCK_SIZE 128
+#endif
+
+// Characters of a message rendered by the C++ front end, see log.hpp.
+#ifndef CONFIG_LOG_CPP_TEXT_SIZE
+#define CONFIG_LOG_CPP_TEXT_SIZE 128
+#endif
+
+// Largest structured record, in bytes, encoded on the stack by log_write_fields.
+#ifndef CONFIG_LOG_STRUCTURED_RECORD_SIZE
+#define CONFIG_LOG_STRUCTURED_RECORD_SIZE 96
+#endif
+
+// Characters of a structured record rendered as JSON when no structured writer is set.
+#ifndef CONFIG_LOG_STRUCTURED_TEXT_SIZE
+#define CONFIG_LOG_STRUCTURED_TEXT_SIZE 128
+#endif
+
+// Characters of a message formatted into the memory-mapped log file by log_file_vprintf, Linux only.
+#ifndef CONFIG_LOG_FILE_LINE_SIZE
+#define CONFIG_LOG_FILE_LINE_SIZE 128
 #endif
 
 /**
@@ -49,6 +149,16 @@
 #define CONFIG_LOG_FUNCTION_NAME 1
 #endif
 
+// Timestamps of the LOGx macros in microseconds from log_timestamp_us, 0 for milliseconds from log_timestamp.
+#ifndef CONFIG_LOG_TIMESTAMP_US
+#define CONFIG_LOG_TIMESTAMP_US 0
+#endif
+
+// Print the wall clock time "HH:MM:SS.sss" instead of milliseconds since startup, FreeRTOS and Linux ports only.
+#ifndef CONFIG_LOG_TIMESTAMP_SOURCE_SYSTEM
+#define CONFIG_LOG_TIMESTAMP_SOURCE_SYSTEM 0
+#endif
+
 //print number of bytes per line for log_buffer_char and log_buffer_hex
 #define BYTES_PER_LINE 16
 
@@ -58,10 +168,15 @@
 #define ESP32
 #endif
 
+// the porting layer can be chosen with build flags, e.g. -DCONFIG_LOG_NOOS
+#if !defined(CONFIG_LOG_FREERTOS) && !defined(CONFIG_LOG_PTHREADS) && !defined(CONFIG_LOG_LINUX) && !defined(CONFIG_LOG_NOOS)
 #if defined(ESP32)
 #define CONFIG_LOG_FREERTOS
 #elif defined(__MINGW32__)
 #define CONFIG_LOG_PTHREADS
+#elif defined(__linux__)
+#define CONFIG_LOG_LINUX
 #else
 #define CONFIG_LOG_NOOS
+#endif
 #endif
\ No newline at end of file
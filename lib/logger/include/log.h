@@ -45,6 +45,7 @@ extern "C"
 
     typedef int (*vprintf_like_t)(const char *, va_list);
     typedef void (*log_writev_t)(uint8_t level, const char *tag, const char *format, va_list args);
+    typedef void (*log_binary_writer_t)(const uint8_t *data, size_t length);
 
     /**
  * @brief Set log level for given tag
@@ -63,8 +64,67 @@ extern "C"
  *
  * @param level Selects log level to enable. Only logs at this and lower verbosity
  * levels will be shown.
+ *
+ * @return false if a new tag could not be stored: the static tag table is full, see
+ * CONFIG_LOG_TAG_TABLE_STATIC_SLOTS, or the table could not be allocated. The tag keeps
+ * the default level.
+ */
+    bool log_level_set(const char *tag, uint8_t level);
+
+    /**
+ * @brief Write only a sample of the messages of a tag at a level
+ *
+ * Messages of the LOGx macros at exactly this level are written with a probability
+ * of 1 in one_in, decided by a per-thread random generator after the level check.
+ * The other ones are counted, see log_sampled_out. Other levels of the tag and
+ * log_write called directly are not sampled. Does nothing when CONFIG_LOG_SAMPLING is 0.
+ *
+ * Sampling ratios are dropped with the tag levels by log_level_set("*", level).
+ *
+ * @param tag Tag of the log entries, "*" is not supported.
+ * @param level Level of the sampled messages, LOG_ERROR to LOG_VERBOSE.
+ * @param one_in one message written out of one_in, 0 or 1 to write all of them.
+ * @return false if the tag could not be stored, like log_level_set, or sampling is disabled
+ */
+    bool log_sample_set(const char *tag, uint8_t level, uint16_t one_in);
+
+    /**
+ * @brief Number of messages not written because of sampling
+ *
+ * Other threads add their count every CONFIG_LOG_SAMPLING_BATCH messages, the
+ * count of the calling thread is always included.
+ */
+    uint32_t log_sampled_out(void);
+
+    /**
+ * @brief Collapse runs of identical messages into one line
+ *
+ * A message with the same format string, tag, level and arguments as the previous
+ * one is not written. Its arguments are hashed, not formatted, the timestamp of the
+ * LOGx macros is left out. The run is summarized by "last message repeated N times"
+ * when a different message is written, every timeout_ms while it lasts, and by
+ * log_dedup_flush. A run that ends without another message is summarized by
+ * log_dedup_poll once timeout_ms passed. A message written while another thread
+ * compares its own is not compared. Messages queued in async mode are not compared.
+ * Does nothing when CONFIG_LOG_DEDUP is 0.
+ *
+ * @param timeout_ms longest time a run is held back before its summary is written,
+ *                   0 turns suppression off
+ */
+    void log_dedup_set(uint32_t timeout_ms);
+
+    /**
+ * @brief Write the summary of the current run of repeated messages, if any
+ */
+    void log_dedup_flush(void);
+
+    /**
+ * @brief Write the summary of the current run if it lasted timeout_ms, see log_dedup_set
+ *
+ * To be called periodically, from a timer or a main loop, so a run followed by silence
+ * is summarized. The async writer calls it every time it wakes up.
  */
-    void log_level_set(const char *tag, uint8_t level);
+    void log_dedup_poll(void);
 
 
 
@@ -90,6 +150,95 @@ extern "C"
  */
     vprintf_like_t log_set_vprintf(vprintf_like_t func);
 
+    /**
+ * @brief Set function used to output binary log records
+ *
+ * While a binary writer is set, log_writev encodes each message into a compact
+ * binary record (see log_binary.h) and passes it to func instead of formatting
+ * it with the vprintf function. Formatting is deferred to the host, which
+ * decodes the records with log_binary_format.
+ *
+ * The stream header is written to func when it is set, records are written
+ * whole, one call per record.
+ *
+ * @param func new function used for binary output, NULL to return to text output
+ *
+ * @return func old function used for binary output
+ */
+    log_binary_writer_t log_set_binary_writer(log_binary_writer_t func);
+
+    /**
+ * @brief Start writing log entries asynchronously
+ *
+ * From now on log_write encodes each message into a binary record and copies it
+ * into a lock-free ring buffer of CONFIG_LOG_ASYNC_BUFFER_SIZE bytes instead of
+ * calling the output functions. A background writer (a pthread, or a FreeRTOS task)
+ * takes the records from the ring in order and writes them to the function set with
+ * log_set_writev, log_set_vprintf or log_set_binary_writer. Messages are dropped
+ * when the ring is full, see log_async_dropped.
+ *
+ * The ring is flushed at exit when the porting layer supports it.
+ *
+ * @return true if a background writer runs, false if records are only written
+ *         by log_flush, on systems without threads or when async mode is disabled
+ */
+    bool log_async_start(void);
+
+    /**
+ * @brief Stop the background writer, flush the ring and return to synchronous writing
+ */
+    void log_async_stop(void);
+
+    /**
+ * @brief Write all records queued before this call
+ *
+ * Waits for the background writer or writes the records itself. Must not be called
+ * from an output function.
+ */
+    void log_flush(void);
+
+    /**
+ * @brief Number of messages dropped because the async ring was full
+ */
+    uint32_t log_async_dropped(void);
+
+    /**
+ * @brief Start the flight recorder
+ *
+ * From now on every message up to level is encoded into a binary record and
+ * copied into a ring of CONFIG_LOG_RECORDER_SIZE bytes in memory that survives
+ * a reset: a noinit section on ESP32 and AVR, a shared mapping of the file
+ * CONFIG_LOG_RECORDER_PATH on Linux, which survives a crash of the process.
+ * The oldest records are overwritten. Messages of the LOGx macros above the
+ * level of their tag, or suppressed by a rate limit, are recorded without being
+ * written. Fields and messages of log_write are recorded when they are written.
+ *
+ * The records of the previous run are cleared, drain them first with
+ * log_recorder_drain.
+ *
+ * @param level most verbose level recorded, LOG_NONE records nothing
+ * @return false if the persistent memory can not be mapped or the recorder is disabled
+ */
+    bool log_recorder_start(uint8_t level);
+
+    /**
+ * @brief Stop recording, the records stay in the ring
+ */
+    void log_recorder_stop(void);
+
+    /**
+ * @brief Write the records found in the flight recorder ring, oldest first
+ *
+ * Called before log_recorder_start, it returns the records of the previous run,
+ * after a reset or a crash. Each entry is validated by its sequence number and
+ * checksum, entries overwritten in part or interrupted by the reset are skipped.
+ * The stream header is written before the first record, see log_binary.h.
+ *
+ * @param writer function the records are written to, NULL to only count them
+ * @return size_t number of valid records, 0 if the ring holds none
+ */
+    size_t log_recorder_drain(log_binary_writer_t writer);
+
     /**
  * @brief Function which returns timestamp to be used in log output
  *
@@ -104,6 +253,29 @@ extern "C"
  */
     uint32_t log_timestamp(void);
 
+    /**
+ * @brief 64 bit timestamp in microseconds, used in expansion of LOGx macros and in binary records
+ *
+ * On ESP32 the cycle counter of each core, extended to 64 bits by a FreeRTOS tick hook
+ * and aligned to esp_timer once per core, esp_timer itself with power management.
+ * On Linux x86-64 the invariant TSC, calibrated against CLOCK_MONOTONIC_RAW 20 ms after
+ * startup, CLOCK_MONOTONIC_RAW until then or without an invariant TSC.
+ *
+ * @return timestamp, in microseconds since startup
+ */
+    uint64_t log_timestamp_us(void);
+
+    /**
+ * @brief Coarse timestamp in milliseconds, for the rate limit of the LOGx_RATE and LOGx_LIMIT macros
+ *
+ * Cheaper than log_timestamp, with the resolution of the system tick: the tick count
+ * on FreeRTOS, CLOCK_MONOTONIC_COARSE on Linux, read from the vDSO without the TSC.
+ * Its origin is not the one of log_timestamp.
+ *
+ * @return timestamp, in milliseconds
+ */
+    uint32_t log_coarse_timestamp(void);
+
     /**
  * @brief Function which returns system timestamp to be used in log output
  *
@@ -115,7 +287,12 @@ extern "C"
  * Currently this will not get used in logging from binary blobs
  * (i.e WiFi & Bluetooth libraries), these will still print the RTOS tick time.
  *
- * @return timestamp, in "HH:MM:SS.sss"
+ * The LOGx macros print it instead of log_timestamp when
+ * CONFIG_LOG_TIMESTAMP_SOURCE_SYSTEM is 1. Only the FreeRTOS and Linux ports
+ * implement it. Each thread renders into its own buffer, "HH:MM:SS" is only
+ * rendered again when the second changes.
+ *
+ * @return timestamp, in "HH:MM:SS.sss", valid until the next call in the same thread
  */
     char *log_system_timestamp(void);
 
@@ -139,6 +316,254 @@ extern "C"
  */
     bool is_tag_level_visible(uint8_t level, const char *tag);
 
+    /**
+ * @brief per-callsite cache of the level for a tag
+ *
+ * Every LOGx macro expansion owns one static instance. The level is cached
+ * together with the generation of the tag table it was read from, the cache
+ * is refreshed lazily when log_level_set publishes a new generation.
+ */
+    typedef struct
+    {
+        const char *tag; /*!< tag of the first call, calls with other tags bypass the cache */
+        uint32_t state;  /*!< generation << LOG_CALLSITE_LEVEL_BITS | level, 0 if not cached yet */
+#if CONFIG_LOG_SAMPLING
+        uint32_t keep; /*!< messages of the callsite level kept out of 2^32, 0 if not sampled */
+#endif
+    } log_callsite_t;
+
+#if CONFIG_LOG_SAMPLING
+#define LOG_CALLSITE_INITIALIZER {NULL, 0, 0}
+#else
+#define LOG_CALLSITE_INITIALIZER {NULL, 0}
+#endif
+#define LOG_CALLSITE_LEVEL_BITS 3
+#define LOG_CALLSITE_LEVEL_MASK ((1u << LOG_CALLSITE_LEVEL_BITS) - 1)
+#define LOG_CALLSITE_GENERATION_MASK (UINT32_MAX >> LOG_CALLSITE_LEVEL_BITS)
+
+    /**
+ * @brief generation of the published tag table, truncated to LOG_CALLSITE_GENERATION_MASK
+ *
+ * Never 0, so a zeroed log_callsite_t is always stale.
+ */
+    extern uint32_t g_log_generation;
+
+    /**
+ * @brief slow path of log_callsite_visible, looks up the tag and updates the callsite cache
+ *
+ * @param callsite callsite cache to update
+ * @param level log level
+ * @param tag tag name
+ * @return true if the tag and level should be logged, false otherwise
+ */
+    bool log_callsite_refresh(log_callsite_t *callsite, uint8_t level, const char *tag);
+
+    /**
+ * @brief sampling decision for a visible message of a sampled callsite
+ *
+ * @param keep messages kept out of 2^32
+ * @return true if the message is written, false if it is counted as sampled out
+ */
+    bool log_sample_keep(uint32_t keep);
+
+#if CONFIG_LOG_RECORDER_SIZE > 0
+    /**
+ * @brief most verbose level recorded by the flight recorder, LOG_NONE when stopped
+ */
+    extern uint8_t g_log_recorder_level;
+
+    /**
+ * @brief record a message in the flight recorder without writing it
+ *
+ * This function is used in expansion of LOGx macros, for messages above the level of their tag.
+ */
+    void log_record(uint8_t level, const char *tag, const char *format, ...) __attribute__((format(printf, 3, 4)));
+
+    /**
+ * @brief record a record encoded by the caller in the flight recorder without writing it
+ *
+ * This function is used by the C++ front end in log.hpp, for messages above the level of their tag.
+ */
+    void log_record_binary(const uint8_t *record, size_t length);
+#endif
+
+    /**
+ * @brief checks if the tag and level should be printed out, using the callsite cache
+ *
+ * This function is used in expansion of LOGx macros. When the cache is up to date
+ * it costs two relaxed loads and a compare.
+ *
+ * @param callsite callsite cache
+ * @param level log level
+ * @param tag tag name
+ * @return true if the tag and level should be logged, false otherwise
+ */
+    static inline bool log_callsite_visible(log_callsite_t *callsite, uint8_t level, const char *tag)
+    {
+        uint32_t state = __atomic_load_n(&callsite->state, __ATOMIC_RELAXED);
+        if ((state >> LOG_CALLSITE_LEVEL_BITS) == __atomic_load_n(&g_log_generation, __ATOMIC_RELAXED) &&
+            __atomic_load_n(&callsite->tag, __ATOMIC_RELAXED) == tag)
+        {
+#if CONFIG_LOG_SAMPLING
+            if (level > (state & LOG_CALLSITE_LEVEL_MASK))
+            {
+                return false;
+            }
+            uint32_t keep = __atomic_load_n(&callsite->keep, __ATOMIC_RELAXED);
+            return keep == 0 || log_sample_keep(keep);
+#else
+            return level <= (state & LOG_CALLSITE_LEVEL_MASK);
+#endif
+        }
+        return log_callsite_refresh(callsite, level, tag);
+    }
+
+#if CONFIG_LOG_TAG_REGISTRY
+    /**
+ * @brief a tag defined once with LOG_TAG_DEFINE
+ *
+ * All definitions are collected in the log_tags linker section, which forms
+ * an array of them: a handle is the index of its tag. log_level_set and
+ * log_sample_set update the handles of the tag name along with the tag table,
+ * the LOGx_TAG macros read the level from the handle without any lookup.
+ */
+    typedef struct
+    {
+        const char *name;
+        uint8_t level; /*!< level of the tag, LOG_TAG_LEVEL_UNSET until read from the tag table */
+#if CONFIG_LOG_SAMPLING
+        uint32_t keep[LOG_VERBOSE]; /*!< messages kept out of 2^32 per level from LOG_ERROR, 0 if not sampled */
+#endif
+    } log_tag_t;
+
+#define LOG_TAG_LEVEL_UNSET 0xff
+#if CONFIG_LOG_SAMPLING
+#define LOG_TAG_INITIALIZER(handle) {#handle, LOG_TAG_LEVEL_UNSET, {0}}
+#else
+#define LOG_TAG_INITIALIZER(handle) {#handle, LOG_TAG_LEVEL_UNSET}
+#endif
+
+/**
+ * @brief define a tag handle, at most once per program for each name
+ *
+ * @param handle a C identifier, also used as the tag string
+ */
+#define LOG_TAG_DEFINE(handle)                                                                               \
+    __attribute__((used, section("log_tags"), aligned(__alignof__(log_tag_t)))) log_tag_t log_tag_##handle = \
+        LOG_TAG_INITIALIZER(handle)
+
+/**
+ * @brief declare a tag handle defined in another file
+ */
+#define LOG_TAG_DECLARE(handle) extern log_tag_t log_tag_##handle
+
+/**
+ * @brief tag string of a handle, for the macros and functions taking a tag string
+ */
+#define LOG_TAG_NAME(handle) (log_tag_##handle.name)
+
+    /**
+ * @brief slow path of log_tag_visible, reads the level of a handle from the tag table once
+ *
+ * @param tag handle with the level LOG_TAG_LEVEL_UNSET
+ * @param level log level
+ * @return true if the tag and level should be logged, false otherwise
+ */
+    bool log_tag_refresh(log_tag_t *tag, uint8_t level);
+
+    /**
+ * @brief checks if the tag and level should be printed out, using the level of the handle
+ *
+ * This function is used in expansion of LOGx_TAG macros, it costs one relaxed load and a
+ * compare for a message that is filtered out.
+ *
+ * @param tag tag handle
+ * @param level log level
+ * @return true if the tag and level should be logged, false otherwise
+ */
+    static inline bool log_tag_visible(log_tag_t *tag, uint8_t level)
+    {
+        uint8_t tag_level = __atomic_load_n(&tag->level, __ATOMIC_RELAXED);
+        if (level > tag_level)
+        {
+            return false;
+        }
+        if (tag_level == LOG_TAG_LEVEL_UNSET)
+        {
+            return log_tag_refresh(tag, level);
+        }
+#if CONFIG_LOG_SAMPLING
+        uint32_t keep = __atomic_load_n(&tag->keep[level - 1], __ATOMIC_RELAXED);
+        return keep == 0 || log_sample_keep(keep);
+#else
+        return true;
+#endif
+    }
+#else
+// a plain string tag, one pointer per name so the tag cache has a single entry for it
+#define LOG_TAG_DEFINE(handle) const char log_tag_##handle[] = #handle
+#define LOG_TAG_DECLARE(handle) extern const char log_tag_##handle[]
+#define LOG_TAG_NAME(handle) (log_tag_##handle)
+#endif
+
+    /**
+ * @brief token bucket limiting how often messages are written
+ *
+ * The LOGx_RATE macros own one static instance per callsite, a bucket shared
+ * by several LOGx_LIMIT callsites limits a whole tag or driver. The bucket is
+ * kept as the theoretical arrival time of the next message (GCRA), so taking
+ * a token is a single compare and swap.
+ */
+    typedef struct
+    {
+        uint32_t rate;       /*!< messages per interval */
+        uint32_t interval;   /*!< interval in milliseconds, interval * burst must stay below 2^31 */
+        uint32_t burst;      /*!< messages that can be written at once, at least 1 */
+        uint32_t tat;        /*!< arrival time of the next message at the sustained rate, in milliseconds * rate */
+        uint32_t suppressed; /*!< messages suppressed since the last one written */
+    } log_rate_limit_t;
+
+#define LOG_RATE_LIMIT_INITIALIZER(rate, interval_ms, burst) {rate, interval_ms, burst, 0, 0}
+
+    /**
+ * @brief takes a token from a rate limit bucket
+ *
+ * This function is used in expansion of the LOGx_RATE and LOGx_LIMIT macros,
+ * after the level check. It costs a coarse timestamp, two relaxed loads and a
+ * compare and swap, suppressed messages are counted with a relaxed increment.
+ * The bucket has the resolution of log_coarse_timestamp, a few milliseconds.
+ *
+ * @param limit bucket
+ * @param suppressed messages suppressed since the last message written, when true is returned
+ * @return true if the message may be written
+ */
+    static inline bool log_rate_limit_take(log_rate_limit_t *limit, uint32_t *suppressed)
+    {
+        // time in milliseconds * rate, a message costs interval, modulo 2^32
+        uint32_t now = log_coarse_timestamp() * limit->rate;
+        uint32_t tolerance = limit->interval * (limit->burst - 1);
+        uint32_t tat = __atomic_load_n(&limit->tat, __ATOMIC_RELAXED);
+        uint32_t next;
+        do
+        {
+            uint32_t ahead = tat - now;
+            // in the past, or further ahead than a bucket can be after the timestamp wrapped
+            if ((int32_t)ahead < 0 || ahead > tolerance + limit->interval)
+            {
+                ahead = 0;
+            }
+            if (ahead > tolerance)
+            {
+                __atomic_fetch_add(&limit->suppressed, 1, __ATOMIC_RELAXED);
+                return false;
+            }
+            next = now + ahead + limit->interval;
+        } while (!__atomic_compare_exchange_n(&limit->tat, &tat, next, true, __ATOMIC_RELAXED, __ATOMIC_RELAXED));
+
+        *suppressed = __atomic_load_n(&limit->suppressed, __ATOMIC_RELAXED) ? __atomic_exchange_n(&limit->suppressed, 0, __ATOMIC_RELAXED) : 0;
+        return true;
+    }
+
     /**
  * @brief Write message into the log
  *
@@ -162,6 +587,72 @@ extern "C"
     void log_write_buffer_char(uint8_t level, const char *tag, const void *buffer, uint16_t buff_len);
     void log_write_buffer_hexdump(uint8_t level, const char *tag, const void *buffer, uint16_t buff_len);
 
+    /**
+ * @brief Line formats of a buffer dump
+ */
+    typedef enum
+    {
+        LOG_DUMP_HEX,     /*!< "xx " for every byte */
+        LOG_DUMP_CHAR,    /*!< the bytes as they are, a zero byte ends the line */
+        LOG_DUMP_HEXDUMP, /*!< address, offset, hex bytes and printable characters */
+    } log_dump_format_t;
+
+    /**
+ * @brief Write a message followed by a dump of a buffer, as one message
+ *
+ * This function is used in expansion of LOGx_BUFFER_HEX, LOGx_BUFFER_CHAR and
+ * LOGx_BUFFER_HEXDUMP macros, which check the level. It does not check it again.
+ *
+ * The message and the dump are written to the output in one call, or as one
+ * record in binary and async mode. A dump longer than CONFIG_LOG_BUFFER_BLOCK_SIZE
+ * characters, or than a record, is continued in further messages.
+ *
+ * @param level level of the log
+ * @param tag description tag
+ * @param dump_format line format of the dump
+ * @param buffer Pointer to the buffer array
+ * @param buff_len length of buffer in bytes
+ * @param format format of the message preceding the dump. see ``printf``
+ */
+    void log_write_buffer(uint8_t level, const char *tag, log_dump_format_t dump_format,
+                          const void *buffer, uint16_t buff_len, const char *format, ...) __attribute__((format(printf, 6, 7)));
+
+#if CONFIG_LOG_RECORDER_SIZE > 0
+    /**
+ * @brief record a message followed by a dump of a buffer in the flight recorder without writing it
+ *
+ * This function is used in expansion of LOGx_BUFFER macros, for messages above the level of their tag.
+ */
+    void log_record_buffer(uint8_t level, const char *tag, log_dump_format_t dump_format,
+                           const void *buffer, uint16_t buff_len, const char *format, ...) __attribute__((format(printf, 6, 7)));
+#endif
+
+    /**
+ * @brief Whether messages are written as binary records, in async mode or to the binary writer
+ *
+ * This function is used by the C++ front end in log.hpp, which encodes its own records.
+ */
+    bool log_binary_output(void);
+
+    /**
+ * @brief Write a record encoded by the caller, see log_binary.h
+ *
+ * The level is not checked, the record is queued in async mode or written to the binary writer.
+ * This function is used by the C++ front end in log.hpp.
+ *
+ * @param record record, at most CONFIG_LOG_BINARY_RECORD_SIZE bytes in async mode
+ * @param length length of the record
+ * @return false if the record was not written because messages are written as text
+ */
+    bool log_write_binary(const uint8_t *record, size_t length);
+
+    /**
+ * @brief Write a message formatted by the caller
+ *
+ * The level is not checked. This function is used by the C++ front end in log.hpp.
+ */
+    void log_write_text(uint8_t level, const char *tag, const char *text);
+
     /** @cond */
 
 #include "log_internal.h"
@@ -308,110 +799,252 @@ extern "C"
 #define LOG_VALUE_FUNCTION_NAME ""
 #endif
 
-#define GET_LOG_FORMAT(letter, format) LOG_COLOR_##letter #letter " (%" PRIu32 ") %s: " LOG_FORMAT_FILENAME LOG_FORMAT_LINE LOG_FORMAT_FUNCTION_NAME " " format LOG_RESET_COLOR "\n"
-#define LOG_SYSTEM_TIME_FORMAT(letter, format) LOG_COLOR_##letter #letter " (%" PRIu32 ") %s: " LOG_FORMAT_FILENAME LOG_FORMAT_LINE LOG_FORMAT_FUNCTION_NAME " " format LOG_RESET_COLOR "\n"
+/* the timestamp of the LOGx macros, in microseconds or in milliseconds */
+#if CONFIG_LOG_TIMESTAMP_US
+#define LOG_TIMESTAMP_CONVERSION "%" PRIu64
+#define LOG_TIMESTAMP_VALUE() log_timestamp_us()
+#else
+#define LOG_TIMESTAMP_CONVERSION "%" PRIu32
+#define LOG_TIMESTAMP_VALUE() log_timestamp()
+#endif
+
+#define GET_LOG_FORMAT(letter, format) LOG_COLOR_##letter #letter " (" LOG_TIMESTAMP_CONVERSION ") %s: " LOG_FORMAT_FILENAME LOG_FORMAT_LINE LOG_FORMAT_FUNCTION_NAME " " format LOG_RESET_COLOR "\n"
+#define LOG_SYSTEM_TIME_FORMAT(letter, format) LOG_COLOR_##letter #letter " (%s) %s: " LOG_FORMAT_FILENAME LOG_FORMAT_LINE LOG_FORMAT_FUNCTION_NAME " " format LOG_RESET_COLOR "\n"
+
+/* format and timestamp of the LOGx macros */
+#if CONFIG_LOG_TIMESTAMP_SOURCE_SYSTEM
+#define LOG_MACRO_FORMAT(letter, format) LOG_SYSTEM_TIME_FORMAT(letter, format)
+#define LOG_MACRO_TIMESTAMP() log_system_timestamp()
+#else
+#define LOG_MACRO_FORMAT(letter, format) GET_LOG_FORMAT(letter, format)
+#define LOG_MACRO_TIMESTAMP() LOG_TIMESTAMP_VALUE()
+#endif
 
     /** @endcond */
 
     /** runtime macro to output logs at a specified level.
  *
- * @param tag tag of the log, which can be used to change the log level by ``log_level_set`` at runtime.
  * @param level level of the output log.
+ * @param letter level letter used in the output, one of E, W, I, D, V.
+ * @param tag tag of the log, which can be used to change the log level by ``log_level_set`` at runtime.
  * @param format format of the output log. see ``printf``
  * @param ... variables to be replaced into the log. see ``printf``
  *
  * @see ``printf``
  */
+#define LOG_AT_LEVEL(level, letter, tag, format, ...)                               \
+    do                                                                              \
+    {                                                                               \
+        static log_callsite_t log_callsite_ = LOG_CALLSITE_INITIALIZER;             \
+        if (log_callsite_visible(&log_callsite_, level, tag))                       \
+        {                                                                           \
+            LOG_WRITE_FORMATTED(level, letter, tag, format, ##__VA_ARGS__);         \
+        }                                                                           \
+        LOG_RECORD_HIDDEN(level, letter, tag, format, ##__VA_ARGS__)                \
+    } while (0)
+
+    /** runtime macro to output logs of a tag defined with LOG_TAG_DEFINE at a specified level.
+ *
+ * @param level level of the output log.
+ * @param letter level letter used in the output, one of E, W, I, D, V.
+ * @param handle tag handle, see ``LOG_TAG_DEFINE``
+ * @param format format of the output log. see ``printf``
+ * @param ... variables to be replaced into the log. see ``printf``
+ */
+#if CONFIG_LOG_TAG_REGISTRY
+#define LOG_TAG_AT_LEVEL(level, letter, handle, format, ...)                                 \
+    do                                                                                       \
+    {                                                                                        \
+        if (log_tag_visible(&log_tag_##handle, level))                                       \
+        {                                                                                    \
+            LOG_WRITE_FORMATTED(level, letter, LOG_TAG_NAME(handle), format, ##__VA_ARGS__); \
+        }                                                                                    \
+        LOG_RECORD_HIDDEN(level, letter, LOG_TAG_NAME(handle), format, ##__VA_ARGS__)        \
+    } while (0)
+#else
+#define LOG_TAG_AT_LEVEL(level, letter, handle, format, ...) LOG_AT_LEVEL(level, letter, LOG_TAG_NAME(handle), format, ##__VA_ARGS__)
+#endif
+
+    /** runtime macro to output a buffer dump at a specified level, preceded by a formatted message.
+ *
+ * The level is checked once, the message and the dump are written as one message.
+ *
+ * @param level level of the output log.
+ * @param letter level letter used in the output, one of E, W, I, D, V.
+ * @param dump_format one of ``LOG_DUMP_HEX``, ``LOG_DUMP_CHAR`` or ``LOG_DUMP_HEXDUMP``
+ * @param tag tag of the log, which can be used to change the log level by ``log_level_set`` at runtime.
+ * @param buffer Pointer to the buffer array
+ * @param buff_len length of buffer in bytes
+ * @param format format of the message preceding the dump. see ``printf``
+ * @param ... variables to be replaced into the message. see ``printf``
+ */
+#define LOG_BUFFER_AT_LEVEL(level, letter, dump_format, tag, buffer, buff_len, format, ...)                          \
+    do                                                                                                              \
+    {                                                                                                               \
+        static log_callsite_t log_callsite_ = LOG_CALLSITE_INITIALIZER;                                             \
+        if (log_callsite_visible(&log_callsite_, level, tag))                                                       \
+        {                                                                                                           \
+            log_write_buffer(level, tag, dump_format, buffer, buff_len, LOG_MACRO_FORMAT(letter, format),           \
+                             LOG_MACRO_TIMESTAMP(), tag, LOG_VALUE_FILENAME, LOG_VALUE_LINE, LOG_VALUE_FUNCTION_NAME, \
+                             ##__VA_ARGS__);                                                                        \
+        }                                                                                                           \
+        LOG_RECORD_BUFFER_HIDDEN(level, letter, dump_format, tag, buffer, buff_len, format, ##__VA_ARGS__)          \
+    } while (0)
+
+    /** runtime macro to output logs at a specified level, limited by a token bucket.
+ *
+ * The bucket is checked after the level, before the arguments are evaluated. The first message
+ * written after some were suppressed is preceded by "suppressed N messages". Suppressed messages
+ * still go to the flight recorder.
+ *
+ * @param limit pointer to the ``log_rate_limit_t`` bucket
+ * @param level level of the output log.
+ * @param letter level letter used in the output, one of E, W, I, D, V.
+ * @param tag tag of the log, which can be used to change the log level by ``log_level_set`` at runtime.
+ * @param format format of the output log. see ``printf``
+ * @param ... variables to be replaced into the log. see ``printf``
+ */
+#define LOG_LIMIT_AT_LEVEL(limit, level, letter, tag, format, ...)                                       \
+    do                                                                                                   \
+    {                                                                                                    \
+        static log_callsite_t log_callsite_ = LOG_CALLSITE_INITIALIZER;                                  \
+        uint32_t log_suppressed_;                                                                        \
+        if (log_callsite_visible(&log_callsite_, level, tag) && log_rate_limit_take(limit, &log_suppressed_)) \
+        {                                                                                                \
+            if (log_suppressed_)                                                                         \
+            {                                                                                            \
+                LOG_WRITE_FORMATTED(level, letter, tag, "suppressed %" PRIu32 " messages", log_suppressed_); \
+            }                                                                                            \
+            LOG_WRITE_FORMATTED(level, letter, tag, format, ##__VA_ARGS__);                              \
+        }                                                                                                \
+        LOG_RECORD_HIDDEN(level, letter, tag, format, ##__VA_ARGS__)                                     \
+    } while (0)
+
+    /** runtime macro to output at most rate logs per interval_ms at a specified level, burst at once.
+ *
+ * Each expansion owns its bucket, see ``LOG_LIMIT_AT_LEVEL``.
+ */
+#define LOG_RATE_AT_LEVEL(level, letter, tag, rate, interval_ms, burst, format, ...)                       \
+    do                                                                                                   \
+    {                                                                                                    \
+        static log_rate_limit_t log_rate_limit_ = LOG_RATE_LIMIT_INITIALIZER(rate, interval_ms, burst);   \
+        LOG_LIMIT_AT_LEVEL(&log_rate_limit_, level, letter, tag, format, ##__VA_ARGS__);                 \
+    } while (0)
+
+/* only expanded once the level check passed, the timestamp and the arguments are not evaluated otherwise */
+#define LOG_WRITE_FORMATTED(level, letter, tag, format, ...)                                                   \
+    log_write(level, tag, LOG_MACRO_FORMAT(letter, format), LOG_MACRO_TIMESTAMP(), tag, LOG_VALUE_FILENAME, LOG_VALUE_LINE, \
+              LOG_VALUE_FUNCTION_NAME, ##__VA_ARGS__)
+
+/* else branch of the level check, hidden messages still go to the flight recorder */
+#if CONFIG_LOG_RECORDER_SIZE > 0
+#define LOG_RECORD_HIDDEN(level, letter, tag, format, ...)                                                    \
+    else if (level <= __atomic_load_n(&g_log_recorder_level, __ATOMIC_RELAXED))                               \
+    {                                                                                                         \
+        log_record(level, tag, LOG_MACRO_FORMAT(letter, format), LOG_MACRO_TIMESTAMP(), tag, LOG_VALUE_FILENAME,      \
+                   LOG_VALUE_LINE, LOG_VALUE_FUNCTION_NAME, ##__VA_ARGS__);                                   \
+    }
+#define LOG_RECORD_BUFFER_HIDDEN(level, letter, dump_format, tag, buffer, buff_len, format, ...)              \
+    else if (level <= __atomic_load_n(&g_log_recorder_level, __ATOMIC_RELAXED))                               \
+    {                                                                                                         \
+        log_record_buffer(level, tag, dump_format, buffer, buff_len, LOG_MACRO_FORMAT(letter, format),        \
+                          LOG_MACRO_TIMESTAMP(), tag, LOG_VALUE_FILENAME, LOG_VALUE_LINE, LOG_VALUE_FUNCTION_NAME, \
+                          ##__VA_ARGS__);                                                                     \
+    }
+#else
+#define LOG_RECORD_HIDDEN(level, letter, tag, format, ...)
+#define LOG_RECORD_BUFFER_HIDDEN(level, letter, dump_format, tag, buffer, buff_len, format, ...)
+#endif
 
 /* definition to expand macro then apply to pragma message */
 #if (MAXIMUM_ENABLED_LOG_LEVEL >= LOG_VERBOSE)
-#define LOGV(tag, format, ...) log_write(LOG_VERBOSE, tag, GET_LOG_FORMAT(V, format), log_timestamp(), tag, LOG_VALUE_FILENAME, LOG_VALUE_LINE, LOG_VALUE_FUNCTION_NAME, ##__VA_ARGS__);
-#define LOGV_BUFFER_HEX(tag, buffer, buff_len, format, ...) \
-    LOGV(tag, format, ##__VA_ARGS__);                       \
-    log_write_buffer_hex(LOG_VERBOSE, tag, buffer, buff_len);
-#define LOGV_BUFFER_CHAR(tag, buffer, buff_len, format, ...) \
-    LOGV(tag, format, ##__VA_ARGS__);                        \
-    log_write_buffer_char(LOG_VERBOSE, tag, buffer, buff_len);
-#define LOGV_BUFFER_HEXDUMP(tag, buffer, buff_len, format, ...) \
-    LOGV(tag, format, ##__VA_ARGS__);                           \
-    log_write_buffer_hexdump(LOG_VERBOSE, tag, buffer, buff_len);
+#define LOGV(tag, format, ...) LOG_AT_LEVEL(LOG_VERBOSE, V, tag, format, ##__VA_ARGS__)
+#define LOGV_TAG(handle, format, ...) LOG_TAG_AT_LEVEL(LOG_VERBOSE, V, handle, format, ##__VA_ARGS__)
+#define LOGV_BUFFER_HEX(tag, buffer, buff_len, format, ...) LOG_BUFFER_AT_LEVEL(LOG_VERBOSE, V, LOG_DUMP_HEX, tag, buffer, buff_len, format, ##__VA_ARGS__)
+#define LOGV_BUFFER_CHAR(tag, buffer, buff_len, format, ...) LOG_BUFFER_AT_LEVEL(LOG_VERBOSE, V, LOG_DUMP_CHAR, tag, buffer, buff_len, format, ##__VA_ARGS__)
+#define LOGV_BUFFER_HEXDUMP(tag, buffer, buff_len, format, ...) LOG_BUFFER_AT_LEVEL(LOG_VERBOSE, V, LOG_DUMP_HEXDUMP, tag, buffer, buff_len, format, ##__VA_ARGS__)
+#define LOGV_RATE(tag, rate, interval_ms, burst, format, ...) LOG_RATE_AT_LEVEL(LOG_VERBOSE, V, tag, rate, interval_ms, burst, format, ##__VA_ARGS__)
+#define LOGV_LIMIT(limit, tag, format, ...) LOG_LIMIT_AT_LEVEL(limit, LOG_VERBOSE, V, tag, format, ##__VA_ARGS__)
 #else
 #define LOGV(tag, format, ...)
+#define LOGV_TAG(handle, format, ...)
 #define LOGV_BUFFER_HEX(tag, buffer, buff_len, format, ...)
 #define LOGV_BUFFER_CHAR(tag, buffer, buff_len, format, ...)
 #define LOGV_BUFFER_HEXDUMP(tag, buffer, buff_len, format, ...)
+#define LOGV_RATE(tag, rate, interval_ms, burst, format, ...)
+#define LOGV_LIMIT(limit, tag, format, ...)
 #endif
 
 #if (MAXIMUM_ENABLED_LOG_LEVEL >= LOG_DEBUG)
-#define LOGD(tag, format, ...) log_write(LOG_DEBUG, tag, GET_LOG_FORMAT(D, format), log_timestamp(), tag, LOG_VALUE_FILENAME, LOG_VALUE_LINE, LOG_VALUE_FUNCTION_NAME, ##__VA_ARGS__);
-#define LOGD_BUFFER_HEX(tag, buffer, buff_len, format, ...) \
-    LOGD(tag, format, ##__VA_ARGS__);                       \
-    log_write_buffer_hex(LOG_DEBUG, tag, buffer, buff_len);
-#define LOGD_BUFFER_CHAR(tag, buffer, buff_len, format, ...) \
-    LOGD(tag, format, ##__VA_ARGS__);                        \
-    log_write_buffer_char(LOG_DEBUG, tag, buffer, buff_len);
-#define LOGD_BUFFER_HEXDUMP(tag, buffer, buff_len, format, ...) \
-    LOGD(tag, format, ##__VA_ARGS__);                           \
-    log_write_buffer_hexdump(LOG_DEBUG, tag, buffer, buff_len);
+#define LOGD(tag, format, ...) LOG_AT_LEVEL(LOG_DEBUG, D, tag, format, ##__VA_ARGS__)
+#define LOGD_TAG(handle, format, ...) LOG_TAG_AT_LEVEL(LOG_DEBUG, D, handle, format, ##__VA_ARGS__)
+#define LOGD_BUFFER_HEX(tag, buffer, buff_len, format, ...) LOG_BUFFER_AT_LEVEL(LOG_DEBUG, D, LOG_DUMP_HEX, tag, buffer, buff_len, format, ##__VA_ARGS__)
+#define LOGD_BUFFER_CHAR(tag, buffer, buff_len, format, ...) LOG_BUFFER_AT_LEVEL(LOG_DEBUG, D, LOG_DUMP_CHAR, tag, buffer, buff_len, format, ##__VA_ARGS__)
+#define LOGD_BUFFER_HEXDUMP(tag, buffer, buff_len, format, ...) LOG_BUFFER_AT_LEVEL(LOG_DEBUG, D, LOG_DUMP_HEXDUMP, tag, buffer, buff_len, format, ##__VA_ARGS__)
+#define LOGD_RATE(tag, rate, interval_ms, burst, format, ...) LOG_RATE_AT_LEVEL(LOG_DEBUG, D, tag, rate, interval_ms, burst, format, ##__VA_ARGS__)
+#define LOGD_LIMIT(limit, tag, format, ...) LOG_LIMIT_AT_LEVEL(limit, LOG_DEBUG, D, tag, format, ##__VA_ARGS__)
 #else
 #define LOGD(tag, format, ...)
+#define LOGD_TAG(handle, format, ...)
 #define LOGD_BUFFER_HEX(tag, buffer, buff_len, format, ...)
 #define LOGD_BUFFER_CHAR(tag, buffer, buff_len, format, ...)
 #define LOGD_BUFFER_HEXDUMP(tag, buffer, buff_len, format, ...)
+#define LOGD_RATE(tag, rate, interval_ms, burst, format, ...)
+#define LOGD_LIMIT(limit, tag, format, ...)
 #endif
 
 #if (MAXIMUM_ENABLED_LOG_LEVEL >= LOG_INFO)
-#define LOGI(tag, format, ...) log_write(LOG_INFO, tag, GET_LOG_FORMAT(I, format), log_timestamp(), tag, LOG_VALUE_FILENAME, LOG_VALUE_LINE, LOG_VALUE_FUNCTION_NAME, ##__VA_ARGS__);
-#define LOGI_BUFFER_HEX(tag, buffer, buff_len, format, ...) \
-    LOGI(tag, format, ##__VA_ARGS__);                       \
-    log_write_buffer_hex(LOG_INFO, tag, buffer, buff_len);
-#define LOGI_BUFFER_CHAR(tag, buffer, buff_len, format, ...) \
-    LOGI(tag, format, ##__VA_ARGS__);                        \
-    log_write_buffer_char(LOG_INFO, tag, buffer, buff_len);
-#define LOGI_BUFFER_HEXDUMP(tag, buffer, buff_len, format, ...) \
-    LOGI(tag, format, ##__VA_ARGS__);                           \
-    log_write_buffer_hexdump(LOG_INFO, tag, buffer, buff_len);
+#define LOGI(tag, format, ...) LOG_AT_LEVEL(LOG_INFO, I, tag, format, ##__VA_ARGS__)
+#define LOGI_TAG(handle, format, ...) LOG_TAG_AT_LEVEL(LOG_INFO, I, handle, format, ##__VA_ARGS__)
+#define LOGI_BUFFER_HEX(tag, buffer, buff_len, format, ...) LOG_BUFFER_AT_LEVEL(LOG_INFO, I, LOG_DUMP_HEX, tag, buffer, buff_len, format, ##__VA_ARGS__)
+#define LOGI_BUFFER_CHAR(tag, buffer, buff_len, format, ...) LOG_BUFFER_AT_LEVEL(LOG_INFO, I, LOG_DUMP_CHAR, tag, buffer, buff_len, format, ##__VA_ARGS__)
+#define LOGI_BUFFER_HEXDUMP(tag, buffer, buff_len, format, ...) LOG_BUFFER_AT_LEVEL(LOG_INFO, I, LOG_DUMP_HEXDUMP, tag, buffer, buff_len, format, ##__VA_ARGS__)
+#define LOGI_RATE(tag, rate, interval_ms, burst, format, ...) LOG_RATE_AT_LEVEL(LOG_INFO, I, tag, rate, interval_ms, burst, format, ##__VA_ARGS__)
+#define LOGI_LIMIT(limit, tag, format, ...) LOG_LIMIT_AT_LEVEL(limit, LOG_INFO, I, tag, format, ##__VA_ARGS__)
 #else
 #define LOGI(tag, format, ...)
+#define LOGI_TAG(handle, format, ...)
 #define LOGI_BUFFER_HEX(tag, buffer, buff_len, format, ...)
 #define LOGI_BUFFER_CHAR(tag, buffer, buff_len, format, ...)
 #define LOGI_BUFFER_HEXDUMP(tag, buffer, buff_len, format, ...)
+#define LOGI_RATE(tag, rate, interval_ms, burst, format, ...)
+#define LOGI_LIMIT(limit, tag, format, ...)
 #endif
 
 #if (MAXIMUM_ENABLED_LOG_LEVEL >= LOG_WARN)
-#define LOGW(tag, format, ...) log_write(LOG_WARN, tag, GET_LOG_FORMAT(W, format), log_timestamp(), tag, LOG_VALUE_FILENAME, LOG_VALUE_LINE, LOG_VALUE_FUNCTION_NAME, ##__VA_ARGS__);
-#define LOGW_BUFFER_HEX(tag, buffer, buff_len, format, ...) \
-    LOGW(tag, format, ##__VA_ARGS__);                       \
-    log_write_buffer_hex(LOG_WARN, tag, buffer, buff_len);
-#define LOGW_BUFFER_CHAR(tag, buffer, buff_len, format, ...) \
-    LOGW(tag, format, ##__VA_ARGS__);                        \
-    log_write_buffer_char(LOG_WARN, tag, buffer, buff_len);
-#define LOGW_BUFFER_HEXDUMP(tag, buffer, buff_len, format, ...) \
-    LOGW(tag, format, ##__VA_ARGS__);                           \
-    log_write_buffer_hexdump(LOG_WARN, tag, buffer, buff_len);
+#define LOGW(tag, format, ...) LOG_AT_LEVEL(LOG_WARN, W, tag, format, ##__VA_ARGS__)
+#define LOGW_TAG(handle, format, ...) LOG_TAG_AT_LEVEL(LOG_WARN, W, handle, format, ##__VA_ARGS__)
+#define LOGW_BUFFER_HEX(tag, buffer, buff_len, format, ...) LOG_BUFFER_AT_LEVEL(LOG_WARN, W, LOG_DUMP_HEX, tag, buffer, buff_len, format, ##__VA_ARGS__)
+#define LOGW_BUFFER_CHAR(tag, buffer, buff_len, format, ...) LOG_BUFFER_AT_LEVEL(LOG_WARN, W, LOG_DUMP_CHAR, tag, buffer, buff_len, format, ##__VA_ARGS__)
+#define LOGW_BUFFER_HEXDUMP(tag, buffer, buff_len, format, ...) LOG_BUFFER_AT_LEVEL(LOG_WARN, W, LOG_DUMP_HEXDUMP, tag, buffer, buff_len, format, ##__VA_ARGS__)
+#define LOGW_RATE(tag, rate, interval_ms, burst, format, ...) LOG_RATE_AT_LEVEL(LOG_WARN, W, tag, rate, interval_ms, burst, format, ##__VA_ARGS__)
+#define LOGW_LIMIT(limit, tag, format, ...) LOG_LIMIT_AT_LEVEL(limit, LOG_WARN, W, tag, format, ##__VA_ARGS__)
 #else
 #define LOGW(tag, format, ...)
+#define LOGW_TAG(handle, format, ...)
 #define LOGW_BUFFER_HEX(tag, buffer, buff_len, format, ...)
 #define LOGW_BUFFER_CHAR(tag, buffer, buff_len, format, ...)
 #define LOGW_BUFFER_HEXDUMP(tag, buffer, buff_len, format, ...)
+#define LOGW_RATE(tag, rate, interval_ms, burst, format, ...)
+#define LOGW_LIMIT(limit, tag, format, ...)
 #endif
 
 #if (MAXIMUM_ENABLED_LOG_LEVEL >= LOG_ERROR)
-#define LOGE(tag, format, ...) log_write(LOG_ERROR, tag, GET_LOG_FORMAT(E, format), log_timestamp(), tag, LOG_VALUE_FILENAME, LOG_VALUE_LINE, LOG_VALUE_FUNCTION_NAME, ##__VA_ARGS__);
-#define LOGE_BUFFER_HEX(tag, buffer, buff_len, format, ...) \
-    LOGE(tag, format, ##__VA_ARGS__);                       \
-    log_write_buffer_hex(LOG_ERROR, tag, buffer, buff_len);
-#define LOGE_BUFFER_CHAR(tag, buffer, buff_len, format, ...) \
-    LOGE(tag, format, ##__VA_ARGS__);                        \
-    log_write_buffer_char(LOG_ERROR, tag, buffer, buff_len);
-#define LOGE_BUFFER_HEXDUMP(tag, buffer, buff_len, format, ...) \
-    LOGE(tag, format, ##__VA_ARGS__);                           \
-    log_write_buffer_hexdump(LOG_ERROR, tag, buffer, buff_len);
+#define LOGE(tag, format, ...) LOG_AT_LEVEL(LOG_ERROR, E, tag, format, ##__VA_ARGS__)
+#define LOGE_TAG(handle, format, ...) LOG_TAG_AT_LEVEL(LOG_ERROR, E, handle, format, ##__VA_ARGS__)
+#define LOGE_BUFFER_HEX(tag, buffer, buff_len, format, ...) LOG_BUFFER_AT_LEVEL(LOG_ERROR, E, LOG_DUMP_HEX, tag, buffer, buff_len, format, ##__VA_ARGS__)
+#define LOGE_BUFFER_CHAR(tag, buffer, buff_len, format, ...) LOG_BUFFER_AT_LEVEL(LOG_ERROR, E, LOG_DUMP_CHAR, tag, buffer, buff_len, format, ##__VA_ARGS__)
+#define LOGE_BUFFER_HEXDUMP(tag, buffer, buff_len, format, ...) LOG_BUFFER_AT_LEVEL(LOG_ERROR, E, LOG_DUMP_HEXDUMP, tag, buffer, buff_len, format, ##__VA_ARGS__)
+#define LOGE_RATE(tag, rate, interval_ms, burst, format, ...) LOG_RATE_AT_LEVEL(LOG_ERROR, E, tag, rate, interval_ms, burst, format, ##__VA_ARGS__)
+#define LOGE_LIMIT(limit, tag, format, ...) LOG_LIMIT_AT_LEVEL(limit, LOG_ERROR, E, tag, format, ##__VA_ARGS__)
 #else
 #define LOGE(tag, format, ...)
+#define LOGE_TAG(handle, format, ...)
 #define LOGE_BUFFER_HEX(tag, buffer, buff_len, format, ...)
 #define LOGE_BUFFER_CHAR(tag, buffer, buff_len, format, ...)
 #define LOGE_BUFFER_HEXDUMP(tag, buffer, buff_len, format, ...)
+#define LOGE_RATE(tag, rate, interval_ms, burst, format, ...)
+#define LOGE_LIMIT(limit, tag, format, ...)
 #endif
 
 #ifdef __cplusplus
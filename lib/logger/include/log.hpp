@@ -0,0 +1,936 @@
+// Copyright 2015-2019 Espressif Systems (Shanghai) PTE LTD
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#ifndef __LOG_HPP__
+#define __LOG_HPP__
+
+#if __cplusplus < 201703L
+#error "log.hpp requires C++17"
+#endif
+
+#include <array>
+#include <cstddef>
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <tuple>
+#include <type_traits>
+#include <utility>
+#include "log.h"
+#include "log_binary.h"
+
+/*
+ * C++ front end
+ *
+ * The LOGx_CPP macros take the same arguments as the LOGx macros. The format
+ * string becomes a type, it is parsed at compile time and the arguments are
+ * checked against its conversions, a mismatch fails to compile. Every
+ * callsite instantiates its own writer: in binary and async mode it packs the
+ * arguments into a record (see log_binary.h) without parsing the format at
+ * runtime, otherwise it renders the text itself, with snprintf only for
+ * conversions that have flags, a width or a precision, floats and pointers.
+ *
+ * Supported conversions are those of log_binary.h, except n and wide
+ * characters. Integers must have the size the length modifier reads, after
+ * promotion, their signedness is not checked.
+ */
+
+namespace chiplogger
+{
+    namespace detail
+    {
+        enum class length_t : uint8_t
+        {
+            none,
+            hh,
+            h,
+            l,
+            ll,
+            j,
+            z,
+            t,
+            long_double,
+        };
+
+        // what a conversion expects of its value
+        enum class kind_t : uint8_t
+        {
+            none, // no value, "%%" or an incomplete conversion at the end
+            integer,
+            character,
+            floating,
+            string,
+            pointer,
+            unsupported,
+        };
+
+        struct conversion_t
+        {
+            size_t literal = 0; // text before the conversion, from the end of the previous one
+            size_t start = 0;   // the '%'
+            size_t end = 0;     // after the conversion character
+            size_t arg = 0;     // first argument consumed
+            size_t args = 0;    // arguments consumed, '*' included
+            bool plain = true;  // no flags, width or precision
+            bool width_star = false;
+            bool precision_star = false;
+            int precision = -1; // -1 if not specified
+            length_t length = length_t::none;
+            char conversion = 0; // 0 for an incomplete conversion at the end of the format
+            kind_t kind = kind_t::none;
+        };
+
+        constexpr size_t length_of(const char *text)
+        {
+            size_t len = 0;
+            while (text[len])
+            {
+                len++;
+            }
+            return len;
+        }
+
+        constexpr bool is_flag(char c)
+        {
+            return c == '-' || c == '+' || c == ' ' || c == '#' || c == '0' || c == '\'';
+        }
+
+        constexpr bool is_digit(char c)
+        {
+            return c >= '0' && c <= '9';
+        }
+
+        constexpr kind_t kind_of(char conversion, length_t length)
+        {
+            switch (conversion)
+            {
+            case 0:
+            case '%':
+                return kind_t::none;
+            case 'd':
+            case 'i':
+            case 'o':
+            case 'u':
+            case 'x':
+            case 'X':
+                return length == length_t::long_double ? kind_t::unsupported : kind_t::integer;
+            case 'c':
+                return length == length_t::none ? kind_t::character : kind_t::unsupported;
+            case 'f':
+            case 'F':
+            case 'e':
+            case 'E':
+            case 'g':
+            case 'G':
+            case 'a':
+            case 'A':
+                return length == length_t::none || length == length_t::l || length == length_t::long_double ? kind_t::floating : kind_t::unsupported;
+            case 's':
+                return length == length_t::none ? kind_t::string : kind_t::unsupported;
+            case 'p':
+                return length == length_t::none ? kind_t::pointer : kind_t::unsupported;
+            default:
+                return kind_t::unsupported;
+            }
+        }
+
+        // same grammar as next_conversion in log_binary.c
+        constexpr conversion_t parse_conversion(const char *format, size_t end, size_t literal, size_t start, size_t arg)
+        {
+            conversion_t c;
+            c.literal = literal;
+            c.start = start;
+            c.arg = arg;
+            size_t it = start + 1;
+            for (; it < end && is_flag(format[it]); it++)
+            {
+                c.plain = false;
+            }
+            if (it < end && format[it] == '*')
+            {
+                c.plain = false;
+                c.width_star = true;
+                it++;
+            }
+            for (; it < end && is_digit(format[it]); it++)
+            {
+                c.plain = false;
+            }
+            if (it < end && format[it] == '.')
+            {
+                c.plain = false;
+                c.precision = 0;
+                it++;
+                if (it < end && format[it] == '*')
+                {
+                    c.precision_star = true;
+                    c.precision = -1;
+                    it++;
+                }
+                for (; it < end && is_digit(format[it]); it++)
+                {
+                    c.precision = c.precision * 10 + (format[it] - '0');
+                }
+            }
+            if (it < end)
+            {
+                switch (format[it])
+                {
+                case 'h':
+                    c.length = it + 1 < end && format[it + 1] == 'h' ? length_t::hh : length_t::h;
+                    it += c.length == length_t::hh ? 2 : 1;
+                    break;
+                case 'l':
+                    c.length = it + 1 < end && format[it + 1] == 'l' ? length_t::ll : length_t::l;
+                    it += c.length == length_t::ll ? 2 : 1;
+                    break;
+                case 'q':
+                    c.length = length_t::ll;
+                    it++;
+                    break;
+                case 'j':
+                    c.length = length_t::j;
+                    it++;
+                    break;
+                case 'z':
+                    c.length = length_t::z;
+                    it++;
+                    break;
+                case 't':
+                    c.length = length_t::t;
+                    it++;
+                    break;
+                case 'L':
+                    c.length = length_t::long_double;
+                    it++;
+                    break;
+                }
+            }
+            if (it < end)
+            {
+                c.conversion = format[it++];
+            }
+            c.end = it;
+            c.kind = kind_of(c.conversion, c.length);
+            // n consumes its argument, it is rejected as unsupported
+            bool has_value = c.kind != kind_t::none && (c.kind != kind_t::unsupported || c.conversion == 'n');
+            c.args = c.width_star + c.precision_star + has_value;
+            return c;
+        }
+
+        template <typename Format>
+        constexpr size_t conversion_count()
+        {
+            const char *format = Format::value();
+            size_t end = length_of(format);
+            size_t count = 0;
+            for (size_t it = 0; it < end;)
+            {
+                if (format[it] != '%')
+                {
+                    it++;
+                    continue;
+                }
+                it = parse_conversion(format, end, it, it, 0).end;
+                count++;
+            }
+            return count;
+        }
+
+        template <typename Format>
+        constexpr std::array<conversion_t, conversion_count<Format>()> parse()
+        {
+            std::array<conversion_t, conversion_count<Format>()> conversions{};
+            const char *format = Format::value();
+            size_t end = length_of(format);
+            size_t literal = 0;
+            size_t arg = 0;
+            size_t count = 0;
+            for (size_t it = 0; it < end;)
+            {
+                if (format[it] != '%')
+                {
+                    it++;
+                    continue;
+                }
+                conversions[count] = parse_conversion(format, end, literal, it, arg);
+                arg += conversions[count].args;
+                literal = it = conversions[count].end;
+                count++;
+            }
+            return conversions;
+        }
+
+        template <typename Format>
+        inline constexpr auto conversions_v = parse<Format>();
+
+        template <typename Format>
+        constexpr size_t argument_count()
+        {
+            size_t count = 0;
+            for (const conversion_t &c : conversions_v<Format>)
+            {
+                count += c.args;
+            }
+            return count;
+        }
+
+        template <typename Format>
+        constexpr bool all_supported()
+        {
+            for (const conversion_t &c : conversions_v<Format>)
+            {
+                if (c.kind == kind_t::unsupported)
+                {
+                    return false;
+                }
+            }
+            return true;
+        }
+
+        // what each argument is consumed as, in order
+        struct requirement_t
+        {
+            kind_t kind;
+            length_t length;
+            bool star;
+        };
+
+        template <typename Format>
+        constexpr std::array<requirement_t, argument_count<Format>()> requirements()
+        {
+            std::array<requirement_t, argument_count<Format>()> result{};
+            size_t arg = 0;
+            for (const conversion_t &c : conversions_v<Format>)
+            {
+                if (c.width_star)
+                {
+                    result[arg++] = {kind_t::integer, length_t::none, true};
+                }
+                if (c.precision_star)
+                {
+                    result[arg++] = {kind_t::integer, length_t::none, true};
+                }
+                if (c.args > static_cast<size_t>(c.width_star + c.precision_star))
+                {
+                    result[arg++] = {c.kind, c.length, false};
+                }
+            }
+            return result;
+        }
+
+        // size of the C type a length modifier reads
+        constexpr size_t c_integer_size(length_t length)
+        {
+            switch (length)
+            {
+            case length_t::l:
+                return sizeof(long);
+            case length_t::ll:
+                return sizeof(long long);
+            case length_t::j:
+                return sizeof(intmax_t);
+            case length_t::z:
+                return sizeof(size_t);
+            case length_t::t:
+                return sizeof(ptrdiff_t);
+            default:
+                return sizeof(int);
+            }
+        }
+
+        template <typename T>
+        inline constexpr bool is_integer_v = std::is_integral_v<T> || (std::is_enum_v<T> && std::is_convertible_v<T, int>);
+
+        template <typename T>
+        constexpr bool accepts(requirement_t requirement)
+        {
+            switch (requirement.kind)
+            {
+            case kind_t::integer:
+            case kind_t::character:
+                if constexpr (is_integer_v<T>)
+                {
+                    // after promotion, shorter types are passed as int
+                    size_t promoted = sizeof(T) < sizeof(int) ? sizeof(int) : sizeof(T);
+                    return promoted == c_integer_size(requirement.length);
+                }
+                return false;
+            case kind_t::floating:
+                if (requirement.length == length_t::long_double)
+                {
+                    return std::is_same_v<T, long double>;
+                }
+                return std::is_same_v<T, float> || std::is_same_v<T, double>;
+            case kind_t::string:
+                return std::is_same_v<T, const char *> || std::is_same_v<T, char *>;
+            case kind_t::pointer:
+                return std::is_pointer_v<T> || std::is_null_pointer_v<T>;
+            default:
+                return false;
+            }
+        }
+
+        template <typename Format, typename... Args, size_t... I>
+        constexpr bool all_accepted(std::index_sequence<I...>)
+        {
+            constexpr auto list = requirements<Format>();
+            (void)list; // unused without arguments
+            return (accepts<Args>(list[I]) && ...);
+        }
+
+        enum class check_t
+        {
+            ok,
+            unsupported_conversion,
+            argument_count,
+            argument_type,
+        };
+
+        template <typename Format, typename... Args>
+        constexpr check_t check()
+        {
+            if constexpr (!all_supported<Format>())
+            {
+                return check_t::unsupported_conversion;
+            }
+            else if constexpr (argument_count<Format>() != sizeof...(Args))
+            {
+                return check_t::argument_count;
+            }
+            else if constexpr (!all_accepted<Format, Args...>(std::index_sequence_for<Args...>{}))
+            {
+                return check_t::argument_type;
+            }
+            else
+            {
+                return check_t::ok;
+            }
+        }
+
+        // the C type vprintf reads for a conversion, the value is converted to it
+        template <kind_t Kind, char Conversion, length_t Length, typename T>
+        auto c_value(T value)
+        {
+            if constexpr (Kind == kind_t::integer)
+            {
+                auto promoted = +value;
+                constexpr bool is_signed = Conversion == 'd' || Conversion == 'i';
+                if constexpr (Length == length_t::l)
+                {
+                    return static_cast<std::conditional_t<is_signed, long, unsigned long>>(promoted);
+                }
+                else if constexpr (Length == length_t::ll)
+                {
+                    return static_cast<std::conditional_t<is_signed, long long, unsigned long long>>(promoted);
+                }
+                else if constexpr (Length == length_t::j)
+                {
+                    return static_cast<std::conditional_t<is_signed, intmax_t, uintmax_t>>(promoted);
+                }
+                else if constexpr (Length == length_t::z || Length == length_t::t)
+                {
+                    return static_cast<std::conditional_t<is_signed, ptrdiff_t, size_t>>(promoted);
+                }
+                else
+                {
+                    return static_cast<std::conditional_t<is_signed, int, unsigned int>>(promoted);
+                }
+            }
+            else if constexpr (Kind == kind_t::character)
+            {
+                return static_cast<int>(+value);
+            }
+            else if constexpr (Kind == kind_t::floating)
+            {
+                return static_cast<std::conditional_t<Length == length_t::long_double, long double, double>>(value);
+            }
+            else if constexpr (Kind == kind_t::string)
+            {
+                return static_cast<const char *>(value);
+            }
+            else
+            {
+                if constexpr (std::is_null_pointer_v<T>)
+                {
+                    return static_cast<const void *>(nullptr);
+                }
+                else
+                {
+                    return reinterpret_cast<const void *>(value);
+                }
+            }
+        }
+
+        // bytes of an integer in a record, see integer_size in log_binary.c
+        constexpr size_t record_integer_size(length_t length)
+        {
+            switch (length)
+            {
+            case length_t::l:
+                return sizeof(long);
+            case length_t::ll:
+                return 8;
+            case length_t::j:
+                return sizeof(intmax_t);
+            case length_t::z:
+                return sizeof(size_t);
+            case length_t::t:
+                return sizeof(ptrdiff_t);
+            default:
+                return 4;
+            }
+        }
+
+        static_assert(sizeof(double) == 8, "log.hpp packs doubles as they are, IEEE 754 binary64");
+
+        struct record_writer
+        {
+            uint8_t *buffer;
+            size_t size;
+            size_t pos;
+            bool overflow;
+
+            void put(uint64_t value, size_t n)
+            {
+                if (pos + n > size)
+                {
+                    overflow = true;
+                    return;
+                }
+                for (size_t i = 0; i < n; i++)
+                {
+                    buffer[pos++] = static_cast<uint8_t>(value >> (8 * i));
+                }
+            }
+
+            bool put_address(const char *value)
+            {
+                uint64_t address;
+                if (!log_binary_image_address(value, &address))
+                {
+                    return false;
+                }
+                put(LOG_BINARY_STRING_ADDRESS, 2);
+                put(address, sizeof(void *));
+                return true;
+            }
+
+            // see put_string in log_binary.c
+            void put_string(const char *value, size_t max_len)
+            {
+                if (value && put_address(value))
+                {
+                    return;
+                }
+                if (!value)
+                {
+                    put_chars("(null)", max_len < 6 ? max_len : 6);
+                    return;
+                }
+                size_t len = 0;
+                while (len < max_len && value[len])
+                {
+                    len++;
+                }
+                put_chars(value, len);
+            }
+
+            void put_chars(const char *value, size_t len)
+            {
+                if (len >= LOG_BINARY_STRING_ADDRESS)
+                {
+                    len = LOG_BINARY_STRING_ADDRESS - 1;
+                }
+                if (pos + 2 + len > size)
+                {
+                    len = pos + 2 < size ? size - pos - 2 : 0;
+                }
+                put(len, 2);
+                if (!overflow)
+                {
+                    memcpy(buffer + pos, value, len);
+                    pos += len;
+                }
+            }
+        };
+
+        template <typename Format, size_t K, typename Tuple>
+        void pack_conversion(record_writer &writer, const Tuple &values)
+        {
+            constexpr conversion_t c = conversions_v<Format>[K];
+            if constexpr (c.args > 0)
+            {
+                size_t max_len = c.precision >= 0 ? static_cast<size_t>(c.precision) : SIZE_MAX;
+                if constexpr (c.width_star)
+                {
+                    writer.put(static_cast<uint32_t>(static_cast<int>(+std::get<c.arg>(values))), 4);
+                }
+                if constexpr (c.precision_star)
+                {
+                    int precision = static_cast<int>(+std::get<c.arg + c.width_star>(values));
+                    writer.put(static_cast<uint32_t>(precision), 4);
+                    max_len = precision >= 0 ? static_cast<size_t>(precision) : SIZE_MAX;
+                }
+                const auto value = c_value<c.kind, c.conversion, c.length>(std::get<c.arg + c.args - 1>(values));
+                if constexpr (c.kind == kind_t::integer)
+                {
+                    // signed values are sign extended, the record keeps their low bytes
+                    writer.put(static_cast<uint64_t>(value), record_integer_size(c.length));
+                }
+                else if constexpr (c.kind == kind_t::character)
+                {
+                    writer.put(static_cast<uint32_t>(value), 4);
+                }
+                else if constexpr (c.kind == kind_t::floating)
+                {
+                    double as_double = static_cast<double>(value);
+                    uint64_t bits;
+                    memcpy(&bits, &as_double, sizeof(bits));
+                    writer.put(bits, 8);
+                }
+                else if constexpr (c.kind == kind_t::string)
+                {
+                    writer.put_string(value, max_len);
+                }
+                else if constexpr (c.kind == kind_t::pointer)
+                {
+                    writer.put(reinterpret_cast<uintptr_t>(value), sizeof(void *));
+                }
+            }
+        }
+
+        template <typename Format, typename Tuple, size_t... K>
+        size_t pack(uint8_t *record, size_t size, uint8_t level, const char *tag, const Tuple &values, std::index_sequence<K...>)
+        {
+            record_writer writer = {record, size, LOG_BINARY_RECORD_HEADER_SIZE, size < LOG_BINARY_RECORD_HEADER_SIZE};
+            writer.put(log_timestamp_us(), 8);
+            if (!writer.put_address(Format::value()))
+            {
+                writer.put_chars(Format::value(), length_of(Format::value()));
+            }
+            writer.put_string(tag, SIZE_MAX);
+            (pack_conversion<Format, K>(writer, values), ...);
+            size_t body_len = writer.pos - LOG_BINARY_RECORD_HEADER_SIZE;
+            if (writer.overflow || body_len > UINT16_MAX)
+            {
+                return 0;
+            }
+            record[0] = LOG_BINARY_RECORD_MAGIC;
+            record[1] = level;
+            record[2] = static_cast<uint8_t>(body_len);
+            record[3] = static_cast<uint8_t>(body_len >> 8);
+            return writer.pos;
+        }
+
+        struct text_writer
+        {
+            char *out;
+            size_t size;
+            size_t len;
+
+            void put(const char *text, size_t n)
+            {
+                size_t room = size - 1 - len;
+                if (n > room)
+                {
+                    n = room;
+                }
+                memcpy(out + len, text, n);
+                len += n;
+            }
+
+            void put(char c)
+            {
+                if (len + 1 < size)
+                {
+                    out[len++] = c;
+                }
+            }
+
+            template <unsigned Base>
+            void put_unsigned(uint64_t value, const char *digits)
+            {
+                char text[22]; // 2**64 has 20 decimal digits
+                size_t n = 0;
+                do
+                {
+                    text[sizeof(text) - ++n] = digits[value % Base];
+                    value /= Base;
+                } while (value);
+                put(text + sizeof(text) - n, n);
+            }
+
+            void put_signed(int64_t value)
+            {
+                if (value < 0)
+                {
+                    put('-');
+                    put_unsigned<10>(0 - static_cast<uint64_t>(value), "0123456789");
+                    return;
+                }
+                put_unsigned<10>(static_cast<uint64_t>(value), "0123456789");
+            }
+
+            template <typename... Values>
+            void print(const char *spec, Values... values)
+            {
+                int n = snprintf(out + len, size - len, spec, values...);
+                if (n > 0)
+                {
+                    len += static_cast<size_t>(n) < size - 1 - len ? static_cast<size_t>(n) : size - 1 - len;
+                }
+            }
+        };
+
+        // one conversion on its own, zero terminated, for snprintf
+        template <typename Format, size_t K>
+        constexpr auto spec()
+        {
+            constexpr conversion_t c = conversions_v<Format>[K];
+            std::array<char, c.end - c.start + 1> text{};
+            for (size_t i = 0; i < c.end - c.start; i++)
+            {
+                text[i] = Format::value()[c.start + i];
+            }
+            return text;
+        }
+
+        template <typename Format, size_t K>
+        inline constexpr auto spec_v = spec<Format, K>();
+
+        template <typename Format, size_t K, typename Tuple>
+        void render_conversion(text_writer &writer, const Tuple &values)
+        {
+            constexpr conversion_t c = conversions_v<Format>[K];
+            writer.put(Format::value() + c.literal, c.start - c.literal);
+            if constexpr (c.kind == kind_t::none)
+            {
+                // "%%", or an incomplete conversion printed as text like the decoder does
+                if constexpr (c.conversion == '%' && c.plain)
+                {
+                    writer.put('%');
+                }
+                else
+                {
+                    writer.put(Format::value() + c.start, c.end - c.start);
+                }
+            }
+            else
+            {
+                const auto value = c_value<c.kind, c.conversion, c.length>(std::get<c.arg + c.args - 1>(values));
+                constexpr bool fast_integer = c.kind == kind_t::integer && c.conversion != 'o' &&
+                                              c.length != length_t::hh && c.length != length_t::h;
+                if constexpr (c.plain && fast_integer && (c.conversion == 'd' || c.conversion == 'i'))
+                {
+                    writer.put_signed(static_cast<int64_t>(value));
+                }
+                else if constexpr (c.plain && fast_integer && c.conversion == 'u')
+                {
+                    writer.put_unsigned<10>(static_cast<uint64_t>(value), "0123456789");
+                }
+                else if constexpr (c.plain && fast_integer && c.conversion == 'x')
+                {
+                    writer.put_unsigned<16>(static_cast<uint64_t>(value), "0123456789abcdef");
+                }
+                else if constexpr (c.plain && fast_integer && c.conversion == 'X')
+                {
+                    writer.put_unsigned<16>(static_cast<uint64_t>(value), "0123456789ABCDEF");
+                }
+                else if constexpr (c.plain && c.kind == kind_t::character)
+                {
+                    writer.put(static_cast<char>(value));
+                }
+                else if constexpr (c.plain && c.kind == kind_t::string)
+                {
+                    const char *text = value ? value : "(null)";
+                    writer.put(text, strlen(text));
+                }
+                else if constexpr (c.width_star && c.precision_star)
+                {
+                    writer.print(spec_v<Format, K>.data(), static_cast<int>(+std::get<c.arg>(values)),
+                                 static_cast<int>(+std::get<c.arg + 1>(values)), value);
+                }
+                else if constexpr (c.width_star || c.precision_star)
+                {
+                    writer.print(spec_v<Format, K>.data(), static_cast<int>(+std::get<c.arg>(values)), value);
+                }
+                else
+                {
+                    writer.print(spec_v<Format, K>.data(), value);
+                }
+            }
+        }
+
+        template <typename Format, typename Tuple, size_t... K>
+        size_t render(char *text, size_t size, const Tuple &values, std::index_sequence<K...>)
+        {
+            text_writer writer = {text, size, 0};
+            (render_conversion<Format, K>(writer, values), ...);
+            constexpr size_t count = sizeof...(K);
+            constexpr size_t tail = count ? conversions_v<Format>[count ? count - 1 : 0].end : 0;
+            writer.put(Format::value() + tail, length_of(Format::value()) - tail);
+            text[writer.len] = '\0';
+            return writer.len;
+        }
+    } // namespace detail
+
+    /**
+     * @brief whether a format, given as LOG_CPP_FORMAT, accepts arguments of these types
+     */
+    template <typename Format, typename... Args>
+    constexpr bool format_accepts()
+    {
+        return detail::check<Format, std::decay_t<Args>...>() == detail::check_t::ok;
+    }
+
+    /**
+     * @brief write a message, the level is not checked
+     *
+     * This function is used in expansion of the LOGx_CPP macros, each format
+     * instantiates its own writer.
+     *
+     * @param format format string type made by LOG_CPP_FORMAT
+     * @param tag tag of the message
+     * @param args values of the conversions in the format
+     */
+    template <uint8_t Level, typename Format, typename... Args>
+    void write(Format format, const char *tag, Args... args)
+    {
+        constexpr detail::check_t result = detail::check<Format, Args...>();
+        static_assert(result != detail::check_t::unsupported_conversion, "log format: unsupported conversion, %n and wide characters can not be logged");
+        static_assert(result != detail::check_t::argument_count, "log format: the number of arguments does not match the format");
+        static_assert(result != detail::check_t::argument_type, "log format: an argument type does not match its conversion");
+
+        const std::tuple<Args...> values(args...);
+        constexpr auto conversions = std::make_index_sequence<detail::conversions_v<Format>.size()>{};
+        if (log_binary_output())
+        {
+            uint8_t record[CONFIG_LOG_BINARY_RECORD_SIZE];
+            size_t length = detail::pack<Format>(record, sizeof(record), Level, tag, values, conversions);
+            // the record did not fit, or binary output was just turned off
+            if (length == 0 || log_write_binary(record, length))
+            {
+                return;
+            }
+        }
+        char text[CONFIG_LOG_CPP_TEXT_SIZE];
+        detail::render<Format>(text, sizeof(text), values, conversions);
+        log_write_text(Level, tag, text);
+    }
+
+#if CONFIG_LOG_RECORDER_SIZE > 0
+    /**
+     * @brief record a message in the flight recorder without writing it
+     *
+     * This function is used in expansion of the LOGx_CPP macros, for messages above the level of their tag.
+     *
+     * @param format format string type made by LOG_CPP_FORMAT
+     * @param tag tag of the message
+     * @param args values of the conversions in the format
+     */
+    template <uint8_t Level, typename Format, typename... Args>
+    void record(Format format, const char *tag, Args... args)
+    {
+        static_assert(detail::check<Format, Args...>() == detail::check_t::ok, "log format: see chiplogger::write");
+
+        const std::tuple<Args...> values(args...);
+        constexpr auto conversions = std::make_index_sequence<detail::conversions_v<Format>.size()>{};
+        uint8_t encoded[CONFIG_LOG_BINARY_RECORD_SIZE];
+        size_t length = detail::pack<Format>(encoded, sizeof(encoded), Level, tag, values, conversions);
+        if (length != 0)
+        {
+            log_record_binary(encoded, length);
+        }
+    }
+#endif
+} // namespace chiplogger
+
+/**
+ * @brief a string literal as a type, for chiplogger::write
+ */
+#define LOG_CPP_FORMAT(format)                                 \
+    [] {                                                       \
+        struct log_format_                                     \
+        {                                                      \
+            static constexpr const char *value() { return format; } \
+        };                                                     \
+        return log_format_{};                                  \
+    }()
+
+/** runtime macro to output logs at a specified level, with a format checked at compile time
+ *
+ * @param level level of the output log.
+ * @param letter level letter used in the output, one of E, W, I, D, V.
+ * @param tag tag of the log, which can be used to change the log level by ``log_level_set`` at runtime.
+ * @param format format of the output log. see ``printf``
+ * @param ... variables to be replaced into the log, their types must match the format
+ */
+#define LOG_CPP_AT_LEVEL(level, letter, tag, format, ...)                                                            \
+    do                                                                                                               \
+    {                                                                                                                \
+        static log_callsite_t log_callsite_ = LOG_CALLSITE_INITIALIZER;                                              \
+        if (log_callsite_visible(&log_callsite_, level, tag))                                                        \
+        {                                                                                                            \
+            ::chiplogger::write<level>(LOG_CPP_FORMAT(LOG_MACRO_FORMAT(letter, format)), tag,                        \
+                                       LOG_MACRO_TIMESTAMP(), tag, LOG_VALUE_FILENAME, LOG_VALUE_LINE,               \
+                                       LOG_VALUE_FUNCTION_NAME, ##__VA_ARGS__);                                      \
+        }                                                                                                            \
+        LOG_CPP_RECORD_HIDDEN(level, letter, tag, format, ##__VA_ARGS__)                                             \
+    } while (0)
+
+/* else branch of the level check, hidden messages still go to the flight recorder */
+#if CONFIG_LOG_RECORDER_SIZE > 0
+#define LOG_CPP_RECORD_HIDDEN(level, letter, tag, format, ...)                                                       \
+    else if (level <= __atomic_load_n(&g_log_recorder_level, __ATOMIC_RELAXED))                                      \
+    {                                                                                                                \
+        ::chiplogger::record<level>(LOG_CPP_FORMAT(LOG_MACRO_FORMAT(letter, format)), tag,                           \
+                                    LOG_MACRO_TIMESTAMP(), tag, LOG_VALUE_FILENAME, LOG_VALUE_LINE,                  \
+                                    LOG_VALUE_FUNCTION_NAME, ##__VA_ARGS__);                                         \
+    }
+#else
+#define LOG_CPP_RECORD_HIDDEN(level, letter, tag, format, ...)
+#endif
+
+#if (MAXIMUM_ENABLED_LOG_LEVEL >= LOG_VERBOSE)
+#define LOGV_CPP(tag, format, ...) LOG_CPP_AT_LEVEL(LOG_VERBOSE, V, tag, format, ##__VA_ARGS__)
+#else
+#define LOGV_CPP(tag, format, ...)
+#endif
+
+#if (MAXIMUM_ENABLED_LOG_LEVEL >= LOG_DEBUG)
+#define LOGD_CPP(tag, format, ...) LOG_CPP_AT_LEVEL(LOG_DEBUG, D, tag, format, ##__VA_ARGS__)
+#else
+#define LOGD_CPP(tag, format, ...)
+#endif
+
+#if (MAXIMUM_ENABLED_LOG_LEVEL >= LOG_INFO)
+#define LOGI_CPP(tag, format, ...) LOG_CPP_AT_LEVEL(LOG_INFO, I, tag, format, ##__VA_ARGS__)
+#else
+#define LOGI_CPP(tag, format, ...)
+#endif
+
+#if (MAXIMUM_ENABLED_LOG_LEVEL >= LOG_WARN)
+#define LOGW_CPP(tag, format, ...) LOG_CPP_AT_LEVEL(LOG_WARN, W, tag, format, ##__VA_ARGS__)
+#else
+#define LOGW_CPP(tag, format, ...)
+#endif
+
+#if (MAXIMUM_ENABLED_LOG_LEVEL >= LOG_ERROR)
+#define LOGE_CPP(tag, format, ...) LOG_CPP_AT_LEVEL(LOG_ERROR, E, tag, format, ##__VA_ARGS__)
+#else
+#define LOGE_CPP(tag, format, ...)
+#endif
+
+#endif /* __LOG_HPP__ */
@@ -0,0 +1,222 @@
+// Copyright 2015-2016 Espressif Systems (Shanghai) PTE LTD
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#ifndef __LOG_BINARY_H__
+#define __LOG_BINARY_H__
+
+#include <stdint.h>
+#include <stddef.h>
+#include <stdbool.h>
+#include <stdarg.h>
+
+#ifdef __cplusplus
+extern "C"
+{
+#endif
+
+/**
+ * @brief Binary record format
+ *
+ * A binary log stream starts with a stream header describing the integer sizes
+ * of the device, followed by records. All multi-byte values are little endian.
+ *
+ * Stream header (LOG_BINARY_STREAM_HEADER_SIZE bytes):
+ *
+ *      "CLOG" version sizeof(void *) sizeof(long) sizeof(size_t) sizeof(intmax_t) sizeof(ptrdiff_t)
+ *
+ * Record:
+ *
+ *      u8   LOG_BINARY_RECORD_MAGIC
+ *      u8   level
+ *      u16  length of the record body
+ *      body:
+ *      u64  timestamp, in microseconds (u32 in milliseconds in version 1 streams)
+ *      str  format
+ *      str  tag
+ *      ...  one value per argument consumed by the format, in order
+ *
+ * A string (str) is a u16 length followed by the characters without terminator,
+ * or LOG_BINARY_STRING_ADDRESS followed by a pointer sized address of a string
+ * in the read-only data of the firmware image, to be resolved from the ELF file.
+ *
+ * Arguments are encoded according to their conversion specifier:
+ * - integers (d i o u x X c, and '*' widths and precisions) in the size of their
+ *   promoted type: 4 bytes for int and shorter, sizeof(long), 8 for long long,
+ *   sizeof(intmax_t), sizeof(size_t) or sizeof(ptrdiff_t) for the j, z and t modifiers
+ * - floating point (f F e E g G a A) as an 8 byte double, long double included
+ * - pointers (p) in sizeof(void *) bytes
+ * - strings (s) as str
+ * - n consumes its argument without encoding anything
+ *
+ * A record whose level has LOG_BINARY_RECORD_DUMP set (version 3) carries a part
+ * of a buffer dump after its arguments, see log_write_buffer:
+ *
+ *      u8   line format, a log_dump_format_t
+ *      u32  offset of the first byte in the dump
+ *      ptr  address of the first byte on the device, pointer sized
+ *      u16  number of bytes
+ *      ...  the bytes
+ *
+ * The bytes are rendered BYTES_PER_LINE per line after the message. A dump that
+ * does not fit in one record continues in records with an empty format.
+ */
+#define LOG_BINARY_STREAM_HEADER_SIZE 10
+#define LOG_BINARY_VERSION 3
+#define LOG_BINARY_RECORD_MAGIC 0xA5
+#define LOG_BINARY_RECORD_HEADER_SIZE 4
+#define LOG_BINARY_STRING_ADDRESS 0xFFFF
+#define LOG_BINARY_RECORD_DUMP 0x80
+#define LOG_BINARY_DUMP_HEADER_SIZE (1 + 4 + sizeof(void *) + 2)
+
+    /**
+ * @brief integer sizes of the device that produced a stream, from the stream header
+ */
+    typedef struct
+    {
+        uint8_t version;
+        uint8_t pointer_size;
+        uint8_t long_size;
+        uint8_t size_t_size;
+        uint8_t intmax_size;
+        uint8_t ptrdiff_size;
+    } log_binary_stream_t;
+
+    /**
+ * @brief resolves a string address in the firmware image
+ *
+ * @param context context passed to log_binary_decode
+ * @param address address of the string as encoded in the record
+ * @return const char* zero terminated string or NULL if unknown
+ */
+    typedef const char *(*log_binary_resolver_t)(void *context, uint64_t address);
+
+    /**
+ * @brief decoded record, strings point into the record or are resolved
+ */
+    typedef struct
+    {
+        uint8_t level;
+        uint64_t timestamp_us;
+        const char *format;
+        uint16_t format_len;
+        const char *tag;
+        uint16_t tag_len;
+        const uint8_t *args; // encoded arguments, followed by the dump if any
+        size_t args_len;
+        bool dump; // LOG_BINARY_RECORD_DUMP was set
+    } log_binary_record_t;
+
+    /**
+ * @brief write the stream header of this device
+ *
+ * @param buffer output, at least LOG_BINARY_STREAM_HEADER_SIZE bytes
+ * @return size_t LOG_BINARY_STREAM_HEADER_SIZE
+ */
+    size_t log_binary_stream_header(uint8_t *buffer);
+
+    /**
+ * @brief parse a stream header
+ *
+ * @param buffer input
+ * @param length available bytes
+ * @param stream parsed integer sizes
+ * @return true if buffer starts with a valid stream header
+ */
+    bool log_binary_parse_stream_header(const uint8_t *buffer, size_t length, log_binary_stream_t *stream);
+
+    /**
+ * @brief whether a string is in the read-only data of the firmware image
+ *
+ * Such strings are encoded by their address instead of their characters.
+ *
+ * @param value string
+ * @param address address to be encoded
+ * @return true if the string is encoded by address
+ */
+    bool log_binary_image_address(const void *value, uint64_t *address);
+
+    /**
+ * @brief encode a message into a binary record
+ *
+ * Strings that do not fit are truncated, the record is not written if the
+ * fixed size values do not fit.
+ *
+ * @param buffer output
+ * @param size size of the output buffer
+ * @return size_t length of the record, 0 if it did not fit
+ */
+    size_t log_binary_encode(uint8_t *buffer, size_t size, uint8_t level, uint64_t timestamp_us,
+                             const char *tag, const char *format, va_list args);
+
+    /**
+ * @brief append a part of a buffer dump to a record encoded by log_binary_encode
+ *
+ * The caller copies the len bytes of the dump to the returned pointer.
+ *
+ * @param record the record, in a buffer of at least *length + LOG_BINARY_DUMP_HEADER_SIZE + len bytes
+ * @param length length of the record, updated
+ * @param dump_format line format, a log_dump_format_t
+ * @param offset offset of the first byte in the dump
+ * @param address address of the first byte
+ * @param len number of bytes
+ * @return uint8_t* where the bytes go
+ */
+    uint8_t *log_binary_append_dump(uint8_t *record, size_t *length, uint8_t dump_format, uint32_t offset,
+                                    const void *address, uint16_t len);
+
+    /**
+ * @brief hash the arguments of a message without formatting them
+ *
+ * The values are hashed as they would be encoded, strings by their characters.
+ *
+ * @param format format of the message
+ * @param args arguments of the message
+ * @param skip number of leading values left out, '*' widths and precisions included
+ * @return uint32_t hash of the values
+ */
+    uint32_t log_binary_hash(const char *format, va_list args, size_t skip);
+
+    /**
+ * @brief split a record into its fields
+ *
+ * @param buffer input, starting with LOG_BINARY_RECORD_MAGIC
+ * @param length available bytes
+ * @param stream stream the record belongs to
+ * @param resolver resolves string addresses, may be NULL
+ * @param context passed to resolver
+ * @param record decoded fields
+ * @return size_t length of the record, 0 if the record is incomplete or invalid
+ */
+    size_t log_binary_parse_record(const uint8_t *buffer, size_t length, const log_binary_stream_t *stream,
+                                   log_binary_resolver_t resolver, void *context, log_binary_record_t *record);
+
+    /**
+ * @brief render a parsed record into the text vprintf would have produced
+ *
+ * @param record parsed record
+ * @param stream stream the record belongs to
+ * @param resolver resolves string addresses, may be NULL
+ * @param context passed to resolver
+ * @param out output buffer, always zero terminated if out_size > 0
+ * @param out_size size of the output buffer
+ * @return int length of the full text, like snprintf, negative if the record is malformed
+ */
+    int log_binary_format(const log_binary_record_t *record, const log_binary_stream_t *stream,
+                          log_binary_resolver_t resolver, void *context, char *out, size_t out_size);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* __LOG_BINARY_H__ */
@@ -0,0 +1,86 @@
+// Copyright 2015-2016 Espressif Systems (Shanghai) PTE LTD
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#ifndef __LOG_FILE_H__
+#define __LOG_FILE_H__
+
+#include <stdint.h>
+#include <stddef.h>
+#include <stdbool.h>
+#include <stdarg.h>
+#include "log.h"
+
+#ifdef __cplusplus
+extern "C"
+{
+#endif
+
+    /**
+ * @brief Open a memory-mapped log file, rotated by size
+ *
+ * The file is preallocated to file_size bytes and mapped, writing a message is a
+ * copy into the mapping, without a system call or a lock. When a message does not
+ * fit, the file is truncated to its content and renamed to path.1, path.1 to path.2
+ * and so on, the oldest one is overwritten, and a new file is mapped at path.
+ * Messages never span two files. The kernel writes the pages back, see log_file_sync.
+ * If a new file can not be created, messages are dropped until the next log_file_open.
+ *
+ * Only available on Linux. A file opened before is closed first.
+ *
+ * @param path path of the current file
+ * @param file_size size of each file, larger messages are dropped, in binary mode
+ *                  larger than the file size less the stream header
+ * @param files number of files kept, including the current one, at least 1
+ * @return false if the file can not be created, mapped or preallocated
+ */
+    bool log_file_open(const char *path, size_t file_size, uint8_t files);
+
+    /**
+ * @brief Close the log file and truncate it to its content
+ *
+ * Must not be called while other threads write to the file.
+ */
+    void log_file_close(void);
+
+    /**
+ * @brief Write the content of the current file back to the disk
+ *
+ * @param wait true to wait until it is written (msync MS_SYNC), false to only start
+ */
+    void log_file_sync(bool wait);
+
+    /**
+ * @brief Append bytes to the log file, does nothing if no file is open
+ *
+ * Can be set with log_set_binary_writer, every file then starts with the stream header.
+ *
+ * @param data bytes to write
+ * @param length number of bytes
+ */
+    void log_file_write(const uint8_t *data, size_t length);
+
+    /**
+ * @brief Format a message into the log file, to be set with log_set_vprintf
+ *
+ * Messages longer than CONFIG_LOG_FILE_LINE_SIZE - 1 characters are truncated.
+ *
+ * @return int length of the message, -1 if it could not be formatted
+ */
+    int log_file_vprintf(const char *format, va_list args);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* __LOG_FILE_H__ */
@@ -0,0 +1,250 @@
+// Copyright 2015-2016 Espressif Systems (Shanghai) PTE LTD
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#ifndef __LOG_STRUCTURED_H__
+#define __LOG_STRUCTURED_H__
+
+#include <stdint.h>
+#include <stddef.h>
+#include <stdbool.h>
+#include "log.h"
+
+#ifdef __cplusplus
+extern "C"
+{
+#endif
+
+/**
+ * @brief Structured record format
+ *
+ * A structured record is one CBOR map (RFC 8949) with text keys:
+ *
+ *      "ts"     uint, timestamp in milliseconds
+ *      "level"  uint, LOG_ERROR to LOG_VERBOSE
+ *      "tag"    text
+ *      "msg"    text
+ *      ...      one entry per field, in order
+ *
+ * Integers use the shortest CBOR encoding, doubles are 8 byte floats (4 bytes
+ * where double is 32 bits wide), strings are text and byte arrays are bytes.
+ * Strings that do not fit are truncated, the record is not written if the
+ * other values do not fit.
+ */
+#define LOG_STRUCTURED_BASE_KEYS 4
+
+    typedef enum
+    {
+        LOG_FIELD_INT,
+        LOG_FIELD_UINT,
+        LOG_FIELD_DOUBLE,
+        LOG_FIELD_BOOL,
+        LOG_FIELD_STRING,
+        LOG_FIELD_BYTES,
+    } log_field_type_t;
+
+    /**
+ * @brief a typed key/value pair, made with log_field_int, log_field_str...
+ */
+    typedef struct
+    {
+        const char *key;
+        log_field_type_t type;
+        union
+        {
+            int64_t i;
+            uint64_t u;
+            double d;
+            bool b;
+            const char *s;
+            struct
+            {
+                const void *data;
+                size_t length;
+            } bytes;
+        } value;
+    } log_field_t;
+
+    static inline log_field_t log_field_int(const char *key, int64_t value)
+    {
+        log_field_t field;
+        field.key = key;
+        field.type = LOG_FIELD_INT;
+        field.value.i = value;
+        return field;
+    }
+
+    static inline log_field_t log_field_uint(const char *key, uint64_t value)
+    {
+        log_field_t field;
+        field.key = key;
+        field.type = LOG_FIELD_UINT;
+        field.value.u = value;
+        return field;
+    }
+
+    static inline log_field_t log_field_double(const char *key, double value)
+    {
+        log_field_t field;
+        field.key = key;
+        field.type = LOG_FIELD_DOUBLE;
+        field.value.d = value;
+        return field;
+    }
+
+    static inline log_field_t log_field_bool(const char *key, bool value)
+    {
+        log_field_t field;
+        field.key = key;
+        field.type = LOG_FIELD_BOOL;
+        field.value.b = value;
+        return field;
+    }
+
+    static inline log_field_t log_field_str(const char *key, const char *value)
+    {
+        log_field_t field;
+        field.key = key;
+        field.type = LOG_FIELD_STRING;
+        field.value.s = value;
+        return field;
+    }
+
+    static inline log_field_t log_field_bytes(const char *key, const void *data, size_t length)
+    {
+        log_field_t field;
+        field.key = key;
+        field.type = LOG_FIELD_BYTES;
+        field.value.bytes.data = data;
+        field.value.bytes.length = length;
+        return field;
+    }
+
+    /**
+ * @brief receives structured records
+ *
+ * @param level level of the message
+ * @param tag tag of the message
+ * @param record CBOR encoded record
+ * @param length length of the record
+ */
+    typedef void (*log_structured_writer_t)(uint8_t level, const char *tag, const uint8_t *record, size_t length);
+
+    /**
+ * @brief Set the function structured records are written to
+ *
+ * Without a structured writer, records are rendered as JSON lines with
+ * log_structured_format_json and written like any other message.
+ *
+ * @param func new function, NULL to write JSON lines
+ * @return log_structured_writer_t the previous function
+ */
+    log_structured_writer_t log_set_structured_writer(log_structured_writer_t func);
+
+    /**
+ * @brief Write a message with typed fields
+ *
+ * The level is not checked. This function is used in expansion of the LOGx_FIELDS macros.
+ *
+ * @param level level of the message
+ * @param tag tag of the message
+ * @param message message, without format conversions
+ * @param fields fields of the message
+ * @param count number of fields
+ */
+    void log_write_fields(uint8_t level, const char *tag, const char *message, const log_field_t *fields, size_t count);
+
+    /**
+ * @brief encode a structured record
+ *
+ * @param buffer output
+ * @param size size of the output
+ * @param level level of the message
+ * @param timestamp timestamp in milliseconds
+ * @param tag tag of the message
+ * @param message message
+ * @param fields fields of the message
+ * @param count number of fields
+ * @return size_t length of the record, 0 if it does not fit
+ */
+    size_t log_structured_encode(uint8_t *buffer, size_t size, uint8_t level, uint32_t timestamp, const char *tag,
+                                 const char *message, const log_field_t *fields, size_t count);
+
+    /**
+ * @brief render a structured record as one line of JSON, terminated by a newline
+ *
+ * Byte arrays are rendered as hex strings, NaN and infinities as null.
+ *
+ * @param record CBOR encoded record
+ * @param length length of the record
+ * @param text output, zero terminated
+ * @param size size of the output
+ * @return int length of the text, -1 if the record is malformed or the text does not fit
+ */
+    int log_structured_format_json(const uint8_t *record, size_t length, char *text, size_t size);
+
+/** runtime macro to output a message with typed fields at a specified level
+ *
+ * @param level level of the output log.
+ * @param tag tag of the log, which can be used to change the log level by ``log_level_set`` at runtime.
+ * @param message message of the log, without format conversions
+ * @param ... fields of the log, made with log_field_int, log_field_str...
+ *
+ * @see ``log_write_fields``
+ */
+#define LOG_FIELDS_AT_LEVEL(level, tag, message, ...)                                                     \
+    do                                                                                                    \
+    {                                                                                                     \
+        static log_callsite_t log_callsite_ = LOG_CALLSITE_INITIALIZER;                                   \
+        if (log_callsite_visible(&log_callsite_, level, tag))                                             \
+        {                                                                                                 \
+            const log_field_t log_fields_[] = {__VA_ARGS__};                                              \
+            log_write_fields(level, tag, message, log_fields_, sizeof(log_fields_) / sizeof(log_fields_[0])); \
+        }                                                                                                 \
+    } while (0)
+
+#if (MAXIMUM_ENABLED_LOG_LEVEL >= LOG_VERBOSE)
+#define LOGV_FIELDS(tag, message, ...) LOG_FIELDS_AT_LEVEL(LOG_VERBOSE, tag, message, __VA_ARGS__)
+#else
+#define LOGV_FIELDS(tag, message, ...)
+#endif
+
+#if (MAXIMUM_ENABLED_LOG_LEVEL >= LOG_DEBUG)
+#define LOGD_FIELDS(tag, message, ...) LOG_FIELDS_AT_LEVEL(LOG_DEBUG, tag, message, __VA_ARGS__)
+#else
+#define LOGD_FIELDS(tag, message, ...)
+#endif
+
+#if (MAXIMUM_ENABLED_LOG_LEVEL >= LOG_INFO)
+#define LOGI_FIELDS(tag, message, ...) LOG_FIELDS_AT_LEVEL(LOG_INFO, tag, message, __VA_ARGS__)
+#else
+#define LOGI_FIELDS(tag, message, ...)
+#endif
+
+#if (MAXIMUM_ENABLED_LOG_LEVEL >= LOG_WARN)
+#define LOGW_FIELDS(tag, message, ...) LOG_FIELDS_AT_LEVEL(LOG_WARN, tag, message, __VA_ARGS__)
+#else
+#define LOGW_FIELDS(tag, message, ...)
+#endif
+
+#if (MAXIMUM_ENABLED_LOG_LEVEL >= LOG_ERROR)
+#define LOGE_FIELDS(tag, message, ...) LOG_FIELDS_AT_LEVEL(LOG_ERROR, tag, message, __VA_ARGS__)
+#else
+#define LOGE_FIELDS(tag, message, ...)
+#endif
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* __LOG_STRUCTURED_H__ */
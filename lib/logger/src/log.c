@@ -15,24 +15,38 @@
 /*
  * Log library implementation notes.
  *
- * Log library stores all tags provided to log_level_set as a linked
- * list. See uncached_tag_entry_t structure.
+ * Tags provided to log_level_set are kept in a hash table which is
+ * updated in place with atomic stores, or replaced atomically when it is
+ * full, see log_tag_table.c.
+ * Looking up the level of a tag never takes a lock, the porting layer
+ * lock only serializes log_level_set calls.
  *
- * To avoid looking up log level for given tag each time message is
- * printed, this library caches pointers to tags. Because the suggested
- * way of creating tags uses one 'TAG' constant per file, this caching
- * should be effective. Cache is a binary min-heap of cached_tag_entry_t
- * items, ordering is done on 'generation' member. In this context,
- * generation is an integer which is incremented each time an operation
- * with cache is performed. When cache is full, new item is inserted in
- * place of an oldest item (that is, with smallest 'generation' value).
- * After that, bubble-down operation is performed to fix ordering in the
- * min-heap.
+ * The LOGx macros keep a per-callsite cache of the level of their tag,
+ * see log_callsite_t. It is only refreshed through log_callsite_refresh
+ * when the tag table generation changed. All other lookups go through
+ * a cache keyed by tag pointer first, see log_tag_cache.c.
  *
- * The potential problem with wrap-around of cache generation counter is
- * ignored for now. This will happen if someone happens to output more
- * than 4 billion log entries, at which point wrap-around will not be
- * the biggest problem.
+ * Tags defined with LOG_TAG_DEFINE keep their level in their handle,
+ * written along with the tag table, see log_tag_registry.c.
+ *
+ * Sampled callsites also cache the share of messages they keep, the
+ * decision is taken with a per-thread xorshift generator, see log_sample_set.
+ *
+ * With duplicate suppression on, a message with the format, tag and level
+ * of the previous one is compared by a hash of its arguments before it is
+ * formatted, runs are summarized by one line, see log_dedup_set. The run
+ * is guarded by its own flag, a message that finds it taken is written
+ * without being compared instead of waiting.
+ *
+ * With a binary writer set, log_writev encodes the format and its raw
+ * arguments instead of formatting them, see log_binary.c. Buffer dumps
+ * add their bytes to the record, the lines are formatted when decoding.
+ *
+ * In async mode log_write queues the same binary records in a ring which
+ * a background writer drains to the output functions, see log_async.c.
+ *
+ * The flight recorder keeps the same records of the latest messages in a
+ * ring in persistent memory, hidden ones included, see log_recorder.c.
  *
  */
 
@@ -42,9 +56,15 @@
 #include <stdlib.h>
 #include <stdio.h>
 // #include <assert.h>
-#include <ctype.h>
 #include "log.h"
 #include "log_private.h"
+#include "log_tag_table.h"
+#include "log_tag_cache.h"
+#include "log_tag_registry.h"
+#include "log_binary.h"
+#include "log_async.h"
+#include "log_recorder.h"
+#include "log_dump.h"
 #include <stddef.h>
 
 // #define __ASSERT_USE_STDERR // do this before including assert.h
@@ -57,164 +77,224 @@
 //     abort(); // halt after outputting information
 // }
 
-// Enable built-in checks in queue.h in debug builds
-#if CONFIG_LOG_INVARIANTS == 1
-#define INVARIANTS
-#endif
-// Enable consistency checks and cache statistics in this file.
+static vprintf_like_t s_log_print_func = &vprintf;
+static log_writev_t s_writev_func = &log_writev;
+static log_binary_writer_t s_log_binary_writer = NULL;
 
-#if CONFIG_LOG_BUILTIN_CHECKS == 1
-#define LOG_BUILTIN_CHECKS
+static inline uint8_t get_log_level(const char *tag, uint32_t *generation);
+static inline bool should_output(uint8_t level_for_message, uint8_t level_for_tag);
+
+#if CONFIG_LOG_SAMPLING
+// every porting layer but CONFIG_LOG_NOOS runs several threads
+#ifdef CONFIG_LOG_NOOS
+#define SAMPLE_THREAD_LOCAL
+#else
+#define SAMPLE_THREAD_LOCAL __thread
 #endif
 
-#include "queue.h"
+static SAMPLE_THREAD_LOCAL uint32_t s_sample_random = 0;
+static SAMPLE_THREAD_LOCAL uint32_t s_sampled_out_pending = 0;
+static uint32_t s_sampled_out = 0;
+static bool s_sampling_used = false;
 
+static uint32_t sample_keep(const char *tag, uint8_t level);
+#endif
+
+#if CONFIG_LOG_DEDUP
+/**
+ * @brief the last message written and how often it was repeated since
+ */
 typedef struct
 {
+    const char *format;
     const char *tag;
-    uint32_t level : 3;
-    uint32_t generation : 29;
-} cached_tag_entry_t;
-
-typedef struct uncached_tag_entry_
-{
-    SLIST_ENTRY(uncached_tag_entry_)
-    entries;
-    uint8_t level; // uint8_t as uint8_t
-    char tag[0];     // beginning of a zero-terminated string
-} uncached_tag_entry_t;
-
-static uint8_t s_log_default_level = DEFAULT_LOG_LEVEL;
-static SLIST_HEAD(log_tags_head, uncached_tag_entry_) s_log_tags = SLIST_HEAD_INITIALIZER(s_log_tags);
-static cached_tag_entry_t s_log_cache[CONFIG_LOG_TAG_CACHE_SIZE];
-static uint32_t s_log_cache_max_generation = 0;
-static uint32_t s_log_cache_entry_count = 0;
-static vprintf_like_t s_log_print_func = &vprintf;
-static log_writev_t s_writev_func = &log_writev;
+    uint8_t level;
+    uint32_t hash;
+    uint32_t repeated;
+    uint32_t since;
+} log_dedup_run_t;
 
-#ifdef LOG_BUILTIN_CHECKS
-static uint32_t s_log_cache_misses = 0;
-#endif
+static log_dedup_run_t s_dedup_run = {0};
+static uint32_t s_dedup_timeout = 0;
+static bool s_dedup_busy = false;
 
-static inline bool get_cached_log_level(const char *tag, uint8_t *level);
-static inline bool get_uncached_log_level(const char *tag, uint8_t *level);
-static inline void add_to_cache(const char *tag, uint8_t level);
-static void heap_bubble_down(int index);
-static inline void heap_swap(int i, int j);
-static inline bool should_output(uint8_t level_for_message, uint8_t level_for_tag);
-static inline void clear_log_level_list(void);
+static inline bool dedup_try_lock(void)
+{
+    return !__atomic_test_and_set(&s_dedup_busy, __ATOMIC_ACQUIRE);
+}
 
-log_writev_t log_set_writev(log_writev_t func){
-    log_impl_lock();
-    log_writev_t orig_func = s_writev_func;
-    s_writev_func = func;
-    log_impl_unlock();
-    return orig_func;
+static inline void dedup_unlock(void)
+{
+    __atomic_clear(&s_dedup_busy, __ATOMIC_RELEASE);
 }
 
-vprintf_like_t log_set_vprintf(vprintf_like_t func)
+static bool dedup_suppressed(uint8_t level, const char *tag, const char *format, va_list args);
+static void dedup_write_repeated(const log_dedup_run_t *run);
+#endif
+
+log_writev_t log_set_writev(log_writev_t func)
 {
-    log_impl_lock();
-    vprintf_like_t orig_func = s_log_print_func;
-    s_log_print_func = func;
-    log_impl_unlock();
-    return orig_func;
+    return __atomic_exchange_n(&s_writev_func, func, __ATOMIC_ACQ_REL);
 }
 
-void log_level_set(const char *tag, uint8_t level)
+vprintf_like_t log_set_vprintf(vprintf_like_t func)
 {
-    log_impl_lock();
+    return __atomic_exchange_n(&s_log_print_func, func, __ATOMIC_ACQ_REL);
+}
 
-    // for wildcard tag, remove all linked list items and clear the cache
-    if (strcmp(tag, "*") == 0)
+log_binary_writer_t log_set_binary_writer(log_binary_writer_t func)
+{
+    if (func)
     {
-        s_log_default_level = level;
-        clear_log_level_list();
-        log_impl_unlock();
-        return;
+        uint8_t header[LOG_BINARY_STREAM_HEADER_SIZE];
+        func(header, log_binary_stream_header(header));
     }
+    return __atomic_exchange_n(&s_log_binary_writer, func, __ATOMIC_ACQ_REL);
+}
 
-    // search for existing tag
-    uncached_tag_entry_t *it = NULL;
-    SLIST_FOREACH(it, &s_log_tags, entries)
+bool log_level_set(const char *tag, uint8_t level)
+{
+    bool stored;
+    log_impl_lock();
+    // for wildcard tag, drop all tags and start over with the new default level
+    if (strcmp(tag, "*") == 0)
     {
-        if (strcmp(it->tag, tag) == 0)
+        stored = log_tag_table_reset(level);
+        if (stored)
         {
-            // one tag in the linked list matched, update the level
-            it->level = level;
-            // quit with it != NULL
-            break;
+            log_tag_registry_reset(level);
         }
     }
-    // no existing tag, append new one
-    if (it == NULL)
+    else
     {
-        // allocate new linked list entry and append it to the head of the list
-        size_t tag_len = strlen(tag) + 1;
-        size_t entry_size = offsetof(uncached_tag_entry_t, tag) + tag_len;
-        uncached_tag_entry_t *new_entry = (uncached_tag_entry_t *)malloc(entry_size);
-        if (!new_entry)
+        stored = log_tag_table_set(tag, level);
+        if (stored)
         {
-            log_impl_unlock();
-            return;
+            log_tag_registry_set(tag, level);
         }
-        new_entry->level = (uint8_t)level;
-        // printf("copy from %p %s %d bytes\r\n", new_entry->tag, tag, tag_len);
-        strncpy(new_entry->tag, tag, tag_len);
-        SLIST_INSERT_HEAD(&s_log_tags, new_entry, entries);
     }
+    log_impl_unlock();
+    return stored;
+}
 
-    // search in the cache and update the entry it if exists
-    for (uint32_t i = 0; i < s_log_cache_entry_count; ++i)
+bool log_sample_set(const char *tag, uint8_t level, uint16_t one_in)
+{
+#if CONFIG_LOG_SAMPLING
+    log_impl_lock();
+    // set before the new table is published, refreshed callsites then look the ratio up
+    if (one_in > 1)
     {
-#ifdef LOG_BUILTIN_CHECKS
-        assert(i == 0 || s_log_cache[(i - 1) / 2].generation < s_log_cache[i].generation);
-#endif
-        if (strcmp(s_log_cache[i].tag, tag) == 0)
-        {
-            s_log_cache[i].level = level;
-            break;
-        }
+        __atomic_store_n(&s_sampling_used, true, __ATOMIC_RELEASE);
+    }
+    bool stored = log_tag_table_set_sample(tag, level, one_in);
+    if (stored)
+    {
+        log_tag_registry_set_keep(tag, level, one_in > 1 ? UINT32_MAX / one_in : 0);
     }
     log_impl_unlock();
+    return stored;
+#else
+    (void)tag;
+    (void)level;
+    (void)one_in;
+    return false;
+#endif
+}
+
+void log_dedup_set(uint32_t timeout_ms)
+{
+#if CONFIG_LOG_DEDUP
+    log_dedup_flush();
+    __atomic_store_n(&s_dedup_timeout, timeout_ms, __ATOMIC_RELAXED);
+#else
+    (void)timeout_ms;
+#endif
 }
 
-void clear_log_level_list(void)
+void log_dedup_flush(void)
 {
-    uncached_tag_entry_t *it;
-    while ((it = SLIST_FIRST(&s_log_tags)) != NULL)
+#if CONFIG_LOG_DEDUP
+    // held for a few instructions by a writer
+    while (!dedup_try_lock())
     {
-        SLIST_REMOVE_HEAD(&s_log_tags, entries);
-        free(it);
+        log_impl_yield();
     }
-    s_log_cache_entry_count = 0;
-    s_log_cache_max_generation = 0;
-#ifdef LOG_BUILTIN_CHECKS
-    s_log_cache_misses = 0;
+    log_dedup_run_t run = s_dedup_run;
+    // the next message starts a new run, even if it repeats this one
+    s_dedup_run.format = NULL;
+    s_dedup_run.repeated = 0;
+    dedup_unlock();
+    dedup_write_repeated(&run);
 #endif
 }
 
-bool is_tag_level_visible(uint8_t level, const char *tag)
+void log_dedup_poll(void)
 {
-    if (!log_impl_lock_timeout())
+#if CONFIG_LOG_DEDUP
+    uint32_t timeout = __atomic_load_n(&s_dedup_timeout, __ATOMIC_RELAXED);
+    // a writer updating the run checks the timeout itself
+    if (!timeout || !dedup_try_lock())
     {
-        // printf("timeout");
-        return false;
+        return;
     }
-    uint8_t level_for_tag;
-    // Look for the tag in cache first, then in the linked list of all tags
-    if (!get_cached_log_level(tag, &level_for_tag))
+    log_dedup_run_t ended;
+    ended.repeated = 0;
+    uint32_t now = log_timestamp();
+    if (s_dedup_run.repeated && now - s_dedup_run.since >= timeout)
     {
-        if (!get_uncached_log_level(tag, &level_for_tag))
-        {
-            level_for_tag = s_log_default_level;
-        }
-        add_to_cache(tag, level_for_tag);
-#ifdef LOG_BUILTIN_CHECKS
-        ++s_log_cache_misses;
+        ended = s_dedup_run;
+        s_dedup_run.repeated = 0;
+        s_dedup_run.since = now;
+    }
+    dedup_unlock();
+    dedup_write_repeated(&ended);
+#endif
+}
+
+uint32_t log_sampled_out(void)
+{
+#if CONFIG_LOG_SAMPLING
+    return __atomic_load_n(&s_sampled_out, __ATOMIC_RELAXED) + s_sampled_out_pending;
+#else
+    return 0;
 #endif
+}
+
+bool log_sample_keep(uint32_t keep)
+{
+#if CONFIG_LOG_SAMPLING
+    // xorshift32, never 0 once seeded from the address of the thread's state and the time
+    uint32_t x = s_sample_random;
+    if (x == 0)
+    {
+        x = ((uint32_t)(uintptr_t)&s_sample_random ^ (log_timestamp() * 2654435761u)) | 1;
     }
-    log_impl_unlock();
+    x ^= x << 13;
+    x ^= x >> 17;
+    x ^= x << 5;
+    s_sample_random = x;
+    if (x < keep)
+    {
+        return true;
+    }
+    // counted per thread, the shared counter is only touched once per batch
+    if (++s_sampled_out_pending >= CONFIG_LOG_SAMPLING_BATCH)
+    {
+        __atomic_fetch_add(&s_sampled_out, s_sampled_out_pending, __ATOMIC_RELAXED);
+        s_sampled_out_pending = 0;
+    }
+    return false;
+#else
+    (void)keep;
+    return true;
+#endif
+}
+
+bool is_tag_level_visible(uint8_t level, const char *tag)
+{
+    uint32_t generation;
+    uint8_t level_for_tag = get_log_level(tag, &generation);
+
     if (!should_output(level, level_for_tag))
     {
         // printf("shouldnt output");
@@ -224,6 +304,91 @@ bool is_tag_level_visible(uint8_t level, const char *tag)
     return true;
 }
 
+bool log_callsite_refresh(log_callsite_t *callsite, uint8_t level, const char *tag)
+{
+    uint32_t generation;
+    uint8_t level_for_tag = get_log_level(tag, &generation);
+#if CONFIG_LOG_SAMPLING
+    uint32_t keep = sample_keep(tag, level);
+#endif
+
+    // the callsite caches only the first tag it sees, a callsite used with
+    // varying tags keeps taking the slow path for the other ones
+    const char *expected = NULL;
+    if (__atomic_compare_exchange_n(&callsite->tag, &expected, tag, false, __ATOMIC_RELAXED, __ATOMIC_RELAXED) ||
+        expected == tag)
+    {
+#if CONFIG_LOG_SAMPLING
+        // a reader may pair the new state with the previous ratio once, it sees this one next time
+        __atomic_store_n(&callsite->keep, keep, __ATOMIC_RELAXED);
+#endif
+        // a racing refresh may store an older generation, it is then refreshed again on next use
+        __atomic_store_n(&callsite->state, (generation << LOG_CALLSITE_LEVEL_BITS) | level_for_tag, __ATOMIC_RELAXED);
+    }
+
+#if CONFIG_LOG_SAMPLING
+    return should_output(level, level_for_tag) && (keep == 0 || log_sample_keep(keep));
+#else
+    return should_output(level, level_for_tag);
+#endif
+}
+
+#if CONFIG_LOG_TAG_REGISTRY
+bool log_tag_refresh(log_tag_t *tag, uint8_t level)
+{
+    uint32_t generation;
+    uint8_t level_for_tag = get_log_level(tag->name, &generation);
+    uint8_t expected = LOG_TAG_LEVEL_UNSET;
+    // a level stored by log_level_set since the lookup is newer, it is kept
+    if (!__atomic_compare_exchange_n(&tag->level, &expected, level_for_tag, false, __ATOMIC_RELAXED, __ATOMIC_RELAXED))
+    {
+        level_for_tag = expected;
+    }
+
+    if (!should_output(level, level_for_tag))
+    {
+        return false;
+    }
+#if CONFIG_LOG_SAMPLING
+    uint32_t keep = __atomic_load_n(&tag->keep[level - 1], __ATOMIC_RELAXED);
+    return keep == 0 || log_sample_keep(keep);
+#else
+    return true;
+#endif
+}
+#endif
+
+// to the binary writer or the vprintf function
+static void log_emit(uint8_t level, const char *tag, const char *format, va_list args)
+{
+    log_binary_writer_t binary_writer = __atomic_load_n(&s_log_binary_writer, __ATOMIC_ACQUIRE);
+    if (binary_writer)
+    {
+        uint8_t record[CONFIG_LOG_BINARY_RECORD_SIZE];
+        size_t length = log_binary_encode(record, sizeof(record), level, log_timestamp_us(), tag, format, args);
+        if (length)
+        {
+            (*binary_writer)(record, length);
+        }
+        return;
+    }
+
+    vprintf_like_t print_func = __atomic_load_n(&s_log_print_func, __ATOMIC_ACQUIRE);
+    (*print_func)(format, args);
+}
+
+// output of a message whose level was already checked
+static void log_output(uint8_t level, const char *tag, const char *format, va_list args)
+{
+#if CONFIG_LOG_DEDUP
+    if (__atomic_load_n(&s_dedup_timeout, __ATOMIC_RELAXED) && dedup_suppressed(level, tag, format, args))
+    {
+        return;
+    }
+#endif
+    log_emit(level, tag, format, args);
+}
+
 void log_writev(uint8_t level,
                 const char *tag,
                 const char *format,
@@ -233,120 +398,304 @@ void log_writev(uint8_t level,
     {
         return;
     }
+    log_output(level, tag, format, args);
+}
 
-    (*s_log_print_func)(format, args);
+// copies a message into the flight recorder, args stays usable
+static inline void log_record_visible(uint8_t level, const char *tag, const char *format, va_list args)
+{
+#if CONFIG_LOG_RECORDER_SIZE > 0
+    if (level <= __atomic_load_n(&g_log_recorder_level, __ATOMIC_RELAXED))
+    {
+        va_list copy;
+        va_copy(copy, args);
+        log_recorder_writev(level, tag, format, copy);
+        va_end(copy);
+    }
+#endif
 }
 
-void log_write(uint8_t level,
-               const char *tag,
-               const char *format, ...)
+// like log_write, for a message whose level was already checked
+static void log_write_visible(uint8_t level, const char *tag, const char *format, ...)
 {
     va_list list;
     va_start(list, format);
-    s_writev_func(level, tag, format, list);
+    log_record_visible(level, tag, format, list);
+    if (!log_async_enqueue(level, tag, format, list))
+    {
+        log_writev_t writev_func = __atomic_load_n(&s_writev_func, __ATOMIC_ACQUIRE);
+        if (writev_func == &log_writev)
+        {
+            log_output(level, tag, format, list);
+        }
+        else
+        {
+            writev_func(level, tag, format, list);
+        }
+    }
     va_end(list);
 }
 
-static inline bool get_cached_log_level(const char *tag, uint8_t *level)
+// the binary writer is bypassed by a writev function set with log_set_writev
+static log_binary_writer_t direct_binary_writer(void)
 {
-    // Look for `tag` in cache
-    uint32_t i;
-    for (i = 0; i < s_log_cache_entry_count; ++i)
+    if (__atomic_load_n(&s_writev_func, __ATOMIC_ACQUIRE) != &log_writev)
     {
-#ifdef LOG_BUILTIN_CHECKS
-        assert(i == 0 || s_log_cache[(i - 1) / 2].generation < s_log_cache[i].generation);
-#endif
-        if (s_log_cache[i].tag == tag)
+        return NULL;
+    }
+    return __atomic_load_n(&s_log_binary_writer, __ATOMIC_ACQUIRE);
+}
+
+bool log_binary_output(void)
+{
+    return log_async_active() || direct_binary_writer() != NULL;
+}
+
+bool log_write_binary(const uint8_t *record, size_t length)
+{
+    bool written = log_async_enqueue_record(record, length);
+    if (!written)
+    {
+        log_binary_writer_t binary_writer = direct_binary_writer();
+        if (binary_writer)
         {
-            break;
+            (*binary_writer)(record, length);
+            written = true;
         }
     }
-    if (i == s_log_cache_entry_count)
-    { // Not found in cache
-        return false;
+#if CONFIG_LOG_RECORDER_SIZE > 0
+    // otherwise the caller writes the message as text, recorded then
+    if (written)
+    {
+        log_recorder_write_record(record, length);
     }
-    // Return level from cache
-    *level = (uint8_t)s_log_cache[i].level;
-    // If cache has been filled, start taking ordering into account
-    // (other options are: dynamically resize cache, add "dummy" entries
-    //  to the cache; this option was chosen because code is much simpler,
-    //  and the unfair behavior of cache will show it self at most once, when
-    //  it has just been filled)
-    if (s_log_cache_entry_count == CONFIG_LOG_TAG_CACHE_SIZE)
+#endif
+    return written;
+}
+
+void log_write_text(uint8_t level, const char *tag, const char *text)
+{
+    log_write_visible(level, tag, "%s", text);
+}
+
+void log_write(uint8_t level,
+               const char *tag,
+               const char *format, ...)
+{
+    va_list list;
+    va_start(list, format);
+    log_record_visible(level, tag, format, list);
+    if (!log_async_write(level, tag, format, list))
     {
-        // Update item generation
-        s_log_cache[i].generation = s_log_cache_max_generation++;
-        // Restore heap ordering
-        heap_bubble_down(i);
+        log_writev_t writev_func = __atomic_load_n(&s_writev_func, __ATOMIC_ACQUIRE);
+        writev_func(level, tag, format, list);
     }
-    return true;
+    va_end(list);
+}
+
+#if CONFIG_LOG_ASYNC_BUFFER_SIZE > 0
+
+static void write_text(log_writev_t writev_func, uint8_t level, const char *tag, const char *format, ...)
+{
+    va_list list;
+    va_start(list, format);
+    if (writev_func == &log_writev)
+    {
+        // the level was checked when the record was queued
+        vprintf_like_t print_func = __atomic_load_n(&s_log_print_func, __ATOMIC_ACQUIRE);
+        (*print_func)(format, list);
+    }
+    else
+    {
+        writev_func(level, tag, format, list);
+    }
+    va_end(list);
+}
+
+// strings referenced by address are in the image of this program
+static const char *resolve_image_address(void *context, uint64_t address)
+{
+    return (const char *)(uintptr_t)address;
 }
 
-static inline void add_to_cache(const char *tag, uint8_t level)
+void log_write_record(const uint8_t *record, size_t length)
 {
-    uint32_t generation = s_log_cache_max_generation++;
-    // First consider the case when cache is not filled yet.
-    // In this case, just add new entry at the end.
-    // This happens to satisfy binary min-heap ordering.
-    if (s_log_cache_entry_count < CONFIG_LOG_TAG_CACHE_SIZE)
+    log_binary_writer_t binary_writer = __atomic_load_n(&s_log_binary_writer, __ATOMIC_ACQUIRE);
+    if (binary_writer)
     {
-        s_log_cache[s_log_cache_entry_count] = (cached_tag_entry_t){
-            .generation = generation,
-            .level = level,
-            .tag = tag};
-        ++s_log_cache_entry_count;
+        (*binary_writer)(record, length);
         return;
     }
 
-    // Cache is full, so we replace the oldest entry (which is at index 0
-    // because this is a min-heap) with the new one, and do bubble-down
-    // operation to restore min-heap ordering.
-    s_log_cache[0] = (cached_tag_entry_t){
-        .tag = tag,
-        .level = level,
-        .generation = generation};
-    heap_bubble_down(0);
+    uint8_t header[LOG_BINARY_STREAM_HEADER_SIZE];
+    log_binary_stream_t stream;
+    log_binary_stream_header(header);
+    log_binary_parse_stream_header(header, sizeof(header), &stream);
+
+    // only one consumer writes records at a time
+    static char text[CONFIG_LOG_ASYNC_TEXT_SIZE];
+    static char tag[CONFIG_LOG_ASYNC_TEXT_SIZE / 4];
+    log_binary_record_t parsed;
+    if (!log_binary_parse_record(record, length, &stream, resolve_image_address, NULL, &parsed) ||
+        log_binary_format(&parsed, &stream, resolve_image_address, NULL, text, sizeof(text)) < 0)
+    {
+        return;
+    }
+    size_t tag_len = parsed.tag_len < sizeof(tag) ? parsed.tag_len : sizeof(tag) - 1;
+    memcpy(tag, parsed.tag, tag_len);
+    tag[tag_len] = 0;
+    write_text(__atomic_load_n(&s_writev_func, __ATOMIC_ACQUIRE), parsed.level, tag, "%s", text);
 }
 
-static inline bool get_uncached_log_level(const char *tag, uint8_t *level)
+#endif
+
+static inline uint8_t get_log_level(const char *tag, uint32_t *generation)
 {
-    // Walk the linked list of all tags and see if given tag is present in the list.
-    // This is slow because tags are compared as strings.
-    uncached_tag_entry_t *it;
-    SLIST_FOREACH(it, &s_log_tags, entries)
+    // Look for the tag pointer in cache first, then in the tag table
+    uint8_t level;
+    *generation = __atomic_load_n(&g_log_generation, __ATOMIC_ACQUIRE);
+    if (log_tag_cache_get(tag, *generation, &level))
     {
-        if (strcmp(tag, it->tag) == 0)
-        {
-            *level = it->level;
-            return true;
-        }
+        return level;
     }
-    return false;
+
+    uint32_t pin;
+    const log_tag_table_t *table = log_tag_table_acquire(&pin);
+    // the generation first, a level read after it is at least as recent
+    *generation = log_tag_table_generation(table) & LOG_CALLSITE_GENERATION_MASK;
+    level = log_tag_table_level(table, tag);
+    log_tag_table_release(table, pin);
+
+    log_tag_cache_put(tag, *generation, level);
+    return level;
 }
 
-static inline bool should_output(uint8_t level_for_message, uint8_t level_for_tag)
+#if CONFIG_LOG_SAMPLING
+// messages kept out of 2^32 for a sampled tag and level, 0 if not sampled
+static uint32_t sample_keep(const char *tag, uint8_t level)
 {
-    // printf("should output %d <= %d\r\n", level_for_message, level_for_tag);
-    return level_for_message <= level_for_tag;
+    if (!__atomic_load_n(&s_sampling_used, __ATOMIC_ACQUIRE))
+    {
+        return 0;
+    }
+    uint32_t pin;
+    const log_tag_table_t *table = log_tag_table_acquire(&pin);
+    uint16_t one_in = log_tag_table_sample(table, tag, level);
+    log_tag_table_release(table, pin);
+    return one_in ? UINT32_MAX / one_in : 0;
+}
+#endif
+
+#if CONFIG_LOG_DEDUP
+// summaries print the timestamp of the LOGx macros
+#if CONFIG_LOG_TIMESTAMP_SOURCE_SYSTEM
+#define REPEATED_TIMESTAMP "%s"
+#else
+#define REPEATED_TIMESTAMP LOG_TIMESTAMP_CONVERSION
+#endif
+#define REPEATED_FORMAT(letter) LOG_COLOR_##letter #letter " (" REPEATED_TIMESTAMP ") %s: last message repeated %" PRIu32 " times" LOG_RESET_COLOR "\n"
+
+static const char *const s_repeated_formats[] = {
+    [LOG_ERROR] = REPEATED_FORMAT(E),
+    [LOG_WARN] = REPEATED_FORMAT(W),
+    [LOG_INFO] = REPEATED_FORMAT(I),
+    [LOG_DEBUG] = REPEATED_FORMAT(D),
+    [LOG_VERBOSE] = REPEATED_FORMAT(V),
+};
+
+// the first argument of the LOGx formats is their timestamp, it differs between repeated messages
+static bool leading_timestamp(const char *format, const char *timestamp, size_t length)
+{
+    const char *percent = strchr(format, '%');
+    return percent && percent > format && strncmp(percent - 1, timestamp, length) == 0;
 }
 
-static void heap_bubble_down(int index)
+// written like a message of the run, without taking part in duplicate suppression
+static void write_repeated(uint8_t level, const char *tag, const char *format, ...)
 {
-    while (index < CONFIG_LOG_TAG_CACHE_SIZE / 2)
+    va_list list;
+    va_start(list, format);
+    log_emit(level, tag, format, list);
+    va_end(list);
+}
+
+static void dedup_write_repeated(const log_dedup_run_t *run)
+{
+    if (run->repeated)
     {
-        int left_index = index * 2 + 1;
-        int right_index = left_index + 1;
-        int next = (s_log_cache[left_index].generation < s_log_cache[right_index].generation) ? left_index : right_index;
-        heap_swap(index, next);
-        index = next;
+        // log_write also takes LOG_NONE, summarized as an error
+        uint8_t letter = run->level >= LOG_ERROR && run->level <= LOG_VERBOSE ? run->level : LOG_ERROR;
+        write_repeated(run->level, run->tag, s_repeated_formats[letter], LOG_MACRO_TIMESTAMP(), run->tag, run->repeated);
     }
 }
 
-static inline void heap_swap(int i, int j)
+static bool dedup_suppressed(uint8_t level, const char *tag, const char *format, va_list args)
 {
-    cached_tag_entry_t tmp = s_log_cache[i];
-    s_log_cache[i] = s_log_cache[j];
-    s_log_cache[j] = tmp;
+    static const char counter[] = "(" LOG_TIMESTAMP_CONVERSION ")";
+    static const char system_time[] = "(%s)";
+    uint32_t now;
+    bool timestamped = leading_timestamp(format, counter, sizeof(counter) - 1);
+    if (timestamped)
+    {
+        // saves reading the clock again
+        va_list list;
+        va_copy(list, args);
+#if CONFIG_LOG_TIMESTAMP_US
+        now = (uint32_t)(va_arg(list, uint64_t) / 1000);
+#else
+        now = va_arg(list, uint32_t);
+#endif
+        va_end(list);
+    }
+    else
+    {
+        // system time text differs from one message to the next, it is left out as well
+        timestamped = leading_timestamp(format, system_time, sizeof(system_time) - 1);
+        now = log_timestamp();
+    }
+    uint32_t hash = log_binary_hash(format, args, timestamped ? 1 : 0);
+    log_dedup_run_t ended;
+    ended.repeated = 0;
+
+    // another thread is comparing its message, this one is written
+    if (!dedup_try_lock())
+    {
+        return false;
+    }
+    bool duplicate = s_dedup_run.format == format && s_dedup_run.tag == tag && s_dedup_run.level == level &&
+                     s_dedup_run.hash == hash;
+    if (duplicate)
+    {
+        s_dedup_run.repeated++;
+        // a long run is summarized every timeout and goes on
+        if (now - s_dedup_run.since >= __atomic_load_n(&s_dedup_timeout, __ATOMIC_RELAXED))
+        {
+            ended = s_dedup_run;
+            s_dedup_run.repeated = 0;
+            s_dedup_run.since = now;
+        }
+    }
+    else
+    {
+        ended = s_dedup_run;
+        s_dedup_run.format = format;
+        s_dedup_run.tag = tag;
+        s_dedup_run.level = level;
+        s_dedup_run.hash = hash;
+        s_dedup_run.repeated = 0;
+        s_dedup_run.since = now;
+    }
+    dedup_unlock();
+
+    dedup_write_repeated(&ended);
+    return duplicate;
+}
+#endif
+
+static inline bool should_output(uint8_t level_for_message, uint8_t level_for_tag)
+{
+    // printf("should output %d <= %d\r\n", level_for_message, level_for_tag);
+    return level_for_message <= level_for_tag;
 }
 
 // static void log_buffer(uint8_t level, const char *tag, const char *value)
@@ -373,185 +722,225 @@ static inline void heap_swap(int i, int j)
 //     }
 // }
 
-static void log_buffer_hex_internal(const char *tag, const void *buffer, uint16_t buff_len,
-                                    uint8_t log_level)
-{
-    if (buff_len == 0)
-    {
-        return;
-    }
-    const char *buffer_ptr = buffer;
-    char temp_buffer[BYTES_PER_LINE + 3]; //for not-byte-accessible memory
-    char hex_buffer[3 * BYTES_PER_LINE + 1];
-    int bytes_cur_line;
+#ifdef CONFIG_LOG_FREERTOS
+// instruction memory can only be read in whole words, copy the line rounded up
+#define LINE_COPY_SIZE(len) (((len) + 3) / 4 * 4)
+#else
+#define LINE_COPY_SIZE(len) (len)
+#endif
 
-    do
-    {
-        char *ptr_line;
+_Static_assert(CONFIG_LOG_BUFFER_BLOCK_SIZE > HEXDUMP_LINE_SIZE, "CONFIG_LOG_BUFFER_BLOCK_SIZE must hold a hexdump line");
 
-        if (buff_len > BYTES_PER_LINE)
-        {
-            bytes_cur_line = BYTES_PER_LINE;
-        }
-        else
-        {
-            bytes_cur_line = buff_len;
-        }
-        //use memcpy to get around alignment issue
-        memcpy(temp_buffer, buffer_ptr, (bytes_cur_line + 3) / 4 * 4);
-        ptr_line = temp_buffer;
+/**
+ * @brief lines of a dump collected into one message, written when the next line does not fit
+ */
+typedef struct
+{
+    uint8_t level;
+    const char *tag;
+    size_t room;
+    size_t len;
+    char text[CONFIG_LOG_BUFFER_BLOCK_SIZE];
+} log_block_t;
 
-        for (int i = 0; i < bytes_cur_line; i++)
-        {
-            sprintf(hex_buffer + 3 * i, "%02x ", (uint8_t)ptr_line[i]);
-        }
-        log_write(log_level, tag, "%s\n", hex_buffer);
-        // LOG_LEVEL(log_level, tag, "%s", hex_buffer);
-        buffer_ptr += bytes_cur_line;
-        buff_len -= bytes_cur_line;
-    } while (buff_len);
+static void log_block_init(log_block_t *block, uint8_t level, const char *tag)
+{
+    block->level = level;
+    block->tag = tag;
+    block->len = 0;
+    block->room = sizeof(block->text) - 1;
 }
 
-static void log_buffer_char_internal(const char *tag, const void *buffer, uint16_t buff_len,
-                                     uint8_t log_level)
+static void log_block_flush(log_block_t *block)
 {
-    if (buff_len == 0)
+    if (block->len)
     {
-        return;
+        block->text[block->len] = '\0';
+        log_write_visible(block->level, block->tag, "%s", block->text);
+        block->len = 0;
     }
-    const char *buffer_ptr = buffer;
+}
 
-    char temp_buffer[BYTES_PER_LINE + 3]; //for not-byte-accessible memory
-    char char_buffer[BYTES_PER_LINE + 1];
+// space for a line of up to line_size characters, a line is never split between two messages
+static char *log_block_reserve(log_block_t *block, size_t line_size)
+{
+    if (block->len && block->len + line_size > block->room)
+    {
+        log_block_flush(block);
+    }
+    return block->text + block->len;
+}
+
+/**
+ * @brief format a buffer BYTES_PER_LINE bytes per line, into as few messages as the block size allows
+ */
+static void log_buffer_dump(log_block_t *block, const void *buffer, uint16_t buff_len, log_dump_format_t dump_format)
+{
+    size_t line_size = log_dump_line_size(dump_format);
+    const uint8_t *buffer_ptr = buffer;
+    uint8_t temp_buffer[LINE_COPY_SIZE(BYTES_PER_LINE)]; //for not-byte-accessible memory
     int bytes_cur_line;
 
-    do
+    for (uint32_t offset = 0; offset < buff_len; offset += bytes_cur_line)
     {
-        char *ptr_line;
-
-        if (buff_len > BYTES_PER_LINE)
+        if (buff_len - offset > BYTES_PER_LINE)
         {
             bytes_cur_line = BYTES_PER_LINE;
         }
         else
         {
-            bytes_cur_line = buff_len;
+            bytes_cur_line = buff_len - offset;
         }
         //use memcpy to get around alignment issue
-        memcpy(temp_buffer, buffer_ptr, (bytes_cur_line + 3) / 4 * 4);
-        ptr_line = temp_buffer;
-
-        for (int i = 0; i < bytes_cur_line; i++)
-        {
-            sprintf(char_buffer + i, "%c", ptr_line[i]);
-        }
-        log_write(log_level, tag, "%s\n", char_buffer);
-        // LOG_LEVEL(log_level, tag, "%s", char_buffer);
-        buffer_ptr += bytes_cur_line;
-        buff_len -= bytes_cur_line;
-    } while (buff_len);
+        memcpy(temp_buffer, buffer_ptr + offset, LINE_COPY_SIZE(bytes_cur_line));
+        char *line = log_block_reserve(block, line_size);
+        block->len += log_dump_line(dump_format, line, temp_buffer, bytes_cur_line, buffer_ptr + offset, offset);
+    }
+    log_block_flush(block);
 }
 
-static void log_buffer_hexdump_internal(const char *tag, const void *buffer,
-                                        uint16_t buff_len, uint8_t log_level)
+// the message starts the first block, the dump continues right after it
+static void log_block_message(log_block_t *block, const char *format, va_list list)
 {
-
-    if (buff_len == 0)
+    static const char terminator[] = LOG_RESET_COLOR "\n";
+    int len = vsnprintf(block->text, block->room + 1, format, list);
+    if (len > 0)
     {
-        return;
+        block->len = (size_t)len < block->room ? (size_t)len : block->room;
     }
-    const char *buffer_ptr = buffer;
-
-    char temp_buffer[BYTES_PER_LINE + 3]; //for not-byte-accessible memory
-    //format: field[length]
-    // ADDR[10]+"   "+DATA_HEX[8*3]+" "+DATA_HEX[8*3]+"  |"+DATA_CHAR[8]+"|"
-    char hd_buffer[sizeof(void *) + 3 + 10 + 3 + BYTES_PER_LINE * 3 + 3 + 1 + BYTES_PER_LINE + 1 + 3];
-    int bytes_cur_line;
+    // a clipped message keeps the end of the LOGx format, the dump starts on its own line
+    if (len > 0 && (size_t)len > block->room && block->room >= sizeof(terminator) - 1)
+    {
+        memcpy(block->text + block->room - (sizeof(terminator) - 1), terminator, sizeof(terminator) - 1);
+    }
+}
 
-    const char *buffer_start = buffer_ptr;
+static size_t log_buffer_encode(uint8_t *record, uint8_t level, uint64_t timestamp_us, const char *tag, const char *format, ...)
+{
+    va_list list;
+    va_start(list, format);
+    size_t length = log_binary_encode(record, CONFIG_LOG_BINARY_RECORD_SIZE, level, timestamp_us, tag, format, list);
+    va_end(list);
+    return length;
+}
 
+/**
+ * @brief write a message and a dump as binary records, the dump is copied as raw bytes
+ *
+ * The first record holds the message and as many lines of the dump as fit, the dump
+ * continues in records with an empty format. format and list are NULL for a dump without message.
+ */
+static void log_buffer_records(uint8_t level, const char *tag, log_dump_format_t dump_format, const void *buffer,
+                               uint16_t buff_len, bool hidden, const char *format, va_list *list)
+{
+    uint8_t record[CONFIG_LOG_BINARY_RECORD_SIZE];
+    uint8_t temp_buffer[LINE_COPY_SIZE(BYTES_PER_LINE)]; //for not-byte-accessible memory
+    const uint8_t *buffer_ptr = buffer;
+    uint64_t timestamp_us = log_timestamp_us();
+    // no more lines than a text message holds, the async writer renders records as text
+    uint32_t max_lines = (CONFIG_LOG_BUFFER_BLOCK_SIZE - 1) / log_dump_line_size(dump_format);
+    uint32_t offset = 0;
     do
     {
-        char *ptr_hd;
-        char *ptr_line;
-
-        if (buff_len > BYTES_PER_LINE)
+        size_t length = format ? log_binary_encode(record, sizeof(record), level, timestamp_us, tag, format, *list) : 0;
+        bool message = length != 0;
+        if (!message)
         {
-            bytes_cur_line = BYTES_PER_LINE;
+            length = log_buffer_encode(record, level, timestamp_us, tag, "");
         }
-        else
+        format = NULL;
+
+        size_t room = length + LOG_BINARY_DUMP_HEADER_SIZE < sizeof(record) ? sizeof(record) - length - LOG_BINARY_DUMP_HEADER_SIZE : 0;
+        uint32_t lines = room / BYTES_PER_LINE < max_lines ? room / BYTES_PER_LINE : max_lines;
+        uint32_t count = buff_len - offset < lines * BYTES_PER_LINE ? buff_len - offset : lines * BYTES_PER_LINE;
+        if (count == 0 && !message)
         {
-            bytes_cur_line = buff_len;
+            // not even a line fits in a record
+            return;
         }
-        //use memcpy to get around alignment issue
-        memcpy(temp_buffer, buffer_ptr, (bytes_cur_line + 3) / 4 * 4);
-        ptr_line = temp_buffer;
-        ptr_hd = hd_buffer;
-
-        ptr_hd += sprintf(ptr_hd, "%p (%08X)", buffer_ptr, buffer_ptr - buffer_start);
-        for (int i = 0; i < BYTES_PER_LINE; i++)
+        if (count)
         {
-            if ((i & 7) == 0)
+            uint8_t *dump = log_binary_append_dump(record, &length, dump_format, offset, buffer_ptr + offset, (uint16_t)count);
+            for (uint32_t i = 0; i < count; i += BYTES_PER_LINE)
             {
-                ptr_hd += sprintf(ptr_hd, " ");
-            }
-            if (i < bytes_cur_line)
-            {
-                ptr_hd += sprintf(ptr_hd, " %02x", (uint8_t)ptr_line[i]);
-            }
-            else
-            {
-                ptr_hd += sprintf(ptr_hd, "   ");
+                uint32_t bytes_cur_line = count - i < BYTES_PER_LINE ? count - i : BYTES_PER_LINE;
+                //use memcpy to get around alignment issue
+                memcpy(temp_buffer, buffer_ptr + offset + i, LINE_COPY_SIZE(bytes_cur_line));
+                memcpy(dump + i, temp_buffer, bytes_cur_line);
             }
         }
-        ptr_hd += sprintf(ptr_hd, "  |");
-        for (int i = 0; i < bytes_cur_line; i++)
+#if CONFIG_LOG_RECORDER_SIZE > 0
+        if (hidden)
         {
-            if (isprint((int)ptr_line[i]))
-            {
-                ptr_hd += sprintf(ptr_hd, "%c", ptr_line[i]);
-            }
-            else
-            {
-                ptr_hd += sprintf(ptr_hd, ".");
-            }
+            log_record_binary(record, length);
         }
-        ptr_hd += sprintf(ptr_hd, "|");
-        // //printf("printing %d out of %d\r\n", ptr_hd - hd_buffer, sizeof(hd_buffer));
-        // (char * )*va_arg(list, char * ) =  hd_buffer;
-        // log_writev(log_level, tag, format, list);
-        log_write(log_level, tag, "%s\n", hd_buffer);
-
-        // LOG_LEVEL(log_level, tag, "%s", hd_buffer);
-        buffer_ptr += bytes_cur_line;
-        buff_len -= bytes_cur_line;
-    } while (buff_len);
+        else
+#endif
+        {
+            log_write_binary(record, length);
+        }
+        offset += count;
+    } while (offset < buff_len);
 }
 
-void log_write_buffer_hex(uint8_t level, const char *tag, const void *buffer, uint16_t buff_len)
+static void log_write_dump(uint8_t level, const char *tag, log_dump_format_t dump_format,
+                           const void *buffer, uint16_t buff_len)
 {
-    if (!is_tag_level_visible(level, tag))
+    if (buff_len == 0 || !is_tag_level_visible(level, tag))
     {
         return;
     }
-
-    log_buffer_hex_internal(tag, buffer, buff_len, level);
+    if (log_binary_output())
+    {
+        log_buffer_records(level, tag, dump_format, buffer, buff_len, false, NULL, NULL);
+        return;
+    }
+    log_block_t block;
+    log_block_init(&block, level, tag);
+    log_buffer_dump(&block, buffer, buff_len, dump_format);
 }
 
-void log_write_buffer_char(uint8_t level, const char *tag, const void *buffer, uint16_t buff_len)
+void log_write_buffer(uint8_t level, const char *tag, log_dump_format_t dump_format,
+                      const void *buffer, uint16_t buff_len, const char *format, ...)
 {
-    if (!is_tag_level_visible(level, tag))
+    va_list list;
+    va_start(list, format);
+    // binary records carry the arguments and the raw bytes, nothing is formatted on the device
+    if (log_binary_output())
     {
+        log_buffer_records(level, tag, dump_format, buffer, buff_len, false, format, &list);
+        va_end(list);
         return;
     }
-    log_buffer_char_internal(tag, buffer, buff_len, level);
+    log_block_t block;
+    log_block_init(&block, level, tag);
+    log_block_message(&block, format, list);
+    va_end(list);
+    log_buffer_dump(&block, buffer, buff_len, dump_format);
+}
+
+#if CONFIG_LOG_RECORDER_SIZE > 0
+void log_record_buffer(uint8_t level, const char *tag, log_dump_format_t dump_format,
+                       const void *buffer, uint16_t buff_len, const char *format, ...)
+{
+    va_list list;
+    va_start(list, format);
+    log_buffer_records(level, tag, dump_format, buffer, buff_len, true, format, &list);
+    va_end(list);
+}
+#endif
+
+void log_write_buffer_hex(uint8_t level, const char *tag, const void *buffer, uint16_t buff_len)
+{
+    log_write_dump(level, tag, LOG_DUMP_HEX, buffer, buff_len);
+}
+
+void log_write_buffer_char(uint8_t level, const char *tag, const void *buffer, uint16_t buff_len)
+{
+    log_write_dump(level, tag, LOG_DUMP_CHAR, buffer, buff_len);
 }
 
 void log_write_buffer_hexdump(uint8_t level, const char *tag, const void *buffer, uint16_t buff_len)
 {
-    if (!is_tag_level_visible(level, tag))
-    {
-        return;
-    }
-    log_buffer_hexdump_internal(tag, buffer, buff_len, level);
+    log_write_dump(level, tag, LOG_DUMP_HEXDUMP, buffer, buff_len);
 }
@@ -0,0 +1,306 @@
+// Copyright 2015-2019 Espressif Systems (Shanghai) PTE LTD
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+/*
+ * Asynchronous logging.
+ *
+ * Producers encode a binary record (see log_binary.h) on their stack and
+ * copy it into a byte ring shared by all producers. A producer reserves
+ * its entry by advancing the write position with a compare and swap, copies
+ * the record and commits it by storing the entry header last. Positions
+ * are free running counters, an entry never wraps around the end of the
+ * ring, the space left before the end is reserved as padding instead.
+ *
+ * There is a single consumer at a time, the background writer or a
+ * log_flush caller. It takes committed entries in order, zeroes them so a
+ * later header can not be mistaken for a committed one, and advances the
+ * read position. An entry reserved but not committed yet holds back the
+ * entries behind it.
+ *
+ * The writer sleeps when the ring is empty, a producer only signals it
+ * when it announced it is about to sleep.
+ */
+
+#include <stdbool.h>
+#include <stdint.h>
+#include <string.h>
+#include "log.h"
+#include "log_private.h"
+#include "log_binary.h"
+#include "log_async.h"
+
+#if CONFIG_LOG_ASYNC_BUFFER_SIZE > 0
+
+#define RING_SIZE CONFIG_LOG_ASYNC_BUFFER_SIZE
+#define RING_MASK (RING_SIZE - 1)
+#define ENTRY_HEADER_SIZE 4
+#define ENTRY_PADDING 0x80000000u
+#define WRITER_IDLE_WAIT_MS 100
+
+_Static_assert((RING_SIZE & RING_MASK) == 0, "CONFIG_LOG_ASYNC_BUFFER_SIZE must be 2**n");
+_Static_assert(RING_SIZE >= 2 * (CONFIG_LOG_BINARY_RECORD_SIZE + ENTRY_HEADER_SIZE),
+               "CONFIG_LOG_ASYNC_BUFFER_SIZE must hold at least two records");
+
+static uint32_t s_ring[RING_SIZE / sizeof(uint32_t)];
+static uint32_t s_write_pos = 0;
+static uint32_t s_read_pos = 0;
+static uint32_t s_dropped = 0;
+static bool s_active = false;
+static bool s_writer_running = false;
+static bool s_writer_stop = false;
+static bool s_writer_sleeping = false;
+static bool s_draining = false;
+static bool s_exit_registered = false;
+
+static inline uint32_t *entry_header(uint32_t pos)
+{
+    return &s_ring[(pos & RING_MASK) / sizeof(uint32_t)];
+}
+
+static void push(const uint8_t *record, size_t length)
+{
+    uint32_t size = ENTRY_HEADER_SIZE + ((length + 3) & ~3u);
+    uint32_t pos = __atomic_load_n(&s_write_pos, __ATOMIC_RELAXED);
+    uint32_t padding;
+    uint32_t next;
+    do
+    {
+        uint32_t offset = pos & RING_MASK;
+        padding = offset + size > RING_SIZE ? RING_SIZE - offset : 0;
+        next = pos + padding + size;
+        // acquire, the consumer zeroed the space before releasing it
+        if (next - __atomic_load_n(&s_read_pos, __ATOMIC_ACQUIRE) > RING_SIZE)
+        {
+            __atomic_fetch_add(&s_dropped, 1, __ATOMIC_RELAXED);
+            return;
+        }
+    } while (!__atomic_compare_exchange_n(&s_write_pos, &pos, next, true, __ATOMIC_RELAXED, __ATOMIC_RELAXED));
+
+    if (padding)
+    {
+        __atomic_store_n(entry_header(pos), padding | ENTRY_PADDING, __ATOMIC_RELEASE);
+    }
+    uint32_t *header = entry_header(pos + padding);
+    memcpy(header + 1, record, length);
+    __atomic_store_n(header, size, __ATOMIC_RELEASE);
+
+    // pairs with the fence in writer_task, either the writer sees the entry or we see it sleeping
+    __atomic_thread_fence(__ATOMIC_SEQ_CST);
+    if (__atomic_load_n(&s_writer_sleeping, __ATOMIC_RELAXED) &&
+        __atomic_exchange_n(&s_writer_sleeping, false, __ATOMIC_RELAXED))
+    {
+        log_impl_signal();
+    }
+}
+
+static void enqueue(uint8_t level, const char *tag, const char *format, va_list args)
+{
+    uint8_t record[CONFIG_LOG_BINARY_RECORD_SIZE];
+    size_t length = log_binary_encode(record, sizeof(record), level, log_timestamp_us(), tag, format, args);
+    if (!length)
+    {
+        __atomic_fetch_add(&s_dropped, 1, __ATOMIC_RELAXED);
+        return;
+    }
+    push(record, length);
+}
+
+bool log_async_write(uint8_t level, const char *tag, const char *format, va_list args)
+{
+    if (!__atomic_load_n(&s_active, __ATOMIC_RELAXED))
+    {
+        return false;
+    }
+    if (is_tag_level_visible(level, tag))
+    {
+        enqueue(level, tag, format, args);
+    }
+    return true;
+}
+
+bool log_async_enqueue(uint8_t level, const char *tag, const char *format, va_list args)
+{
+    if (!__atomic_load_n(&s_active, __ATOMIC_RELAXED))
+    {
+        return false;
+    }
+    enqueue(level, tag, format, args);
+    return true;
+}
+
+bool log_async_enqueue_record(const uint8_t *record, size_t length)
+{
+    if (!__atomic_load_n(&s_active, __ATOMIC_RELAXED))
+    {
+        return false;
+    }
+    if (length > CONFIG_LOG_BINARY_RECORD_SIZE)
+    {
+        __atomic_fetch_add(&s_dropped, 1, __ATOMIC_RELAXED);
+        return true;
+    }
+    push(record, length);
+    return true;
+}
+
+bool log_async_active(void)
+{
+    return __atomic_load_n(&s_active, __ATOMIC_RELAXED);
+}
+
+/**
+ * @brief write all committed entries, unless another consumer is at it
+ *
+ * @return true if this call was the consumer
+ */
+static bool drain(void)
+{
+    if (__atomic_exchange_n(&s_draining, true, __ATOMIC_ACQUIRE))
+    {
+        return false;
+    }
+    uint32_t pos = __atomic_load_n(&s_read_pos, __ATOMIC_RELAXED);
+    uint32_t value;
+    while ((value = __atomic_load_n(entry_header(pos), __ATOMIC_ACQUIRE)) != 0)
+    {
+        uint32_t *header = entry_header(pos);
+        uint32_t size = value & ~ENTRY_PADDING;
+        if (!(value & ENTRY_PADDING))
+        {
+            const uint8_t *record = (const uint8_t *)(header + 1);
+            log_write_record(record, LOG_BINARY_RECORD_HEADER_SIZE + (record[2] | (record[3] << 8)));
+        }
+        // the writer task checks the header while log_flush drains
+        memset(header + 1, 0, size - ENTRY_HEADER_SIZE);
+        __atomic_store_n(header, 0, __ATOMIC_RELAXED);
+        pos += size;
+        __atomic_store_n(&s_read_pos, pos, __ATOMIC_RELEASE);
+    }
+    __atomic_store_n(&s_draining, false, __ATOMIC_RELEASE);
+    return true;
+}
+
+static void writer_task(void)
+{
+    while (!__atomic_load_n(&s_writer_stop, __ATOMIC_ACQUIRE))
+    {
+        drain();
+        // at least every WRITER_IDLE_WAIT_MS, a run that ended in silence is summarized
+        log_dedup_poll();
+        __atomic_store_n(&s_writer_sleeping, true, __ATOMIC_RELAXED);
+        __atomic_thread_fence(__ATOMIC_SEQ_CST);
+        uint32_t pos = __atomic_load_n(&s_read_pos, __ATOMIC_RELAXED);
+        if (!__atomic_load_n(entry_header(pos), __ATOMIC_RELAXED) && !__atomic_load_n(&s_writer_stop, __ATOMIC_RELAXED))
+        {
+            log_impl_wait(WRITER_IDLE_WAIT_MS);
+        }
+        __atomic_store_n(&s_writer_sleeping, false, __ATOMIC_RELAXED);
+    }
+    __atomic_store_n(&s_writer_running, false, __ATOMIC_RELEASE);
+}
+
+void log_flush(void)
+{
+    uint32_t target = __atomic_load_n(&s_write_pos, __ATOMIC_ACQUIRE);
+    while ((int32_t)(target - __atomic_load_n(&s_read_pos, __ATOMIC_ACQUIRE)) > 0)
+    {
+        // another consumer is writing, or the next entry is not committed yet
+        if (!drain() || (int32_t)(target - __atomic_load_n(&s_read_pos, __ATOMIC_ACQUIRE)) > 0)
+        {
+            log_impl_yield();
+        }
+    }
+}
+
+bool log_async_start(void)
+{
+    if (__atomic_exchange_n(&s_active, true, __ATOMIC_ACQ_REL))
+    {
+        return __atomic_load_n(&s_writer_running, __ATOMIC_ACQUIRE);
+    }
+    if (!__atomic_exchange_n(&s_exit_registered, true, __ATOMIC_RELAXED))
+    {
+        log_impl_at_exit(log_flush);
+    }
+    __atomic_store_n(&s_writer_stop, false, __ATOMIC_RELAXED);
+    __atomic_store_n(&s_writer_running, true, __ATOMIC_RELEASE);
+    if (!log_impl_thread_start(writer_task))
+    {
+        __atomic_store_n(&s_writer_running, false, __ATOMIC_RELEASE);
+        return false;
+    }
+    return true;
+}
+
+void log_async_stop(void)
+{
+    if (!__atomic_exchange_n(&s_active, false, __ATOMIC_ACQ_REL))
+    {
+        return;
+    }
+    __atomic_store_n(&s_writer_stop, true, __ATOMIC_RELEASE);
+    log_impl_signal();
+    while (__atomic_load_n(&s_writer_running, __ATOMIC_ACQUIRE))
+    {
+        log_impl_yield();
+    }
+    log_flush();
+}
+
+uint32_t log_async_dropped(void)
+{
+    return __atomic_load_n(&s_dropped, __ATOMIC_RELAXED);
+}
+
+#else
+
+bool log_async_write(uint8_t level, const char *tag, const char *format, va_list args)
+{
+    return false;
+}
+
+bool log_async_enqueue(uint8_t level, const char *tag, const char *format, va_list args)
+{
+    return false;
+}
+
+bool log_async_enqueue_record(const uint8_t *record, size_t length)
+{
+    return false;
+}
+
+bool log_async_active(void)
+{
+    return false;
+}
+
+void log_flush(void)
+{
+}
+
+bool log_async_start(void)
+{
+    return false;
+}
+
+void log_async_stop(void)
+{
+}
+
+uint32_t log_async_dropped(void)
+{
+    return 0;
+}
+
+#endif
@@ -0,0 +1,36 @@
+#pragma once
+#include <stdbool.h>
+#include <stdint.h>
+#include <stddef.h>
+#include <stdarg.h>
+
+/**
+ * @brief queue a message for the background writer, see log_async.c
+ *
+ * @return true if the message was handled, queued or dropped, false if async mode is off
+ */
+bool log_async_write(uint8_t level, const char *tag, const char *format, va_list args);
+
+/**
+ * @brief queue a message whose level was already checked
+ *
+ * @return true if the message was queued or dropped, false if async mode is off
+ */
+bool log_async_enqueue(uint8_t level, const char *tag, const char *format, va_list args);
+
+/**
+ * @brief queue a record encoded by the caller, see log_binary.h
+ *
+ * @return true if the record was queued or dropped, false if async mode is off
+ */
+bool log_async_enqueue_record(const uint8_t *record, size_t length);
+
+/**
+ * @brief whether messages are queued for the background writer
+ */
+bool log_async_active(void);
+
+/**
+ * @brief write a binary record taken from the ring to the current output, implemented in log.c
+ */
+void log_write_record(const uint8_t *record, size_t length);
@@ -0,0 +1,856 @@
+// Copyright 2015-2019 Espressif Systems (Shanghai) PTE LTD
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+/*
+ * Binary log records, see log_binary.h for the format.
+ *
+ * Encoding walks the format string once and copies the raw value of each
+ * argument according to its conversion specifier, no number is converted
+ * to text on the device. Decoding walks the same format string and renders
+ * each conversion on its own with snprintf, using the host type matching
+ * the specifier, so the output is the text vprintf would have produced.
+ * The bytes of a buffer dump are copied as they are and rendered into
+ * lines by the functions of the text output, see log_dump.c.
+ */
+
+#include <stdbool.h>
+#include <stdint.h>
+#include <stddef.h>
+#include <string.h>
+#include <stdio.h>
+#include <limits.h>
+#include "log.h"
+#include "log_binary.h"
+#include "log_private.h"
+#include "log_dump.h"
+
+typedef enum
+{
+    LENGTH_NONE,
+    LENGTH_HH,
+    LENGTH_H,
+    LENGTH_L,
+    LENGTH_LL,
+    LENGTH_J,
+    LENGTH_Z,
+    LENGTH_T,
+    LENGTH_LONG_DOUBLE,
+} length_modifier_t;
+
+typedef struct
+{
+    const char *start;      // the '%'
+    const char *flags;      // first flag character
+    uint8_t flags_len;
+    bool width_star;
+    int width;              // -1 if not specified
+    bool precision_star;
+    int precision;          // -1 if not specified
+    length_modifier_t length;
+    char conversion;
+    const char *end;        // after the conversion character
+} conversion_t;
+
+static const char *next_conversion(const char *format, const char *end, conversion_t *conversion);
+static uint8_t integer_size(const log_binary_stream_t *stream, length_modifier_t length);
+
+// sizes of this device, the encoder always writes in its own sizes
+static const log_binary_stream_t s_native_stream = {
+    .version = LOG_BINARY_VERSION,
+    .pointer_size = sizeof(void *),
+    .long_size = sizeof(long),
+    .size_t_size = sizeof(size_t),
+    .intmax_size = sizeof(intmax_t),
+    .ptrdiff_size = sizeof(ptrdiff_t),
+};
+
+size_t log_binary_stream_header(uint8_t *buffer)
+{
+    buffer[0] = 'C';
+    buffer[1] = 'L';
+    buffer[2] = 'O';
+    buffer[3] = 'G';
+    buffer[4] = s_native_stream.version;
+    buffer[5] = s_native_stream.pointer_size;
+    buffer[6] = s_native_stream.long_size;
+    buffer[7] = s_native_stream.size_t_size;
+    buffer[8] = s_native_stream.intmax_size;
+    buffer[9] = s_native_stream.ptrdiff_size;
+    return LOG_BINARY_STREAM_HEADER_SIZE;
+}
+
+bool log_binary_parse_stream_header(const uint8_t *buffer, size_t length, log_binary_stream_t *stream)
+{
+    if (length < LOG_BINARY_STREAM_HEADER_SIZE || memcmp(buffer, "CLOG", 4) != 0 || buffer[4] < 1 ||
+        buffer[4] > LOG_BINARY_VERSION)
+    {
+        return false;
+    }
+    for (int i = 5; i < LOG_BINARY_STREAM_HEADER_SIZE; i++)
+    {
+        // 2 for the pointers, size_t and ptrdiff_t of 16 bit devices (AVR)
+        if (buffer[i] != 2 && buffer[i] != 4 && buffer[i] != 8)
+        {
+            return false;
+        }
+    }
+    stream->version = buffer[4];
+    stream->pointer_size = buffer[5];
+    stream->long_size = buffer[6];
+    stream->size_t_size = buffer[7];
+    stream->intmax_size = buffer[8];
+    stream->ptrdiff_size = buffer[9];
+    return true;
+}
+
+// Encoding
+
+// IEEE 754 binary64 bits of value, also where double is only 32 bits wide (AVR)
+static uint64_t double_bits(double value)
+{
+#if __SIZEOF_DOUBLE__ == 8
+    uint64_t bits;
+    memcpy(&bits, &value, sizeof(bits));
+    return bits;
+#else
+    uint32_t single;
+    memcpy(&single, &value, sizeof(single));
+    uint64_t sign = (uint64_t)(single >> 31) << 63;
+    int32_t exponent = (single >> 23) & 0xFF;
+    uint64_t mantissa = single & 0x7FFFFF;
+    if (exponent == 0xFF)
+    {
+        return sign | (0x7FFull << 52) | (mantissa << 29);
+    }
+    if (exponent == 0)
+    {
+        if (mantissa == 0)
+        {
+            return sign;
+        }
+        // denormal single, normal double
+        exponent = 1;
+        while (!(mantissa & 0x800000))
+        {
+            mantissa <<= 1;
+            exponent--;
+        }
+        mantissa &= 0x7FFFFF;
+    }
+    return sign | ((uint64_t)(exponent + 1023 - 127) << 52) | (mantissa << 29);
+#endif
+}
+
+// without a buffer the values are folded into a hash instead, after the first skip ones
+typedef struct
+{
+    uint8_t *buffer;
+    size_t size;
+    size_t pos;
+    bool overflow;
+    uint64_t hash;
+    size_t skip;
+} writer_t;
+
+// a word at a time, rotate, xor and multiply by the 64 bit golden ratio
+static inline void hash_word(writer_t *writer, uint64_t word)
+{
+    writer->hash = (((writer->hash << 5) | (writer->hash >> 59)) ^ word) * 0x9E3779B97F4A7C15ull;
+}
+
+static void hash_bytes(writer_t *writer, const uint8_t *bytes, size_t len)
+{
+    hash_word(writer, len);
+    for (; len >= 8; bytes += 8, len -= 8)
+    {
+        uint64_t word;
+        memcpy(&word, bytes, 8);
+        hash_word(writer, word);
+    }
+    uint64_t tail = 0;
+    memcpy(&tail, bytes, len);
+    hash_word(writer, tail);
+}
+
+static inline void put_value(writer_t *writer, uint64_t value, uint8_t size)
+{
+    if (!writer->buffer)
+    {
+        if (writer->skip)
+        {
+            writer->skip--;
+            return;
+        }
+        hash_word(writer, value);
+        return;
+    }
+    if (writer->pos + size > writer->size)
+    {
+        writer->overflow = true;
+        return;
+    }
+    for (uint8_t i = 0; i < size; i++)
+    {
+        writer->buffer[writer->pos++] = (uint8_t)(value >> (8 * i));
+    }
+}
+
+static void put_string(writer_t *writer, const char *value, size_t max_len)
+{
+    if (!writer->buffer)
+    {
+        // characters unless in the image, a string at the same address may have changed
+        if (writer->skip)
+        {
+            writer->skip--;
+            return;
+        }
+        uint64_t address;
+        if (value && log_impl_image_address(value, &address))
+        {
+            hash_word(writer, address);
+            return;
+        }
+        if (!value)
+        {
+            value = "(null)";
+        }
+        size_t len = strnlen(value, max_len);
+        hash_bytes(writer, (const uint8_t *)value, len);
+        return;
+    }
+    uint64_t address;
+    if (value && log_impl_image_address(value, &address))
+    {
+        put_value(writer, LOG_BINARY_STRING_ADDRESS, 2);
+        put_value(writer, address, sizeof(void *));
+        return;
+    }
+    if (!value)
+    {
+        value = "(null)";
+    }
+    // a precision may be used on arrays that are not terminated
+    size_t len = strnlen(value, max_len);
+    if (len >= LOG_BINARY_STRING_ADDRESS)
+    {
+        len = LOG_BINARY_STRING_ADDRESS - 1;
+    }
+    // truncate to what is left, the rest of the record may still fit
+    if (writer->pos + 2 + len > writer->size)
+    {
+        len = writer->pos + 2 < writer->size ? writer->size - writer->pos - 2 : 0;
+    }
+    put_value(writer, len, 2);
+    if (!writer->overflow)
+    {
+        memcpy(writer->buffer + writer->pos, value, len);
+        writer->pos += len;
+    }
+}
+
+bool log_binary_image_address(const void *value, uint64_t *address)
+{
+    return log_impl_image_address(value, address);
+}
+
+// one value per argument consumed by the format
+static void put_arguments(writer_t *writer, const char *format, va_list args)
+{
+    va_list list;
+    va_copy(list, args);
+    conversion_t conversion;
+    const char *end = format + strlen(format);
+    for (const char *it = format; !writer->overflow && (it = next_conversion(it, end, &conversion)) != NULL; it = conversion.end)
+    {
+        if (conversion.width_star)
+        {
+            put_value(writer, (uint32_t)va_arg(list, int), 4);
+        }
+        int precision = conversion.precision;
+        if (conversion.precision_star)
+        {
+            precision = va_arg(list, int);
+            put_value(writer, (uint32_t)precision, 4);
+        }
+        switch (conversion.conversion)
+        {
+        case 'c':
+            put_value(writer, (uint32_t)va_arg(list, int), 4);
+            break;
+        case 'd':
+        case 'i':
+        {
+            // sign extended, int may be shorter than its 4 encoded bytes
+            int64_t value;
+            switch (conversion.length)
+            {
+            case LENGTH_L:
+                value = va_arg(list, long);
+                break;
+            case LENGTH_LL:
+                value = va_arg(list, long long);
+                break;
+            case LENGTH_J:
+                value = va_arg(list, intmax_t);
+                break;
+            case LENGTH_Z:
+            case LENGTH_T:
+                value = va_arg(list, ptrdiff_t);
+                break;
+            default:
+                value = va_arg(list, int);
+                break;
+            }
+            put_value(writer, (uint64_t)value, integer_size(&s_native_stream, conversion.length));
+            break;
+        }
+        case 'o':
+        case 'u':
+        case 'x':
+        case 'X':
+        {
+            uint64_t value;
+            switch (conversion.length)
+            {
+            case LENGTH_L:
+                value = va_arg(list, unsigned long);
+                break;
+            case LENGTH_LL:
+                value = va_arg(list, unsigned long long);
+                break;
+            case LENGTH_J:
+                value = va_arg(list, uintmax_t);
+                break;
+            case LENGTH_Z:
+            case LENGTH_T:
+                value = va_arg(list, size_t);
+                break;
+            default:
+                value = va_arg(list, unsigned int);
+                break;
+            }
+            put_value(writer, value, integer_size(&s_native_stream, conversion.length));
+            break;
+        }
+        case 'f':
+        case 'F':
+        case 'e':
+        case 'E':
+        case 'g':
+        case 'G':
+        case 'a':
+        case 'A':
+        {
+            double value = conversion.length == LENGTH_LONG_DOUBLE ? (double)va_arg(list, long double)
+                                                                   : va_arg(list, double);
+            put_value(writer, double_bits(value), 8);
+            break;
+        }
+        case 'p':
+            put_value(writer, (uintptr_t)va_arg(list, void *), sizeof(void *));
+            break;
+        case 's':
+            put_string(writer, va_arg(list, const char *), precision >= 0 ? (size_t)precision : SIZE_MAX);
+            break;
+        case 'n':
+            (void)va_arg(list, void *);
+            break;
+        default:
+            break;
+        }
+    }
+    va_end(list);
+}
+
+size_t log_binary_encode(uint8_t *buffer, size_t size, uint8_t level, uint64_t timestamp_us,
+                         const char *tag, const char *format, va_list args)
+{
+    writer_t writer = {.buffer = buffer, .size = size, .pos = LOG_BINARY_RECORD_HEADER_SIZE};
+    if (size < LOG_BINARY_RECORD_HEADER_SIZE)
+    {
+        return 0;
+    }
+    put_value(&writer, timestamp_us, 8);
+    put_string(&writer, format, SIZE_MAX);
+    put_string(&writer, tag, SIZE_MAX);
+    put_arguments(&writer, format, args);
+
+    if (writer.overflow)
+    {
+        return 0;
+    }
+    size_t body_len = writer.pos - LOG_BINARY_RECORD_HEADER_SIZE;
+    if (body_len > UINT16_MAX)
+    {
+        return 0;
+    }
+    buffer[0] = LOG_BINARY_RECORD_MAGIC;
+    buffer[1] = level;
+    buffer[2] = (uint8_t)body_len;
+    buffer[3] = (uint8_t)(body_len >> 8);
+    return writer.pos;
+}
+
+uint8_t *log_binary_append_dump(uint8_t *record, size_t *length, uint8_t dump_format, uint32_t offset,
+                                const void *address, uint16_t len)
+{
+    writer_t writer = {.buffer = record, .size = *length + LOG_BINARY_DUMP_HEADER_SIZE, .pos = *length};
+    put_value(&writer, dump_format, 1);
+    put_value(&writer, offset, 4);
+    put_value(&writer, (uintptr_t)address, sizeof(void *));
+    put_value(&writer, len, 2);
+    *length = writer.pos + len;
+
+    size_t body_len = *length - LOG_BINARY_RECORD_HEADER_SIZE;
+    record[1] |= LOG_BINARY_RECORD_DUMP;
+    record[2] = (uint8_t)body_len;
+    record[3] = (uint8_t)(body_len >> 8);
+    return record + writer.pos;
+}
+
+uint32_t log_binary_hash(const char *format, va_list args, size_t skip)
+{
+    writer_t writer = {.skip = skip};
+    put_arguments(&writer, format, args);
+    return (uint32_t)(writer.hash >> 32);
+}
+
+// Decoding
+
+typedef struct
+{
+    const uint8_t *buffer;
+    size_t length;
+    size_t pos;
+    bool underflow;
+} reader_t;
+
+static inline uint64_t get_value(reader_t *reader, uint8_t size)
+{
+    if (reader->pos + size > reader->length)
+    {
+        reader->underflow = true;
+        return 0;
+    }
+    uint64_t value = 0;
+    for (uint8_t i = 0; i < size; i++)
+    {
+        value |= (uint64_t)reader->buffer[reader->pos++] << (8 * i);
+    }
+    return value;
+}
+
+static inline int64_t sign_extend(uint64_t value, uint8_t size)
+{
+    if (size >= 8)
+    {
+        return (int64_t)value;
+    }
+    uint64_t sign = 1ull << (size * 8 - 1);
+    return (int64_t)((value ^ sign) - sign);
+}
+
+static const char *get_string(reader_t *reader, const log_binary_stream_t *stream,
+                              log_binary_resolver_t resolver, void *context, uint16_t *len)
+{
+    uint16_t value_len = (uint16_t)get_value(reader, 2);
+    if (reader->underflow)
+    {
+        return NULL;
+    }
+    if (value_len == LOG_BINARY_STRING_ADDRESS)
+    {
+        uint64_t address = get_value(reader, stream->pointer_size);
+        const char *resolved = (!reader->underflow && resolver) ? resolver(context, address) : NULL;
+        if (!resolved)
+        {
+            resolved = "(unresolved)";
+        }
+        size_t resolved_len = strlen(resolved);
+        *len = resolved_len < LOG_BINARY_STRING_ADDRESS ? (uint16_t)resolved_len : LOG_BINARY_STRING_ADDRESS - 1;
+        return resolved;
+    }
+    if (reader->pos + value_len > reader->length)
+    {
+        reader->underflow = true;
+        return NULL;
+    }
+    const char *value = (const char *)reader->buffer + reader->pos;
+    reader->pos += value_len;
+    *len = value_len;
+    return value;
+}
+
+size_t log_binary_parse_record(const uint8_t *buffer, size_t length, const log_binary_stream_t *stream,
+                               log_binary_resolver_t resolver, void *context, log_binary_record_t *record)
+{
+    if (length < LOG_BINARY_RECORD_HEADER_SIZE || buffer[0] != LOG_BINARY_RECORD_MAGIC)
+    {
+        return 0;
+    }
+    size_t record_len = LOG_BINARY_RECORD_HEADER_SIZE + (buffer[2] | (buffer[3] << 8));
+    if (record_len > length)
+    {
+        return 0;
+    }
+    reader_t reader = {.buffer = buffer, .length = record_len, .pos = LOG_BINARY_RECORD_HEADER_SIZE};
+    record->level = buffer[1] & ~LOG_BINARY_RECORD_DUMP;
+    record->dump = (buffer[1] & LOG_BINARY_RECORD_DUMP) != 0;
+    // version 1 streams have millisecond timestamps
+    record->timestamp_us = stream->version == 1 ? get_value(&reader, 4) * 1000 : get_value(&reader, 8);
+    record->format = get_string(&reader, stream, resolver, context, &record->format_len);
+    record->tag = get_string(&reader, stream, resolver, context, &record->tag_len);
+    if (reader.underflow)
+    {
+        return 0;
+    }
+    record->args = buffer + reader.pos;
+    record->args_len = record_len - reader.pos;
+    return record_len;
+}
+
+typedef struct
+{
+    char *out;
+    size_t size;
+    size_t len; // full length, may exceed size
+} output_t;
+
+static void output_append(output_t *output, const char *text, size_t len)
+{
+    if (output->len < output->size)
+    {
+        size_t room = output->size - output->len - 1;
+        memcpy(output->out + output->len, text, len < room ? len : room);
+    }
+    output->len += len;
+}
+
+static void output_printf(output_t *output, const char *spec, ...) __attribute__((format(printf, 2, 3)));
+
+static void output_printf(output_t *output, const char *spec, ...)
+{
+    va_list list;
+    va_start(list, spec);
+    char *out = output->len < output->size ? output->out + output->len : NULL;
+    size_t room = output->len < output->size ? output->size - output->len : 0;
+    int written = vsnprintf(out, room, spec, list);
+    va_end(list);
+    if (written > 0)
+    {
+        output->len += written;
+    }
+}
+
+#define SPEC_FLAGS_MAX 8
+#define SPEC_SIZE (SPEC_FLAGS_MAX + 32)
+#define NOT_SPECIFIED INT_MIN
+
+static void build_spec(char *spec, const conversion_t *conversion, int width, int precision, const char *length, char type)
+{
+    char *it = spec;
+    *it++ = '%';
+    // repeated flags mean nothing more, keep the spec bounded
+    uint8_t flags_len = conversion->flags_len < SPEC_FLAGS_MAX ? conversion->flags_len : SPEC_FLAGS_MAX;
+    memcpy(it, conversion->flags, flags_len);
+    it += flags_len;
+    if (width != NOT_SPECIFIED && width < 0)
+    {
+        // a negative '*' width is a '-' flag followed by a positive width
+        *it++ = '-';
+        width = width == INT_MIN + 1 ? INT_MAX : -width;
+    }
+    if (width != NOT_SPECIFIED)
+    {
+        it += sprintf(it, "%d", width);
+    }
+    if (precision >= 0)
+    {
+        it += sprintf(it, ".%d", precision);
+    }
+    while (*length)
+    {
+        *it++ = *length++;
+    }
+    *it++ = type;
+    *it = 0;
+}
+
+// the lines of a dump, after the arguments
+static bool format_dump(reader_t *reader, const log_binary_stream_t *stream, output_t *output)
+{
+    uint8_t dump_format = (uint8_t)get_value(reader, 1);
+    uint32_t offset = (uint32_t)get_value(reader, 4);
+    uint64_t address = get_value(reader, stream->pointer_size);
+    uint16_t len = (uint16_t)get_value(reader, 2);
+    if (reader->underflow || dump_format > LOG_DUMP_HEXDUMP || reader->pos + len > reader->length)
+    {
+        return false;
+    }
+    const uint8_t *bytes = reader->buffer + reader->pos;
+    char line[HEXDUMP_LINE_SIZE];
+    for (uint32_t i = 0; i < len; i += BYTES_PER_LINE)
+    {
+        int bytes_cur_line = len - i < BYTES_PER_LINE ? len - i : BYTES_PER_LINE;
+        size_t line_len = log_dump_line((log_dump_format_t)dump_format, line, bytes + i, bytes_cur_line,
+                                        (const void *)(uintptr_t)(address + i), offset + i);
+        output_append(output, line, line_len);
+    }
+    reader->pos += len;
+    return true;
+}
+
+int log_binary_format(const log_binary_record_t *record, const log_binary_stream_t *stream,
+                      log_binary_resolver_t resolver, void *context, char *out, size_t out_size)
+{
+    output_t output = {.out = out, .size = out_size, .len = 0};
+    reader_t reader = {.buffer = record->args, .length = record->args_len, .pos = 0};
+    char spec[SPEC_SIZE];
+
+    const char *it = record->format;
+    const char *end = record->format + record->format_len;
+    conversion_t conversion;
+    while (it < end)
+    {
+        const char *next = next_conversion(it, end, &conversion);
+        output_append(&output, it, (next ? conversion.start : end) - it);
+        if (!next)
+        {
+            break;
+        }
+        it = conversion.end;
+
+        int width = conversion.width_star ? (int32_t)get_value(&reader, 4)
+                                          : (conversion.width < 0 ? NOT_SPECIFIED : conversion.width);
+        // a negative precision is taken as if it was omitted
+        int precision = conversion.precision_star ? (int32_t)get_value(&reader, 4) : conversion.precision;
+        if (width == NOT_SPECIFIED && conversion.width_star)
+        {
+            width = INT_MIN + 1; // same as INT_MIN once the '-' flag is applied
+        }
+
+        switch (conversion.conversion)
+        {
+        case 'd':
+        case 'i':
+        {
+            uint8_t size = integer_size(stream, conversion.length);
+            int64_t value = sign_extend(get_value(&reader, size), size);
+            value = conversion.length == LENGTH_HH ? (signed char)value : value;
+            value = conversion.length == LENGTH_H ? (short)value : value;
+            build_spec(spec, &conversion, width, precision, "ll", conversion.conversion);
+            output_printf(&output, spec, (long long)value);
+            break;
+        }
+        case 'o':
+        case 'u':
+        case 'x':
+        case 'X':
+        {
+            uint8_t size = integer_size(stream, conversion.length);
+            uint64_t value = get_value(&reader, size);
+            value = conversion.length == LENGTH_HH ? (unsigned char)value : value;
+            value = conversion.length == LENGTH_H ? (unsigned short)value : value;
+            build_spec(spec, &conversion, width, precision, "ll", conversion.conversion);
+            output_printf(&output, spec, (unsigned long long)value);
+            break;
+        }
+        case 'c':
+        {
+            int value = (unsigned char)get_value(&reader, 4);
+            build_spec(spec, &conversion, width, -1, "", 'c');
+            output_printf(&output, spec, value);
+            break;
+        }
+        case 'f':
+        case 'F':
+        case 'e':
+        case 'E':
+        case 'g':
+        case 'G':
+        case 'a':
+        case 'A':
+        {
+            uint64_t bits = get_value(&reader, 8);
+            double value;
+            memcpy(&value, &bits, sizeof(value));
+            build_spec(spec, &conversion, width, precision, "", conversion.conversion);
+            output_printf(&output, spec, value);
+            break;
+        }
+        case 'p':
+        {
+            uint64_t value = get_value(&reader, stream->pointer_size);
+            build_spec(spec, &conversion, width, -1, "", 'p');
+            output_printf(&output, spec, (void *)(uintptr_t)value);
+            break;
+        }
+        case 's':
+        {
+            uint16_t len = 0;
+            const char *value = get_string(&reader, stream, resolver, context, &len);
+            if (!value)
+            {
+                break;
+            }
+            int shown = (precision >= 0 && precision < len) ? precision : len;
+            build_spec(spec, &conversion, width, -1, ".*", 's');
+            output_printf(&output, spec, shown, value);
+            break;
+        }
+        case '%':
+            output_append(&output, "%", 1);
+            break;
+        case 'n':
+            break;
+        default:
+            // unknown conversion, printed as it was written
+            output_append(&output, conversion.start, conversion.end - conversion.start);
+            break;
+        }
+        if (reader.underflow)
+        {
+            return -1;
+        }
+    }
+
+    if (record->dump && !format_dump(&reader, stream, &output))
+    {
+        return -1;
+    }
+
+    if (out_size > 0)
+    {
+        out[output.len < out_size ? output.len : out_size - 1] = 0;
+    }
+    return (int)output.len;
+}
+
+static const char *next_conversion(const char *format, const char *end, conversion_t *conversion)
+{
+    const char *it = format;
+    while (it < end && *it != '%')
+    {
+        it++;
+    }
+    if (it >= end)
+    {
+        return NULL;
+    }
+    conversion->start = it++;
+    conversion->flags = it;
+    while (it < end && strchr("-+ #0'", *it) && *it)
+    {
+        it++;
+    }
+    conversion->flags_len = (uint8_t)(it - conversion->flags);
+    conversion->width_star = false;
+    conversion->width = -1;
+    if (it < end && *it == '*')
+    {
+        conversion->width_star = true;
+        it++;
+    }
+    else
+    {
+        for (; it < end && *it >= '0' && *it <= '9'; it++)
+        {
+            conversion->width = (conversion->width < 0 ? 0 : conversion->width * 10) + (*it - '0');
+        }
+    }
+    conversion->precision_star = false;
+    conversion->precision = -1;
+    if (it < end && *it == '.')
+    {
+        it++;
+        conversion->precision = 0;
+        if (it < end && *it == '*')
+        {
+            conversion->precision_star = true;
+            it++;
+        }
+        else
+        {
+            for (; it < end && *it >= '0' && *it <= '9'; it++)
+            {
+                conversion->precision = conversion->precision * 10 + (*it - '0');
+            }
+        }
+    }
+    conversion->length = LENGTH_NONE;
+    if (it < end)
+    {
+        switch (*it)
+        {
+        case 'h':
+            conversion->length = (it + 1 < end && it[1] == 'h') ? LENGTH_HH : LENGTH_H;
+            it += conversion->length == LENGTH_HH ? 2 : 1;
+            break;
+        case 'l':
+            conversion->length = (it + 1 < end && it[1] == 'l') ? LENGTH_LL : LENGTH_L;
+            it += conversion->length == LENGTH_LL ? 2 : 1;
+            break;
+        case 'q':
+            conversion->length = LENGTH_LL;
+            it++;
+            break;
+        case 'j':
+            conversion->length = LENGTH_J;
+            it++;
+            break;
+        case 'z':
+            conversion->length = LENGTH_Z;
+            it++;
+            break;
+        case 't':
+            conversion->length = LENGTH_T;
+            it++;
+            break;
+        case 'L':
+            conversion->length = LENGTH_LONG_DOUBLE;
+            it++;
+            break;
+        }
+    }
+    if (it >= end)
+    {
+        // incomplete conversion at the end of the format, printed as text
+        conversion->conversion = 0;
+        conversion->end = end;
+        return conversion->start;
+    }
+    conversion->conversion = *it++;
+    conversion->end = it;
+    return conversion->start;
+}
+
+static uint8_t integer_size(const log_binary_stream_t *stream, length_modifier_t length)
+{
+    switch (length)
+    {
+    case LENGTH_L:
+        return stream->long_size;
+    case LENGTH_LL:
+        return 8;
+    case LENGTH_J:
+        return stream->intmax_size;
+    case LENGTH_Z:
+        return stream->size_t_size;
+    case LENGTH_T:
+        return stream->ptrdiff_size;
+    default:
+        return 4;
+    }
+}
@@ -0,0 +1,194 @@
+// Copyright 2015-2019 Espressif Systems (Shanghai) PTE LTD
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+/*
+ * Lines of the buffer dumps, see log_write_buffer.
+ *
+ * The text output formats its dumps with these on the device. Binary
+ * records carry the raw bytes of a dump instead, log_binary_format renders
+ * them with the same functions, so a decoded dump reads like the text one.
+ */
+
+#include <stdio.h>
+#include <string.h>
+#include "log.h"
+#include "log_dump.h"
+
+static const char s_hex_lower[] = "0123456789abcdef";
+static const char s_hex_upper[] = "0123456789ABCDEF";
+
+#if CONFIG_LOG_BUFFER_SIMD && defined(__SSE2__)
+#include <emmintrin.h>
+#define LOG_BUFFER_SSE2
+#elif CONFIG_LOG_BUFFER_SIMD && defined(__ARM_NEON)
+#include <arm_neon.h>
+#define LOG_BUFFER_NEON
+#endif
+
+// Converts a line to pairs of lower case hex digits and, unless printable is NULL,
+// to its printable characters with '.' in place of everything else (isprint in the C locale).
+static void log_buffer_encode_line(const uint8_t *line, int len, char *hex, char *printable)
+{
+    int i = 0;
+#if defined(LOG_BUFFER_SSE2)
+    const __m128i nibble_mask = _mm_set1_epi8(0x0f);
+    const __m128i nine = _mm_set1_epi8(9);
+    const __m128i digit_zero = _mm_set1_epi8('0');
+    const __m128i letter_gap = _mm_set1_epi8('a' - '0' - 10);
+    for (; i + 16 <= len; i += 16)
+    {
+        __m128i bytes = _mm_loadu_si128((const __m128i *)(line + i));
+        __m128i high = _mm_and_si128(_mm_srli_epi16(bytes, 4), nibble_mask);
+        __m128i low = _mm_and_si128(bytes, nibble_mask);
+        high = _mm_add_epi8(_mm_add_epi8(high, digit_zero), _mm_and_si128(_mm_cmpgt_epi8(high, nine), letter_gap));
+        low = _mm_add_epi8(_mm_add_epi8(low, digit_zero), _mm_and_si128(_mm_cmpgt_epi8(low, nine), letter_gap));
+        _mm_storeu_si128((__m128i *)(hex + 2 * i), _mm_unpacklo_epi8(high, low));
+        _mm_storeu_si128((__m128i *)(hex + 2 * i + 16), _mm_unpackhi_epi8(high, low));
+        if (printable)
+        {
+            // signed compares, bytes from 0x80 up are negative and never printable
+            __m128i visible = _mm_and_si128(_mm_cmpgt_epi8(bytes, _mm_set1_epi8(0x1f)),
+                                            _mm_cmplt_epi8(bytes, _mm_set1_epi8(0x7f)));
+            __m128i chars = _mm_or_si128(_mm_and_si128(visible, bytes),
+                                         _mm_andnot_si128(visible, _mm_set1_epi8('.')));
+            _mm_storeu_si128((__m128i *)(printable + i), chars);
+        }
+    }
+#elif defined(LOG_BUFFER_NEON)
+    const uint8x16_t nibble_mask = vdupq_n_u8(0x0f);
+    const uint8x16_t nine = vdupq_n_u8(9);
+    const uint8x16_t digit_zero = vdupq_n_u8('0');
+    const uint8x16_t letter_gap = vdupq_n_u8('a' - '0' - 10);
+    for (; i + 16 <= len; i += 16)
+    {
+        uint8x16_t bytes = vld1q_u8(line + i);
+        uint8x16_t high = vshrq_n_u8(bytes, 4);
+        uint8x16_t low = vandq_u8(bytes, nibble_mask);
+        uint8x16x2_t digits;
+        digits.val[0] = vaddq_u8(vaddq_u8(high, digit_zero), vandq_u8(vcgtq_u8(high, nine), letter_gap));
+        digits.val[1] = vaddq_u8(vaddq_u8(low, digit_zero), vandq_u8(vcgtq_u8(low, nine), letter_gap));
+        vst2q_u8((uint8_t *)(hex + 2 * i), digits);
+        if (printable)
+        {
+            uint8x16_t visible = vandq_u8(vcgeq_u8(bytes, vdupq_n_u8(0x20)), vcltq_u8(bytes, vdupq_n_u8(0x7f)));
+            vst1q_u8((uint8_t *)(printable + i), vbslq_u8(visible, bytes, vdupq_n_u8('.')));
+        }
+    }
+#endif
+    for (; i < len; i++)
+    {
+        hex[2 * i] = s_hex_lower[line[i] >> 4];
+        hex[2 * i + 1] = s_hex_lower[line[i] & 0x0f];
+        if (printable)
+        {
+            printable[i] = (line[i] >= 0x20 && line[i] < 0x7f) ? (char)line[i] : '.';
+        }
+    }
+}
+
+typedef size_t (*log_line_formatter_t)(char *line, const uint8_t *bytes, int len, const void *address, uint32_t offset);
+
+// "xx " for every byte
+static size_t log_format_hex_line(char *line, const uint8_t *bytes, int len, const void *address, uint32_t offset)
+{
+    char digits[2 * BYTES_PER_LINE];
+    log_buffer_encode_line(bytes, len, digits, NULL);
+
+    char *ptr_hex = line;
+    for (int i = 0; i < len; i++)
+    {
+        *ptr_hex++ = digits[2 * i];
+        *ptr_hex++ = digits[2 * i + 1];
+        *ptr_hex++ = ' ';
+    }
+    *ptr_hex++ = '\n';
+    return ptr_hex - line;
+}
+
+// the bytes are written as they are, a zero byte ends the line
+static size_t log_format_char_line(char *line, const uint8_t *bytes, int len, const void *address, uint32_t offset)
+{
+    const uint8_t *end = memchr(bytes, 0, len);
+    size_t text_len = end ? (size_t)(end - bytes) : (size_t)len;
+    memcpy(line, bytes, text_len);
+    line[text_len] = '\n';
+    return text_len + 1;
+}
+
+static size_t log_format_hexdump_line(char *line, const uint8_t *bytes, int len, const void *address, uint32_t offset)
+{
+    char digits[2 * BYTES_PER_LINE];
+    char printable[BYTES_PER_LINE];
+    log_buffer_encode_line(bytes, len, digits, printable);
+
+    // %p is platform defined, everything after it is built from the digit tables
+    int address_len = snprintf(line, HEXDUMP_ADDRESS_SIZE + 1, "%p", address);
+    char *ptr_hd = line + (address_len < 0 ? 0 : address_len > (int)HEXDUMP_ADDRESS_SIZE ? (int)HEXDUMP_ADDRESS_SIZE : address_len);
+
+    *ptr_hd++ = ' ';
+    *ptr_hd++ = '(';
+    for (int shift = 28; shift >= 0; shift -= 4)
+    {
+        *ptr_hd++ = s_hex_upper[(offset >> shift) & 0x0f];
+    }
+    *ptr_hd++ = ')';
+
+    for (int i = 0; i < BYTES_PER_LINE; i++)
+    {
+        if ((i & 7) == 0)
+        {
+            *ptr_hd++ = ' ';
+        }
+        *ptr_hd++ = ' ';
+        if (i < len)
+        {
+            *ptr_hd++ = digits[2 * i];
+            *ptr_hd++ = digits[2 * i + 1];
+        }
+        else
+        {
+            *ptr_hd++ = ' ';
+            *ptr_hd++ = ' ';
+        }
+    }
+    *ptr_hd++ = ' ';
+    *ptr_hd++ = ' ';
+    *ptr_hd++ = '|';
+    memcpy(ptr_hd, printable, len);
+    ptr_hd += len;
+    *ptr_hd++ = '|';
+    *ptr_hd++ = '\n';
+    return ptr_hd - line;
+}
+
+static const struct
+{
+    log_line_formatter_t format_line;
+    size_t line_size;
+} s_dump_formats[] = {
+    [LOG_DUMP_HEX] = {log_format_hex_line, HEX_LINE_SIZE},
+    [LOG_DUMP_CHAR] = {log_format_char_line, CHAR_LINE_SIZE},
+    [LOG_DUMP_HEXDUMP] = {log_format_hexdump_line, HEXDUMP_LINE_SIZE},
+};
+
+size_t log_dump_line_size(log_dump_format_t dump_format)
+{
+    return s_dump_formats[dump_format].line_size;
+}
+
+size_t log_dump_line(log_dump_format_t dump_format, char *line, const uint8_t *bytes, int len,
+                     const void *address, uint32_t offset)
+{
+    return s_dump_formats[dump_format].format_line(line, bytes, len, address, offset);
+}
@@ -0,0 +1,30 @@
+#pragma once
+#include <stddef.h>
+#include <stdint.h>
+#include "log.h"
+
+// longest line of each format, including the newline
+#define HEX_LINE_SIZE (3 * BYTES_PER_LINE + 1)
+#define CHAR_LINE_SIZE (BYTES_PER_LINE + 1)
+//format: field[length]
+// ADDR[2+2*sizeof(void*)]+" ("+OFFSET[8]+")"+(" "+(" "+DATA_HEX[2])*8)*(BYTES_PER_LINE/8)+"  |"+DATA_CHAR[BYTES_PER_LINE]+"|\n"
+#define HEXDUMP_ADDRESS_SIZE (2 + 2 * sizeof(void *))
+#define HEXDUMP_LINE_SIZE (HEXDUMP_ADDRESS_SIZE + 2 + 8 + 1 + (BYTES_PER_LINE + 7) / 8 + 3 * BYTES_PER_LINE + 3 + BYTES_PER_LINE + 1 + 1)
+
+/**
+ * @brief longest line of a dump format, including the newline
+ */
+size_t log_dump_line_size(log_dump_format_t dump_format);
+
+/**
+ * @brief format up to BYTES_PER_LINE bytes as one line of a dump, see log_dump.c
+ *
+ * @param line output, at least log_dump_line_size(dump_format) characters, not terminated
+ * @param bytes bytes of the line
+ * @param len number of bytes, at most BYTES_PER_LINE
+ * @param address address of the first byte on the device, printed by LOG_DUMP_HEXDUMP
+ * @param offset offset of the first byte in the dump, printed by LOG_DUMP_HEXDUMP
+ * @return size_t length of the line
+ */
+size_t log_dump_line(log_dump_format_t dump_format, char *line, const uint8_t *bytes, int len,
+                     const void *address, uint32_t offset);
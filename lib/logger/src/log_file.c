@@ -0,0 +1,304 @@
+// Copyright 2015-2019 Espressif Systems (Shanghai) PTE LTD
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+/*
+ * Memory-mapped log files, see log_file.h.
+ *
+ * Writers reserve their bytes in the current mapping with one atomic add
+ * and copy them, the first reservation past the end marks the content of
+ * the file. Two mapping slots alternate: a writer announces itself in the
+ * slot it loaded and checks that the slot is still current before touching
+ * the mapping, the rotating thread publishes the next slot and waits until
+ * no writer is left in the previous one before it unmaps and truncates it.
+ * Rotations, open and close serialize on log_impl_lock().
+ */
+
+#ifndef _GNU_SOURCE
+#define _GNU_SOURCE // for posix_fallocate and MADV_POPULATE_WRITE
+#endif
+
+#include <stdbool.h>
+#include <stdint.h>
+#include <stddef.h>
+#include <string.h>
+#include <stdio.h>
+#include "log.h"
+#include "log_file.h"
+#include "log_binary.h"
+#include "log_private.h"
+
+#if defined(__linux__)
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+
+/**
+ * @brief a mapped file and the writers using it
+ */
+typedef struct
+{
+    int fd;
+    uint8_t *base;
+    size_t size;
+    size_t start;    // first byte after the stream header copied by rotate
+    size_t pos;      // next free byte, may run past size
+    size_t end;      // first reservation that did not fit
+    uint32_t writers;
+} log_file_map_t;
+
+static log_file_map_t s_file_maps[2];
+static log_file_map_t *s_file_map = NULL;
+static char s_file_path[256];
+static uint8_t s_file_count = 1;
+
+static size_t map_content(const log_file_map_t *map)
+{
+    size_t pos = __atomic_load_n(&map->pos, __ATOMIC_ACQUIRE);
+    size_t end = __atomic_load_n(&map->end, __ATOMIC_ACQUIRE);
+    return pos < end ? pos : end;
+}
+
+static void wait_for_writers(log_file_map_t *map)
+{
+    while (__atomic_load_n(&map->writers, __ATOMIC_ACQUIRE))
+    {
+        log_impl_yield();
+    }
+}
+
+// path.1 becomes path.2 and so on, path becomes path.1, the oldest file is overwritten
+static void shift_files(void)
+{
+    char from[sizeof(s_file_path) + 4];
+    char to[sizeof(s_file_path) + 4];
+    if (s_file_count < 2)
+    {
+        // the mapping of the previous file stays valid until it is unmapped
+        unlink(s_file_path);
+        return;
+    }
+    for (unsigned i = s_file_count - 1; i > 0; i--)
+    {
+        if (i == 1)
+        {
+            snprintf(from, sizeof(from), "%s", s_file_path);
+        }
+        else
+        {
+            snprintf(from, sizeof(from), "%s.%u", s_file_path, i - 1);
+        }
+        snprintf(to, sizeof(to), "%s.%u", s_file_path, i);
+        rename(from, to);
+    }
+}
+
+static bool map_file(log_file_map_t *map, size_t size)
+{
+    int fd = open(s_file_path, O_RDWR | O_CREAT | O_TRUNC | O_CLOEXEC, 0644);
+    if (fd < 0)
+    {
+        return false;
+    }
+    // allocated up front, a full disk fails here instead of raising SIGBUS in a writer
+    if (posix_fallocate(fd, 0, (off_t)size) != 0)
+    {
+        close(fd);
+        return false;
+    }
+    void *base = mmap(NULL, size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    if (base == MAP_FAILED)
+    {
+        close(fd);
+        return false;
+    }
+    madvise(base, size, MADV_SEQUENTIAL);
+#ifdef MADV_POPULATE_WRITE
+    // writable page tables up front, writers then never take a page fault (Linux 5.14)
+    madvise(base, size, MADV_POPULATE_WRITE);
+#endif
+    map->fd = fd;
+    map->base = base;
+    map->size = size;
+    map->start = 0;
+    map->pos = 0;
+    map->end = size;
+    return true;
+}
+
+static void unmap_file(log_file_map_t *map)
+{
+    size_t content = map_content(map);
+    munmap(map->base, map->size);
+    if (ftruncate(map->fd, (off_t)content) != 0)
+    {
+        // the file keeps its preallocated size, the end is padded with zeros
+    }
+    close(map->fd);
+}
+
+// replaces the current file by a new one, unless another writer already did
+static void rotate(log_file_map_t *full)
+{
+    log_impl_lock();
+    if (__atomic_load_n(&s_file_map, __ATOMIC_SEQ_CST) == full)
+    {
+        log_file_map_t *next = full == &s_file_maps[0] ? &s_file_maps[1] : &s_file_maps[0];
+        shift_files();
+        if (map_file(next, full->size))
+        {
+            // a binary stream stays readable, every file starts with the stream header
+            if (map_content(full) >= LOG_BINARY_STREAM_HEADER_SIZE && memcmp(full->base, "CLOG", 4) == 0)
+            {
+                memcpy(next->base, full->base, LOG_BINARY_STREAM_HEADER_SIZE);
+                next->start = LOG_BINARY_STREAM_HEADER_SIZE;
+                next->pos = LOG_BINARY_STREAM_HEADER_SIZE;
+            }
+            __atomic_store_n(&s_file_map, next, __ATOMIC_SEQ_CST);
+        }
+        else
+        {
+            __atomic_store_n(&s_file_map, NULL, __ATOMIC_SEQ_CST);
+        }
+        wait_for_writers(full);
+        unmap_file(full);
+    }
+    log_impl_unlock();
+}
+
+// closes the current file, called with log_impl_lock() held
+static void close_file(void)
+{
+    log_file_map_t *map = __atomic_exchange_n(&s_file_map, NULL, __ATOMIC_SEQ_CST);
+    if (map)
+    {
+        wait_for_writers(map);
+        unmap_file(map);
+    }
+}
+
+bool log_file_open(const char *path, size_t file_size, uint8_t files)
+{
+    if (strlen(path) >= sizeof(s_file_path) || file_size == 0)
+    {
+        return false;
+    }
+    log_impl_lock();
+    close_file();
+    strcpy(s_file_path, path);
+    s_file_count = files ? files : 1;
+    // the file of a previous run is kept like a rotated one
+    shift_files();
+    bool opened = map_file(&s_file_maps[0], file_size);
+    if (opened)
+    {
+        __atomic_store_n(&s_file_map, &s_file_maps[0], __ATOMIC_SEQ_CST);
+    }
+    log_impl_unlock();
+    return opened;
+}
+
+void log_file_close(void)
+{
+    log_impl_lock();
+    close_file();
+    log_impl_unlock();
+}
+
+void log_file_sync(bool wait)
+{
+    log_impl_lock();
+    log_file_map_t *map = __atomic_load_n(&s_file_map, __ATOMIC_SEQ_CST);
+    if (map)
+    {
+        msync(map->base, map_content(map), wait ? MS_SYNC : MS_ASYNC);
+    }
+    log_impl_unlock();
+}
+
+void log_file_write(const uint8_t *data, size_t length)
+{
+    for (;;)
+    {
+        log_file_map_t *map = __atomic_load_n(&s_file_map, __ATOMIC_SEQ_CST);
+        if (!map)
+        {
+            return;
+        }
+        __atomic_fetch_add(&map->writers, 1, __ATOMIC_SEQ_CST);
+        if (map != __atomic_load_n(&s_file_map, __ATOMIC_SEQ_CST))
+        {
+            // rotated in between, the slot may already be unmapped
+            __atomic_fetch_sub(&map->writers, 1, __ATOMIC_RELEASE);
+            continue;
+        }
+        // would not fit in the next file either, rotating again would not help
+        if (length > map->size - map->start)
+        {
+            __atomic_fetch_sub(&map->writers, 1, __ATOMIC_RELEASE);
+            return;
+        }
+        size_t offset = __atomic_fetch_add(&map->pos, length, __ATOMIC_RELAXED);
+        if (offset + length <= map->size)
+        {
+            memcpy(map->base + offset, data, length);
+            __atomic_fetch_sub(&map->writers, 1, __ATOMIC_RELEASE);
+            return;
+        }
+        // reservations are in order, the smallest one that does not fit ends the content
+        size_t end = __atomic_load_n(&map->end, __ATOMIC_RELAXED);
+        while (offset < end && !__atomic_compare_exchange_n(&map->end, &end, offset, true, __ATOMIC_RELAXED, __ATOMIC_RELAXED))
+        {
+        }
+        __atomic_fetch_sub(&map->writers, 1, __ATOMIC_RELEASE);
+        rotate(map);
+    }
+}
+
+int log_file_vprintf(const char *format, va_list args)
+{
+    char text[CONFIG_LOG_FILE_LINE_SIZE];
+    int length = vsnprintf(text, sizeof(text), format, args);
+    if (length < 0)
+    {
+        return -1;
+    }
+    log_file_write((const uint8_t *)text, (size_t)length < sizeof(text) ? (size_t)length : sizeof(text) - 1);
+    return length;
+}
+
+#else
+
+bool log_file_open(const char *path, size_t file_size, uint8_t files)
+{
+    return false;
+}
+
+void log_file_close(void)
+{
+}
+
+void log_file_sync(bool wait)
+{
+}
+
+void log_file_write(const uint8_t *data, size_t length)
+{
+}
+
+int log_file_vprintf(const char *format, va_list args)
+{
+    return 0;
+}
+
+#endif
@@ -1,6 +1,20 @@
 #pragma once
 #include <stdbool.h>
+#include <stdint.h>
+#include <time.h>
+
+// "HH:MM:SS.sss" and the terminator
+#define LOG_SYSTEM_TIME_SIZE 13
 
 void log_impl_lock(void);
 bool log_impl_lock_timeout(void);
 void log_impl_unlock(void);
+void log_impl_yield(void);
+bool log_impl_image_address(const void *ptr, uint64_t *address);
+bool log_impl_thread_start(void (*func)(void));
+void log_impl_wait(uint32_t timeout_ms);
+void log_impl_signal(void);
+void log_impl_at_exit(void (*func)(void));
+
+// "HH:MM:SS.sss" in a buffer of the calling thread, valid until its next call, see log_system_time.c
+char *log_impl_system_time(time_t seconds, uint32_t milliseconds);
@@ -0,0 +1,301 @@
+// Copyright 2015-2019 Espressif Systems (Shanghai) PTE LTD
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+/*
+ * Flight recorder, see log_recorder_start.
+ *
+ * Binary records are kept in a ring in memory that survives a reset: a
+ * noinit section on ESP32 and AVR, a shared mapping of a file on Linux.
+ * Writers reserve an entry by a CAS on the free-running write position,
+ * stored in the region as well, and overwrite the oldest entries. There is
+ * no read position, entries never wrap, the bytes left before the end of
+ * the ring are skipped.
+ *
+ * Each entry starts with the position it was reserved at and a 16 bit
+ * multiply-xor check of its words. After a reset the ring is scanned from the write position: an
+ * entry is valid if its position maps to its offset, lies within the last
+ * ring size bytes before the write position and its check matches. An
+ * entry overwritten in part or interrupted by the reset fails one of them.
+ */
+
+#include <stdbool.h>
+#include <stdint.h>
+#include <stddef.h>
+#include <string.h>
+#include "log.h"
+#include "log_binary.h"
+#include "log_private.h"
+#include "log_recorder.h"
+
+#if CONFIG_LOG_RECORDER_SIZE > 0
+
+#if (CONFIG_LOG_RECORDER_SIZE & (CONFIG_LOG_RECORDER_SIZE - 1)) != 0
+#error "CONFIG_LOG_RECORDER_SIZE must be a power of two"
+#endif
+
+#define RECORDER_MAGIC 0x52464c43 // "CLFR"
+#define RECORDER_MASK (CONFIG_LOG_RECORDER_SIZE - 1)
+// an entry is two words, the write position it was reserved at and length | check << 16, then the record
+#define ENTRY_HEADER_SIZE 8
+#define ENTRY_SIZE(length) (ENTRY_HEADER_SIZE + (((uint32_t)(length) + 3) & ~3u))
+
+/**
+ * @brief the persistent region
+ */
+typedef struct
+{
+    uint32_t magic;
+    uint32_t size;      // CONFIG_LOG_RECORDER_SIZE of the run that wrote the ring
+    uint32_t write_pos; // free-running, the next entry is reserved here
+    uint8_t stream_header[(LOG_BINARY_STREAM_HEADER_SIZE + 3) & ~3];
+    uint32_t ring[CONFIG_LOG_RECORDER_SIZE / 4];
+} log_recorder_region_t;
+
+uint8_t g_log_recorder_level = LOG_NONE;
+static log_recorder_region_t *s_region = NULL;
+
+#if defined(__linux__)
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+// the file keeps the ring of a process that crashed, a path on a persistent file system keeps it across reboots
+static log_recorder_region_t *map_region(void)
+{
+    int fd = open(CONFIG_LOG_RECORDER_PATH, O_RDWR | O_CREAT | O_CLOEXEC, 0644);
+    if (fd < 0)
+    {
+        return NULL;
+    }
+    struct stat st;
+    // a file of another size is cleared, its magic is gone
+    if (fstat(fd, &st) != 0 || (st.st_size != sizeof(log_recorder_region_t) &&
+                                (ftruncate(fd, 0) != 0 || ftruncate(fd, sizeof(log_recorder_region_t)) != 0)))
+    {
+        close(fd);
+        return NULL;
+    }
+    void *base = mmap(NULL, sizeof(log_recorder_region_t), PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    close(fd);
+    return base == MAP_FAILED ? NULL : (log_recorder_region_t *)base;
+}
+#else
+#if defined(ESP32)
+#include "esp_attr.h"
+#define RECORDER_NOINIT __NOINIT_ATTR
+#elif defined(__AVR__)
+#define RECORDER_NOINIT __attribute__((section(".noinit")))
+#else
+// cleared at startup, the ring only survives in a debugger
+#define RECORDER_NOINIT
+#endif
+static RECORDER_NOINIT log_recorder_region_t s_noinit_region;
+
+static log_recorder_region_t *map_region(void)
+{
+    return &s_noinit_region;
+}
+#endif
+
+static log_recorder_region_t *attach_region(void)
+{
+    log_recorder_region_t *region = __atomic_load_n(&s_region, __ATOMIC_ACQUIRE);
+    if (!region)
+    {
+        log_impl_lock();
+        region = s_region;
+        if (!region)
+        {
+            region = map_region();
+            __atomic_store_n(&s_region, region, __ATOMIC_RELEASE);
+        }
+        log_impl_unlock();
+    }
+    return region;
+}
+
+// multiply-xor over the words of the entry, computed while they are stored
+#define CHECK_MULTIPLIER 0x9E3779B1u
+
+static inline uint32_t check_word(uint32_t check, uint32_t word)
+{
+    return (check ^ word) * CHECK_MULTIPLIER;
+}
+
+static uint16_t entry_check(uint32_t pos, uint16_t length, const uint32_t *words)
+{
+    uint32_t check = check_word(check_word(0, pos), length);
+    for (size_t i = 0; i < ((size_t)length + 3) / 4; i++)
+    {
+        check = check_word(check, words[i]);
+    }
+    return (uint16_t)(check >> 16);
+}
+
+// record is zero padded to a whole number of words
+static void push_record(const uint32_t *record, size_t length)
+{
+    log_recorder_region_t *region = __atomic_load_n(&s_region, __ATOMIC_ACQUIRE);
+    uint32_t size = ENTRY_SIZE(length);
+    if (!region || length == 0 || size > CONFIG_LOG_RECORDER_SIZE)
+    {
+        return;
+    }
+    uint32_t pos = __atomic_load_n(&region->write_pos, __ATOMIC_RELAXED);
+    uint32_t start;
+    do
+    {
+        // an entry does not fit before the end of the ring starts over at offset 0
+        start = pos;
+        if ((pos & RECORDER_MASK) + size > CONFIG_LOG_RECORDER_SIZE)
+        {
+            start = pos + CONFIG_LOG_RECORDER_SIZE - (pos & RECORDER_MASK);
+        }
+    } while (!__atomic_compare_exchange_n(&region->write_pos, &pos, start + size, true,
+                                          __ATOMIC_RELAXED, __ATOMIC_RELAXED));
+
+    // stored word by word, a writer lapped by the others races with them, its check then fails
+    uint32_t *entry = region->ring + (start & RECORDER_MASK) / 4;
+    uint32_t check = check_word(check_word(0, start), (uint32_t)length);
+    for (size_t i = 0; i < (length + 3) / 4; i++)
+    {
+        check = check_word(check, record[i]);
+        __atomic_store_n(&entry[2 + i], record[i], __ATOMIC_RELAXED);
+    }
+    __atomic_store_n(&entry[0], start, __ATOMIC_RELAXED);
+    __atomic_store_n(&entry[1], (check >> 16) << 16 | (uint32_t)length, __ATOMIC_RELAXED);
+}
+
+void log_recorder_writev(uint8_t level, const char *tag, const char *format, va_list args)
+{
+    uint32_t record[(CONFIG_LOG_BINARY_RECORD_SIZE + 3) / 4];
+    size_t length = log_binary_encode((uint8_t *)record, sizeof(record), level, log_timestamp_us(), tag, format, args);
+    memset((uint8_t *)record + length, 0, (4 - length % 4) % 4);
+    push_record(record, length);
+}
+
+void log_recorder_write_record(const uint8_t *record, size_t length)
+{
+    if (length >= LOG_BINARY_RECORD_HEADER_SIZE && length <= CONFIG_LOG_BINARY_RECORD_SIZE &&
+        (record[1] & ~LOG_BINARY_RECORD_DUMP) <= __atomic_load_n(&g_log_recorder_level, __ATOMIC_RELAXED))
+    {
+        uint32_t words[(CONFIG_LOG_BINARY_RECORD_SIZE + 3) / 4];
+        memcpy(words, record, length);
+        memset((uint8_t *)words + length, 0, (4 - length % 4) % 4);
+        push_record(words, length);
+    }
+}
+
+void log_record(uint8_t level, const char *tag, const char *format, ...)
+{
+    va_list list;
+    va_start(list, format);
+    log_recorder_writev(level, tag, format, list);
+    va_end(list);
+}
+
+void log_record_binary(const uint8_t *record, size_t length)
+{
+    log_recorder_write_record(record, length);
+}
+
+bool log_recorder_start(uint8_t level)
+{
+    log_recorder_region_t *region = attach_region();
+    if (!region)
+    {
+        return false;
+    }
+    __atomic_store_n(&g_log_recorder_level, LOG_NONE, __ATOMIC_SEQ_CST);
+    // entries of the previous run would be valid again once the write position returns to them
+    region->magic = 0;
+    memset(region->ring, 0, sizeof(region->ring));
+    region->size = CONFIG_LOG_RECORDER_SIZE;
+    log_binary_stream_header(region->stream_header);
+    __atomic_store_n(&region->write_pos, 0, __ATOMIC_SEQ_CST);
+    __atomic_store_n(&region->magic, RECORDER_MAGIC, __ATOMIC_SEQ_CST);
+    __atomic_store_n(&g_log_recorder_level, level, __ATOMIC_SEQ_CST);
+    return true;
+}
+
+void log_recorder_stop(void)
+{
+    __atomic_store_n(&g_log_recorder_level, LOG_NONE, __ATOMIC_SEQ_CST);
+}
+
+size_t log_recorder_drain(log_binary_writer_t writer)
+{
+    log_recorder_region_t *region = attach_region();
+    if (!region)
+    {
+        return 0;
+    }
+    uint32_t write_pos = __atomic_load_n(&region->write_pos, __ATOMIC_ACQUIRE);
+    log_binary_stream_t stream;
+    if (region->magic != RECORDER_MAGIC || region->size != CONFIG_LOG_RECORDER_SIZE || (write_pos & 3) != 0 ||
+        !log_binary_parse_stream_header(region->stream_header, LOG_BINARY_STREAM_HEADER_SIZE, &stream))
+    {
+        return 0;
+    }
+
+    // the oldest entry that can still be intact starts at the offset of the write position
+    size_t records = 0;
+    uint32_t scanned = 0;
+    while (scanned < CONFIG_LOG_RECORDER_SIZE)
+    {
+        uint32_t offset = (write_pos + scanned) & RECORDER_MASK;
+        const uint32_t *entry = region->ring + offset / 4;
+        const uint8_t *record = (const uint8_t *)&entry[2];
+        uint32_t pos = entry[0];
+        uint16_t length = (uint16_t)entry[1];
+        uint32_t size = ENTRY_SIZE(length);
+        uint32_t age = write_pos - pos;
+        if ((pos & RECORDER_MASK) != offset || length == 0 || offset + size > CONFIG_LOG_RECORDER_SIZE ||
+            age > CONFIG_LOG_RECORDER_SIZE || age < size || (entry[1] >> 16) != entry_check(pos, length, &entry[2]))
+        {
+            scanned += 4;
+            continue;
+        }
+        if (writer)
+        {
+            if (records == 0)
+            {
+                writer(region->stream_header, LOG_BINARY_STREAM_HEADER_SIZE);
+            }
+            writer(record, length);
+        }
+        records++;
+        scanned += size;
+    }
+    return records;
+}
+
+#else
+
+bool log_recorder_start(uint8_t level)
+{
+    return false;
+}
+
+void log_recorder_stop(void)
+{
+}
+
+size_t log_recorder_drain(log_binary_writer_t writer)
+{
+    return 0;
+}
+
+#endif
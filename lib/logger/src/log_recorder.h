@@ -0,0 +1,19 @@
+#pragma once
+#include <stdbool.h>
+#include <stdint.h>
+#include <stddef.h>
+#include <stdarg.h>
+
+/**
+ * @brief encode a message into the flight recorder ring, see log_recorder.c
+ *
+ * The caller checked the level against g_log_recorder_level.
+ */
+void log_recorder_writev(uint8_t level, const char *tag, const char *format, va_list args);
+
+/**
+ * @brief copy a record encoded by the caller into the flight recorder ring
+ *
+ * The record is skipped if its level is above g_log_recorder_level.
+ */
+void log_recorder_write_record(const uint8_t *record, size_t length);
@@ -0,0 +1,456 @@
+// Copyright 2015-2019 Espressif Systems (Shanghai) PTE LTD
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+/*
+ * Structured records, see log_structured.h for the format.
+ *
+ * Fields are encoded straight to CBOR, nothing goes through printf on the
+ * device. The JSON renderer walks a record once and writes each value as it
+ * is decoded, it is used when no structured writer is set and by host tools.
+ */
+
+#include <stdbool.h>
+#include <stdint.h>
+#include <stddef.h>
+#include <string.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include "log.h"
+#include "log_structured.h"
+
+#define CBOR_UINT 0
+#define CBOR_NEGATIVE 1
+#define CBOR_BYTES 2
+#define CBOR_TEXT 3
+#define CBOR_MAP 5
+#define CBOR_SIMPLE 7
+
+#define CBOR_FALSE 0xF4
+#define CBOR_TRUE 0xF5
+#define CBOR_FLOAT32 0xFA
+#define CBOR_FLOAT64 0xFB
+
+static log_structured_writer_t s_structured_writer = NULL;
+
+log_structured_writer_t log_set_structured_writer(log_structured_writer_t func)
+{
+    return __atomic_exchange_n(&s_structured_writer, func, __ATOMIC_ACQ_REL);
+}
+
+void log_write_fields(uint8_t level, const char *tag, const char *message, const log_field_t *fields, size_t count)
+{
+    uint8_t record[CONFIG_LOG_STRUCTURED_RECORD_SIZE];
+    size_t length = log_structured_encode(record, sizeof(record), level, log_timestamp(), tag, message, fields, count);
+    if (!length)
+    {
+        return;
+    }
+    log_structured_writer_t structured_writer = __atomic_load_n(&s_structured_writer, __ATOMIC_ACQUIRE);
+    if (structured_writer)
+    {
+        (*structured_writer)(level, tag, record, length);
+        return;
+    }
+    char text[CONFIG_LOG_STRUCTURED_TEXT_SIZE];
+    if (log_structured_format_json(record, length, text, sizeof(text)) > 0)
+    {
+        log_write_text(level, tag, text);
+    }
+}
+
+// Encoding
+
+typedef struct
+{
+    uint8_t *buffer;
+    size_t size;
+    size_t pos;
+    bool overflow;
+} writer_t;
+
+static uint8_t head_size(uint64_t argument)
+{
+    return argument < 24 ? 1 : argument <= 0xFF ? 2 : argument <= 0xFFFF ? 3 : argument <= 0xFFFFFFFF ? 5 : 9;
+}
+
+static void put_bytes(writer_t *writer, const void *data, size_t length)
+{
+    if (writer->pos + length > writer->size)
+    {
+        writer->overflow = true;
+        return;
+    }
+    memcpy(writer->buffer + writer->pos, data, length);
+    writer->pos += length;
+}
+
+// major type and argument in the shortest form, multi-byte arguments are big endian
+static void put_head(writer_t *writer, uint8_t major, uint64_t argument)
+{
+    uint8_t size = head_size(argument);
+    if (writer->pos + size > writer->size)
+    {
+        writer->overflow = true;
+        return;
+    }
+    static const uint8_t additional[] = {0, 0, 24, 25, 0, 26, 0, 0, 0, 27};
+    writer->buffer[writer->pos++] = (uint8_t)((major << 5) | (size == 1 ? argument : additional[size]));
+    for (int shift = 8 * (size - 2); shift >= 0; shift -= 8)
+    {
+        writer->buffer[writer->pos++] = (uint8_t)(argument >> shift);
+    }
+}
+
+// truncate to what is left, the rest of the record may still fit
+static void put_string(writer_t *writer, uint8_t major, const void *data, size_t length)
+{
+    size_t room = writer->pos < writer->size ? writer->size - writer->pos : 0;
+    if (head_size(length) + length > room)
+    {
+        length = room > 9 ? room - 9 : 0;
+        while (head_size(length + 1) + length + 1 <= room)
+        {
+            length++;
+        }
+        // do not split a UTF-8 sequence
+        while (major == CBOR_TEXT && length > 0 && (((const uint8_t *)data)[length] & 0xC0) == 0x80)
+        {
+            length--;
+        }
+    }
+    put_head(writer, major, length);
+    put_bytes(writer, data, length);
+}
+
+static void put_text(writer_t *writer, const char *text)
+{
+    if (!text)
+    {
+        text = "(null)";
+    }
+    put_string(writer, CBOR_TEXT, text, strlen(text));
+}
+
+static void put_double(writer_t *writer, double value)
+{
+#if __SIZEOF_DOUBLE__ == 8
+    uint64_t bits;
+    memcpy(&bits, &value, sizeof(bits));
+    uint8_t encoded[9] = {CBOR_FLOAT64};
+#else
+    uint32_t bits;
+    memcpy(&bits, &value, sizeof(bits));
+    uint8_t encoded[5] = {CBOR_FLOAT32};
+#endif
+    for (size_t i = 1; i < sizeof(encoded); i++)
+    {
+        encoded[i] = (uint8_t)(bits >> (8 * (sizeof(encoded) - 1 - i)));
+    }
+    put_bytes(writer, encoded, sizeof(encoded));
+}
+
+static void put_field(writer_t *writer, const log_field_t *field)
+{
+    put_text(writer, field->key);
+    switch (field->type)
+    {
+    case LOG_FIELD_INT:
+        if (field->value.i < 0)
+        {
+            // -1 - n, without overflow for INT64_MIN
+            put_head(writer, CBOR_NEGATIVE, (uint64_t)(-(field->value.i + 1)));
+        }
+        else
+        {
+            put_head(writer, CBOR_UINT, (uint64_t)field->value.i);
+        }
+        break;
+    case LOG_FIELD_UINT:
+        put_head(writer, CBOR_UINT, field->value.u);
+        break;
+    case LOG_FIELD_DOUBLE:
+        put_double(writer, field->value.d);
+        break;
+    case LOG_FIELD_BOOL:
+    {
+        uint8_t value = field->value.b ? CBOR_TRUE : CBOR_FALSE;
+        put_bytes(writer, &value, 1);
+        break;
+    }
+    case LOG_FIELD_STRING:
+        put_text(writer, field->value.s);
+        break;
+    case LOG_FIELD_BYTES:
+        put_string(writer, CBOR_BYTES, field->value.bytes.data, field->value.bytes.length);
+        break;
+    default:
+        writer->overflow = true;
+        break;
+    }
+}
+
+size_t log_structured_encode(uint8_t *buffer, size_t size, uint8_t level, uint32_t timestamp, const char *tag,
+                             const char *message, const log_field_t *fields, size_t count)
+{
+    writer_t writer = {buffer, size, 0, false};
+    put_head(&writer, CBOR_MAP, LOG_STRUCTURED_BASE_KEYS + count);
+    put_text(&writer, "ts");
+    put_head(&writer, CBOR_UINT, timestamp);
+    put_text(&writer, "level");
+    put_head(&writer, CBOR_UINT, level);
+    put_text(&writer, "tag");
+    put_text(&writer, tag);
+    put_text(&writer, "msg");
+    put_text(&writer, message);
+    for (size_t i = 0; i < count && !writer.overflow; i++)
+    {
+        put_field(&writer, &fields[i]);
+    }
+    return writer.overflow ? 0 : writer.pos;
+}
+
+// Decoding
+
+typedef struct
+{
+    const uint8_t *record;
+    size_t length;
+    size_t pos;
+    char *text;
+    size_t size;
+    size_t text_len;
+    bool failed;
+} renderer_t;
+
+static void emit(renderer_t *renderer, const char *text, size_t length)
+{
+    if (renderer->text_len + length >= renderer->size)
+    {
+        renderer->failed = true;
+        return;
+    }
+    memcpy(renderer->text + renderer->text_len, text, length);
+    renderer->text_len += length;
+}
+
+static bool take_head(renderer_t *renderer, uint8_t *major, uint8_t *additional, uint64_t *argument)
+{
+    if (renderer->pos >= renderer->length)
+    {
+        return false;
+    }
+    uint8_t initial = renderer->record[renderer->pos++];
+    *major = initial >> 5;
+    *additional = initial & 0x1F;
+    if (*additional < 24)
+    {
+        *argument = *additional;
+        return true;
+    }
+    if (*additional > 27)
+    {
+        return false;
+    }
+    size_t size = (size_t)1 << (*additional - 24);
+    if (renderer->pos + size > renderer->length)
+    {
+        return false;
+    }
+    *argument = 0;
+    for (size_t i = 0; i < size; i++)
+    {
+        *argument = (*argument << 8) | renderer->record[renderer->pos++];
+    }
+    return true;
+}
+
+static void emit_uint(renderer_t *renderer, uint64_t value)
+{
+    char digits[24];
+    int length = snprintf(digits, sizeof(digits), "%llu", (unsigned long long)value);
+    emit(renderer, digits, (size_t)length);
+}
+
+static void emit_double(renderer_t *renderer, double value, int precision)
+{
+    if (value != value || value - value != 0)
+    {
+        emit(renderer, "null", 4);
+        return;
+    }
+    // shortest of the usual precisions that reads back the same value
+    char digits[32];
+    int length = snprintf(digits, sizeof(digits), "%.15g", value);
+    if (strtod(digits, NULL) != value)
+    {
+        length = snprintf(digits, sizeof(digits), "%.*g", precision, value);
+    }
+    emit(renderer, digits, (size_t)length);
+}
+
+static void emit_string(renderer_t *renderer, const uint8_t *data, size_t length)
+{
+    static const char hex[] = "0123456789abcdef";
+    emit(renderer, "\"", 1);
+    size_t start = 0;
+    for (size_t i = 0; i < length; i++)
+    {
+        uint8_t c = data[i];
+        if (c >= 0x20 && c != '"' && c != '\\')
+        {
+            continue;
+        }
+        emit(renderer, (const char *)data + start, i - start);
+        start = i + 1;
+        char escape[6] = {'\\', (char)c};
+        size_t escape_len = 2;
+        if (c == '\n')
+        {
+            escape[1] = 'n';
+        }
+        else if (c == '\t')
+        {
+            escape[1] = 't';
+        }
+        else if (c == '\r')
+        {
+            escape[1] = 'r';
+        }
+        else if (c < 0x20)
+        {
+            memcpy(escape + 1, "u00", 3);
+            escape[4] = hex[c >> 4];
+            escape[5] = hex[c & 0xF];
+            escape_len = 6;
+        }
+        emit(renderer, escape, escape_len);
+    }
+    emit(renderer, (const char *)data + start, length - start);
+    emit(renderer, "\"", 1);
+}
+
+static void emit_hex(renderer_t *renderer, const uint8_t *data, size_t length)
+{
+    static const char hex[] = "0123456789abcdef";
+    emit(renderer, "\"", 1);
+    for (size_t i = 0; i < length; i++)
+    {
+        char pair[2] = {hex[data[i] >> 4], hex[data[i] & 0xF]};
+        emit(renderer, pair, 2);
+    }
+    emit(renderer, "\"", 1);
+}
+
+// one value of a record, nested maps and arrays are not part of the format
+static bool render_value(renderer_t *renderer, bool key)
+{
+    uint8_t major;
+    uint8_t additional;
+    uint64_t argument;
+    if (!take_head(renderer, &major, &additional, &argument) || (key && major != CBOR_TEXT))
+    {
+        return false;
+    }
+    switch (major)
+    {
+    case CBOR_UINT:
+        emit_uint(renderer, argument);
+        return true;
+    case CBOR_NEGATIVE:
+        emit(renderer, "-", 1);
+        if (argument == UINT64_MAX)
+        {
+            emit(renderer, "18446744073709551616", 20);
+            return true;
+        }
+        emit_uint(renderer, argument + 1);
+        return true;
+    case CBOR_BYTES:
+    case CBOR_TEXT:
+        if (argument > renderer->length - renderer->pos)
+        {
+            return false;
+        }
+        if (major == CBOR_TEXT)
+        {
+            emit_string(renderer, renderer->record + renderer->pos, (size_t)argument);
+        }
+        else
+        {
+            emit_hex(renderer, renderer->record + renderer->pos, (size_t)argument);
+        }
+        renderer->pos += (size_t)argument;
+        return true;
+    case CBOR_SIMPLE:
+        if (additional == (CBOR_FALSE & 0x1F) || additional == (CBOR_TRUE & 0x1F))
+        {
+            emit(renderer, additional == (CBOR_TRUE & 0x1F) ? "true" : "false", additional == (CBOR_TRUE & 0x1F) ? 4 : 5);
+            return true;
+        }
+        if (additional == (CBOR_FLOAT32 & 0x1F))
+        {
+            uint32_t bits = (uint32_t)argument;
+            float value;
+            memcpy(&value, &bits, sizeof(value));
+            emit_double(renderer, value, 9);
+            return true;
+        }
+        if (additional == (CBOR_FLOAT64 & 0x1F) && sizeof(double) == 8)
+        {
+            double value;
+            memcpy(&value, &argument, sizeof(value));
+            emit_double(renderer, value, 17);
+            return true;
+        }
+        return false;
+    default:
+        return false;
+    }
+}
+
+int log_structured_format_json(const uint8_t *record, size_t length, char *text, size_t size)
+{
+    renderer_t renderer = {record, length, 0, text, size, 0, size == 0};
+    uint8_t major;
+    uint8_t additional;
+    uint64_t count;
+    if (!take_head(&renderer, &major, &additional, &count) || major != CBOR_MAP)
+    {
+        return -1;
+    }
+    emit(&renderer, "{", 1);
+    for (uint64_t i = 0; i < count; i++)
+    {
+        if (i > 0)
+        {
+            emit(&renderer, ",", 1);
+        }
+        if (!render_value(&renderer, true))
+        {
+            return -1;
+        }
+        emit(&renderer, ":", 1);
+        if (!render_value(&renderer, false))
+        {
+            return -1;
+        }
+    }
+    emit(&renderer, "}\n", 2);
+    if (renderer.failed || renderer.pos != length)
+    {
+        return -1;
+    }
+    text[renderer.text_len] = '\0';
+    return (int)renderer.text_len;
+}
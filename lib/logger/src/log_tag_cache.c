@@ -0,0 +1,182 @@
+// Copyright 2015-2019 Espressif Systems (Shanghai) PTE LTD
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+/*
+ * Tag cache implementation notes.
+ *
+ * Looking a tag up in the tag table hashes and compares strings. Because
+ * the suggested way of creating tags uses one 'TAG' constant per file,
+ * this library caches the level per tag pointer in front of the table.
+ *
+ * The cache is set associative, CONFIG_LOG_TAG_CACHE_WAYS entries per set
+ * (1 is a direct mapped cache), the set is selected by a hash of the tag
+ * address. Each entry stores the tag pointer and the level packed with
+ * the generation of the tag table it was read from, the same way as
+ * log_callsite_t. Entries of an older generation are stale and never hit,
+ * so log_level_set does not need to touch the cache.
+ *
+ * Lookups never write on a hit once the entry is referenced. Each set has
+ * a reference bit per way and a clock hand for second chance replacement:
+ * a hit sets the reference bit of its way if it is not set yet, a miss
+ * replaces a stale way first, otherwise the way under the hand if it is
+ * not referenced, clearing reference bits as the hand passes over them.
+ *
+ * Sets are updated by whichever reader missed, without a lock. Each set
+ * is guarded by a sequence counter (seqlock): an updater makes it odd
+ * with a compare-and-swap, writes the entry and makes it even again.
+ * Readers retry nothing, a lookup racing with an update is a miss and
+ * an updater losing the compare-and-swap does not cache its entry.
+ *
+ */
+
+#include <stdbool.h>
+#include <stdint.h>
+#include "log.h"
+#include "log_tag_cache.h"
+
+#if CONFIG_LOG_TAG_CACHE_SIZE > 0
+
+#define TAG_CACHE_SETS (CONFIG_LOG_TAG_CACHE_SIZE / CONFIG_LOG_TAG_CACHE_WAYS)
+
+#if (TAG_CACHE_SETS & (TAG_CACHE_SETS - 1)) != 0 || TAG_CACHE_SETS * CONFIG_LOG_TAG_CACHE_WAYS != CONFIG_LOG_TAG_CACHE_SIZE
+#error "CONFIG_LOG_TAG_CACHE_SIZE / CONFIG_LOG_TAG_CACHE_WAYS must be a power of 2"
+#endif
+#if CONFIG_LOG_TAG_CACHE_WAYS > 8
+#error "CONFIG_LOG_TAG_CACHE_WAYS must be at most 8"
+#endif
+
+typedef struct
+{
+    const char *tag;
+    uint32_t state; // generation << LOG_CALLSITE_LEVEL_BITS | level, 0 if empty
+} tag_cache_entry_t;
+
+typedef struct
+{
+    uint32_t sequence; // odd while an update is in progress
+    uint8_t referenced; // reference bit per way
+    uint8_t hand;       // next way considered for replacement
+    tag_cache_entry_t ways[CONFIG_LOG_TAG_CACHE_WAYS];
+} tag_cache_set_t;
+
+static tag_cache_set_t s_log_tag_cache[TAG_CACHE_SETS];
+
+static inline tag_cache_set_t *cache_set(const char *tag)
+{
+    // tags are rarely aligned the same way, mix all address bits into the index
+    uint32_t hash = (uint32_t)(uintptr_t)tag;
+    hash ^= hash >> 16;
+    hash *= 0x45d9f3bu;
+    hash ^= hash >> 16;
+    return &s_log_tag_cache[hash & (TAG_CACHE_SETS - 1)];
+}
+
+bool log_tag_cache_get(const char *tag, uint32_t generation, uint8_t *level)
+{
+    tag_cache_set_t *set = cache_set(tag);
+    uint32_t sequence = __atomic_load_n(&set->sequence, __ATOMIC_ACQUIRE);
+    if (sequence & 1)
+    {
+        return false;
+    }
+    for (int way = 0; way < CONFIG_LOG_TAG_CACHE_WAYS; way++)
+    {
+        tag_cache_entry_t *entry = &set->ways[way];
+        if (__atomic_load_n(&entry->tag, __ATOMIC_RELAXED) != tag)
+        {
+            continue;
+        }
+        uint32_t state = __atomic_load_n(&entry->state, __ATOMIC_RELAXED);
+        // the entry is only valid if no update started while it was read
+        __atomic_thread_fence(__ATOMIC_ACQUIRE);
+        if (__atomic_load_n(&set->sequence, __ATOMIC_RELAXED) != sequence ||
+            (state >> LOG_CALLSITE_LEVEL_BITS) != generation)
+        {
+            return false;
+        }
+        uint8_t bit = (uint8_t)(1u << way);
+        if (!(__atomic_load_n(&set->referenced, __ATOMIC_RELAXED) & bit))
+        {
+            __atomic_fetch_or(&set->referenced, bit, __ATOMIC_RELAXED);
+        }
+        *level = (uint8_t)(state & LOG_CALLSITE_LEVEL_MASK);
+        return true;
+    }
+    return false;
+}
+
+void log_tag_cache_put(const char *tag, uint32_t generation, uint8_t level)
+{
+    tag_cache_set_t *set = cache_set(tag);
+    uint32_t sequence = __atomic_load_n(&set->sequence, __ATOMIC_RELAXED);
+    if ((sequence & 1) ||
+        !__atomic_compare_exchange_n(&set->sequence, &sequence, sequence + 1, false, __ATOMIC_ACQUIRE, __ATOMIC_RELAXED))
+    {
+        return;
+    }
+    __atomic_thread_fence(__ATOMIC_RELEASE);
+
+    // the same tag, an empty or a stale way are replaced first
+    int victim = -1;
+    for (int way = 0; way < CONFIG_LOG_TAG_CACHE_WAYS && victim < 0; way++)
+    {
+        tag_cache_entry_t *entry = &set->ways[way];
+        if (entry->tag == tag || (entry->state >> LOG_CALLSITE_LEVEL_BITS) != generation)
+        {
+            victim = way;
+        }
+    }
+    // otherwise second chance, the first unreferenced way from the hand
+    uint8_t referenced = __atomic_load_n(&set->referenced, __ATOMIC_RELAXED);
+    uint8_t cleared = 0;
+    while (victim < 0)
+    {
+        uint8_t bit = (uint8_t)(1u << set->hand);
+        if (referenced & bit)
+        {
+            referenced &= (uint8_t)~bit;
+            cleared |= bit;
+        }
+        else
+        {
+            victim = set->hand;
+        }
+        set->hand = (uint8_t)((set->hand + 1) % CONFIG_LOG_TAG_CACHE_WAYS);
+    }
+    // the new entry starts unreferenced, bits cleared by the hand stay cleared, readers may set the others meanwhile
+    __atomic_fetch_and(&set->referenced, (uint8_t)~(cleared | 1u << victim), __ATOMIC_RELAXED);
+
+    __atomic_store_n(&set->ways[victim].tag, tag, __ATOMIC_RELAXED);
+    __atomic_store_n(&set->ways[victim].state, (generation << LOG_CALLSITE_LEVEL_BITS) | level, __ATOMIC_RELAXED);
+    __atomic_store_n(&set->sequence, sequence + 2, __ATOMIC_RELEASE);
+}
+
+#else
+
+bool log_tag_cache_get(const char *tag, uint32_t generation, uint8_t *level)
+{
+    (void)tag;
+    (void)generation;
+    (void)level;
+    return false;
+}
+
+void log_tag_cache_put(const char *tag, uint32_t generation, uint8_t level)
+{
+    (void)tag;
+    (void)generation;
+    (void)level;
+}
+
+#endif
@@ -0,0 +1,20 @@
+#pragma once
+#include <stdbool.h>
+#include <stdint.h>
+
+/**
+ * @brief look up the cached level of a tag pointer, see log_tag_cache.c
+ *
+ * @param tag tag pointer, compared by address
+ * @param generation current tag table generation, entries of older generations miss
+ * @param level level of the tag on hit
+ * @return true on hit
+ */
+bool log_tag_cache_get(const char *tag, uint32_t generation, uint8_t *level);
+
+/**
+ * @brief cache the level of a tag pointer, read from the tag table of the given generation
+ *
+ * Best effort, the entry is not cached if another thread is updating the same set.
+ */
+void log_tag_cache_put(const char *tag, uint32_t generation, uint8_t level);
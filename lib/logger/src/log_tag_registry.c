@@ -0,0 +1,99 @@
+// Copyright 2015-2019 Espressif Systems (Shanghai) PTE LTD
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+/*
+ * Tag handles, see log_tag_t.
+ *
+ * LOG_TAG_DEFINE places every handle in the log_tags section, the linker
+ * puts them next to each other and defines __start_log_tags and
+ * __stop_log_tags around them. Writers walk that array under
+ * log_impl_lock() and store the new level in each handle of the tag name,
+ * once the tag table holding it is published.
+ *
+ * A handle starts with LOG_TAG_LEVEL_UNSET, the default level of the
+ * library is not known where the handle is defined. The first
+ * log_tag_visible reads it from the tag table and stores it with a CAS,
+ * so a level stored by a writer in between is not overwritten. Sampling
+ * shares start at 0 like those of the initial tag table.
+ */
+
+#include <stdbool.h>
+#include <stdint.h>
+#include <string.h>
+#include "log.h"
+#include "log_tag_registry.h"
+
+#if CONFIG_LOG_TAG_REGISTRY
+
+// weak, both are 0 if no handle is defined
+extern log_tag_t __start_log_tags[] __attribute__((weak));
+extern log_tag_t __stop_log_tags[] __attribute__((weak));
+
+void log_tag_registry_set(const char *tag, uint8_t level)
+{
+    for (log_tag_t *it = __start_log_tags; it < __stop_log_tags; it++)
+    {
+        if (strcmp(it->name, tag) == 0)
+        {
+            __atomic_store_n(&it->level, level, __ATOMIC_RELAXED);
+        }
+    }
+}
+
+void log_tag_registry_set_keep(const char *tag, uint8_t level, uint32_t keep)
+{
+#if CONFIG_LOG_SAMPLING
+    for (log_tag_t *it = __start_log_tags; it < __stop_log_tags; it++)
+    {
+        if (strcmp(it->name, tag) == 0)
+        {
+            __atomic_store_n(&it->keep[level - 1], keep, __ATOMIC_RELAXED);
+        }
+    }
+#else
+    (void)tag;
+    (void)level;
+    (void)keep;
+#endif
+}
+
+void log_tag_registry_reset(uint8_t default_level)
+{
+    for (log_tag_t *it = __start_log_tags; it < __stop_log_tags; it++)
+    {
+#if CONFIG_LOG_SAMPLING
+        for (int level = 0; level < LOG_VERBOSE; level++)
+        {
+            __atomic_store_n(&it->keep[level], 0, __ATOMIC_RELAXED);
+        }
+#endif
+        __atomic_store_n(&it->level, default_level, __ATOMIC_RELAXED);
+    }
+}
+
+#else
+
+void log_tag_registry_set(const char *tag, uint8_t level)
+{
+}
+
+void log_tag_registry_set_keep(const char *tag, uint8_t level, uint32_t keep)
+{
+}
+
+void log_tag_registry_reset(uint8_t default_level)
+{
+}
+
+#endif
@@ -0,0 +1,26 @@
+#pragma once
+#include <stdbool.h>
+#include <stdint.h>
+
+/**
+ * @brief store the level of the handles named tag, see log_tag_registry.c
+ *
+ * Must be called with log_impl_lock held, after the tag table was published.
+ */
+void log_tag_registry_set(const char *tag, uint8_t level);
+
+/**
+ * @brief store the sampling share of the handles named tag at a level
+ *
+ * Must be called with log_impl_lock held, after the tag table was published.
+ *
+ * @param keep messages kept out of 2^32, 0 if not sampled
+ */
+void log_tag_registry_set_keep(const char *tag, uint8_t level, uint32_t keep);
+
+/**
+ * @brief store the default level in every handle and drop their sampling shares
+ *
+ * Must be called with log_impl_lock held, after the tag table was published.
+ */
+void log_tag_registry_reset(uint8_t default_level);
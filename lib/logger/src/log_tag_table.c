@@ -0,0 +1,567 @@
+// Copyright 2015-2019 Espressif Systems (Shanghai) PTE LTD
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+/*
+ * Tag table implementation notes.
+ *
+ * All tags provided to log_level_set are stored in a table, see
+ * log_tag_table_t. A table holds the default level and a copy of every
+ * tag with its level in an open addressing hash table with linear
+ * probing, keyed by the tag string. The hash of a tag is computed once
+ * when the tag is first set and kept in its slot, rebuilding a table
+ * copies the stored hashes instead of hashing the strings again. The
+ * table is never filled above half of its slots, so a probe sequence
+ * always ends on an empty slot.
+ *
+ * Readers never take a lock. They pin the currently published table,
+ * look the tag up and unpin it. Writers serialize on log_impl_lock() and
+ * change the published table in place whenever they can:
+ *
+ * - the level and sampling ratios of a tag already in the table are
+ *   overwritten with atomic stores,
+ * - a new tag is added if the table has a free slot and room in its
+ *   string pool: the slot is filled first and its tag pointer is stored
+ *   last with release semantics, readers load it with acquire semantics
+ *   and ignore the slot until it is set. Tags are never removed.
+ *
+ * Either way the generation of the table is advanced afterwards with a
+ * release store, readers load the generation before the level so a level
+ * read under a generation is never older than that generation.
+ *
+ * A table is only replaced when it is full, or on log_level_set("*"),
+ * which drops every tag. The replacement is built completely, with twice
+ * the needed string pool and at most half of its slots used, and
+ * published with a single atomic pointer exchange. A replaced table can
+ * still be in use by readers that pinned it just before the exchange. How
+ * it is reclaimed depends on the storage:
+ *
+ * - dynamic storage (CONFIG_LOG_TAG_TABLE_STATIC_SLOTS == 0): readers are
+ *   counted in one of two counters, selected by the parity of s_log_epoch.
+ *   A reader increments the counter of the epoch it loaded and checks that
+ *   the epoch did not change before it loads the table pointer, otherwise
+ *   it backs off and retries. After publishing, the writer advances the
+ *   epoch and waits for the counter of the previous one to drop to zero
+ *   before it frees the replaced table: any reader that could have loaded
+ *   it is counted there, new readers are counted in the other counter and
+ *   load the new table. The wait lasts one lookup, readers never block and
+ *   a replaced table is always freed by the writer that replaced it.
+ *
+ * - static storage: the table never grows, tags are added in place until
+ *   it is full. Two tables are used alternately on reset. A reader
+ *   increments the reader count of the table it loaded and checks that
+ *   the table is still published, otherwise it backs off and retries. The
+ *   writer waits for the reader count of the unpublished table to drop to
+ *   zero before clearing it, readers that back off never look at its
+ *   contents.
+ *
+ * A tag can also carry a sampling ratio per level, see log_sample_set. It
+ * is stored with its level, a table counts the tags that have one so the
+ * lookup is skipped entirely when sampling is not used.
+ *
+ * Every table carries a generation number, incremented on each published
+ * change. The generation of the published table is mirrored in
+ * g_log_generation, which the LOGx macros compare against the generation
+ * stored in their per-callsite cache (see log_callsite_t). A matching
+ * generation means the cached level is still valid and the tag table
+ * does not need to be consulted at all.
+ *
+ */
+
+#include <stdbool.h>
+#include <string.h>
+#include <stdlib.h>
+#include <stddef.h>
+#include "log.h"
+#include "log_private.h"
+#include "log_tag_table.h"
+
+#include <assert.h>
+
+#if CONFIG_LOG_BUILTIN_CHECKS == 1
+#define LOG_BUILTIN_CHECKS
+#endif
+
+#define TAG_TABLE_STATIC (CONFIG_LOG_TAG_TABLE_STATIC_SLOTS > 0)
+
+#if TAG_TABLE_STATIC && (CONFIG_LOG_TAG_TABLE_STATIC_SLOTS & (CONFIG_LOG_TAG_TABLE_STATIC_SLOTS - 1)) != 0
+#error "CONFIG_LOG_TAG_TABLE_STATIC_SLOTS must be a power of 2"
+#endif
+
+typedef struct
+{
+    const char *tag; // points into the string pool of the owning table, NULL for an empty slot
+    uint32_t hash;
+    uint8_t level;
+#if CONFIG_LOG_SAMPLING
+    uint16_t one_in[LOG_VERBOSE]; // sampling ratio of each level from LOG_ERROR, 0 if not sampled
+#endif
+} tag_level_entry_t;
+
+// change applied to one tag
+typedef struct
+{
+    bool set_level;
+    uint8_t level;
+    uint8_t sample_level; // LOG_NONE to keep the sampling ratios
+    uint16_t one_in;
+} tag_update_t;
+
+struct log_tag_table_
+{
+#if TAG_TABLE_STATIC
+    uint32_t readers; // readers currently pinning this table
+#endif
+    uint32_t generation;
+    uint8_t default_level;
+    uint32_t count;
+    uint32_t sampled;        // tags with a sampling ratio
+    uint32_t mask;           // number of slots - 1, the number of slots is a power of 2
+    size_t strings_size;     // bytes used by the tag strings
+    size_t strings_capacity; // bytes available for tag strings
+    char *strings;
+    tag_level_entry_t *slots;
+};
+
+#if TAG_TABLE_STATIC
+
+typedef struct
+{
+    log_tag_table_t table;
+    tag_level_entry_t slots[CONFIG_LOG_TAG_TABLE_STATIC_SLOTS];
+    char strings[CONFIG_LOG_TAG_TABLE_STATIC_STRINGS];
+} static_tag_table_t;
+
+static static_tag_table_t s_log_tables[2] = {
+    {.table = {
+         .generation = 1,
+         .default_level = DEFAULT_LOG_LEVEL,
+         .mask = CONFIG_LOG_TAG_TABLE_STATIC_SLOTS - 1,
+         .strings_capacity = CONFIG_LOG_TAG_TABLE_STATIC_STRINGS,
+         .strings = s_log_tables[0].strings,
+         .slots = s_log_tables[0].slots}},
+    {.table = {
+         .mask = CONFIG_LOG_TAG_TABLE_STATIC_SLOTS - 1,
+         .strings_capacity = CONFIG_LOG_TAG_TABLE_STATIC_STRINGS,
+         .strings = s_log_tables[1].strings,
+         .slots = s_log_tables[1].slots}}};
+static log_tag_table_t *s_log_table = &s_log_tables[0].table;
+
+#else
+
+static log_tag_table_t s_log_initial_table = {
+    .generation = 1,
+    .default_level = DEFAULT_LOG_LEVEL};
+static log_tag_table_t *s_log_table = &s_log_initial_table;
+static uint32_t s_log_epoch = 0;
+static uint32_t s_log_readers[2] = {0, 0}; // readers of each epoch parity
+
+#endif
+
+uint32_t g_log_generation = 1;
+
+static inline uint32_t tag_hash(const char *tag);
+static inline uint32_t next_generation(const log_tag_table_t *current);
+static tag_level_entry_t *table_find(const log_tag_table_t *table, const char *tag, uint32_t hash);
+static void table_insert(log_tag_table_t *table, const tag_level_entry_t *entry);
+static void apply_update(tag_level_entry_t *entry, const tag_update_t *update);
+static void table_apply(log_tag_table_t *table, tag_level_entry_t *entry, const tag_update_t *update);
+static void table_copy(log_tag_table_t *next, const log_tag_table_t *current);
+static void table_add(log_tag_table_t *table, const char *tag, uint32_t hash, size_t tag_len,
+                      const tag_update_t *update);
+static bool table_update(const char *tag, const tag_update_t *update);
+static void table_advance(log_tag_table_t *table);
+static log_tag_table_t *table_alloc(uint32_t count, size_t strings_size);
+static void table_publish(log_tag_table_t *table);
+
+const log_tag_table_t *log_tag_table_acquire(uint32_t *pin)
+{
+#if TAG_TABLE_STATIC
+    *pin = 0;
+    for (;;)
+    {
+        log_tag_table_t *table = __atomic_load_n(&s_log_table, __ATOMIC_SEQ_CST);
+        __atomic_fetch_add(&table->readers, 1, __ATOMIC_SEQ_CST);
+        // the writer only clears a table once it is unpublished and has no readers
+        if (__atomic_load_n(&s_log_table, __ATOMIC_SEQ_CST) == table)
+        {
+            return table;
+        }
+        __atomic_fetch_sub(&table->readers, 1, __ATOMIC_RELEASE);
+    }
+#else
+    // announce the reader in its epoch before loading the pointer, see implementation notes
+    for (;;)
+    {
+        uint32_t epoch = __atomic_load_n(&s_log_epoch, __ATOMIC_SEQ_CST);
+        __atomic_fetch_add(&s_log_readers[epoch & 1], 1, __ATOMIC_SEQ_CST);
+        if (__atomic_load_n(&s_log_epoch, __ATOMIC_SEQ_CST) == epoch)
+        {
+            *pin = epoch & 1;
+            return __atomic_load_n(&s_log_table, __ATOMIC_SEQ_CST);
+        }
+        __atomic_fetch_sub(&s_log_readers[epoch & 1], 1, __ATOMIC_RELEASE);
+    }
+#endif
+}
+
+void log_tag_table_release(const log_tag_table_t *table, uint32_t pin)
+{
+#if TAG_TABLE_STATIC
+    (void)pin;
+    __atomic_fetch_sub(&((log_tag_table_t *)table)->readers, 1, __ATOMIC_RELEASE);
+#else
+    (void)table;
+    __atomic_fetch_sub(&s_log_readers[pin], 1, __ATOMIC_RELEASE);
+#endif
+}
+
+uint8_t log_tag_table_level(const log_tag_table_t *table, const char *tag)
+{
+    if (__atomic_load_n(&table->count, __ATOMIC_RELAXED) == 0)
+    {
+        return table->default_level;
+    }
+    const tag_level_entry_t *entry = table_find(table, tag, tag_hash(tag));
+    return entry ? __atomic_load_n(&entry->level, __ATOMIC_RELAXED) : table->default_level;
+}
+
+uint16_t log_tag_table_sample(const log_tag_table_t *table, const char *tag, uint8_t level)
+{
+#if CONFIG_LOG_SAMPLING
+    if (__atomic_load_n(&table->sampled, __ATOMIC_ACQUIRE) == 0 || level < LOG_ERROR || level > LOG_VERBOSE)
+    {
+        return 0;
+    }
+    const tag_level_entry_t *entry = table_find(table, tag, tag_hash(tag));
+    return entry ? __atomic_load_n(&entry->one_in[level - 1], __ATOMIC_RELAXED) : 0;
+#else
+    (void)table;
+    (void)tag;
+    (void)level;
+    return 0;
+#endif
+}
+
+uint32_t log_tag_table_generation(const log_tag_table_t *table)
+{
+    // levels are changed in place before the generation advances, see implementation notes
+    return __atomic_load_n(&table->generation, __ATOMIC_ACQUIRE);
+}
+
+bool log_tag_table_set(const char *tag, uint8_t level)
+{
+    tag_update_t update = {.set_level = true, .level = level, .sample_level = LOG_NONE};
+    return table_update(tag, &update);
+}
+
+bool log_tag_table_set_sample(const char *tag, uint8_t level, uint16_t one_in)
+{
+#if CONFIG_LOG_SAMPLING
+    if (level < LOG_ERROR || level > LOG_VERBOSE)
+    {
+        return false;
+    }
+    tag_update_t update = {.set_level = false, .sample_level = level, .one_in = one_in > 1 ? one_in : 0};
+    return table_update(tag, &update);
+#else
+    (void)tag;
+    (void)level;
+    (void)one_in;
+    return false;
+#endif
+}
+
+static bool table_update(const char *tag, const tag_update_t *update)
+{
+    // only writers modify the published table, so it can be read without pinning it
+    log_tag_table_t *current = s_log_table;
+    uint32_t hash = tag_hash(tag);
+    tag_level_entry_t *entry = current->count != 0 ? table_find(current, tag, hash) : NULL;
+    if (entry)
+    {
+        table_apply(current, entry, update);
+        table_advance(current);
+        return true;
+    }
+
+    size_t tag_len = strlen(tag) + 1;
+    if (current->count + 1 <= (current->mask + 1) / 2 && current->strings_size + tag_len <= current->strings_capacity)
+    {
+        table_add(current, tag, hash, tag_len, update);
+        table_advance(current);
+        return true;
+    }
+
+    // full, the static table cannot grow
+    log_tag_table_t *next = table_alloc(current->count + 1, (current->strings_size + tag_len) * 2);
+    if (!next)
+    {
+        return false;
+    }
+    next->default_level = current->default_level;
+    table_copy(next, current);
+    table_add(next, tag, hash, tag_len, update);
+    table_publish(next);
+    return true;
+}
+
+bool log_tag_table_reset(uint8_t default_level)
+{
+    log_tag_table_t *next = table_alloc(0, 0);
+    if (!next)
+    {
+        return false;
+    }
+    next->default_level = default_level;
+    table_publish(next);
+    return true;
+}
+
+static inline uint32_t tag_hash(const char *tag)
+{
+    // 32 bit FNV-1a
+    uint32_t hash = 2166136261u;
+    while (*tag)
+    {
+        hash = (hash ^ (uint8_t)*tag++) * 16777619u;
+    }
+    return hash;
+}
+
+static inline uint32_t next_generation(const log_tag_table_t *current)
+{
+    // callsites keep a truncated generation where 0 means "not cached", skip it on wrap-around
+    uint32_t generation = current->generation + 1;
+    if ((generation & LOG_CALLSITE_GENERATION_MASK) == 0)
+    {
+        ++generation;
+    }
+    return generation;
+}
+
+static tag_level_entry_t *table_find(const log_tag_table_t *table, const char *tag, uint32_t hash)
+{
+    // a slot is ignored until the writer stores its tag, see table_insert
+    for (uint32_t i = hash & table->mask;; i = (i + 1) & table->mask)
+    {
+        tag_level_entry_t *slot = &table->slots[i];
+        const char *slot_tag = __atomic_load_n(&slot->tag, __ATOMIC_ACQUIRE);
+        if (slot_tag == NULL)
+        {
+            return NULL;
+        }
+        if (slot->hash == hash && strcmp(slot_tag, tag) == 0)
+        {
+            return slot;
+        }
+    }
+}
+
+#if CONFIG_LOG_SAMPLING
+static bool entry_sampled(const tag_level_entry_t *entry)
+{
+    for (int level = 0; level < LOG_VERBOSE; level++)
+    {
+        if (entry->one_in[level])
+        {
+            return true;
+        }
+    }
+    return false;
+}
+#endif
+
+static void table_insert(log_tag_table_t *table, const tag_level_entry_t *entry)
+{
+    uint32_t i = entry->hash & table->mask;
+    while (table->slots[i].tag != NULL)
+    {
+        i = (i + 1) & table->mask;
+    }
+    tag_level_entry_t *slot = &table->slots[i];
+    slot->hash = entry->hash;
+    slot->level = entry->level;
+#if CONFIG_LOG_SAMPLING
+    memcpy(slot->one_in, entry->one_in, sizeof(slot->one_in));
+    if (entry_sampled(entry))
+    {
+        __atomic_store_n(&table->sampled, table->sampled + 1, __ATOMIC_RELEASE);
+    }
+#endif
+    // the table may be published, readers see the slot once its tag is set
+    __atomic_store_n(&slot->tag, entry->tag, __ATOMIC_RELEASE);
+    __atomic_store_n(&table->count, table->count + 1, __ATOMIC_RELAXED);
+}
+
+static void apply_update(tag_level_entry_t *entry, const tag_update_t *update)
+{
+    // the entry may be in the published table, readers load these atomically
+    if (update->set_level)
+    {
+        __atomic_store_n(&entry->level, update->level, __ATOMIC_RELAXED);
+    }
+#if CONFIG_LOG_SAMPLING
+    if (update->sample_level != LOG_NONE)
+    {
+        __atomic_store_n(&entry->one_in[update->sample_level - 1], update->one_in, __ATOMIC_RELAXED);
+    }
+#endif
+}
+
+static void table_apply(log_tag_table_t *table, tag_level_entry_t *entry, const tag_update_t *update)
+{
+#if CONFIG_LOG_SAMPLING
+    bool sampled = entry_sampled(entry);
+    apply_update(entry, update);
+    if (sampled != entry_sampled(entry))
+    {
+        __atomic_store_n(&table->sampled, sampled ? table->sampled - 1 : table->sampled + 1, __ATOMIC_RELEASE);
+    }
+#else
+    (void)table;
+    apply_update(entry, update);
+#endif
+}
+
+static void table_add(log_tag_table_t *table, const char *tag, uint32_t hash, size_t tag_len,
+                      const tag_update_t *update)
+{
+    // a tag first set by log_sample_set keeps the default level
+    tag_level_entry_t entry = {.hash = hash, .level = table->default_level};
+    apply_update(&entry, update);
+    entry.tag = table->strings + table->strings_size;
+    memcpy(table->strings + table->strings_size, tag, tag_len);
+    table->strings_size += tag_len;
+    table_insert(table, &entry);
+#ifdef LOG_BUILTIN_CHECKS
+    uint32_t used = 0;
+    for (uint32_t i = 0; i <= table->mask; ++i)
+    {
+        used += table->slots[i].tag != NULL;
+    }
+    assert(used == table->count && used <= (table->mask + 1) / 2);
+    assert(table->strings_size <= table->strings_capacity);
+#endif
+}
+
+static void table_copy(log_tag_table_t *next, const log_tag_table_t *current)
+{
+    if (current->count == 0)
+    {
+        return;
+    }
+    for (uint32_t i = 0; i <= current->mask; ++i)
+    {
+        const tag_level_entry_t *slot = &current->slots[i];
+        if (slot->tag == NULL)
+        {
+            continue;
+        }
+        tag_level_entry_t entry = *slot;
+        size_t tag_len = strlen(slot->tag) + 1;
+        entry.tag = next->strings + next->strings_size;
+        memcpy(next->strings + next->strings_size, slot->tag, tag_len);
+        next->strings_size += tag_len;
+        table_insert(next, &entry);
+    }
+}
+
+static void table_advance(log_tag_table_t *table)
+{
+    uint32_t generation = next_generation(table);
+    __atomic_store_n(&table->generation, generation, __ATOMIC_RELEASE);
+    // a callsite that sees the new generation also sees the new levels
+    __atomic_store_n(&g_log_generation, generation & LOG_CALLSITE_GENERATION_MASK, __ATOMIC_RELEASE);
+}
+
+#if TAG_TABLE_STATIC
+
+static log_tag_table_t *table_alloc(uint32_t count, size_t strings_size)
+{
+    if (count > CONFIG_LOG_TAG_TABLE_STATIC_SLOTS / 2 || strings_size > CONFIG_LOG_TAG_TABLE_STATIC_STRINGS)
+    {
+        return NULL;
+    }
+    static_tag_table_t *next = (s_log_table == &s_log_tables[0].table) ? &s_log_tables[1] : &s_log_tables[0];
+    // readers that pinned the table before it was replaced, or are backing off from it
+    while (__atomic_load_n(&next->table.readers, __ATOMIC_SEQ_CST) != 0)
+    {
+        log_impl_yield();
+    }
+    next->table.generation = next_generation(s_log_table);
+    next->table.count = 0;
+    next->table.sampled = 0;
+    next->table.strings_size = 0;
+    memset(next->slots, 0, sizeof(next->slots));
+    return &next->table;
+}
+
+static void table_publish(log_tag_table_t *table)
+{
+    __atomic_store_n(&s_log_table, table, __ATOMIC_SEQ_CST);
+    // published after the table, a callsite that sees the new generation also sees the new levels
+    __atomic_store_n(&g_log_generation, table->generation & LOG_CALLSITE_GENERATION_MASK, __ATOMIC_RELEASE);
+}
+
+#else
+
+static log_tag_table_t *table_alloc(uint32_t count, size_t strings_size)
+{
+    // keep the table at most half full, with at least 4 slots once it has tags
+    uint32_t slot_count = 0;
+    if (count != 0)
+    {
+        slot_count = 4;
+        while (slot_count < count * 2)
+        {
+            slot_count *= 2;
+        }
+    }
+    size_t slots_size = slot_count * sizeof(tag_level_entry_t);
+    log_tag_table_t *next = (log_tag_table_t *)malloc(sizeof(log_tag_table_t) + slots_size + strings_size);
+    if (!next)
+    {
+        return NULL;
+    }
+    next->generation = next_generation(s_log_table);
+    next->count = 0;
+    next->sampled = 0;
+    next->mask = slot_count ? slot_count - 1 : 0;
+    next->strings_size = 0;
+    next->strings_capacity = strings_size;
+    next->slots = (tag_level_entry_t *)(next + 1);
+    next->strings = (char *)next->slots + slots_size;
+    memset(next->slots, 0, slots_size);
+    return next;
+}
+
+static void table_publish(log_tag_table_t *table)
+{
+    log_tag_table_t *previous = __atomic_exchange_n(&s_log_table, table, __ATOMIC_SEQ_CST);
+    // published after the table, a callsite that sees the new generation also sees the new levels
+    __atomic_store_n(&g_log_generation, table->generation & LOG_CALLSITE_GENERATION_MASK, __ATOMIC_RELEASE);
+
+    // readers that may still hold the previous table are counted in the previous epoch
+    uint32_t epoch = __atomic_fetch_add(&s_log_epoch, 1, __ATOMIC_SEQ_CST);
+    while (__atomic_load_n(&s_log_readers[epoch & 1], __ATOMIC_SEQ_CST) != 0)
+    {
+        log_impl_yield();
+    }
+    if (previous != &s_log_initial_table)
+    {
+        free(previous);
+    }
+}
+
+#endif
@@ -0,0 +1,63 @@
+#pragma once
+#include <stdbool.h>
+#include <stdint.h>
+
+/**
+ * @brief table of tags and their levels, see log_tag_table.c
+ */
+typedef struct log_tag_table_ log_tag_table_t;
+
+/**
+ * @brief pin the published table for reading, never blocks
+ *
+ * @param pin set to what log_tag_table_release needs to unpin the table
+ * @return log_tag_table_t* the table, valid until log_tag_table_release
+ */
+const log_tag_table_t *log_tag_table_acquire(uint32_t *pin);
+
+/**
+ * @brief unpin a table returned by log_tag_table_acquire
+ */
+void log_tag_table_release(const log_tag_table_t *table, uint32_t pin);
+
+/**
+ * @brief level of a tag, the default level if the tag was never set
+ */
+uint8_t log_tag_table_level(const log_tag_table_t *table, const char *tag);
+
+/**
+ * @brief sampling ratio of a tag at a level, 0 if every message is written
+ */
+uint16_t log_tag_table_sample(const log_tag_table_t *table, const char *tag, uint8_t level);
+
+/**
+ * @brief generation of the table, incremented on every published change
+ */
+uint32_t log_tag_table_generation(const log_tag_table_t *table);
+
+/**
+ * @brief set the level of tag in the published table, replacing it if it is full
+ *
+ * Must be called with log_impl_lock held.
+ *
+ * @return false if the table could not be allocated or the static table is full
+ */
+bool log_tag_table_set(const char *tag, uint8_t level);
+
+/**
+ * @brief set the sampling ratio of tag at level to 1 in one_in, replacing the table if it is full
+ *
+ * Must be called with log_impl_lock held.
+ *
+ * @return false if the table could not be allocated, the static table is full or sampling is disabled
+ */
+bool log_tag_table_set_sample(const char *tag, uint8_t level, uint16_t one_in);
+
+/**
+ * @brief publish a new empty table with a new default level
+ *
+ * Must be called with log_impl_lock held.
+ *
+ * @return false if the table could not be allocated
+ */
+bool log_tag_table_reset(uint8_t default_level);
@@ -26,6 +26,10 @@
 #include "freertos/task.h"
 #include "freertos/semphr.h"
 #include "hal/cpu_hal.h" // for cpu_hal_get_cycle_count()
+#include "soc/soc_memory_layout.h" // for esp_ptr_in_drom()
+#include "esp_system.h" // for esp_register_shutdown_handler()
+#include "esp_timer.h" // for esp_timer_get_time()
+#include "esp_freertos_hooks.h" // for esp_register_freertos_tick_hook_for_cpu()
 #include "log.h"
 #include "log_private.h"
 
@@ -57,10 +61,73 @@ void log_impl_unlock(void)
     xSemaphoreGive(s_log_mutex);
 }
 
+void log_impl_yield(void)
+{
+    // a delay rather than taskYIELD() so lower priority tasks get to run as well
+    vTaskDelay(1);
+}
+
+bool log_impl_image_address(const void *ptr, uint64_t *address)
+{
+    // string literals live in flash, mapped at the same address the ELF file has
+    if (!esp_ptr_in_drom(ptr))
+    {
+        return false;
+    }
+    *address = (uintptr_t)ptr;
+    return true;
+}
+
+static SemaphoreHandle_t s_writer_signal = NULL;
+static void (*s_writer_func)(void) = NULL;
+
+static void writer_task(void *arg)
+{
+    s_writer_func();
+    vTaskDelete(NULL);
+}
+
+bool log_impl_thread_start(void (*func)(void))
+{
+    if (!s_writer_signal) {
+        s_writer_signal = xSemaphoreCreateBinary();
+    }
+    s_writer_func = func;
+    return s_writer_signal &&
+           xTaskCreate(writer_task, "log_writer", CONFIG_LOG_ASYNC_TASK_STACK_SIZE, NULL,
+                       CONFIG_LOG_ASYNC_TASK_PRIORITY, NULL) == pdPASS;
+}
+
+void log_impl_wait(uint32_t timeout_ms)
+{
+    xSemaphoreTake(s_writer_signal, pdMS_TO_TICKS(timeout_ms));
+}
+
+void log_impl_signal(void)
+{
+    if (!s_writer_signal) {
+        return;
+    }
+    if (xPortInIsrContext()) {
+        BaseType_t woken = pdFALSE;
+        xSemaphoreGiveFromISR(s_writer_signal, &woken);
+        if (woken) {
+            portYIELD_FROM_ISR();
+        }
+    } else {
+        xSemaphoreGive(s_writer_signal);
+    }
+}
+
+void log_impl_at_exit(void (*func)(void))
+{
+    // runs before esp_restart()
+    esp_register_shutdown_handler(func);
+}
+
 char *log_system_timestamp(void)
 {
     static char buffer[18] = {0};
-    static _lock_t bufferLock = 0;
 
     if (xTaskGetSchedulerState() == taskSCHEDULER_NOT_STARTED) {
         uint32_t timestamp = log_early_timestamp();
@@ -79,21 +146,10 @@ char *log_system_timestamp(void)
         return buffer;
     } else {
         struct timeval tv;
-        struct tm timeinfo;
 
         gettimeofday(&tv, NULL);
-        localtime_r(&tv.tv_sec, &timeinfo);
-
-        _lock_acquire(&bufferLock);
-        snprintf(buffer, sizeof(buffer),
-                 "%02d:%02d:%02d.%03ld",
-                 timeinfo.tm_hour,
-                 timeinfo.tm_min,
-                 timeinfo.tm_sec,
-                 tv.tv_usec / 1000);
-        _lock_release(&bufferLock);
-
-        return buffer;
+        // a buffer per task, only the milliseconds are rendered again within a second
+        return log_impl_system_time(tv.tv_sec, (uint32_t)(tv.tv_usec / 1000));
     }
 }
 
@@ -110,15 +166,117 @@ uint32_t log_timestamp(void)
     return base + tick_count * (1000 / configTICK_RATE_HZ);
 }
 
-/* FIXME: define an API for getting the timestamp in soc/hal IDF-2351 */
-uint32_t log_early_timestamp(void)
+// log_timestamp is the tick count already
+uint32_t log_coarse_timestamp(void)
+{
+    return log_timestamp();
+}
+
+static uint32_t cycles_per_us(void)
 {
 #if CONFIG_IDF_TARGET_ESP32
     /* ESP32 ROM stores separate clock rate values for each CPU, but we want the PRO CPU value always */
     extern uint32_t g_ticks_per_us_pro;
-    return cpu_hal_get_cycle_count() / (g_ticks_per_us_pro * 1000);
+    return g_ticks_per_us_pro;
+#else
+    return ets_get_cpu_frequency();
+#endif
+}
+
+/* FIXME: define an API for getting the timestamp in soc/hal IDF-2351 */
+uint32_t log_early_timestamp(void)
+{
+    return cpu_hal_get_cycle_count() / (cycles_per_us() * 1000);
+}
+
+/*
+ * log_timestamp_us extends the 32 bit cycle counter of each core to 64 bits,
+ * a tick hook on the core counts the wraps (every 17 s at 240 MHz). The
+ * counters of the cores are not synchronized, each one is aligned to
+ * esp_timer when the core first takes a timestamp.
+ */
+typedef struct
+{
+    volatile uint32_t high; // wraps counted by the tick hook
+    volatile uint32_t last; // counter at the last tick
+    int64_t offset_us;      // esp_timer time at counter 0
+    bool calibrated;
+} log_cycles_t;
+
+static log_cycles_t s_cycles[portNUM_PROCESSORS];
+// microseconds per cycle << 32
+static uint32_t s_us_per_cycle = 0;
+static portMUX_TYPE s_cycles_mux = portMUX_INITIALIZER_UNLOCKED;
+
+static void cycles_tick_hook(void)
+{
+    log_cycles_t *cycles = &s_cycles[xPortGetCoreID()];
+    uint32_t now = cpu_hal_get_cycle_count();
+    if (now < cycles->last) {
+        cycles->high++;
+    }
+    cycles->last = now;
+}
+
+static inline uint64_t cycles_to_us(uint32_t high, uint32_t low)
+{
+    // (high << 32 | low) * s_us_per_cycle >> 32 without a 96 bit product
+    return (uint64_t)high * s_us_per_cycle + (((uint64_t)low * s_us_per_cycle) >> 32);
+}
+
+// interrupts are off in the critical section, the tick hook and task switches wait
+static void cycles_calibrate(int core)
+{
+    bool calibrated = false;
+    portENTER_CRITICAL_SAFE(&s_cycles_mux);
+    log_cycles_t *cycles = &s_cycles[core];
+    if (!cycles->calibrated) {
+        if (!s_us_per_cycle) {
+            s_us_per_cycle = (uint32_t)((1ull << 32) / cycles_per_us());
+        }
+        cycles->high = 0;
+        cycles->last = cpu_hal_get_cycle_count();
+        cycles->offset_us = esp_timer_get_time() - (int64_t)cycles_to_us(0, cycles->last);
+        cycles->calibrated = true;
+        calibrated = true;
+    }
+    portEXIT_CRITICAL_SAFE(&s_cycles_mux);
+    if (calibrated) {
+        esp_register_freertos_tick_hook_for_cpu(cycles_tick_hook, core);
+    }
+}
+
+uint64_t log_timestamp_us(void)
+{
+#if CONFIG_PM_ENABLE
+    // frequency scaling changes the rate of the cycle counter
+    return esp_timer_get_time();
 #else
-    return cpu_hal_get_cycle_count() / (ets_get_cpu_frequency() * 1000);
+    if (xTaskGetSchedulerState() == taskSCHEDULER_NOT_STARTED) {
+        return cpu_hal_get_cycle_count() / cycles_per_us();
+    }
+    for (;;) {
+        int core = xPortGetCoreID();
+        log_cycles_t *cycles = &s_cycles[core];
+        if (!cycles->calibrated) {
+            cycles_calibrate(core);
+            continue;
+        }
+        uint32_t high, last, now;
+        do {
+            high = cycles->high;
+            last = cycles->last;
+            now = cpu_hal_get_cycle_count();
+        } while (high != cycles->high);
+        if (now < last) {
+            // wrapped since the last tick
+            high++;
+        }
+        // the task may have moved to the other core in between
+        if (core == xPortGetCoreID()) {
+            return (uint64_t)(cycles->offset_us + (int64_t)cycles_to_us(high, now));
+        }
+    }
 #endif
 }
 
@@ -0,0 +1,255 @@
+// Copyright 2019 Espressif Systems (Shanghai) PTE LTD
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#ifndef _GNU_SOURCE
+#define _GNU_SOURCE // for pthread_mutex_clocklock and sem_clockwait
+#endif
+
+#ifdef LOG_CONFIG
+#include LOG_CONFIG
+#else
+#include "log_config.h"
+#endif
+
+#ifdef CONFIG_LOG_LINUX
+#include <stdint.h>
+#include <stdlib.h>
+#include <time.h>
+#include <pthread.h>
+#include <sched.h>
+#include <semaphore.h>
+#if defined(__x86_64__)
+#include <cpuid.h>
+#include <x86intrin.h>
+#endif
+#include "log.h"
+#include "log_private.h"
+
+// Maximum time to wait for the mutex in a logging statement.
+#define MAX_MUTEX_WAIT_MS 10
+
+// glibc 2.30 waits on CLOCK_MONOTONIC, older versions only on CLOCK_REALTIME
+#if defined(__GLIBC__) && (__GLIBC__ > 2 || (__GLIBC__ == 2 && __GLIBC_MINOR__ >= 30))
+#define LOG_WAIT_MONOTONIC 1
+#define LOG_WAIT_CLOCK CLOCK_MONOTONIC
+#else
+#define LOG_WAIT_MONOTONIC 0
+#define LOG_WAIT_CLOCK CLOCK_REALTIME
+#endif
+
+// glibc mutexes are futex based, locking an uncontended mutex does not enter the kernel
+static pthread_mutex_t s_log_mutex = PTHREAD_MUTEX_INITIALIZER;
+
+static void deadline_after_ms(struct timespec *deadline, uint32_t milliseconds)
+{
+    clock_gettime(LOG_WAIT_CLOCK, deadline);
+    deadline->tv_sec += milliseconds / 1000;
+    deadline->tv_nsec += (milliseconds % 1000) * 1000000L;
+    if (deadline->tv_nsec >= 1000000000L)
+    {
+        deadline->tv_sec++;
+        deadline->tv_nsec -= 1000000000L;
+    }
+}
+
+void log_impl_lock(void)
+{
+    pthread_mutex_lock(&s_log_mutex);
+}
+
+bool log_impl_lock_timeout(void)
+{
+    if (pthread_mutex_trylock(&s_log_mutex) == 0)
+    {
+        return true;
+    }
+    struct timespec deadline;
+    deadline_after_ms(&deadline, MAX_MUTEX_WAIT_MS);
+#if LOG_WAIT_MONOTONIC
+    return pthread_mutex_clocklock(&s_log_mutex, CLOCK_MONOTONIC, &deadline) == 0;
+#else
+    return pthread_mutex_timedlock(&s_log_mutex, &deadline) == 0;
+#endif
+}
+
+void log_impl_unlock(void)
+{
+    pthread_mutex_unlock(&s_log_mutex);
+}
+
+void log_impl_yield(void)
+{
+    sched_yield();
+}
+
+bool log_impl_image_address(const void *ptr, uint64_t *address)
+{
+    return false;
+}
+
+static sem_t s_writer_signal;
+static pthread_once_t s_writer_signal_once = PTHREAD_ONCE_INIT;
+static void (*s_writer_func)(void) = NULL;
+
+static void writer_signal_init(void)
+{
+    sem_init(&s_writer_signal, 0, 0);
+}
+
+static void *writer_thread(void *arg)
+{
+    s_writer_func();
+    return NULL;
+}
+
+bool log_impl_thread_start(void (*func)(void))
+{
+    pthread_once(&s_writer_signal_once, writer_signal_init);
+    s_writer_func = func;
+    pthread_t thread;
+    if (pthread_create(&thread, NULL, writer_thread, NULL) != 0)
+    {
+        return false;
+    }
+    pthread_detach(thread);
+    return true;
+}
+
+void log_impl_wait(uint32_t timeout_ms)
+{
+    struct timespec deadline;
+    deadline_after_ms(&deadline, timeout_ms);
+#if LOG_WAIT_MONOTONIC
+    sem_clockwait(&s_writer_signal, CLOCK_MONOTONIC, &deadline);
+#else
+    sem_timedwait(&s_writer_signal, &deadline);
+#endif
+}
+
+void log_impl_signal(void)
+{
+    pthread_once(&s_writer_signal_once, writer_signal_init);
+    sem_post(&s_writer_signal);
+}
+
+void log_impl_at_exit(void (*func)(void))
+{
+    atexit(func);
+}
+
+// CLOCK_MONOTONIC is read through the vDSO, no system call
+static uint64_t monotonic_ms(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000 + ts.tv_nsec / 1000000;
+}
+
+static uint64_t s_start_ms = 0;
+
+__attribute__((constructor)) static void timestamp_init(void)
+{
+    s_start_ms = monotonic_ms();
+}
+
+uint32_t log_early_timestamp(void)
+{
+    return (uint32_t)(monotonic_ms() - s_start_ms);
+}
+
+uint32_t log_timestamp(void)
+{
+    return (uint32_t)(monotonic_ms() - s_start_ms);
+}
+
+// the tick of the kernel, the vDSO reads it without the TSC
+uint32_t log_coarse_timestamp(void)
+{
+#ifdef CLOCK_MONOTONIC_COARSE
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC_COARSE, &ts);
+    return (uint32_t)((uint64_t)ts.tv_sec * 1000 + ts.tv_nsec / 1000000);
+#else
+    return log_timestamp();
+#endif
+}
+
+// CLOCK_MONOTONIC_RAW is not slewed by NTP, the TSC is calibrated against it
+static uint64_t monotonic_raw_ns(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC_RAW, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000 + (uint64_t)ts.tv_nsec;
+}
+
+static uint64_t s_start_ns = 0;
+
+#if defined(__x86_64__)
+// time between the two calibration points, the error of reading both clocks is a few ns
+#define TSC_CALIBRATION_NS 20000000
+#define TSC_SCALE_BITS 48
+
+static uint64_t s_start_tsc = 0;
+static bool s_tsc_invariant = false;
+// microseconds per TSC tick << TSC_SCALE_BITS, 0 until calibrated
+static uint64_t s_tsc_scale = 0;
+
+// the TSC ticks at a constant rate in all power states and on all cores
+static bool tsc_invariant(void)
+{
+    unsigned eax, ebx, ecx, edx;
+    return __get_cpuid(0x80000007, &eax, &ebx, &ecx, &edx) && (edx & (1u << 8));
+}
+#endif
+
+__attribute__((constructor)) static void timestamp_us_init(void)
+{
+    s_start_ns = monotonic_raw_ns();
+#if defined(__x86_64__)
+    s_start_tsc = __rdtsc();
+    s_tsc_invariant = tsc_invariant();
+#endif
+}
+
+uint64_t log_timestamp_us(void)
+{
+#if defined(__x86_64__)
+    uint64_t scale = __atomic_load_n(&s_tsc_scale, __ATOMIC_RELAXED);
+    if (scale)
+    {
+        return (uint64_t)(((unsigned __int128)(__rdtsc() - s_start_tsc) * scale) >> TSC_SCALE_BITS);
+    }
+#endif
+    uint64_t elapsed_ns = monotonic_raw_ns() - s_start_ns;
+#if defined(__x86_64__)
+    if (s_tsc_invariant && elapsed_ns >= TSC_CALIBRATION_NS)
+    {
+        // the second point, threads calibrating at the same time store about the same scale
+        uint64_t ticks = __rdtsc() - s_start_tsc;
+        scale = (uint64_t)((((unsigned __int128)elapsed_ns << TSC_SCALE_BITS) / 1000) / ticks);
+        __atomic_store_n(&s_tsc_scale, scale, __ATOMIC_RELAXED);
+    }
+#endif
+    return elapsed_ns / 1000;
+}
+
+char *log_system_timestamp(void)
+{
+    struct timespec now;
+    // the vDSO reads the clock without entering the kernel
+    clock_gettime(CLOCK_REALTIME, &now);
+    return log_impl_system_time(now.tv_sec, (uint32_t)(now.tv_nsec / 1000000));
+}
+
+#endif
@@ -22,6 +22,7 @@
 
 #include <assert.h>
 #include <stdint.h>
+#include <stdlib.h>
 #include "log_private.h"
 
 static int s_lock = 0;
@@ -44,16 +45,56 @@ void log_impl_unlock(void)
     s_lock = 0;
 }
 
+void log_impl_yield(void)
+{
+}
+
+bool log_impl_image_address(const void *ptr, uint64_t *address)
+{
+    return false;
+}
+
+// no threads, async records are written by log_flush
+bool log_impl_thread_start(void (*func)(void))
+{
+    return false;
+}
+
+void log_impl_wait(uint32_t timeout_ms)
+{
+}
+
+void log_impl_signal(void)
+{
+}
+
+void log_impl_at_exit(void (*func)(void))
+{
+#ifndef __AVR__
+    atexit(func);
+#endif
+}
+
 static uint32_t timestamp = 0;
 
 uint32_t log_early_timestamp(void)
 {
-    return timestamp++;
+    return __atomic_fetch_add(&timestamp, 1, __ATOMIC_RELAXED);
 }
 
 uint32_t log_timestamp(void)
 {
-    return timestamp++;
+    return __atomic_fetch_add(&timestamp, 1, __ATOMIC_RELAXED);
+}
+
+uint32_t log_coarse_timestamp(void)
+{
+    return log_timestamp();
+}
+
+uint64_t log_timestamp_us(void)
+{
+    return (uint64_t)log_timestamp() * 1000;
 }
 
 #endif
\ No newline at end of file
@@ -20,52 +20,56 @@
 
 #ifdef CONFIG_LOG_PTHREADS
 #include <stdint.h>
+#include <stdlib.h>
 #include <assert.h>
 #include "log_private.h"
 #include <time.h>
 #include <sys/time.h>
 
 #include <pthread.h>
+#include <sched.h>
 #include <semaphore.h>
 #include <errno.h>
 
 #define MAX_MUTEX_WAIT_MS 10
 
-static sem_t mutex = NULL;
+static sem_t mutex;
+static pthread_once_t mutex_once = PTHREAD_ONCE_INIT;
 
-void log_impl_lock(void)
+static void mutex_init(void)
 {
-    if (!mutex)
-    {
-        sem_init(&mutex,0,1);
-    }
-    sem_wait(&mutex);
+    sem_init(&mutex, 0, 1);
 }
 
-
-int sem_timedwait_ms(sem_t *sem, int milliseconds)
+// sem_timedwait takes an absolute CLOCK_REALTIME time
+static void deadline_after_ms(struct timespec *deadline, uint32_t milliseconds)
 {
-    if (!mutex)
+    clock_gettime(CLOCK_REALTIME, deadline);
+    deadline->tv_sec += milliseconds / 1000;
+    deadline->tv_nsec += (milliseconds % 1000) * 1000000L;
+    if (deadline->tv_nsec >= 1000000000L)
     {
-        sem_init(&mutex,0,1);
+        deadline->tv_sec++;
+        deadline->tv_nsec -= 1000000000L;
     }
+}
 
-    struct timespec ts = {
-        0,(1000 * milliseconds)
-    };
-    // if (clock_gettime(CLOCK_REALTIME, &ts) == -1) {
-    //     printf("clock_gettime\r\n");
-    // }
-    //ts.tv_sec += atoi(argv[2]);
-    // ts.tv_nsec += (1000 * milliseconds);
+void log_impl_lock(void)
+{
+    pthread_once(&mutex_once, mutex_init);
+    sem_wait(&mutex);
+}
 
-    int result = sem_timedwait(sem, &ts) ;
-    // printf("[semt %d %d]", result, errno);
-    return result == 0;
+int sem_timedwait_ms(sem_t *sem, int milliseconds)
+{
+    struct timespec deadline;
+    deadline_after_ms(&deadline, milliseconds);
+    return sem_timedwait(sem, &deadline) == 0;
 }
 
 bool log_impl_lock_timeout(void)
 {
+    pthread_once(&mutex_once, mutex_init);
     return sem_timedwait_ms(&mutex, MAX_MUTEX_WAIT_MS);
 }
 
@@ -74,16 +78,103 @@ void log_impl_unlock(void)
     sem_post(&mutex);
 }
 
+void log_impl_yield(void)
+{
+    sched_yield();
+}
+
+bool log_impl_image_address(const void *ptr, uint64_t *address)
+{
+    return false;
+}
+
+static sem_t s_writer_signal;
+static bool s_writer_signal_initialized = false;
+static void (*s_writer_func)(void) = NULL;
+
+static void *writer_thread(void *arg)
+{
+    s_writer_func();
+    return NULL;
+}
+
+bool log_impl_thread_start(void (*func)(void))
+{
+    if (!s_writer_signal_initialized)
+    {
+        sem_init(&s_writer_signal, 0, 0);
+        s_writer_signal_initialized = true;
+    }
+    s_writer_func = func;
+    pthread_t thread;
+    if (pthread_create(&thread, NULL, writer_thread, NULL) != 0)
+    {
+        return false;
+    }
+    pthread_detach(thread);
+    return true;
+}
+
+void log_impl_wait(uint32_t timeout_ms)
+{
+    sem_timedwait_ms(&s_writer_signal, timeout_ms);
+}
+
+void log_impl_signal(void)
+{
+    if (s_writer_signal_initialized)
+    {
+        sem_post(&s_writer_signal);
+    }
+}
+
+void log_impl_at_exit(void (*func)(void))
+{
+    atexit(func);
+}
+
+// milliseconds since the logger was loaded, clock() would count CPU time
+static uint64_t monotonic_ms(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000 + ts.tv_nsec / 1000000;
+}
+
+static uint64_t s_start_ms = 0;
+
+__attribute__((constructor)) static void timestamp_init(void)
+{
+    s_start_ms = monotonic_ms();
+}
+
 uint32_t log_early_timestamp(void)
 {
-    clock_t tick = clock();
-    return tick;
+    return (uint32_t)(monotonic_ms() - s_start_ms);
 }
 
 uint32_t log_timestamp(void)
 {
-    clock_t tick = clock();
-    return tick;
+    return (uint32_t)(monotonic_ms() - s_start_ms);
+}
+
+// the tick of the kernel, the vDSO reads it without the TSC
+uint32_t log_coarse_timestamp(void)
+{
+#ifdef CLOCK_MONOTONIC_COARSE
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC_COARSE, &ts);
+    return (uint32_t)((uint64_t)ts.tv_sec * 1000 + ts.tv_nsec / 1000000);
+#else
+    return log_timestamp();
+#endif
+}
+
+uint64_t log_timestamp_us(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000 + ts.tv_nsec / 1000 - s_start_ms * 1000;
 }
 
 #endif
\ No newline at end of file
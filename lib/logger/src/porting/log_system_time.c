@@ -0,0 +1,62 @@
+// Copyright 2015-2019 Espressif Systems (Shanghai) PTE LTD
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#ifdef LOG_CONFIG
+#include LOG_CONFIG
+#else
+#include "log_config.h"
+#endif
+
+// shared by the ports with a wall clock, see log_system_timestamp
+#if defined(CONFIG_LOG_FREERTOS) || defined(CONFIG_LOG_LINUX)
+#include <stdint.h>
+#include <time.h>
+#include "log_private.h"
+
+/**
+ * @brief "HH:MM:SS.sss" of a thread and the second it was rendered for
+ */
+typedef struct
+{
+    time_t second;
+    char text[LOG_SYSTEM_TIME_SIZE];
+} log_system_time_t;
+
+// the second is never valid before the first call, text is rendered then
+static __thread log_system_time_t s_system_time = {(time_t)-1, "00:00:00.000"};
+
+static inline void put_digits(char *out, unsigned value)
+{
+    out[0] = (char)('0' + value / 10);
+    out[1] = (char)('0' + value % 10);
+}
+
+char *log_impl_system_time(time_t seconds, uint32_t milliseconds)
+{
+    log_system_time_t *time = &s_system_time;
+    if (seconds != time->second)
+    {
+        struct tm timeinfo;
+        localtime_r(&seconds, &timeinfo);
+        put_digits(time->text, (unsigned)timeinfo.tm_hour);
+        put_digits(time->text + 3, (unsigned)timeinfo.tm_min);
+        put_digits(time->text + 6, (unsigned)timeinfo.tm_sec);
+        time->second = seconds;
+    }
+    time->text[9] = (char)('0' + milliseconds / 100);
+    put_digits(time->text + 10, milliseconds % 100);
+    return time->text;
+}
+
+#endif
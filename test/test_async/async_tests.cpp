@@ -0,0 +1,271 @@
+#include <unity.h>
+
+#include "log.h"
+#include <stdio.h>
+#include <string.h>
+#include <atomic>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+void setUp() {}
+void tearDown() {}
+
+void run_all_tests();
+
+#ifdef __cplusplus
+extern "C"
+{
+#endif
+
+#ifdef ESP_PLATFORM
+    void app_main()
+#elif defined(ARDUINO)
+void setup()
+#else
+int main(/*int argc, char * argv[]*/)
+#endif
+    {
+
+        run_all_tests();
+
+#ifdef ESP_PLATFORM
+#elif defined(ARDUINO)
+#else
+    return 0;
+#endif
+    }
+
+#ifdef ARDUINO
+    void loop()
+    {
+    }
+#endif
+#ifdef __cplusplus
+}
+#endif
+
+static const int PRODUCER_THREADS = 16;
+static const int PRODUCER_MESSAGES = 20000;
+
+static std::mutex s_output_mutex;
+static std::vector<std::string> s_output;
+static std::thread::id s_output_thread;
+
+int capture_vprintf(const char *format, va_list args)
+{
+    char text[256];
+    int length = vsnprintf(text, sizeof(text), format, args);
+    std::lock_guard<std::mutex> lock(s_output_mutex);
+    s_output.push_back(text);
+    s_output_thread = std::this_thread::get_id();
+    return length;
+}
+
+static std::vector<std::string> take_output()
+{
+    std::lock_guard<std::mutex> lock(s_output_mutex);
+    std::vector<std::string> output;
+    output.swap(s_output);
+    return output;
+}
+
+// without a background writer, records are only written by log_flush
+class Flusher
+{
+public:
+    explicit Flusher(bool writer_running) : done(false)
+    {
+        if (!writer_running)
+        {
+            thread = std::thread([this]() {
+                while (!done.load())
+                {
+                    log_flush();
+                    std::this_thread::yield();
+                }
+            });
+        }
+    }
+    ~Flusher()
+    {
+        done = true;
+        if (thread.joinable())
+        {
+            thread.join();
+        }
+    }
+
+private:
+    std::atomic<bool> done;
+    std::thread thread;
+};
+
+void async_messages_are_written_in_order()
+{
+    log_level_set("*", LOG_VERBOSE);
+    vprintf_like_t original = log_set_vprintf(capture_vprintf);
+    take_output();
+
+    log_async_start();
+    for (int i = 0; i < 10; i++)
+    {
+        log_write(LOG_INFO, "async", "message %d of %s\n", i, "ten");
+    }
+    log_write(LOG_DEBUG, "async", "%s %c %.1f %llu\n", "mixed", 'x', 2.5, 1ULL << 40);
+    log_flush();
+    std::vector<std::string> output = take_output();
+    log_async_stop();
+    log_set_vprintf(original);
+
+    TEST_ASSERT_EQUAL(11, output.size());
+    for (int i = 0; i < 10; i++)
+    {
+        char expected[64];
+        snprintf(expected, sizeof(expected), "message %d of ten\n", i);
+        TEST_ASSERT_EQUAL_STRING(expected, output[i].c_str());
+    }
+    TEST_ASSERT_EQUAL_STRING("mixed x 2.5 1099511627776\n", output[10].c_str());
+}
+
+void async_hidden_messages_are_not_queued()
+{
+    vprintf_like_t original = log_set_vprintf(capture_vprintf);
+    take_output();
+    log_level_set("quiet", LOG_WARN);
+
+    log_async_start();
+    log_write(LOG_INFO, "quiet", "hidden\n");
+    log_write(LOG_WARN, "quiet", "shown\n");
+    log_flush();
+    std::vector<std::string> output = take_output();
+    log_async_stop();
+    log_set_vprintf(original);
+
+    TEST_ASSERT_EQUAL(1, output.size());
+    TEST_ASSERT_EQUAL_STRING("shown\n", output[0].c_str());
+}
+
+void async_buffer_dump_is_one_entry()
+{
+    log_level_set("*", LOG_VERBOSE);
+    vprintf_like_t original = log_set_vprintf(capture_vprintf);
+    take_output();
+
+    const char buffer[] = "The quick brown fox";
+    log_async_start();
+    LOGI_BUFFER_CHAR("async", buffer, sizeof(buffer), "dump of %d bytes", (int)sizeof(buffer));
+    log_flush();
+    std::vector<std::string> output = take_output();
+    log_async_stop();
+    log_set_vprintf(original);
+
+    TEST_ASSERT_EQUAL(1, output.size());
+    TEST_ASSERT_TRUE(output[0].find("dump of 20 bytes") != std::string::npos);
+    TEST_ASSERT_TRUE(output[0].find("\nThe quick brown \nfox\n") != std::string::npos);
+}
+
+static void expected_payload(int thread, int index, char *payload)
+{
+    int length = (index * 7 + thread) % 40;
+    for (int i = 0; i < length; i++)
+    {
+        payload[i] = 'a' + (thread + index + i) % 26;
+    }
+    payload[length] = 0;
+}
+
+void async_producers_keep_order_without_corruption()
+{
+    log_level_set("*", LOG_VERBOSE);
+    vprintf_like_t original = log_set_vprintf(capture_vprintf);
+    take_output();
+    uint32_t dropped_before = log_async_dropped();
+
+    {
+        Flusher flusher(log_async_start());
+        std::vector<std::thread> producers;
+        for (int t = 0; t < PRODUCER_THREADS; t++)
+        {
+            producers.emplace_back([t]() {
+                char payload[64];
+                for (int i = 0; i < PRODUCER_MESSAGES; i++)
+                {
+                    expected_payload(t, i, payload);
+                    log_write(LOG_INFO, "stress", "%d %d %s|\n", t, i, payload);
+                    // give the writer a chance, a full ring only drops messages
+                    std::this_thread::yield();
+                }
+            });
+        }
+        for (auto &producer : producers)
+        {
+            producer.join();
+        }
+        log_flush();
+    }
+    std::vector<std::string> output = take_output();
+    log_async_stop();
+    log_set_vprintf(original);
+
+    int last[PRODUCER_THREADS];
+    memset(last, -1, sizeof(last));
+    int corrupt = 0;
+    int out_of_order = 0;
+    for (const std::string &line : output)
+    {
+        int t = -1;
+        int i = -1;
+        char payload[64] = {0};
+        char expected[64];
+        if (sscanf(line.c_str(), "%d %d %63[a-z]|", &t, &i, payload) < 2 || t < 0 || t >= PRODUCER_THREADS)
+        {
+            corrupt++;
+            continue;
+        }
+        expected_payload(t, i, expected);
+        char expected_line[128];
+        snprintf(expected_line, sizeof(expected_line), "%d %d %s|\n", t, i, expected);
+        corrupt += line != expected_line;
+        out_of_order += i <= last[t];
+        last[t] = i;
+    }
+    uint32_t dropped = log_async_dropped() - dropped_before;
+    char message[128];
+    snprintf(message, sizeof(message), "%zu written, %u dropped", output.size(), (unsigned)dropped);
+    TEST_MESSAGE(message);
+
+    TEST_ASSERT_EQUAL_MESSAGE(0, corrupt, "no corrupted messages");
+    TEST_ASSERT_EQUAL_MESSAGE(0, out_of_order, "messages of each producer in order");
+    TEST_ASSERT_EQUAL_MESSAGE(PRODUCER_THREADS * PRODUCER_MESSAGES, output.size() + dropped, "every message written or counted as dropped");
+    TEST_ASSERT_TRUE_MESSAGE(output.size() > 0, "messages written");
+}
+
+void async_stop_returns_to_synchronous_writing()
+{
+    vprintf_like_t original = log_set_vprintf(capture_vprintf);
+    take_output();
+    log_level_set("*", LOG_VERBOSE);
+
+    log_async_start();
+    log_async_stop();
+    log_write(LOG_INFO, "sync", "written by the caller\n");
+    std::vector<std::string> output = take_output();
+    std::thread::id thread = s_output_thread;
+    log_set_vprintf(original);
+
+    TEST_ASSERT_EQUAL(1, output.size());
+    TEST_ASSERT_TRUE(thread == std::this_thread::get_id());
+}
+
+void run_all_tests()
+{
+    UNITY_BEGIN();
+    RUN_TEST(async_messages_are_written_in_order);
+    RUN_TEST(async_hidden_messages_are_not_queued);
+    RUN_TEST(async_buffer_dump_is_one_entry);
+    RUN_TEST(async_producers_keep_order_without_corruption);
+    RUN_TEST(async_stop_returns_to_synchronous_writing);
+    UNITY_END();
+}
@@ -0,0 +1,350 @@
+#include <unity.h>
+
+#include "log.h"
+#include "log_binary.h"
+#include <stdio.h>
+#include <stdint.h>
+#include <stddef.h>
+#include <string.h>
+#include <string>
+#include <vector>
+
+void setUp() {}
+void tearDown() {}
+
+void run_all_tests();
+
+#ifdef __cplusplus
+extern "C"
+{
+#endif
+
+#ifdef ESP_PLATFORM
+    void app_main()
+#elif defined(ARDUINO)
+void setup()
+#else
+int main(/*int argc, char * argv[]*/)
+#endif
+    {
+
+        run_all_tests();
+
+#ifdef ESP_PLATFORM
+#elif defined(ARDUINO)
+#else
+    return 0;
+#endif
+    }
+
+#ifdef ARDUINO
+    void loop()
+    {
+    }
+#endif
+#ifdef __cplusplus
+}
+#endif
+
+static log_binary_stream_t s_stream;
+
+// strings are never moved to flash on the host, so an address is a pointer in this process
+static const char *resolve_pointer(void *context, uint64_t address)
+{
+    return (const char *)(uintptr_t)address;
+}
+
+static std::string decode(const uint8_t *record, size_t length)
+{
+    log_binary_record_t parsed;
+    if (log_binary_parse_record(record, length, &s_stream, resolve_pointer, NULL, &parsed) != length)
+    {
+        return "<invalid record>";
+    }
+    char text[512];
+    int text_len = log_binary_format(&parsed, &s_stream, resolve_pointer, NULL, text, sizeof(text));
+    if (text_len < 0)
+    {
+        return "<malformed arguments>";
+    }
+    return std::string(text, text_len);
+}
+
+static size_t encode(uint8_t *record, size_t size, const char *tag, const char *format, ...)
+{
+    va_list list;
+    va_start(list, format);
+    size_t length = log_binary_encode(record, size, LOG_INFO, 5000000001234ull, tag, format, list);
+    va_end(list);
+    return length;
+}
+
+static std::string expected(const char *format, ...)
+{
+    va_list list;
+    va_start(list, format);
+    char text[512];
+    int text_len = vsnprintf(text, sizeof(text), format, list);
+    va_end(list);
+    return std::string(text, text_len);
+}
+
+#define TEST_ROUND_TRIP(format, ...)                                                   \
+    do                                                                                 \
+    {                                                                                  \
+        uint8_t record[256];                                                           \
+        size_t length = encode(record, sizeof(record), "tag", format, ##__VA_ARGS__);  \
+        TEST_ASSERT_TRUE_MESSAGE(length > 0, format);                                  \
+        TEST_ASSERT_EQUAL_STRING_MESSAGE(expected(format, ##__VA_ARGS__).c_str(),      \
+                                         decode(record, length).c_str(), format);      \
+    } while (0)
+
+void binary_stream_header_round_trip()
+{
+    uint8_t header[LOG_BINARY_STREAM_HEADER_SIZE];
+    TEST_ASSERT_EQUAL(LOG_BINARY_STREAM_HEADER_SIZE, log_binary_stream_header(header));
+
+    log_binary_stream_t stream;
+    TEST_ASSERT_TRUE(log_binary_parse_stream_header(header, sizeof(header), &stream));
+    TEST_ASSERT_EQUAL(sizeof(void *), stream.pointer_size);
+    TEST_ASSERT_EQUAL(sizeof(long), stream.long_size);
+    TEST_ASSERT_EQUAL(sizeof(size_t), stream.size_t_size);
+
+    header[0] = 'X';
+    TEST_ASSERT_FALSE(log_binary_parse_stream_header(header, sizeof(header), &stream));
+    TEST_ASSERT_FALSE(log_binary_parse_stream_header(header, 4, &stream));
+}
+
+void binary_version_1_timestamps_are_read_in_milliseconds()
+{
+    // a version 1 stream of a 64 bit device, records carry a u32 timestamp in milliseconds
+    const uint8_t header[LOG_BINARY_STREAM_HEADER_SIZE] = {'C', 'L', 'O', 'G', 1, 8, 8, 8, 8, 8};
+    const uint8_t record[] = {LOG_BINARY_RECORD_MAGIC, LOG_WARN, 13, 0,
+                              0xd2, 0x04, 0, 0,
+                              2, 0, 'o', 'k',
+                              3, 0, 't', 'a', 'g'};
+    log_binary_stream_t stream;
+    TEST_ASSERT_TRUE(log_binary_parse_stream_header(header, sizeof(header), &stream));
+    log_binary_record_t parsed;
+    TEST_ASSERT_EQUAL(sizeof(record), log_binary_parse_record(record, sizeof(record), &stream, NULL, NULL, &parsed));
+    TEST_ASSERT_TRUE(parsed.timestamp_us == 1234000);
+    TEST_ASSERT_EQUAL_MEMORY("ok", parsed.format, 2);
+    TEST_ASSERT_EQUAL_MEMORY("tag", parsed.tag, 3);
+    TEST_ASSERT_EQUAL(0, parsed.args_len);
+}
+
+void binary_16_bit_device_stream_is_decoded()
+{
+    // an AVR stream: 2 byte pointers, size_t and ptrdiff_t
+    const uint8_t header[LOG_BINARY_STREAM_HEADER_SIZE] = {'C', 'L', 'O', 'G', LOG_BINARY_VERSION, 2, 4, 2, 8, 2};
+    const uint8_t record[] = {LOG_BINARY_RECORD_MAGIC, LOG_WARN, 35, 0,
+                              1, 0, 0, 0, 0, 0, 0, 0,
+                              12, 0, '%', 'z', 'u', ' ', '%', 't', 'd', ' ', '%', 'l', 'd', '\n',
+                              3, 0, 'a', 'v', 'r',
+                              0xff, 0xff,
+                              0xfe, 0xff,
+                              0xfb, 0xff, 0xff, 0xff};
+    log_binary_stream_t stream;
+    TEST_ASSERT_TRUE(log_binary_parse_stream_header(header, sizeof(header), &stream));
+    TEST_ASSERT_EQUAL(2, stream.pointer_size);
+    log_binary_record_t parsed;
+    TEST_ASSERT_EQUAL(sizeof(record), log_binary_parse_record(record, sizeof(record), &stream, NULL, NULL, &parsed));
+    char text[64];
+    log_binary_format(&parsed, &stream, NULL, NULL, text, sizeof(text));
+    TEST_ASSERT_EQUAL_STRING("65535 -2 -5\n", text);
+
+    // other sizes are still rejected
+    uint8_t invalid[LOG_BINARY_STREAM_HEADER_SIZE];
+    memcpy(invalid, header, sizeof(invalid));
+    invalid[5] = 3;
+    TEST_ASSERT_FALSE(log_binary_parse_stream_header(invalid, sizeof(invalid), &stream));
+}
+
+void binary_record_fields()
+{
+    uint8_t record[64];
+    size_t length = encode(record, sizeof(record), "fields", "value %d\n", 5);
+    TEST_ASSERT_TRUE(length > 0);
+
+    log_binary_record_t parsed;
+    TEST_ASSERT_EQUAL(length, log_binary_parse_record(record, length, &s_stream, NULL, NULL, &parsed));
+    TEST_ASSERT_EQUAL(LOG_INFO, parsed.level);
+    TEST_ASSERT_TRUE(parsed.timestamp_us == 5000000001234ull);
+    TEST_ASSERT_EQUAL(6, parsed.tag_len);
+    TEST_ASSERT_EQUAL_MEMORY("fields", parsed.tag, 6);
+    TEST_ASSERT_EQUAL(strlen("value %d\n"), parsed.format_len);
+    TEST_ASSERT_EQUAL(4, parsed.args_len);
+
+    // incomplete records are not parsed
+    TEST_ASSERT_EQUAL(0, log_binary_parse_record(record, length - 1, &s_stream, NULL, NULL, &parsed));
+    record[0] = 0;
+    TEST_ASSERT_EQUAL(0, log_binary_parse_record(record, length, &s_stream, NULL, NULL, &parsed));
+}
+
+void binary_integers_round_trip()
+{
+    TEST_ROUND_TRIP("plain text, no arguments");
+    TEST_ROUND_TRIP("%d %i %u %x %X %o", -12345, 77, 4000000000u, 0xbeefu, 0xCAFEu, 0755u);
+    TEST_ROUND_TRIP("%hhd %hhu %hd %hu", -3, 250, -30000, 65000);
+    TEST_ROUND_TRIP("%ld %lu %lx", -1234567890L, 3000000000UL, 0xdeadbeefUL);
+    TEST_ROUND_TRIP("%lld %llu %llx", -1234567890123LL, 18446744073709551615ULL, 0x123456789abcdefULL);
+    TEST_ROUND_TRIP("%jd %zu %zd %td", (intmax_t)-42, (size_t)123456, (ptrdiff_t)-7, (ptrdiff_t)-99);
+    TEST_ROUND_TRIP("%c%c%c", 'a', 'b', 'c');
+    TEST_ROUND_TRIP("%08d|%-6d|%+d|% d|%#x|%#o|%.5d", 42, 42, 42, 42, 255u, 8u, 17);
+    TEST_ROUND_TRIP("%*d|%-*d|%*d|%.*d", 6, 1, 4, 2, -5, 3, 3, 4);
+    TEST_ROUND_TRIP("100%% %d%%", 5);
+    TEST_ROUND_TRIP("%p %p", (void *)&s_stream, (void *)NULL);
+}
+
+void binary_floats_round_trip()
+{
+    TEST_ROUND_TRIP("%f %F %e %E", 3.14159, -2.5, 12345.678, 0.000123);
+    TEST_ROUND_TRIP("%g %G %a", 1e-10, 1e20, 1.0);
+    TEST_ROUND_TRIP("%10.3f|%-10.2e|%+.0f", 3.14159, 2.71828, 99.5);
+    TEST_ROUND_TRIP("%Lf", (long double)1.5);
+    TEST_ROUND_TRIP("%d %f %d", 1, 2.0, 3);
+}
+
+void binary_strings_round_trip()
+{
+    const char *text = "hello world";
+    char unterminated[4] = {'a', 'b', 'c', 'd'};
+    TEST_ROUND_TRIP("[%s] [%10s] [%-10s] [%.5s]", text, "right", "left", text);
+    TEST_ROUND_TRIP("[%.*s] [%*s]", 3, text, -8, "neg");
+    TEST_ROUND_TRIP("[%.4s]", unterminated);
+    TEST_ROUND_TRIP("[%s]", "");
+    TEST_ROUND_TRIP("%s=%d, %s=%u", "first", -1, "second", 2u);
+}
+
+void binary_string_address_is_resolved()
+{
+    // hand made record, the format and the %s argument are referenced by address
+    static const char format[] = "%s is %d\n";
+    static const char value[] = "answer";
+    std::vector<uint8_t> record = {LOG_BINARY_RECORD_MAGIC, LOG_WARN, 0, 0, 1, 0, 0, 0, 0, 0, 0, 0};
+    auto put = [&record](uint64_t value, size_t size) {
+        for (size_t i = 0; i < size; i++)
+        {
+            record.push_back((uint8_t)(value >> (8 * i)));
+        }
+    };
+    put(LOG_BINARY_STRING_ADDRESS, 2);
+    put((uintptr_t)format, sizeof(void *));
+    put(3, 2);
+    record.insert(record.end(), {'t', 'a', 'g'});
+    put(LOG_BINARY_STRING_ADDRESS, 2);
+    put((uintptr_t)value, sizeof(void *));
+    put(42, 4);
+    size_t body_len = record.size() - LOG_BINARY_RECORD_HEADER_SIZE;
+    record[2] = (uint8_t)body_len;
+    record[3] = (uint8_t)(body_len >> 8);
+
+    TEST_ASSERT_EQUAL_STRING("answer is 42\n", decode(record.data(), record.size()).c_str());
+
+    // without a resolver the record is still rendered
+    log_binary_record_t parsed;
+    char text[64];
+    TEST_ASSERT_EQUAL(record.size(), log_binary_parse_record(record.data(), record.size(), &s_stream, NULL, NULL, &parsed));
+    TEST_ASSERT_TRUE(log_binary_format(&parsed, &s_stream, NULL, NULL, text, sizeof(text)) > 0);
+}
+
+void binary_record_does_not_overflow()
+{
+    uint8_t record[40];
+    // strings are truncated to the space left
+    size_t length = encode(record, sizeof(record), "tag", "%s", "a string much longer than the remaining record space");
+    TEST_ASSERT_TRUE(length > 0);
+    TEST_ASSERT_TRUE(length <= sizeof(record));
+
+    // fixed size values are never truncated
+    length = encode(record, 20, "tag", "%d %d %d %d %d", 1, 2, 3, 4, 5);
+    TEST_ASSERT_EQUAL(0, length);
+
+    // short output buffers are always terminated, the full length is returned
+    length = encode(record, sizeof(record), "tag", "%d", 123456);
+    log_binary_record_t parsed;
+    log_binary_parse_record(record, length, &s_stream, NULL, NULL, &parsed);
+    char text[4];
+    TEST_ASSERT_EQUAL(6, log_binary_format(&parsed, &s_stream, NULL, NULL, text, sizeof(text)));
+    TEST_ASSERT_EQUAL_STRING("123", text);
+
+    // missing arguments are reported
+    parsed.args_len = 2;
+    TEST_ASSERT_TRUE(log_binary_format(&parsed, &s_stream, NULL, NULL, text, sizeof(text)) < 0);
+}
+
+static std::vector<uint8_t> s_binary_output;
+static std::vector<std::string> s_vprintf_output;
+static log_writev_t s_original_writev;
+
+static void capture_binary(const uint8_t *data, size_t length)
+{
+    s_binary_output.insert(s_binary_output.end(), data, data + length);
+}
+
+// formats the message with vsnprintf and then writes it through the binary writer
+static void capture_writev(uint8_t level, const char *tag, const char *format, va_list args)
+{
+    va_list copy;
+    va_copy(copy, args);
+    char text[512];
+    int text_len = vsnprintf(text, sizeof(text), format, copy);
+    va_end(copy);
+    s_vprintf_output.push_back(std::string(text, text_len));
+    log_writev(level, tag, format, args);
+}
+
+void binary_logger_output_matches_vprintf()
+{
+    s_binary_output.clear();
+    s_vprintf_output.clear();
+    log_level_set("*", LOG_VERBOSE);
+    log_set_binary_writer(capture_binary);
+    s_original_writev = log_set_writev(capture_writev);
+
+    LOGE("binary", "error %d", -1);
+    LOGW("binary", "warning %s %u", "text", 2u);
+    LOGI("binary", "info %.2f %c", 2.5, 'x');
+    LOGD("binary", "debug %p", (void *)&s_stream);
+    LOGV("binary", "verbose %llu", 1ULL << 40);
+    LOGV("hidden", "written before the level is lowered");
+    log_level_set("hidden", LOG_NONE);
+    LOGE("hidden", "not written");
+
+    log_set_writev(s_original_writev);
+    log_set_binary_writer(NULL);
+
+    log_binary_stream_t stream;
+    TEST_ASSERT_TRUE(log_binary_parse_stream_header(s_binary_output.data(), s_binary_output.size(), &stream));
+    size_t pos = LOG_BINARY_STREAM_HEADER_SIZE;
+    for (const std::string &text : s_vprintf_output)
+    {
+        log_binary_record_t parsed;
+        size_t length = log_binary_parse_record(s_binary_output.data() + pos, s_binary_output.size() - pos, &stream, NULL, NULL, &parsed);
+        TEST_ASSERT_TRUE(length > 0);
+        TEST_ASSERT_EQUAL_STRING(text.c_str(), decode(s_binary_output.data() + pos, length).c_str());
+        pos += length;
+    }
+    TEST_ASSERT_EQUAL(6, s_vprintf_output.size());
+    TEST_ASSERT_EQUAL(s_binary_output.size(), pos);
+}
+
+void run_all_tests()
+{
+    uint8_t header[LOG_BINARY_STREAM_HEADER_SIZE];
+    log_binary_stream_header(header);
+    log_binary_parse_stream_header(header, sizeof(header), &s_stream);
+
+    UNITY_BEGIN();
+    RUN_TEST(binary_stream_header_round_trip);
+    RUN_TEST(binary_record_fields);
+    RUN_TEST(binary_version_1_timestamps_are_read_in_milliseconds);
+    RUN_TEST(binary_16_bit_device_stream_is_decoded);
+    RUN_TEST(binary_integers_round_trip);
+    RUN_TEST(binary_floats_round_trip);
+    RUN_TEST(binary_strings_round_trip);
+    RUN_TEST(binary_string_address_is_resolved);
+    RUN_TEST(binary_record_does_not_overflow);
+    RUN_TEST(binary_logger_output_matches_vprintf);
+    UNITY_END();
+}
@@ -0,0 +1,444 @@
+#include <unity.h>
+
+#include "log.h"
+#include "log_binary.h"
+#include <ctype.h>
+#include <stdio.h>
+#include <stdint.h>
+#include <string.h>
+#include <string>
+#include <vector>
+
+void setUp() {}
+void tearDown() {}
+
+void run_all_tests();
+
+#ifdef __cplusplus
+extern "C"
+{
+#endif
+
+#ifdef ESP_PLATFORM
+    void app_main()
+#elif defined(ARDUINO)
+void setup()
+#else
+int main(/*int argc, char * argv[]*/)
+#endif
+    {
+
+        run_all_tests();
+
+#ifdef ESP_PLATFORM
+#elif defined(ARDUINO)
+#else
+    return 0;
+#endif
+    }
+
+#ifdef ARDUINO
+    void loop()
+    {
+    }
+#endif
+#ifdef __cplusplus
+}
+#endif
+
+typedef void (*buffer_writer_t)(uint8_t level, const char *tag, const void *buffer, uint16_t buff_len);
+
+static std::vector<std::string> s_lines;
+
+static void capture_writev(uint8_t level, const char *tag, const char *format, va_list args)
+{
+    char line[CONFIG_LOG_BUFFER_BLOCK_SIZE + 1];
+    vsnprintf(line, sizeof(line), format, args);
+    s_lines.push_back(line);
+}
+
+static std::string join(const std::vector<std::string> &lines)
+{
+    std::string text;
+    for (const std::string &line : lines)
+    {
+        text += line;
+    }
+    return text;
+}
+
+// The sprintf based formatters, one line per message, their output is the reference.
+
+static std::vector<std::string> reference_hex(const void *buffer, uint16_t buff_len)
+{
+    std::vector<std::string> lines;
+    const char *buffer_ptr = (const char *)buffer;
+    char hex_buffer[3 * BYTES_PER_LINE + 1];
+    while (buff_len)
+    {
+        int bytes_cur_line = buff_len > BYTES_PER_LINE ? BYTES_PER_LINE : buff_len;
+        for (int i = 0; i < bytes_cur_line; i++)
+        {
+            sprintf(hex_buffer + 3 * i, "%02x ", (uint8_t)buffer_ptr[i]);
+        }
+        lines.push_back(std::string(hex_buffer) + "\n");
+        buffer_ptr += bytes_cur_line;
+        buff_len -= bytes_cur_line;
+    }
+    return lines;
+}
+
+static std::vector<std::string> reference_char(const void *buffer, uint16_t buff_len)
+{
+    std::vector<std::string> lines;
+    const char *buffer_ptr = (const char *)buffer;
+    char char_buffer[BYTES_PER_LINE + 1];
+    while (buff_len)
+    {
+        int bytes_cur_line = buff_len > BYTES_PER_LINE ? BYTES_PER_LINE : buff_len;
+        for (int i = 0; i < bytes_cur_line; i++)
+        {
+            sprintf(char_buffer + i, "%c", buffer_ptr[i]);
+        }
+        lines.push_back(std::string(char_buffer) + "\n");
+        buffer_ptr += bytes_cur_line;
+        buff_len -= bytes_cur_line;
+    }
+    return lines;
+}
+
+static std::vector<std::string> reference_hexdump(const void *buffer, uint16_t buff_len)
+{
+    std::vector<std::string> lines;
+    const char *buffer_ptr = (const char *)buffer;
+    const char *buffer_start = buffer_ptr;
+    char hd_buffer[256];
+    while (buff_len)
+    {
+        int bytes_cur_line = buff_len > BYTES_PER_LINE ? BYTES_PER_LINE : buff_len;
+        char *ptr_hd = hd_buffer;
+        ptr_hd += sprintf(ptr_hd, "%p (%08X)", buffer_ptr, (unsigned)(buffer_ptr - buffer_start));
+        for (int i = 0; i < BYTES_PER_LINE; i++)
+        {
+            if ((i & 7) == 0)
+            {
+                ptr_hd += sprintf(ptr_hd, " ");
+            }
+            if (i < bytes_cur_line)
+            {
+                ptr_hd += sprintf(ptr_hd, " %02x", (uint8_t)buffer_ptr[i]);
+            }
+            else
+            {
+                ptr_hd += sprintf(ptr_hd, "   ");
+            }
+        }
+        ptr_hd += sprintf(ptr_hd, "  |");
+        for (int i = 0; i < bytes_cur_line; i++)
+        {
+            if (isprint((int)buffer_ptr[i]))
+            {
+                ptr_hd += sprintf(ptr_hd, "%c", buffer_ptr[i]);
+            }
+            else
+            {
+                ptr_hd += sprintf(ptr_hd, ".");
+            }
+        }
+        sprintf(ptr_hd, "|");
+        lines.push_back(std::string(hd_buffer) + "\n");
+        buffer_ptr += bytes_cur_line;
+        buff_len -= bytes_cur_line;
+    }
+    return lines;
+}
+
+// a dump is written in as few messages as possible, every message holds whole lines
+static void assert_same_lines(const std::vector<std::string> &expected, const char *message)
+{
+    for (const std::string &text : s_lines)
+    {
+        TEST_ASSERT_TRUE_MESSAGE(text.size() < CONFIG_LOG_BUFFER_BLOCK_SIZE, message);
+        TEST_ASSERT_EQUAL_MESSAGE('\n', text.back(), message);
+    }
+    TEST_ASSERT_EQUAL_STRING_MESSAGE(join(expected).c_str(), join(s_lines).c_str(), message);
+}
+
+static void compare_with_reference(const uint8_t *buffer, uint16_t buff_len)
+{
+    s_lines.clear();
+    log_write_buffer_hex(LOG_ERROR, "TAG", buffer, buff_len);
+    assert_same_lines(reference_hex(buffer, buff_len), "hex");
+
+    s_lines.clear();
+    log_write_buffer_char(LOG_ERROR, "TAG", buffer, buff_len);
+    assert_same_lines(reference_char(buffer, buff_len), "char");
+
+    s_lines.clear();
+    log_write_buffer_hexdump(LOG_ERROR, "TAG", buffer, buff_len);
+    assert_same_lines(reference_hexdump(buffer, buff_len), "hexdump");
+}
+
+static uint8_t s_all_bytes[512];
+
+void buffers_every_byte_value_matches_reference()
+{
+    for (int i = 0; i < 256; i++)
+    {
+        s_all_bytes[i] = (uint8_t)i;
+        s_all_bytes[511 - i] = (uint8_t)i;
+    }
+    compare_with_reference(s_all_bytes, sizeof(s_all_bytes));
+}
+
+void buffers_every_length_matches_reference()
+{
+    uint8_t text[3 * BYTES_PER_LINE + 1];
+    for (size_t i = 0; i < sizeof(text); i++)
+    {
+        text[i] = (uint8_t)(' ' + i * 7 % 95);
+    }
+    for (uint16_t length = 0; length <= sizeof(text); length++)
+    {
+        compare_with_reference(text, length);
+    }
+}
+
+void buffers_unaligned_pointers_match_reference()
+{
+    uint8_t data[2 * BYTES_PER_LINE + 8];
+    uint32_t state = 12345;
+    for (size_t i = 0; i < sizeof(data); i++)
+    {
+        state = state * 1103515245 + 12345;
+        data[i] = (uint8_t)(state >> 16);
+    }
+    for (int start = 1; start < 8; start++)
+    {
+        compare_with_reference(data + start, (uint16_t)(sizeof(data) - start));
+    }
+}
+
+void buffers_zero_byte_ends_char_line()
+{
+    const char buffer[] = "abc\0def\0\0ghijklmnopqrstuvwxyz";
+    s_lines.clear();
+    log_write_buffer_char(LOG_ERROR, "TAG", buffer, sizeof(buffer));
+
+    TEST_ASSERT_EQUAL(1, s_lines.size());
+    TEST_ASSERT_EQUAL_STRING("abc\nnopqrstuvwxyz\n", s_lines[0].c_str());
+    compare_with_reference((const uint8_t *)buffer, sizeof(buffer));
+}
+
+void buffers_dump_is_one_message()
+{
+    const char buffer[] = "\1The quick brown fox jumps over the lazy dog";
+    s_lines.clear();
+    log_write_buffer_hexdump(LOG_ERROR, "TAG", buffer, sizeof(buffer));
+
+    TEST_ASSERT_EQUAL(1, s_lines.size());
+    TEST_ASSERT_EQUAL_STRING(join(reference_hexdump(buffer, sizeof(buffer))).c_str(), s_lines[0].c_str());
+}
+
+void buffers_long_dump_is_split_between_lines()
+{
+    static uint8_t data[4096];
+    for (size_t i = 0; i < sizeof(data); i++)
+    {
+        data[i] = (uint8_t)(i * 31);
+    }
+    s_lines.clear();
+    log_write_buffer_hexdump(LOG_ERROR, "TAG", data, sizeof(data));
+
+    TEST_ASSERT_TRUE(s_lines.size() > 1);
+    TEST_ASSERT_TRUE(s_lines.size() < reference_hexdump(data, sizeof(data)).size());
+    compare_with_reference(data, sizeof(data));
+}
+
+static std::vector<std::string> s_records;
+
+// strings are never moved to flash on the host, so an address is a pointer in this process
+static const char *resolve_pointer(void *context, uint64_t address)
+{
+    return (const char *)(uintptr_t)address;
+}
+
+static void capture_binary(const uint8_t *data, size_t length)
+{
+    log_binary_stream_t stream;
+    if (log_binary_parse_stream_header(data, length, &stream))
+    {
+        return;
+    }
+    uint8_t header[LOG_BINARY_STREAM_HEADER_SIZE];
+    log_binary_stream_header(header);
+    log_binary_parse_stream_header(header, sizeof(header), &stream);
+
+    log_binary_record_t parsed;
+    TEST_ASSERT_EQUAL(length, log_binary_parse_record(data, length, &stream, resolve_pointer, NULL, &parsed));
+    // the dump is rendered from raw bytes, up to a text block per record
+    char text[CONFIG_LOG_BINARY_RECORD_SIZE + CONFIG_LOG_BUFFER_BLOCK_SIZE];
+    int text_len = log_binary_format(&parsed, &stream, resolve_pointer, NULL, text, sizeof(text));
+    TEST_ASSERT_TRUE(text_len > 0);
+    s_records.push_back(std::string(text, text_len));
+}
+
+void buffers_binary_records_are_not_truncated()
+{
+    s_records.clear();
+    log_set_binary_writer(capture_binary);
+    log_set_writev(log_writev);
+    log_write_buffer_hexdump(LOG_ERROR, "TAG", s_all_bytes, sizeof(s_all_bytes));
+    log_set_binary_writer(NULL);
+    log_set_writev(capture_writev);
+
+    TEST_ASSERT_TRUE(s_records.size() > 1);
+    for (const std::string &text : s_records)
+    {
+        TEST_ASSERT_EQUAL('\n', text.back());
+    }
+    TEST_ASSERT_EQUAL_STRING(join(reference_hexdump(s_all_bytes, sizeof(s_all_bytes))).c_str(), join(s_records).c_str());
+}
+
+// one callsite for every length, so the header of the message stays the same
+static void log_hello_and_dump(const char *buffer, uint16_t len)
+{
+    LOGE_BUFFER_HEXDUMP("TAG", buffer, len, "hello %s", "world");
+}
+
+void buffers_message_and_dump_are_one_message()
+{
+    const char buffer[] = "\1The quick brown fox jumps over the lazy dog";
+    // the header holds __FILE__, which may be an absolute path, only dump the lines that fit after it
+    s_lines.clear();
+    log_hello_and_dump(buffer, 0);
+    TEST_ASSERT_EQUAL(1, s_lines.size());
+    size_t size = s_lines[0].size();
+    uint16_t len = 0;
+    for (const std::string &line : reference_hexdump(buffer, sizeof(buffer)))
+    {
+        if (size + line.size() > CONFIG_LOG_BUFFER_BLOCK_SIZE - 1)
+        {
+            break;
+        }
+        size += line.size();
+        len = (size_t)(len + BYTES_PER_LINE) < sizeof(buffer) ? len + BYTES_PER_LINE : sizeof(buffer);
+    }
+    TEST_ASSERT_TRUE_MESSAGE(len > 0, "a line fits after the header");
+
+    s_lines.clear();
+    log_hello_and_dump(buffer, len);
+    TEST_ASSERT_EQUAL(1, s_lines.size());
+    std::string dump = join(reference_hexdump(buffer, len));
+    size_t header_end = s_lines[0].size() - dump.size();
+    TEST_ASSERT_EQUAL_STRING(dump.c_str(), s_lines[0].c_str() + header_end);
+    TEST_ASSERT_EQUAL('\n', s_lines[0][header_end - 1]);
+    TEST_ASSERT_TRUE(s_lines[0].find("hello world") < header_end);
+}
+
+void buffers_clipped_message_keeps_its_line_end()
+{
+    const char buffer[] = "fox";
+    std::string message(CONFIG_LOG_BUFFER_BLOCK_SIZE, 'm');
+    s_lines.clear();
+    LOGE_BUFFER_HEX("TAG", buffer, sizeof(buffer), "%s", message.c_str());
+
+    TEST_ASSERT_EQUAL(2, s_lines.size());
+    TEST_ASSERT_EQUAL(CONFIG_LOG_BUFFER_BLOCK_SIZE - 1, s_lines[0].size());
+    std::string end = LOG_RESET_COLOR "\n";
+    TEST_ASSERT_EQUAL_STRING(end.c_str(), s_lines[0].c_str() + s_lines[0].size() - end.size());
+    TEST_ASSERT_EQUAL_STRING(join(reference_hex(buffer, sizeof(buffer))).c_str(), s_lines[1].c_str());
+}
+
+static std::vector<std::string> s_raw_records;
+
+static void capture_raw_binary(const uint8_t *data, size_t length)
+{
+    log_binary_stream_t stream;
+    if (!log_binary_parse_stream_header(data, length, &stream))
+    {
+        s_raw_records.push_back(std::string((const char *)data, length));
+    }
+}
+
+// one callsite for every length, so the header of the record stays the same
+static void log_value_and_dump(const char *buffer, uint16_t len)
+{
+    LOGE_BUFFER_HEX("TAG", buffer, len, "value %d", 42);
+}
+
+void buffers_message_and_dump_are_one_binary_record()
+{
+    const char buffer[] = "The quick brown fox";
+    log_set_writev(log_writev);
+    // the header holds __FILE__, inline on the host, only dump the bytes that fit after it;
+    // with no room at all, the whole dump follows in one continuation record
+    s_raw_records.clear();
+    log_set_binary_writer(capture_raw_binary);
+    log_value_and_dump(buffer, 0);
+    TEST_ASSERT_EQUAL(1, s_raw_records.size());
+    size_t used = s_raw_records[0].size() + LOG_BINARY_DUMP_HEADER_SIZE;
+    size_t room = used < CONFIG_LOG_BINARY_RECORD_SIZE ? CONFIG_LOG_BINARY_RECORD_SIZE - used : 0;
+    uint16_t len = room && room < sizeof(buffer) ? room : sizeof(buffer);
+
+    s_records.clear();
+    log_set_binary_writer(capture_binary);
+    log_value_and_dump(buffer, len);
+    log_set_binary_writer(NULL);
+    log_set_writev(capture_writev);
+
+    TEST_ASSERT_EQUAL(room ? 1 : 2, s_records.size());
+    std::string records = join(s_records);
+    std::string dump = join(reference_hex(buffer, len));
+    size_t header_end = records.size() - dump.size();
+    TEST_ASSERT_EQUAL_STRING(dump.c_str(), records.c_str() + header_end);
+    TEST_ASSERT_TRUE(s_records[0].find("value 42") < header_end);
+}
+
+void buffers_binary_dump_is_raw_bytes()
+{
+    const char buffer[] = "The quick brown fox";
+    s_raw_records.clear();
+    log_set_binary_writer(capture_raw_binary);
+    log_set_writev(log_writev);
+    LOGE_BUFFER_HEXDUMP("TAG", buffer, sizeof(buffer), "value %d", 42);
+    log_set_binary_writer(NULL);
+    log_set_writev(capture_writev);
+
+    // the bytes are copied as they are, no line is formatted on the device
+    TEST_ASSERT_EQUAL(1, s_raw_records.size());
+    const std::string &record = s_raw_records[0];
+    TEST_ASSERT_EQUAL(LOG_ERROR | LOG_BINARY_RECORD_DUMP, (uint8_t)record[1]);
+    TEST_ASSERT_EQUAL(record.size() - sizeof(buffer), record.rfind(std::string(buffer, sizeof(buffer))));
+    TEST_ASSERT_TRUE(record.find("54 68 65") == std::string::npos);
+}
+
+void buffers_filtered_level_writes_nothing()
+{
+    s_lines.clear();
+    log_write_buffer_hexdump(LOG_VERBOSE, "TAG", s_all_bytes, sizeof(s_all_bytes));
+    LOGV_BUFFER_CHAR("TAG", s_all_bytes, sizeof(s_all_bytes), "hidden");
+
+    TEST_ASSERT_EQUAL(0, s_lines.size());
+}
+
+void run_all_tests()
+{
+    log_level_set("*", LOG_ERROR);
+    log_set_writev(capture_writev);
+
+    UNITY_BEGIN();
+    RUN_TEST(buffers_every_byte_value_matches_reference);
+    RUN_TEST(buffers_every_length_matches_reference);
+    RUN_TEST(buffers_unaligned_pointers_match_reference);
+    RUN_TEST(buffers_zero_byte_ends_char_line);
+    RUN_TEST(buffers_dump_is_one_message);
+    RUN_TEST(buffers_long_dump_is_split_between_lines);
+    RUN_TEST(buffers_binary_records_are_not_truncated);
+    RUN_TEST(buffers_message_and_dump_are_one_message);
+    RUN_TEST(buffers_clipped_message_keeps_its_line_end);
+    RUN_TEST(buffers_message_and_dump_are_one_binary_record);
+    RUN_TEST(buffers_binary_dump_is_raw_bytes);
+    RUN_TEST(buffers_filtered_level_writes_nothing);
+    UNITY_END();
+}
@@ -0,0 +1,264 @@
+#include <unity.h>
+
+#include "log.h"
+#include <stdio.h>
+#include <atomic>
+#include <thread>
+#include <vector>
+#ifdef __GLIBC__
+#include <malloc.h>
+#endif
+
+void setUp() {}
+void tearDown() {}
+
+void run_all_tests();
+
+#ifdef __cplusplus
+extern "C"
+{
+#endif
+
+#ifdef ESP_PLATFORM
+    void app_main()
+#elif defined(ARDUINO)
+void setup()
+#else
+int main(/*int argc, char * argv[]*/)
+#endif
+    {
+
+        run_all_tests();
+
+#ifdef ESP_PLATFORM
+#elif defined(ARDUINO)
+#else
+    return 0;
+#endif
+    }
+
+#ifdef ARDUINO
+    void loop()
+    {
+    }
+#endif
+#ifdef __cplusplus
+}
+#endif
+
+static const int READER_THREADS = 8;
+static const int READER_ITERATIONS = 100000;
+
+static std::atomic<uint32_t> s_emitted(0);
+
+int counting_vprintf(const char *format, va_list list)
+{
+    s_emitted.fetch_add(1, std::memory_order_relaxed);
+    return 0;
+}
+
+// keeps replacing the snapshot until the readers are done
+static void churn_levels(std::atomic<bool> *done, std::atomic<uint32_t> *updates)
+{
+    char tag[16];
+    uint32_t round = 0;
+    while (!done->load())
+    {
+        log_level_set("*", LOG_VERBOSE);
+        for (int i = 0; i < 32; i++)
+        {
+            snprintf(tag, sizeof(tag), "churn%d", i);
+            log_level_set(tag, (uint8_t)((round + i) % (LOG_VERBOSE + 1)));
+        }
+        log_level_set("flip", (round & 1) ? LOG_ERROR : LOG_VERBOSE);
+        updates->fetch_add(1);
+        round++;
+    }
+}
+
+void concurrency_readers_never_drop_while_levels_change()
+{
+    log_level_set("*", LOG_VERBOSE);
+    log_set_vprintf(counting_vprintf);
+    s_emitted = 0;
+
+    std::atomic<bool> done(false);
+    std::atomic<uint32_t> updates(0);
+    std::atomic<uint32_t> invisible(0);
+
+    std::thread writer(churn_levels, &done, &updates);
+
+    std::vector<std::thread> readers;
+    for (int t = 0; t < READER_THREADS; t++)
+    {
+        readers.emplace_back([&invisible]() {
+            for (int i = 0; i < READER_ITERATIONS; i++)
+            {
+                if (!is_tag_level_visible(LOG_INFO, "stable"))
+                {
+                    invisible.fetch_add(1);
+                }
+                LOGI("stable", "iteration %d", i);
+            }
+        });
+    }
+    for (auto &reader : readers)
+    {
+        reader.join();
+    }
+    done = true;
+    writer.join();
+
+    TEST_ASSERT_TRUE_MESSAGE(updates.load() > 0, "writer made progress");
+    TEST_ASSERT_EQUAL_MESSAGE(0, invisible.load(), "visibility never failed");
+    TEST_ASSERT_EQUAL_MESSAGE(READER_THREADS * READER_ITERATIONS, s_emitted.load(), "no message dropped");
+}
+
+void concurrency_readers_never_see_torn_level()
+{
+    log_level_set("*", LOG_VERBOSE);
+    log_set_vprintf(counting_vprintf);
+
+    std::atomic<bool> done(false);
+    std::atomic<uint32_t> updates(0);
+    std::atomic<uint32_t> invisible(0);
+
+    std::thread writer(churn_levels, &done, &updates);
+
+    std::vector<std::thread> readers;
+    for (int t = 0; t < READER_THREADS; t++)
+    {
+        readers.emplace_back([&invisible]() {
+            for (int i = 0; i < READER_ITERATIONS; i++)
+            {
+                // "flip" alternates between ERROR and VERBOSE, ERROR is visible in both
+                if (!is_tag_level_visible(LOG_ERROR, "flip"))
+                {
+                    invisible.fetch_add(1);
+                }
+            }
+        });
+    }
+    for (auto &reader : readers)
+    {
+        reader.join();
+    }
+    done = true;
+    writer.join();
+
+    TEST_ASSERT_TRUE_MESSAGE(updates.load() > 0, "writer made progress");
+    TEST_ASSERT_EQUAL_MESSAGE(0, invisible.load(), "level always consistent");
+}
+
+void concurrency_tag_cache_thrashing_returns_correct_levels()
+{
+    // more tags than cache entries, so readers keep replacing each other's entries
+    static char tags[256][16];
+    log_level_set("*", LOG_VERBOSE);
+    for (int i = 0; i < 256; i++)
+    {
+        snprintf(tags[i], sizeof(tags[i]), "fixed%d", i);
+        log_level_set(tags[i], (i & 1) ? LOG_WARN : LOG_ERROR);
+    }
+
+    std::atomic<bool> done(false);
+    std::atomic<uint32_t> updates(0);
+    std::atomic<uint32_t> wrong(0);
+
+    std::thread writer([&done, &updates]() {
+        uint32_t round = 0;
+        while (!done.load())
+        {
+            log_level_set("flip", (round++ & 1) ? LOG_ERROR : LOG_VERBOSE);
+            updates.fetch_add(1);
+        }
+    });
+
+    std::vector<std::thread> readers;
+    for (int t = 0; t < READER_THREADS; t++)
+    {
+        readers.emplace_back([&wrong, t]() {
+            for (int i = 0; i < READER_ITERATIONS; i++)
+            {
+                int index = (i * 7 + t * 31) & 255;
+                uint8_t level = (index & 1) ? LOG_WARN : LOG_ERROR;
+                if (!is_tag_level_visible(level, tags[index]) || is_tag_level_visible(level + 1, tags[index]))
+                {
+                    wrong.fetch_add(1);
+                }
+            }
+        });
+    }
+    for (auto &reader : readers)
+    {
+        reader.join();
+    }
+    done = true;
+    writer.join();
+
+    TEST_ASSERT_TRUE_MESSAGE(updates.load() > 0, "writer made progress");
+    TEST_ASSERT_EQUAL_MESSAGE(0, wrong.load(), "levels always correct");
+}
+
+void concurrency_replaced_tables_are_freed_under_reader_load()
+{
+    // readers keep missing the tag cache, so one of them always holds a table
+    static char tags[256][16];
+    log_level_set("*", LOG_VERBOSE);
+    for (int i = 0; i < 256; i++)
+    {
+        snprintf(tags[i], sizeof(tags[i]), "held%d", i);
+        log_level_set(tags[i], LOG_WARN);
+    }
+
+    std::atomic<bool> done(false);
+    std::atomic<uint32_t> lookups(0);
+    std::vector<std::thread> readers;
+    for (int t = 0; t < READER_THREADS; t++)
+    {
+        readers.emplace_back([&done, &lookups, t]() {
+            for (int i = 0; !done.load(std::memory_order_relaxed); i++)
+            {
+                is_tag_level_visible(LOG_WARN, tags[(i * 7 + t * 31) & 255]);
+                lookups.fetch_add(1, std::memory_order_relaxed);
+            }
+        });
+    }
+    while (lookups.load() < 1000)
+    {
+        std::this_thread::yield();
+    }
+
+#ifdef __GLIBC__
+    size_t before = mallinfo2().uordblks;
+#endif
+    for (int round = 0; round < 2000; round++)
+    {
+        log_level_set("flip", (round & 1) ? LOG_ERROR : LOG_VERBOSE);
+    }
+#ifdef __GLIBC__
+    // measured while the readers still run, every replaced table must be gone already
+    size_t after = mallinfo2().uordblks;
+    size_t growth = after > before ? after - before : 0;
+#endif
+    done = true;
+    for (auto &reader : readers)
+    {
+        reader.join();
+    }
+
+#ifdef __GLIBC__
+    TEST_ASSERT_TRUE_MESSAGE(growth < 64 * 1024, "replaced tables freed while readers are active");
+#endif
+    TEST_ASSERT_TRUE_MESSAGE(lookups.load() > 1000, "readers made progress");
+}
+
+void run_all_tests()
+{
+    UNITY_BEGIN();
+    RUN_TEST(concurrency_readers_never_drop_while_levels_change);
+    RUN_TEST(concurrency_readers_never_see_torn_level);
+    RUN_TEST(concurrency_tag_cache_thrashing_returns_correct_levels);
+    RUN_TEST(concurrency_replaced_tables_are_freed_under_reader_load);
+    UNITY_END();
+}
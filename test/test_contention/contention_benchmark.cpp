@@ -0,0 +1,211 @@
+#include <unity.h>
+
+#include "log.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+#include <algorithm>
+#include <atomic>
+#include <thread>
+#include <vector>
+
+void setUp() {}
+void tearDown() {}
+
+void run_all_tests();
+
+#ifdef __cplusplus
+extern "C"
+{
+#endif
+
+#ifdef ESP_PLATFORM
+    void app_main()
+#elif defined(ARDUINO)
+void setup()
+#else
+int main(/*int argc, char * argv[]*/)
+#endif
+    {
+
+        run_all_tests();
+
+#ifdef ESP_PLATFORM
+#elif defined(ARDUINO)
+#else
+    return 0;
+#endif
+    }
+
+#ifdef ARDUINO
+    void loop()
+    {
+    }
+#endif
+#ifdef __cplusplus
+}
+#endif
+
+#if defined(CONFIG_LOG_LINUX)
+static const char *PORT = "linux";
+#elif defined(CONFIG_LOG_PTHREADS)
+static const char *PORT = "pthreads";
+#elif defined(CONFIG_LOG_FREERTOS)
+static const char *PORT = "freertos";
+#else
+static const char *PORT = "noos";
+#endif
+
+static const int MAX_THREADS = 64;
+static const uint32_t MESSAGES = 400000;
+
+// half of the tags are enabled, the other half filtered out
+static const char *TAGS[] = {"enabled_a", "disabled_a", "enabled_b", "disabled_b"};
+
+static FILE *s_csv = NULL;
+
+static uint64_t now_ns()
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000ull + ts.tv_nsec;
+}
+
+int null_vprintf(const char *format, va_list list)
+{
+    return 0;
+}
+
+static void csv_line(const char *line)
+{
+    printf("%s", line);
+    if (s_csv)
+    {
+        fputs(line, s_csv);
+    }
+}
+
+static uint32_t percentile(std::vector<uint32_t> &latencies, double fraction)
+{
+    size_t index = std::min(latencies.size() - 1, (size_t)(latencies.size() * fraction));
+    std::nth_element(latencies.begin(), latencies.begin() + index, latencies.end());
+    return latencies[index];
+}
+
+// MESSAGES calls of log_write spread over the threads, the latency of every call is recorded
+static void run(const char *mode, int threads)
+{
+    std::vector<std::vector<uint32_t>> latencies(threads);
+    std::vector<std::thread> workers;
+    uint32_t per_thread = MESSAGES / threads;
+    uint32_t dropped_before = log_async_dropped();
+    std::atomic<int> ready(0);
+    std::atomic<bool> go(false);
+
+    for (int t = 0; t < threads; t++)
+    {
+        workers.emplace_back([&, t]() {
+            std::vector<uint32_t> &samples = latencies[t];
+            samples.reserve(per_thread);
+            ready.fetch_add(1);
+            while (!go.load())
+            {
+                std::this_thread::yield();
+            }
+            for (uint32_t i = 0; i < per_thread; i++)
+            {
+                const char *tag = TAGS[(i + t) & 3];
+                uint64_t start = now_ns();
+                log_write(LOG_INFO, tag, "thread %d message %u %s\n", t, i, tag);
+                samples.push_back((uint32_t)(now_ns() - start));
+            }
+        });
+    }
+    while (ready.load() < threads)
+    {
+        std::this_thread::yield();
+    }
+    uint64_t start = now_ns();
+    go = true;
+    for (auto &worker : workers)
+    {
+        worker.join();
+    }
+    log_flush();
+    double seconds = (now_ns() - start) / 1e9;
+
+    std::vector<uint32_t> all;
+    all.reserve(per_thread * threads);
+    for (auto &samples : latencies)
+    {
+        all.insert(all.end(), samples.begin(), samples.end());
+    }
+    char line[256];
+    snprintf(line, sizeof(line), "%s,%s,%d,%zu,%.4f,%.0f,%u,%u,%u,%u\n", PORT, mode, threads, all.size(), seconds,
+             all.size() / seconds, percentile(all, 0.50), percentile(all, 0.99), percentile(all, 0.999),
+             (unsigned)(log_async_dropped() - dropped_before));
+    csv_line(line);
+}
+
+void contention_scaling()
+{
+    const char *path = getenv("LOG_BENCHMARK_CSV");
+    s_csv = path ? fopen(path, "a") : NULL;
+    if (s_csv && ftell(s_csv) != 0)
+    {
+        // appending the results of another porting layer
+        printf("port,mode,threads,calls,seconds,calls_per_second,p50_ns,p99_ns,p999_ns,dropped\n");
+    }
+    else
+    {
+        csv_line("port,mode,threads,calls,seconds,calls_per_second,p50_ns,p99_ns,p999_ns,dropped\n");
+    }
+
+    vprintf_like_t original = log_set_vprintf(null_vprintf);
+    log_level_set("*", LOG_INFO);
+    log_level_set("disabled_a", LOG_WARN);
+    log_level_set("disabled_b", LOG_WARN);
+
+    for (int threads = 1; threads <= MAX_THREADS; threads *= 2)
+    {
+        run("sync", threads);
+    }
+
+    // lock-free ring, without a background writer a thread drains it like the main loop would
+    bool writer_running = log_async_start();
+    std::atomic<bool> done(false);
+    std::thread flusher;
+    if (!writer_running)
+    {
+        flusher = std::thread([&done]() {
+            while (!done.load())
+            {
+                log_flush();
+                std::this_thread::yield();
+            }
+        });
+    }
+    for (int threads = 1; threads <= MAX_THREADS; threads *= 2)
+    {
+        run("async", threads);
+    }
+    done = true;
+    if (flusher.joinable())
+    {
+        flusher.join();
+    }
+    log_async_stop();
+    log_set_vprintf(original);
+
+    if (s_csv)
+    {
+        fclose(s_csv);
+    }
+}
+
+void run_all_tests()
+{
+    UNITY_BEGIN();
+    RUN_TEST(contention_scaling);
+    UNITY_END();
+}
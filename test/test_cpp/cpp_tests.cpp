@@ -0,0 +1,240 @@
+#include <unity.h>
+
+#include "log.hpp"
+#include <limits.h>
+#include <stdarg.h>
+#include <stdio.h>
+#include <string.h>
+#include <string>
+#include <vector>
+
+void setUp() {}
+void tearDown() {}
+
+void run_all_tests();
+
+#ifdef __cplusplus
+extern "C"
+{
+#endif
+
+#ifdef ESP_PLATFORM
+    void app_main()
+#elif defined(ARDUINO)
+void setup()
+#else
+int main(/*int argc, char * argv[]*/)
+#endif
+    {
+
+        run_all_tests();
+
+#ifdef ESP_PLATFORM
+#elif defined(ARDUINO)
+#else
+    return 0;
+#endif
+    }
+
+#ifdef ARDUINO
+    void loop()
+    {
+    }
+#endif
+#ifdef __cplusplus
+}
+#endif
+
+static std::vector<std::string> s_output;
+
+static int capture_vprintf(const char *format, va_list args)
+{
+    char text[512];
+    int length = vsnprintf(text, sizeof(text), format, args);
+    s_output.push_back(text);
+    return length;
+}
+
+static std::vector<uint8_t> s_binary_output;
+
+static void capture_binary(const uint8_t *data, size_t length)
+{
+    s_binary_output.insert(s_binary_output.end(), data, data + length);
+}
+
+static std::string expected(const char *format, ...)
+{
+    va_list list;
+    va_start(list, format);
+    char text[512];
+    int text_len = vsnprintf(text, sizeof(text), format, list);
+    va_end(list);
+    return std::string(text, text_len);
+}
+
+static std::vector<uint8_t> encode(const char *format, ...)
+{
+    va_list list;
+    va_start(list, format);
+    uint8_t record[CONFIG_LOG_BINARY_RECORD_SIZE];
+    size_t length = log_binary_encode(record, sizeof(record), LOG_INFO, 0, "cpp", format, list);
+    va_end(list);
+    return std::vector<uint8_t>(record, record + length);
+}
+
+#define TEST_CPP_TEXT(format, ...)                                                               \
+    do                                                                                           \
+    {                                                                                            \
+        s_output.clear();                                                                        \
+        chiplogger::write<LOG_INFO>(LOG_CPP_FORMAT(format), "cpp", ##__VA_ARGS__);               \
+        TEST_ASSERT_EQUAL_MESSAGE(1, s_output.size(), format);                                   \
+        TEST_ASSERT_EQUAL_STRING_MESSAGE(expected(format, ##__VA_ARGS__).c_str(),                \
+                                         s_output[0].c_str(), format);                           \
+    } while (0)
+
+// records are compared without their timestamp, bytes 4 to 11
+#define TEST_CPP_RECORD(format, ...)                                                             \
+    do                                                                                           \
+    {                                                                                            \
+        s_binary_output.clear();                                                                 \
+        chiplogger::write<LOG_INFO>(LOG_CPP_FORMAT(format), "cpp", ##__VA_ARGS__);               \
+        std::vector<uint8_t> record = encode(format, ##__VA_ARGS__);                             \
+        TEST_ASSERT_TRUE_MESSAGE(record.size() > 0, format);                                     \
+        TEST_ASSERT_EQUAL_MESSAGE(record.size(), s_binary_output.size(), format);                \
+        memset(record.data() + 4, 0, 8);                                                         \
+        memset(s_binary_output.data() + 4, 0, 8);                                                \
+        TEST_ASSERT_EQUAL_MEMORY_MESSAGE(record.data(), s_binary_output.data(), record.size(), format);     \
+    } while (0)
+
+#define ACCEPTS(format, ...)                                                                     \
+    [] {                                                                                         \
+        auto log_format = LOG_CPP_FORMAT(format);                                                \
+        return chiplogger::format_accepts<decltype(log_format), ##__VA_ARGS__>();                \
+    }()
+
+enum color_t
+{
+    RED,
+    GREEN,
+};
+
+void cpp_text_matches_printf()
+{
+    vprintf_like_t original = log_set_vprintf(capture_vprintf);
+    const char *null_string = NULL;
+    char name[] = "mutable";
+
+    TEST_CPP_TEXT("no conversions\n");
+    TEST_CPP_TEXT("%d %i %u %x %X\n", -42, INT_MIN, 42u, 0xbeefu, 0xBEEFu);
+    TEST_CPP_TEXT("%ld %lu %lld %llu %llx\n", LONG_MIN, ULONG_MAX, LLONG_MIN, ULLONG_MAX, 1ULL << 40);
+    TEST_CPP_TEXT("%zu %td %jd %hhd %hu %o\n", sizeof(name), (ptrdiff_t)-3, (intmax_t)-7, 300, 70000, 8);
+    TEST_CPP_TEXT("%c%c %s %s %s|\n", 'o', 'k', "text", name, null_string);
+    TEST_CPP_TEXT("%5d|%-5d|%05d|%+d|%#x|% d\n", 42, 42, -42, 42, 255u, 7);
+    TEST_CPP_TEXT("%.2f %e %g %10.3f %Lf\n", 3.14159, 1e-10, 0.5f, -2.5, 1.5L);
+    TEST_CPP_TEXT("%.3s|%8s|%-8s|%*d|%.*s|%*.*s\n", "truncated", "right", "left", 6, 42, 2, "precision", 6, 3, "both");
+    TEST_CPP_TEXT("%p %p\n", (void *)&original, nullptr);
+    TEST_CPP_TEXT("%d%% done, %s\n", 100, "100%");
+    TEST_CPP_TEXT("%d %u %c\n", GREEN, true, (uint8_t)'A');
+    TEST_CPP_TEXT("%d %d\n", (int16_t)-1, (uint16_t)65535);
+
+    log_set_vprintf(original);
+}
+
+void cpp_records_match_log_binary_encode()
+{
+    log_set_binary_writer(capture_binary);
+    const char *null_string = NULL;
+
+    TEST_CPP_RECORD("no conversions\n");
+    TEST_CPP_RECORD("%d %i %u %x %X\n", -42, INT_MIN, 42u, 0xbeefu, 0xBEEFu);
+    TEST_CPP_RECORD("%ld %lu %lld %llu %llx\n", LONG_MIN, ULONG_MAX, LLONG_MIN, ULLONG_MAX, 1ULL << 40);
+    TEST_CPP_RECORD("%zu %td %jd %hhd %hu %o\n", sizeof(int), (ptrdiff_t)-3, (intmax_t)-7, 300, 70000, 8);
+    TEST_CPP_RECORD("%c%c %s %s|\n", 'o', 'k', "text", null_string);
+    TEST_CPP_RECORD("%.2f %e %g %Lf\n", 3.14159, 1e-10, 0.5f, 1.5L);
+    TEST_CPP_RECORD("%.3s|%*d|%.*s|%*.*s\n", "truncated", 6, 42, 2, "precision", 6, 3, "both");
+    TEST_CPP_RECORD("%p %p\n", (void *)&null_string, nullptr);
+    TEST_CPP_RECORD("%d%% %5%\n", 100);
+
+    log_set_binary_writer(NULL);
+}
+
+void cpp_formats_are_checked_at_compile_time()
+{
+    static_assert(ACCEPTS("%d %s %c %f", int, const char *, char, double));
+    static_assert(ACCEPTS("%hhd %hd %u %x", int8_t, short, unsigned, uint16_t));
+    static_assert(ACCEPTS("%lu %llu %zu %jd", unsigned long, unsigned long long, size_t, intmax_t));
+    static_assert(ACCEPTS("%s %s", char *, const char (&)[4]));
+    static_assert(ACCEPTS("%*.*s", int, int, const char *));
+    static_assert(ACCEPTS("%p %p %p", void *, const int *, std::nullptr_t));
+    static_assert(ACCEPTS("%Lf %f", long double, float));
+    static_assert(ACCEPTS("%d %%", color_t));
+    // the system time of CONFIG_LOG_TIMESTAMP_SOURCE_SYSTEM is a string
+    static_assert(ACCEPTS(LOG_SYSTEM_TIME_FORMAT(I, "%d"), decltype(log_system_timestamp()), const char *,
+                          decltype(LOG_VALUE_FILENAME), decltype(LOG_VALUE_LINE), decltype(LOG_VALUE_FUNCTION_NAME), int));
+
+    static_assert(!ACCEPTS("%d"), "missing argument");
+    static_assert(!ACCEPTS("%d", int, int), "extra argument");
+    static_assert(!ACCEPTS("%d", const char *), "string for an integer");
+    static_assert(!ACCEPTS("%d", double), "float for an integer");
+    static_assert(!ACCEPTS("%d", long long), "integer wider than the conversion");
+    static_assert(!ACCEPTS("%lld", int), "integer narrower than the conversion");
+    static_assert(!ACCEPTS("%s", int), "integer for a string");
+    static_assert(!ACCEPTS("%s", std::string), "object for a string");
+    static_assert(!ACCEPTS("%f", int), "integer for a float");
+    static_assert(!ACCEPTS("%f", long double), "long double without L");
+    static_assert(!ACCEPTS("%p", int), "integer for a pointer");
+    static_assert(!ACCEPTS("%*d", long long, int), "wide width");
+    static_assert(!ACCEPTS("%n", int *), "n is not supported");
+    static_assert(!ACCEPTS("%ls", const wchar_t *), "wide strings are not supported");
+    static_assert(!ACCEPTS("%y", int), "unknown conversion");
+    TEST_ASSERT_FALSE(ACCEPTS("%u", unsigned long long));
+}
+
+void cpp_macros_write_like_c_macros()
+{
+    log_level_set("*", LOG_VERBOSE);
+    log_level_set("quiet", LOG_WARN);
+    vprintf_like_t original = log_set_vprintf(capture_vprintf);
+    s_output.clear();
+
+    LOGI("cpp", "value %d of %s", 7, "seven");
+    LOGI_CPP("cpp", "value %d of %s", 7, "seven");
+    LOGI_CPP("quiet", "hidden %d", 1);
+    LOGW_CPP("quiet", "shown");
+
+    log_set_vprintf(original);
+
+    TEST_ASSERT_EQUAL(3, s_output.size());
+    // the timestamp and the line differ
+    TEST_ASSERT_EQUAL_STRING(strchr(s_output[0].c_str(), ']'), strchr(s_output[1].c_str(), ']'));
+    TEST_ASSERT_EQUAL(0, strncmp(s_output[0].c_str(), s_output[1].c_str(), 4));
+    TEST_ASSERT_TRUE(s_output[2].find("quiet") != std::string::npos);
+    TEST_ASSERT_TRUE(s_output[2].find("shown") != std::string::npos);
+}
+
+void cpp_async_writes_one_entry()
+{
+    log_level_set("*", LOG_VERBOSE);
+    vprintf_like_t original = log_set_vprintf(capture_vprintf);
+    s_output.clear();
+
+    log_async_start();
+    chiplogger::write<LOG_INFO>(LOG_CPP_FORMAT("%s %d %.1f|%5s\n"), "cpp", "async", -1, 2.5, "pad");
+    log_flush();
+    log_async_stop();
+    log_set_vprintf(original);
+
+    TEST_ASSERT_EQUAL(1, s_output.size());
+    TEST_ASSERT_EQUAL_STRING("async -1 2.5|  pad\n", s_output[0].c_str());
+}
+
+void run_all_tests()
+{
+    UNITY_BEGIN();
+    RUN_TEST(cpp_text_matches_printf);
+    RUN_TEST(cpp_records_match_log_binary_encode);
+    RUN_TEST(cpp_formats_are_checked_at_compile_time);
+    RUN_TEST(cpp_macros_write_like_c_macros);
+    RUN_TEST(cpp_async_writes_one_entry);
+    UNITY_END();
+}
@@ -0,0 +1,187 @@
+#include <unity.h>
+
+#include "log.h"
+#include <stdarg.h>
+#include <stdio.h>
+#include <string.h>
+#include <string>
+#include <vector>
+
+void setUp() {}
+void tearDown() {}
+
+void run_all_tests();
+
+#ifdef __cplusplus
+extern "C"
+{
+#endif
+
+#ifdef ESP_PLATFORM
+    void app_main()
+#elif defined(ARDUINO)
+void setup()
+#else
+int main(/*int argc, char * argv[]*/)
+#endif
+    {
+
+        run_all_tests();
+
+#ifdef ESP_PLATFORM
+#elif defined(ARDUINO)
+#else
+    return 0;
+#endif
+    }
+
+#ifdef ARDUINO
+    void loop()
+    {
+    }
+#endif
+#ifdef __cplusplus
+}
+#endif
+
+static std::vector<std::string> s_output;
+
+static int capture_vprintf(const char *format, va_list args)
+{
+    char text[256];
+    int length = vsnprintf(text, sizeof(text), format, args);
+    s_output.push_back(text);
+    return length;
+}
+
+static vprintf_like_t s_original;
+
+static void start_capture(uint32_t timeout_ms)
+{
+    log_level_set("*", LOG_VERBOSE);
+    log_dedup_set(timeout_ms);
+    s_original = log_set_vprintf(capture_vprintf);
+    s_output.clear();
+}
+
+static void stop_capture()
+{
+    log_dedup_set(0);
+    log_set_vprintf(s_original);
+}
+
+static bool output_contains(size_t index, const char *text)
+{
+    return index < s_output.size() && s_output[index].find(text) != std::string::npos;
+}
+
+void dedup_collapses_a_run()
+{
+    start_capture(3600000);
+    for (int i = 0; i < 5; i++)
+    {
+        LOGW("dedup", "retry %d failed", 7);
+    }
+    LOGI("dedup", "connected");
+    stop_capture();
+
+    TEST_ASSERT_EQUAL(3, s_output.size());
+    TEST_ASSERT_TRUE(output_contains(0, "retry 7 failed"));
+    TEST_ASSERT_TRUE(output_contains(1, "W ("));
+    TEST_ASSERT_TRUE(output_contains(1, "dedup: last message repeated 4 times"));
+    TEST_ASSERT_TRUE(output_contains(2, "connected"));
+}
+
+void dedup_compares_arguments()
+{
+    char name[8] = "first";
+    start_capture(3600000);
+    for (int i = 0; i < 3; i++)
+    {
+        LOGI("dedup", "attempt %d", i);
+    }
+    for (int i = 0; i < 2; i++)
+    {
+        // same pointer, other characters
+        LOGI("dedup", "name %s", name);
+        strcpy(name, "second");
+    }
+    LOGI("dedup", "%.1f", 1.5);
+    LOGI("dedup", "%.1f", 2.5);
+    stop_capture();
+
+    TEST_ASSERT_EQUAL(7, s_output.size());
+    TEST_ASSERT_TRUE(output_contains(4, "name second"));
+}
+
+void dedup_summarizes_long_runs_every_timeout()
+{
+    start_capture(20);
+    for (int i = 0; i < 7; i++)
+    {
+        if (i == 3)
+        {
+            uint32_t start = log_timestamp();
+            while (log_timestamp() - start < 30)
+            {
+            }
+        }
+        LOGE("dedup", "sensor stuck");
+    }
+    log_dedup_flush();
+    LOGE("dedup", "sensor stuck");
+    stop_capture();
+
+    TEST_ASSERT_EQUAL(4, s_output.size());
+    TEST_ASSERT_TRUE(output_contains(0, "sensor stuck"));
+    TEST_ASSERT_TRUE(output_contains(1, "last message repeated 3 times"));
+    TEST_ASSERT_TRUE(output_contains(2, "last message repeated 3 times"));
+    // a flush ends the run
+    TEST_ASSERT_TRUE(output_contains(3, "sensor stuck"));
+}
+
+void dedup_summarizes_a_run_that_ends_in_silence()
+{
+    start_capture(20);
+    for (int i = 0; i < 5; i++)
+    {
+        LOGW("dedup", "retry failed");
+    }
+    log_dedup_poll();
+    TEST_ASSERT_EQUAL(1, s_output.size());
+
+    uint32_t start = log_timestamp();
+    while (log_timestamp() - start < 30)
+    {
+    }
+    log_dedup_poll();
+    TEST_ASSERT_EQUAL(2, s_output.size());
+    TEST_ASSERT_TRUE(output_contains(1, "last message repeated 4 times"));
+    // summarized once
+    log_dedup_poll();
+    stop_capture();
+    TEST_ASSERT_EQUAL(2, s_output.size());
+}
+
+void dedup_is_off_by_default()
+{
+    start_capture(0);
+    for (int i = 0; i < 3; i++)
+    {
+        LOGI("dedup", "same");
+    }
+    stop_capture();
+
+    TEST_ASSERT_EQUAL(3, s_output.size());
+}
+
+void run_all_tests()
+{
+    UNITY_BEGIN();
+    RUN_TEST(dedup_collapses_a_run);
+    RUN_TEST(dedup_compares_arguments);
+    RUN_TEST(dedup_summarizes_long_runs_every_timeout);
+    RUN_TEST(dedup_summarizes_a_run_that_ends_in_silence);
+    RUN_TEST(dedup_is_off_by_default);
+    UNITY_END();
+}
@@ -0,0 +1,242 @@
+#include <unity.h>
+
+#include "log.h"
+#include "log_file.h"
+#include "log_binary.h"
+#include <stdio.h>
+#include <string.h>
+#include <unistd.h>
+#include <string>
+#include <thread>
+#include <vector>
+
+void setUp() {}
+void tearDown() {}
+
+void run_all_tests();
+
+#ifdef __cplusplus
+extern "C"
+{
+#endif
+
+#ifdef ESP_PLATFORM
+    void app_main()
+#elif defined(ARDUINO)
+void setup()
+#else
+int main(/*int argc, char * argv[]*/)
+#endif
+    {
+
+        run_all_tests();
+
+#ifdef ESP_PLATFORM
+#elif defined(ARDUINO)
+#else
+    return 0;
+#endif
+    }
+
+#ifdef ARDUINO
+    void loop()
+    {
+    }
+#endif
+#ifdef __cplusplus
+}
+#endif
+
+static const char *PATH = "/tmp/chiplogger_test_file.log";
+
+static std::string file_name(unsigned index)
+{
+    return index ? std::string(PATH) + "." + std::to_string(index) : std::string(PATH);
+}
+
+static void remove_files()
+{
+    for (unsigned i = 0; i < 8; i++)
+    {
+        unlink(file_name(i).c_str());
+    }
+}
+
+static bool read_file(unsigned index, std::string *content)
+{
+    FILE *file = fopen(file_name(index).c_str(), "rb");
+    if (!file)
+    {
+        return false;
+    }
+    content->clear();
+    char chunk[4096];
+    size_t read;
+    while ((read = fread(chunk, 1, sizeof(chunk), file)) > 0)
+    {
+        content->append(chunk, read);
+    }
+    fclose(file);
+    return true;
+}
+
+static size_t count_lines(const std::string &content)
+{
+    size_t lines = 0;
+    for (char c : content)
+    {
+        lines += c == '\n';
+    }
+    return lines;
+}
+
+void file_is_truncated_to_its_messages()
+{
+    remove_files();
+    log_level_set("*", LOG_VERBOSE);
+    TEST_ASSERT_TRUE(log_file_open(PATH, 65536, 2));
+    vprintf_like_t original = log_set_vprintf(log_file_vprintf);
+    LOGI("file", "first %d", 1);
+    LOGW("file", "second %s", "message");
+    log_file_sync(true);
+    log_set_vprintf(original);
+    log_file_close();
+
+    std::string content;
+    TEST_ASSERT_TRUE(read_file(0, &content));
+    TEST_ASSERT_EQUAL(2, count_lines(content));
+    TEST_ASSERT_EQUAL('\n', content.back());
+    TEST_ASSERT_TRUE(content.find("first 1") != std::string::npos);
+    TEST_ASSERT_TRUE(content.find("second message") != std::string::npos);
+    remove_files();
+}
+
+void file_rotates_by_size()
+{
+    remove_files();
+    TEST_ASSERT_TRUE(log_file_open(PATH, 1024, 3));
+    char line[64];
+    for (int i = 0; i < 100; i++)
+    {
+        int length = snprintf(line, sizeof(line), "line %04d of the rotation test.\n", i);
+        log_file_write((const uint8_t *)line, length);
+    }
+    log_file_close();
+
+    // 3200 bytes, 32 lines a file, the oldest ones are gone
+    std::string content[3];
+    for (unsigned i = 0; i < 3; i++)
+    {
+        TEST_ASSERT_TRUE(read_file(i, &content[i]));
+        TEST_ASSERT_TRUE(content[i].size() <= 1024);
+        TEST_ASSERT_EQUAL(0, content[i].size() % 32);
+    }
+    TEST_ASSERT_FALSE(read_file(3, &content[0]));
+    TEST_ASSERT_TRUE(content[0].find("line 0099") != std::string::npos);
+    TEST_ASSERT_EQUAL(0, content[1].find("line 0064"));
+    TEST_ASSERT_EQUAL(0, content[2].find("line 0032"));
+    remove_files();
+}
+
+void file_keeps_every_message_of_concurrent_writers()
+{
+    static const int THREADS = 8;
+    static const int MESSAGES = 5000;
+    remove_files();
+    TEST_ASSERT_TRUE(log_file_open(PATH, 256 * 1024, 8));
+
+    std::vector<std::thread> threads;
+    for (int t = 0; t < THREADS; t++)
+    {
+        threads.emplace_back([t]() {
+            char line[64];
+            for (int i = 0; i < MESSAGES; i++)
+            {
+                int length = snprintf(line, sizeof(line), "thread %d message %05d\n", t, i);
+                log_file_write((const uint8_t *)line, length);
+            }
+        });
+    }
+    for (auto &thread : threads)
+    {
+        thread.join();
+    }
+    log_file_close();
+
+    // 40000 lines of 23 bytes fill 4 files, no line is torn or lost
+    size_t lines = 0;
+    std::string content;
+    for (unsigned i = 0; i < 8 && read_file(i, &content); i++)
+    {
+        TEST_ASSERT_EQUAL(0, content.size() % 23);
+        int thread;
+        int message;
+        for (size_t at = 0; at < content.size(); at += 23)
+        {
+            TEST_ASSERT_EQUAL(2, sscanf(content.c_str() + at, "thread %d message %05d\n", &thread, &message));
+        }
+        lines += count_lines(content);
+    }
+    TEST_ASSERT_EQUAL(THREADS * MESSAGES, lines);
+    remove_files();
+}
+
+void file_rotation_repeats_the_binary_stream_header()
+{
+    remove_files();
+    log_level_set("*", LOG_VERBOSE);
+    TEST_ASSERT_TRUE(log_file_open(PATH, 512, 2));
+    log_binary_writer_t original = log_set_binary_writer(log_file_write);
+    for (int i = 0; i < 20; i++)
+    {
+        LOGI("file", "binary %d", i);
+    }
+    log_set_binary_writer(original);
+    log_file_close();
+
+    std::string content;
+    for (unsigned i = 0; i < 2; i++)
+    {
+        TEST_ASSERT_TRUE(read_file(i, &content));
+        TEST_ASSERT_EQUAL(0, content.find("CLOG"));
+    }
+    remove_files();
+}
+
+void file_drops_a_record_larger_than_a_file_after_its_header()
+{
+    remove_files();
+    TEST_ASSERT_TRUE(log_file_open(PATH, 512, 2));
+    uint8_t header[LOG_BINARY_STREAM_HEADER_SIZE];
+    log_binary_stream_header(header);
+    log_file_write(header, sizeof(header));
+    uint8_t record[512 - LOG_BINARY_STREAM_HEADER_SIZE + 1];
+    memset(record, 'r', sizeof(record));
+    // fits the first file, then no file after its stream header: dropped instead of rotating forever
+    log_file_write(record, sizeof(record) - 1);
+    log_file_write(record, sizeof(record));
+    log_file_write((const uint8_t *)"last", 4);
+    log_file_close();
+
+    std::string content;
+    TEST_ASSERT_TRUE(read_file(1, &content));
+    TEST_ASSERT_EQUAL(512, content.size());
+    TEST_ASSERT_TRUE(read_file(0, &content));
+    TEST_ASSERT_EQUAL(LOG_BINARY_STREAM_HEADER_SIZE + 4, content.size());
+    TEST_ASSERT_EQUAL(0, content.find("CLOG"));
+    TEST_ASSERT_EQUAL(LOG_BINARY_STREAM_HEADER_SIZE, content.find("last"));
+    remove_files();
+}
+
+void run_all_tests()
+{
+    UNITY_BEGIN();
+#ifdef __linux__
+    RUN_TEST(file_is_truncated_to_its_messages);
+    RUN_TEST(file_rotates_by_size);
+    RUN_TEST(file_keeps_every_message_of_concurrent_writers);
+    RUN_TEST(file_rotation_repeats_the_binary_stream_header);
+    RUN_TEST(file_drops_a_record_larger_than_a_file_after_its_header);
+#endif
+    UNITY_END();
+}
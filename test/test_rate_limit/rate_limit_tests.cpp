@@ -0,0 +1,178 @@
+#include <unity.h>
+
+#include "log.h"
+#include <stdarg.h>
+#include <stdio.h>
+#include <string.h>
+#include <atomic>
+#include <chrono>
+#include <string>
+#include <thread>
+#include <vector>
+
+void setUp() {}
+void tearDown() {}
+
+void run_all_tests();
+
+#ifdef __cplusplus
+extern "C"
+{
+#endif
+
+#ifdef ESP_PLATFORM
+    void app_main()
+#elif defined(ARDUINO)
+void setup()
+#else
+int main(/*int argc, char * argv[]*/)
+#endif
+    {
+
+        run_all_tests();
+
+#ifdef ESP_PLATFORM
+#elif defined(ARDUINO)
+#else
+    return 0;
+#endif
+    }
+
+#ifdef ARDUINO
+    void loop()
+    {
+    }
+#endif
+#ifdef __cplusplus
+}
+#endif
+
+static std::vector<std::string> s_output;
+
+static int capture_vprintf(const char *format, va_list args)
+{
+    char text[256];
+    int length = vsnprintf(text, sizeof(text), format, args);
+    s_output.push_back(text);
+    return length;
+}
+
+static const uint32_t HOUR_MS = 3600000;
+
+void rate_limit_allows_burst_then_rate()
+{
+    log_rate_limit_t limit = LOG_RATE_LIMIT_INITIALIZER(2, HOUR_MS, 3);
+    uint32_t suppressed = 0;
+    for (int i = 0; i < 3; i++)
+    {
+        TEST_ASSERT_TRUE(log_rate_limit_take(&limit, &suppressed));
+        TEST_ASSERT_EQUAL(0, suppressed);
+    }
+    for (int i = 0; i < 5; i++)
+    {
+        TEST_ASSERT_FALSE(log_rate_limit_take(&limit, &suppressed));
+    }
+
+    // half an interval later one token is back, at 2 messages per interval
+    limit.tat -= HOUR_MS;
+    TEST_ASSERT_TRUE(log_rate_limit_take(&limit, &suppressed));
+    TEST_ASSERT_EQUAL(5, suppressed);
+    TEST_ASSERT_FALSE(log_rate_limit_take(&limit, &suppressed));
+}
+
+void rate_limit_refills_after_a_timestamp_wrap()
+{
+    log_rate_limit_t limit = LOG_RATE_LIMIT_INITIALIZER(1, HOUR_MS, 1);
+    uint32_t suppressed;
+    TEST_ASSERT_TRUE(log_rate_limit_take(&limit, &suppressed));
+    TEST_ASSERT_FALSE(log_rate_limit_take(&limit, &suppressed));
+    // a bucket can not be that far ahead, the timestamp wrapped while it was idle
+    limit.tat += 0x80000000u;
+    TEST_ASSERT_TRUE(log_rate_limit_take(&limit, &suppressed));
+    TEST_ASSERT_EQUAL(1, suppressed);
+}
+
+void rate_limit_is_exact_under_contention()
+{
+    static const int THREADS = 8;
+    static const int ATTEMPTS = 20000;
+    log_rate_limit_t limit = LOG_RATE_LIMIT_INITIALIZER(1, HOUR_MS, 100);
+    std::atomic<int> taken(0);
+    std::vector<std::thread> threads;
+    for (int t = 0; t < THREADS; t++)
+    {
+        threads.emplace_back([&]() {
+            uint32_t suppressed;
+            for (int i = 0; i < ATTEMPTS; i++)
+            {
+                taken += log_rate_limit_take(&limit, &suppressed);
+            }
+        });
+    }
+    for (auto &thread : threads)
+    {
+        thread.join();
+    }
+    TEST_ASSERT_EQUAL(100, taken.load());
+    TEST_ASSERT_EQUAL(THREADS * ATTEMPTS - 100, limit.suppressed);
+}
+
+void rate_macros_write_a_suppressed_count()
+{
+    log_level_set("*", LOG_VERBOSE);
+    vprintf_like_t original = log_set_vprintf(capture_vprintf);
+    s_output.clear();
+
+    int evaluated = 0;
+    for (int i = 0; i < 11; i++)
+    {
+        if (i == 10)
+        {
+            // the bucket of the callsite refills one message every 50 ms
+            std::this_thread::sleep_for(std::chrono::milliseconds(60));
+        }
+        LOGW_RATE("rate", 1, 50, 2, "message %d", ++evaluated);
+    }
+
+    log_set_vprintf(original);
+
+    // suppressed messages do not evaluate their arguments
+    TEST_ASSERT_EQUAL(3, evaluated);
+    TEST_ASSERT_EQUAL(4, s_output.size());
+    TEST_ASSERT_TRUE(s_output[0].find("message 1") != std::string::npos);
+    TEST_ASSERT_TRUE(s_output[1].find("message 2") != std::string::npos);
+    TEST_ASSERT_TRUE(s_output[2].find("W (") != std::string::npos);
+    TEST_ASSERT_TRUE(s_output[2].find("suppressed 8 messages") != std::string::npos);
+    TEST_ASSERT_TRUE(s_output[3].find("message 3") != std::string::npos);
+}
+
+static log_rate_limit_t s_driver_limit = LOG_RATE_LIMIT_INITIALIZER(1, HOUR_MS, 2);
+
+void limit_macros_share_a_bucket()
+{
+    log_level_set("*", LOG_VERBOSE);
+    log_level_set("quiet", LOG_ERROR);
+    vprintf_like_t original = log_set_vprintf(capture_vprintf);
+    s_output.clear();
+
+    LOGW_LIMIT(&s_driver_limit, "quiet", "hidden messages do not take tokens");
+    LOGW_LIMIT(&s_driver_limit, "driver", "first");
+    LOGE_LIMIT(&s_driver_limit, "driver", "second");
+    LOGI_LIMIT(&s_driver_limit, "driver", "third");
+
+    log_set_vprintf(original);
+
+    TEST_ASSERT_EQUAL(2, s_output.size());
+    TEST_ASSERT_EQUAL(1, s_driver_limit.suppressed);
+}
+
+void run_all_tests()
+{
+    UNITY_BEGIN();
+    RUN_TEST(rate_limit_allows_burst_then_rate);
+    RUN_TEST(rate_limit_refills_after_a_timestamp_wrap);
+    RUN_TEST(rate_limit_is_exact_under_contention);
+    RUN_TEST(rate_macros_write_a_suppressed_count);
+    RUN_TEST(limit_macros_share_a_bucket);
+    UNITY_END();
+}
@@ -0,0 +1,282 @@
+#include <unity.h>
+
+#include "log.hpp"
+#include "log_binary.h"
+#include <stdio.h>
+#include <string.h>
+#include <string>
+#include <thread>
+#include <vector>
+#ifdef __linux__
+#include <fcntl.h>
+#include <signal.h>
+#include <unistd.h>
+#include <sys/wait.h>
+#endif
+
+void setUp() {}
+void tearDown() {}
+
+void run_all_tests();
+
+#ifdef __cplusplus
+extern "C"
+{
+#endif
+
+#ifdef ESP_PLATFORM
+    void app_main()
+#elif defined(ARDUINO)
+void setup()
+#else
+int main(/*int argc, char * argv[]*/)
+#endif
+    {
+
+        run_all_tests();
+
+#ifdef ESP_PLATFORM
+#elif defined(ARDUINO)
+#else
+    return 0;
+#endif
+    }
+
+#ifdef ARDUINO
+    void loop()
+    {
+    }
+#endif
+#ifdef __cplusplus
+}
+#endif
+
+static std::vector<std::string> s_drained;
+static log_binary_stream_t s_stream;
+static int s_output_count = 0;
+
+static const char *resolve_pointer(void *context, uint64_t address)
+{
+    return (const char *)(uintptr_t)address;
+}
+
+static void drain_writer(const uint8_t *data, size_t length)
+{
+    if (length == LOG_BINARY_STREAM_HEADER_SIZE && memcmp(data, "CLOG", 4) == 0)
+    {
+        TEST_ASSERT_TRUE(log_binary_parse_stream_header(data, length, &s_stream));
+        return;
+    }
+    log_binary_record_t record;
+    TEST_ASSERT_EQUAL(length, log_binary_parse_record(data, length, &s_stream, resolve_pointer, NULL, &record));
+    char text[256];
+    TEST_ASSERT_TRUE(log_binary_format(&record, &s_stream, resolve_pointer, NULL, text, sizeof(text)) > 0);
+    s_drained.push_back(text);
+}
+
+static size_t drain()
+{
+    s_drained.clear();
+    return log_recorder_drain(drain_writer);
+}
+
+static int counting_vprintf(const char *format, va_list args)
+{
+    s_output_count++;
+    return 0;
+}
+
+// number following "number " in a drained message, -1 if none
+static int number_of(const std::string &text)
+{
+    size_t at = text.find("number ");
+    return at == std::string::npos ? -1 : atoi(text.c_str() + at + 7);
+}
+
+void recorder_keeps_hidden_messages()
+{
+    log_level_set("*", LOG_INFO);
+    vprintf_like_t original = log_set_vprintf(counting_vprintf);
+    s_output_count = 0;
+    TEST_ASSERT_TRUE(log_recorder_start(LOG_VERBOSE));
+    LOGV("recorder", "hidden %d", 1);
+    LOGI("recorder", "shown %d", 2);
+    LOGD("recorder", "hidden %s", "too");
+    log_recorder_stop();
+    LOGV("recorder", "not recorded");
+    log_set_vprintf(original);
+
+    TEST_ASSERT_EQUAL(1, s_output_count);
+    TEST_ASSERT_EQUAL(3, drain());
+    TEST_ASSERT_EQUAL(3, s_drained.size());
+    TEST_ASSERT_TRUE(s_drained[0].find("hidden 1") != std::string::npos);
+    TEST_ASSERT_TRUE(s_drained[1].find("shown 2") != std::string::npos);
+    TEST_ASSERT_TRUE(s_drained[2].find("hidden too") != std::string::npos);
+    TEST_ASSERT_EQUAL('V', s_drained[0][0]);
+}
+
+void recorder_keeps_hidden_buffer_limited_and_cpp_messages()
+{
+    static const uint8_t bytes[] = {0xde, 0xad, 0xbe, 0xef};
+    log_rate_limit_t limit = LOG_RATE_LIMIT_INITIALIZER(1, 3600000, 1);
+    log_level_set("*", LOG_INFO);
+    vprintf_like_t original = log_set_vprintf(counting_vprintf);
+    s_output_count = 0;
+    TEST_ASSERT_TRUE(log_recorder_start(LOG_VERBOSE));
+    LOGV_BUFFER_HEX("recorder", bytes, sizeof(bytes), "dump %d", 1);
+    LOGI_LIMIT(&limit, "recorder", "limited %d", 2);
+    LOGI_LIMIT(&limit, "recorder", "limited %d", 3);
+    LOGD_CPP("recorder", "cpp %d", 4);
+    log_recorder_stop();
+    log_set_vprintf(original);
+
+    TEST_ASSERT_EQUAL(1, s_output_count);
+    TEST_ASSERT_EQUAL(4, drain());
+    TEST_ASSERT_TRUE(s_drained[0].find("dump 1") != std::string::npos);
+    TEST_ASSERT_TRUE(s_drained[0].find("de ad be ef") != std::string::npos);
+    TEST_ASSERT_TRUE(s_drained[1].find("limited 2") != std::string::npos);
+    TEST_ASSERT_TRUE(s_drained[2].find("limited 3") != std::string::npos);
+    TEST_ASSERT_TRUE(s_drained[3].find("cpp 4") != std::string::npos);
+    TEST_ASSERT_EQUAL('D', s_drained[3][0]);
+    log_level_set("*", LOG_VERBOSE);
+}
+
+void recorder_keeps_the_latest_records_in_order()
+{
+    log_level_set("*", LOG_NONE);
+    TEST_ASSERT_TRUE(log_recorder_start(LOG_VERBOSE));
+    for (int i = 0; i < 1000; i++)
+    {
+        LOGV("recorder", "number %d", i);
+    }
+    log_recorder_stop();
+
+    size_t records = drain();
+    TEST_ASSERT_EQUAL(records, s_drained.size());
+    TEST_ASSERT_TRUE(records > 10);
+    TEST_ASSERT_TRUE(records < 1000);
+    for (size_t i = 0; i < records; i++)
+    {
+        TEST_ASSERT_EQUAL(1000 - records + i, number_of(s_drained[i]));
+    }
+    log_level_set("*", LOG_VERBOSE);
+}
+
+void recorder_is_empty_after_start()
+{
+    log_level_set("*", LOG_NONE);
+    TEST_ASSERT_TRUE(log_recorder_start(LOG_NONE));
+    LOGE("recorder", "not recorded");
+    TEST_ASSERT_EQUAL(0, log_recorder_drain(NULL));
+    log_recorder_stop();
+    log_level_set("*", LOG_VERBOSE);
+}
+
+#ifdef __linux__
+// offset of the ring in the file, after magic, size, write position and the padded stream header
+#define RING_OFFSET 24
+
+void recorder_skips_corrupted_entries()
+{
+    log_level_set("*", LOG_NONE);
+    TEST_ASSERT_TRUE(log_recorder_start(LOG_VERBOSE));
+    for (int i = 0; i < 20; i++)
+    {
+        LOGV("recorder", "number %d", i);
+    }
+    log_recorder_stop();
+    TEST_ASSERT_EQUAL(20, log_recorder_drain(NULL));
+
+    // the level of the first record, the file is mapped shared by the recorder
+    int fd = open(CONFIG_LOG_RECORDER_PATH, O_RDWR);
+    TEST_ASSERT_TRUE(fd >= 0);
+    uint8_t level = LOG_ERROR;
+    TEST_ASSERT_EQUAL(1, pwrite(fd, &level, 1, RING_OFFSET + 8 + 1));
+    close(fd);
+
+    TEST_ASSERT_EQUAL(19, drain());
+    TEST_ASSERT_EQUAL(1, number_of(s_drained[0]));
+    TEST_ASSERT_EQUAL(19, number_of(s_drained[18]));
+    log_level_set("*", LOG_VERBOSE);
+}
+
+void recorder_survives_a_crash()
+{
+    TEST_ASSERT_TRUE(log_recorder_start(LOG_NONE));
+    pid_t child = fork();
+    TEST_ASSERT_TRUE(child >= 0);
+    if (child == 0)
+    {
+        log_level_set("*", LOG_NONE);
+        log_recorder_start(LOG_VERBOSE);
+        for (int i = 0; i < 3; i++)
+        {
+            LOGV("recorder", "number %d", i);
+        }
+        raise(SIGKILL);
+    }
+    int status;
+    TEST_ASSERT_EQUAL(child, waitpid(child, &status, 0));
+    TEST_ASSERT_TRUE(WIFSIGNALED(status));
+
+    TEST_ASSERT_EQUAL(3, drain());
+    for (int i = 0; i < 3; i++)
+    {
+        TEST_ASSERT_EQUAL(i, number_of(s_drained[i]));
+    }
+}
+
+void recorder_keeps_every_record_of_concurrent_writers_valid()
+{
+    const int threads = 4;
+    const int messages = 500;
+    log_level_set("*", LOG_NONE);
+    TEST_ASSERT_TRUE(log_recorder_start(LOG_VERBOSE));
+    std::vector<std::thread> workers;
+    for (int t = 0; t < threads; t++)
+    {
+        workers.emplace_back([t]() {
+            for (int i = 0; i < messages; i++)
+            {
+                LOGV("recorder", "thread %d number %d", t, i);
+            }
+        });
+    }
+    for (auto &worker : workers)
+    {
+        worker.join();
+    }
+    log_recorder_stop();
+
+    size_t records = drain();
+    TEST_ASSERT_TRUE(records > 10);
+    int last[threads] = {-1, -1, -1, -1};
+    for (const std::string &text : s_drained)
+    {
+        int t = atoi(text.c_str() + text.find("thread ") + 7);
+        TEST_ASSERT_TRUE(t >= 0 && t < threads);
+        TEST_ASSERT_TRUE(number_of(text) > last[t]);
+        last[t] = number_of(text);
+    }
+    // the last record written is the last one of its thread
+    TEST_ASSERT_EQUAL(messages - 1, number_of(s_drained.back()));
+    log_level_set("*", LOG_VERBOSE);
+}
+#endif
+
+void run_all_tests()
+{
+    UNITY_BEGIN();
+#if CONFIG_LOG_RECORDER_SIZE > 0
+    RUN_TEST(recorder_keeps_hidden_messages);
+    RUN_TEST(recorder_keeps_hidden_buffer_limited_and_cpp_messages);
+    RUN_TEST(recorder_keeps_the_latest_records_in_order);
+    RUN_TEST(recorder_is_empty_after_start);
+#ifdef __linux__
+    RUN_TEST(recorder_skips_corrupted_entries);
+    RUN_TEST(recorder_survives_a_crash);
+    RUN_TEST(recorder_keeps_every_record_of_concurrent_writers_valid);
+#endif
+#endif
+    UNITY_END();
+}
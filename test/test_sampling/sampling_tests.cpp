@@ -0,0 +1,163 @@
+#include <unity.h>
+
+#include "log.h"
+#include <stdarg.h>
+#include <atomic>
+#include <thread>
+#include <vector>
+
+void setUp() {}
+void tearDown() {}
+
+void run_all_tests();
+
+#ifdef __cplusplus
+extern "C"
+{
+#endif
+
+#ifdef ESP_PLATFORM
+    void app_main()
+#elif defined(ARDUINO)
+void setup()
+#else
+int main(/*int argc, char * argv[]*/)
+#endif
+    {
+
+        run_all_tests();
+
+#ifdef ESP_PLATFORM
+#elif defined(ARDUINO)
+#else
+    return 0;
+#endif
+    }
+
+#ifdef ARDUINO
+    void loop()
+    {
+    }
+#endif
+#ifdef __cplusplus
+}
+#endif
+
+static std::atomic<int> s_written(0);
+
+static int count_vprintf(const char *format, va_list args)
+{
+    (void)format;
+    (void)args;
+    s_written++;
+    return 0;
+}
+
+void sampling_keeps_about_one_in_n()
+{
+    log_level_set("*", LOG_VERBOSE);
+    log_sample_set("spi", LOG_VERBOSE, 100);
+    vprintf_like_t original = log_set_vprintf(count_vprintf);
+    s_written = 0;
+    uint32_t sampled_out = log_sampled_out();
+
+    for (int i = 0; i < 100000; i++)
+    {
+        LOGV("spi", "transfer %d", i);
+    }
+
+    log_set_vprintf(original);
+
+    TEST_ASSERT_TRUE(s_written > 700 && s_written < 1300);
+    // the count of the calling thread is exact
+    TEST_ASSERT_EQUAL(100000 - s_written, log_sampled_out() - sampled_out);
+}
+
+void sampling_leaves_other_levels_and_tags()
+{
+    log_level_set("*", LOG_VERBOSE);
+    log_sample_set("spi", LOG_VERBOSE, 1000);
+    vprintf_like_t original = log_set_vprintf(count_vprintf);
+    s_written = 0;
+
+    for (int i = 0; i < 100; i++)
+    {
+        LOGD("spi", "debug %d", i);
+        LOGV("i2c", "verbose %d", i);
+    }
+
+    log_set_vprintf(original);
+
+    TEST_ASSERT_EQUAL(200, s_written.load());
+}
+
+void sampling_is_reset_by_ratio_one_and_level_set_all()
+{
+    log_level_set("*", LOG_VERBOSE);
+    vprintf_like_t original = log_set_vprintf(count_vprintf);
+
+    log_sample_set("spi", LOG_VERBOSE, 65535);
+    log_sample_set("spi", LOG_VERBOSE, 1);
+    s_written = 0;
+    for (int i = 0; i < 100; i++)
+    {
+        LOGV("spi", "verbose %d", i);
+    }
+    TEST_ASSERT_EQUAL(100, s_written.load());
+
+    log_sample_set("spi", LOG_VERBOSE, 65535);
+    log_level_set("*", LOG_VERBOSE);
+    s_written = 0;
+    for (int i = 0; i < 100; i++)
+    {
+        LOGV("spi", "verbose %d", i);
+    }
+    TEST_ASSERT_EQUAL(100, s_written.load());
+
+    log_set_vprintf(original);
+}
+
+void sampling_counts_across_threads()
+{
+    static const int THREADS = 8;
+    static const int MESSAGES = 20000;
+    log_level_set("*", LOG_VERBOSE);
+    log_sample_set("spi", LOG_VERBOSE, 10);
+    vprintf_like_t original = log_set_vprintf(count_vprintf);
+    s_written = 0;
+    uint32_t sampled_out = log_sampled_out();
+
+    std::vector<std::thread> threads;
+    for (int t = 0; t < THREADS; t++)
+    {
+        threads.emplace_back([]() {
+            for (int i = 0; i < MESSAGES; i++)
+            {
+                LOGV("spi", "transfer %d", i);
+            }
+        });
+    }
+    for (auto &thread : threads)
+    {
+        thread.join();
+    }
+
+    log_set_vprintf(original);
+
+    int dropped = THREADS * MESSAGES - s_written;
+    TEST_ASSERT_TRUE(s_written > THREADS * MESSAGES / 20 && s_written < THREADS * MESSAGES / 5);
+    // every thread holds back less than a batch
+    uint32_t counted = log_sampled_out() - sampled_out;
+    TEST_ASSERT_TRUE(counted <= (uint32_t)dropped);
+    TEST_ASSERT_TRUE(counted > (uint32_t)(dropped - THREADS * CONFIG_LOG_SAMPLING_BATCH));
+}
+
+void run_all_tests()
+{
+    UNITY_BEGIN();
+    RUN_TEST(sampling_keeps_about_one_in_n);
+    RUN_TEST(sampling_leaves_other_levels_and_tags);
+    RUN_TEST(sampling_is_reset_by_ratio_one_and_level_set_all);
+    RUN_TEST(sampling_counts_across_threads);
+    UNITY_END();
+}
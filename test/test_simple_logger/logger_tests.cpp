@@ -3,19 +3,23 @@
 #include "log.h"
 #include <string.h>
 #include <stdbool.h>
+#ifdef __linux__
+#include <time.h>
+#include <thread>
+#endif
 
 // #include <avr/pgmspace.h>
 
 void setUp(){}
 void tearDown(){}
 
-static char log_lines[4][105];
+static char log_lines[4][512];
 static uint8_t current_index;
 
 struct log_writes_t{
     uint8_t level;
     char tag[50];
-    char line[100];
+    char line[200];
 };
 
 static log_writes_t log_item[4];
@@ -29,7 +33,7 @@ void clear_log()
 
 void log_line(const char *line)
 {
-    snprintf(log_lines[current_index++], 105, "%s", line);
+    snprintf(log_lines[current_index++], sizeof(log_lines[0]), "%s", line);
 }
 
 void run_all_tests();
@@ -79,7 +83,7 @@ bool string_contains(const char *str, const char *substr)
 int mock_vprintf(const char *format, va_list list)
 {
     // vprintf(format, list);
-    char buffer[105];
+    char buffer[512];
     int len = vsnprintf(buffer, sizeof(buffer), format, list);
     log_line(buffer);
     return len;
@@ -93,7 +97,7 @@ void mock_log_writev(uint8_t level,
     struct log_writes_t * next_write = &log_item[current_log_item_index++];
     next_write->level = level;
     strncpy(next_write->tag, tag, 49);
-    vsnprintf(next_write->line, 99, format, args);
+    vsnprintf(next_write->line, sizeof(next_write->line), format, args);
 }
 
 void logger_log_verbose()
@@ -236,11 +240,11 @@ void logger_hex_display()
 
     LOGE_BUFFER_HEX("TAG", buffer, sizeof(buffer), "hello %s", "world");
 
-    TEST_ASSERT_TRUE(current_index == 4);
+    TEST_ASSERT_TRUE(current_index == 1);
     TEST_ASSERT_TRUE(string_contains(log_lines[0], "hello world"));
-    TEST_ASSERT_TRUE(string_contains(log_lines[1], "54 68 65 20 71 75 69 63 6b 20 62 72 6f 77 6e 20"));
-    TEST_ASSERT_TRUE(string_contains(log_lines[2], "66 6f 78 20 6a 75 6d 70 73 20 6f 76 65 72 20 74"));
-    TEST_ASSERT_TRUE(string_contains(log_lines[3], "68 65 20 6c 61 7a 79 20 64 6f 67 00"));
+    TEST_ASSERT_TRUE(string_contains(log_lines[0], "54 68 65 20 71 75 69 63 6b 20 62 72 6f 77 6e 20 \n"
+                                                   "66 6f 78 20 6a 75 6d 70 73 20 6f 76 65 72 20 74 \n"
+                                                   "68 65 20 6c 61 7a 79 20 64 6f 67 00 \n"));
 }
 
 void logger_char_display()
@@ -253,11 +257,9 @@ void logger_char_display()
 
     LOGE_BUFFER_CHAR("TAG", buffer, sizeof(buffer), "hello %s", "world");
 
-    TEST_ASSERT_TRUE(current_index == 4);
+    TEST_ASSERT_TRUE(current_index == 1);
     TEST_ASSERT_TRUE(string_contains(log_lines[0], "hello world"));
-    TEST_ASSERT_TRUE(string_contains(log_lines[1], "The quick brown"));
-    TEST_ASSERT_TRUE(string_contains(log_lines[2], "fox jumps over"));
-    TEST_ASSERT_TRUE(string_contains(log_lines[3], "the lazy dog"));
+    TEST_ASSERT_TRUE(string_contains(log_lines[0], "The quick brown\n fox jumps over \nthe lazy dog\n"));
 }
 
 void logger_hexdump_display()
@@ -270,11 +272,11 @@ void logger_hexdump_display()
 
     LOGE_BUFFER_HEXDUMP("TAG", buffer, sizeof(buffer), "hello %s", "world");
 
-    TEST_ASSERT_EQUAL_MESSAGE(4, current_index, "index");
+    TEST_ASSERT_EQUAL_MESSAGE(1, current_index, "index");
     TEST_ASSERT_TRUE_MESSAGE(string_contains(log_lines[0], "hello world"), "message");
-    TEST_ASSERT_TRUE_MESSAGE(string_contains(log_lines[1], "(00000000)  01 54 68 65 20 71 75 69  63 6b 20 62 72 6f 77 6e  |.The quick brown|"), "1st line");
-    TEST_ASSERT_TRUE_MESSAGE(string_contains(log_lines[2], "(00000010)  20 66 6f 78 20 6a 75 6d  70 73 20 6f 76 65 72 20  | fox jumps over |"), "2nd line");
-    TEST_ASSERT_TRUE_MESSAGE(string_contains(log_lines[3], "(00000020)  74 68 65 20 6c 61 7a 79  20 64 6f 67 00           |the lazy dog.|"), "3rd line");
+    TEST_ASSERT_TRUE_MESSAGE(string_contains(log_lines[0], "(00000000)  01 54 68 65 20 71 75 69  63 6b 20 62 72 6f 77 6e  |.The quick brown|\n"), "1st line");
+    TEST_ASSERT_TRUE_MESSAGE(string_contains(log_lines[0], "(00000010)  20 66 6f 78 20 6a 75 6d  70 73 20 6f 76 65 72 20  | fox jumps over |\n"), "2nd line");
+    TEST_ASSERT_TRUE_MESSAGE(string_contains(log_lines[0], "(00000020)  74 68 65 20 6c 61 7a 79  20 64 6f 67 00           |the lazy dog.|\n"), "3rd line");
 }
 
 void logger_default_log_level_is_overwritten_by_specific_tag()
@@ -326,6 +328,138 @@ void logger_is_tag_level_visible_specific_tag_is_overwritten_by_default_log_leve
     TEST_ASSERT_FALSE(is_tag_level_visible(LOG_INFO, "TAG2"));
 }
 
+void logger_many_tags_keep_their_levels()
+{
+    // levels are cached by tag address, every tag needs its own buffer
+    static char tags[250][16];
+    log_level_set("*", LOG_ERROR);
+    for (int i = 0; i < 250; i++)
+    {
+        snprintf(tags[i], sizeof(tags[i]), "tag%d", i);
+        log_level_set(tags[i], (uint8_t)(i % (LOG_VERBOSE + 1)));
+    }
+    // overwrite some of them
+    for (int i = 0; i < 250; i += 7)
+    {
+        log_level_set(tags[i], LOG_VERBOSE);
+    }
+
+    for (int i = 0; i < 250; i++)
+    {
+        const char *tag = tags[i];
+        uint8_t level = (i % 7 == 0) ? LOG_VERBOSE : (uint8_t)(i % (LOG_VERBOSE + 1));
+        TEST_ASSERT_TRUE_MESSAGE(level == LOG_VERBOSE || !is_tag_level_visible(level + 1, tag), tag);
+        TEST_ASSERT_TRUE_MESSAGE(level == LOG_NONE || is_tag_level_visible(level, tag), tag);
+    }
+    TEST_ASSERT_FALSE(is_tag_level_visible(LOG_WARN, "tag250"));
+
+    log_level_set("*", LOG_INFO);
+    TEST_ASSERT_TRUE(is_tag_level_visible(LOG_INFO, "tag0"));
+    TEST_ASSERT_FALSE(is_tag_level_visible(LOG_DEBUG, "tag5"));
+}
+
+static void log_info_with_tag(const char *tag)
+{
+    LOGI(tag, "level %s", "info");
+}
+
+#if CONFIG_LOG_TAG_TABLE_STATIC_SLOTS > 0
+#define FULL_TABLE_TAGS (CONFIG_LOG_TAG_TABLE_STATIC_SLOTS / 2 + 1)
+#else
+#define FULL_TABLE_TAGS 64
+#endif
+
+void logger_level_set_reports_a_full_tag_table()
+{
+    static char tags[FULL_TABLE_TAGS][12];
+    TEST_ASSERT_TRUE(log_level_set("*", LOG_ERROR));
+    int stored = 0;
+    while (stored < FULL_TABLE_TAGS)
+    {
+        snprintf(tags[stored], sizeof(tags[stored]), "full%d", stored);
+        if (!log_level_set(tags[stored], LOG_DEBUG))
+        {
+            break;
+        }
+        stored++;
+    }
+#if CONFIG_LOG_TAG_TABLE_STATIC_SLOTS > 0
+    TEST_ASSERT_TRUE(stored > 0 && stored <= CONFIG_LOG_TAG_TABLE_STATIC_SLOTS / 2);
+    // the tag that did not fit keeps the default level, stored tags can still change
+    TEST_ASSERT_FALSE(is_tag_level_visible(LOG_WARN, tags[stored]));
+    TEST_ASSERT_TRUE(log_level_set(tags[0], LOG_VERBOSE));
+    TEST_ASSERT_TRUE(is_tag_level_visible(LOG_VERBOSE, tags[0]));
+#else
+    TEST_ASSERT_EQUAL(FULL_TABLE_TAGS, stored);
+#endif
+    TEST_ASSERT_TRUE(is_tag_level_visible(LOG_DEBUG, tags[stored - 1]));
+
+    // the wildcard drops every tag, new ones fit again
+    TEST_ASSERT_TRUE(log_level_set("*", LOG_INFO));
+    TEST_ASSERT_TRUE(log_level_set("after reset", LOG_VERBOSE));
+    TEST_ASSERT_TRUE(is_tag_level_visible(LOG_VERBOSE, "after reset"));
+    log_level_set("*", LOG_INFO);
+}
+
+void logger_callsite_cache_follows_level_changes()
+{
+    clear_log();
+    log_level_set("*", LOG_INFO);
+    log_set_vprintf(mock_vprintf);
+
+    log_info_with_tag("TAG");
+    log_level_set("TAG", LOG_WARN);
+    log_info_with_tag("TAG");
+    log_level_set("TAG", LOG_INFO);
+    log_info_with_tag("TAG");
+
+    TEST_ASSERT_EQUAL_MESSAGE(2, current_index, "index");
+}
+
+void logger_callsite_cache_with_varying_tags()
+{
+    clear_log();
+    log_level_set("*", LOG_ERROR);
+    log_level_set("TAG2", LOG_INFO);
+    log_set_vprintf(mock_vprintf);
+
+    log_info_with_tag("TAG1");
+    log_info_with_tag("TAG2");
+    log_info_with_tag("TAG1");
+    log_info_with_tag("TAG2");
+
+    TEST_ASSERT_EQUAL_MESSAGE(2, current_index, "index");
+    TEST_ASSERT_TRUE(string_contains(log_lines[0], "TAG2"));
+    TEST_ASSERT_TRUE(string_contains(log_lines[1], "TAG2"));
+}
+
+static int s_evaluations;
+
+static int evaluated_argument()
+{
+    return ++s_evaluations;
+}
+
+void logger_disabled_level_does_not_evaluate_arguments()
+{
+    clear_log();
+    log_level_set("*", LOG_INFO);
+    log_set_vprintf(mock_vprintf);
+    s_evaluations = 0;
+
+    const char buffer[] = "The quick brown fox";
+
+    LOGD("TAG", "value %d", evaluated_argument());
+    LOGD_BUFFER_HEX("TAG", buffer, (uint16_t)evaluated_argument(), "value %d", evaluated_argument());
+
+    TEST_ASSERT_EQUAL_MESSAGE(0, s_evaluations, "disabled arguments");
+    TEST_ASSERT_EQUAL_MESSAGE(0, current_index, "index");
+
+    LOGI("TAG", "value %d", evaluated_argument());
+
+    TEST_ASSERT_EQUAL_MESSAGE(1, s_evaluations, "enabled arguments");
+    TEST_ASSERT_EQUAL_MESSAGE(1, current_index, "index");
+}
 
 void logger_log_writev_verbose()
 {
@@ -346,6 +480,57 @@ void logger_log_writev_verbose()
     TEST_ASSERT_TRUE_MESSAGE(string_contains(log_item[0].line, "hello world"), "contents");
 }
 
+#ifdef CONFIG_LOG_LINUX
+void logger_system_timestamp_renders_wall_clock()
+{
+    time_t before = time(NULL);
+    char rendered[16];
+    strcpy(rendered, log_system_timestamp());
+    time_t after = time(NULL);
+
+    // "HH:MM:SS.sss" of the second the clock was read in
+    TEST_ASSERT_EQUAL(12, strlen(rendered));
+    TEST_ASSERT_EQUAL('.', rendered[8]);
+    char expected[2][16];
+    struct tm timeinfo;
+    strftime(expected[0], sizeof(expected[0]), "%H:%M:%S", localtime_r(&before, &timeinfo));
+    strftime(expected[1], sizeof(expected[1]), "%H:%M:%S", localtime_r(&after, &timeinfo));
+    TEST_ASSERT_TRUE(strncmp(rendered, expected[0], 8) == 0 || strncmp(rendered, expected[1], 8) == 0);
+    for (int i = 9; i < 12; i++)
+    {
+        TEST_ASSERT_TRUE(rendered[i] >= '0' && rendered[i] <= '9');
+    }
+
+    // every thread renders into its own buffer
+    const char *mine = log_system_timestamp();
+    const char *other = NULL;
+    std::thread([&other]() { other = log_system_timestamp(); }).join();
+    TEST_ASSERT_TRUE(other != NULL && other != mine);
+}
+#endif
+
+#ifdef CONFIG_LOG_LINUX
+void logger_timestamp_us_follows_log_timestamp()
+{
+    // long enough to switch to a calibrated cycle counter where there is one
+    uint32_t start = log_timestamp();
+    uint64_t previous = log_timestamp_us();
+    while (log_timestamp() - start < 50)
+    {
+        uint64_t now = log_timestamp_us();
+        TEST_ASSERT_TRUE(now >= previous);
+        previous = now;
+    }
+
+    uint32_t before = log_timestamp();
+    uint64_t now_us = log_timestamp_us();
+    uint32_t after = log_timestamp();
+    // both count from about the start of the program
+    TEST_ASSERT_TRUE(now_us / 1000 + 2 >= before);
+    TEST_ASSERT_TRUE(now_us / 1000 <= (uint64_t)after + 2);
+}
+#endif
+
 void run_all_tests()
 {
     UNITY_BEGIN();
@@ -370,7 +555,17 @@ void run_all_tests()
     RUN_TEST(logger_is_tag_level_visible_default_log_level_is_overwritten_by_specific_tag);
     RUN_TEST(logger_is_tag_level_visible_specific_tag_is_overwritten_by_default_log_level);
 
+    RUN_TEST(logger_many_tags_keep_their_levels);
+    RUN_TEST(logger_level_set_reports_a_full_tag_table);
+    RUN_TEST(logger_callsite_cache_follows_level_changes);
+    RUN_TEST(logger_callsite_cache_with_varying_tags);
+    RUN_TEST(logger_disabled_level_does_not_evaluate_arguments);
+
     RUN_TEST(logger_log_writev_verbose);
+#ifdef CONFIG_LOG_LINUX
+    RUN_TEST(logger_system_timestamp_renders_wall_clock);
+    RUN_TEST(logger_timestamp_us_follows_log_timestamp);
+#endif
 
     UNITY_END();
 }
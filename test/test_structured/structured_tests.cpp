@@ -0,0 +1,212 @@
+#include <unity.h>
+
+#include "log_structured.h"
+#include <math.h>
+#include <stdarg.h>
+#include <stdio.h>
+#include <string.h>
+#include <string>
+#include <vector>
+
+void setUp() {}
+void tearDown() {}
+
+void run_all_tests();
+
+#ifdef __cplusplus
+extern "C"
+{
+#endif
+
+#ifdef ESP_PLATFORM
+    void app_main()
+#elif defined(ARDUINO)
+void setup()
+#else
+int main(/*int argc, char * argv[]*/)
+#endif
+    {
+
+        run_all_tests();
+
+#ifdef ESP_PLATFORM
+#elif defined(ARDUINO)
+#else
+    return 0;
+#endif
+    }
+
+#ifdef ARDUINO
+    void loop()
+    {
+    }
+#endif
+#ifdef __cplusplus
+}
+#endif
+
+static std::vector<std::string> s_output;
+
+static int capture_vprintf(const char *format, va_list args)
+{
+    char text[512];
+    int length = vsnprintf(text, sizeof(text), format, args);
+    s_output.push_back(text);
+    return length;
+}
+
+struct captured_record_t
+{
+    uint8_t level;
+    std::string tag;
+    std::vector<uint8_t> record;
+};
+
+static std::vector<captured_record_t> s_records;
+
+static void capture_structured(uint8_t level, const char *tag, const uint8_t *record, size_t length)
+{
+    s_records.push_back({level, tag, std::vector<uint8_t>(record, record + length)});
+}
+
+static std::string to_json(const uint8_t *record, size_t length)
+{
+    char text[512];
+    int text_len = log_structured_format_json(record, length, text, sizeof(text));
+    return text_len < 0 ? "<malformed>" : std::string(text, text_len);
+}
+
+void structured_record_is_cbor()
+{
+    const log_field_t fields[] = {
+        log_field_int("n", -500),
+        log_field_uint("u", 24),
+        log_field_bool("ok", true),
+        log_field_str("s", "hi"),
+        log_field_bytes("b", "\x01\xff", 2),
+        log_field_double("d", 1.5),
+    };
+    uint8_t record[128];
+    size_t length = log_structured_encode(record, sizeof(record), LOG_WARN, 1000, "net", "up", fields, 6);
+
+    const uint8_t expected[] = {
+        0xAA,                                              // map of 10 entries
+        0x62, 't', 's', 0x19, 0x03, 0xE8,                  // "ts": 1000
+        0x65, 'l', 'e', 'v', 'e', 'l', 0x02,               // "level": LOG_WARN
+        0x63, 't', 'a', 'g', 0x63, 'n', 'e', 't',          // "tag": "net"
+        0x63, 'm', 's', 'g', 0x62, 'u', 'p',               // "msg": "up"
+        0x61, 'n', 0x39, 0x01, 0xF3,                       // "n": -500
+        0x61, 'u', 0x18, 0x18,                             // "u": 24
+        0x62, 'o', 'k', 0xF5,                              // "ok": true
+        0x61, 's', 0x62, 'h', 'i',                         // "s": "hi"
+        0x61, 'b', 0x42, 0x01, 0xFF,                       // "b": h'01ff'
+        0x61, 'd', 0xFB, 0x3F, 0xF8, 0, 0, 0, 0, 0, 0,     // "d": 1.5
+    };
+    TEST_ASSERT_EQUAL(sizeof(expected), length);
+    TEST_ASSERT_EQUAL_MEMORY(expected, record, sizeof(expected));
+}
+
+void structured_record_renders_as_json()
+{
+    const log_field_t fields[] = {
+        log_field_int("min", INT64_MIN),
+        log_field_uint("max", UINT64_MAX),
+        log_field_double("ratio", 0.1),
+        log_field_double("nan", NAN),
+        log_field_bool("off", false),
+        log_field_str("text", "quote \" backslash \\ tab \t newline \n bell \a"),
+        log_field_str("missing", NULL),
+        log_field_bytes("raw", "\x00\x10\xab", 3),
+    };
+    uint8_t record[256];
+    size_t length = log_structured_encode(record, sizeof(record), LOG_INFO, 42, "app", "started", fields, 8);
+    TEST_ASSERT_TRUE(length > 0);
+    TEST_ASSERT_EQUAL_STRING("{\"ts\":42,\"level\":3,\"tag\":\"app\",\"msg\":\"started\","
+                             "\"min\":-9223372036854775808,\"max\":18446744073709551615,\"ratio\":0.1,\"nan\":null,"
+                             "\"off\":false,\"text\":\"quote \\\" backslash \\\\ tab \\t newline \\n bell \\u0007\","
+                             "\"missing\":\"(null)\",\"raw\":\"0010ab\"}\n",
+                             to_json(record, length).c_str());
+}
+
+void structured_record_does_not_overflow()
+{
+    const log_field_t fields[] = {log_field_str("long", "a string that is longer than the record"), log_field_int("after", 1)};
+    uint8_t record[48];
+    size_t length = log_structured_encode(record, sizeof(record), LOG_INFO, 0, "t", "m", fields, 1);
+    TEST_ASSERT_EQUAL(sizeof(record), length);
+    TEST_ASSERT_TRUE(to_json(record, length).find("\"long\":\"a string that") != std::string::npos);
+
+    // the string takes the whole record, the next field does not fit
+    TEST_ASSERT_EQUAL(0, log_structured_encode(record, sizeof(record), LOG_INFO, 0, "t", "m", fields, 2));
+    TEST_ASSERT_EQUAL(0, log_structured_encode(record, 4, LOG_INFO, 0, "t", "m", NULL, 0));
+
+    // UTF-8 sequences are not split
+    const log_field_t utf8[] = {log_field_str("s", "\xc3\xa9\xc3\xa9\xc3\xa9\xc3\xa9")};
+    length = log_structured_encode(record, 30, LOG_INFO, 0, "t", "m", utf8, 1);
+    TEST_ASSERT_EQUAL(29, length);
+    TEST_ASSERT_EQUAL_STRING("{\"ts\":0,\"level\":3,\"tag\":\"t\",\"msg\":\"m\",\"s\":\"\xc3\xa9\"}\n", to_json(record, length).c_str());
+}
+
+void structured_malformed_records_are_rejected()
+{
+    uint8_t record[64];
+    size_t length = log_structured_encode(record, sizeof(record), LOG_INFO, 0, "t", "m", NULL, 0);
+    char text[64];
+    TEST_ASSERT_EQUAL(-1, log_structured_format_json(record, length - 1, text, sizeof(text)));
+    TEST_ASSERT_EQUAL(-1, log_structured_format_json(record, length, text, 16));
+    const uint8_t not_a_map[] = {0x83, 0x01, 0x02, 0x03};
+    TEST_ASSERT_EQUAL(-1, log_structured_format_json(not_a_map, sizeof(not_a_map), text, sizeof(text)));
+    const uint8_t nested[] = {0xA1, 0x61, 'a', 0xA0};
+    TEST_ASSERT_EQUAL(-1, log_structured_format_json(nested, sizeof(nested), text, sizeof(text)));
+    const uint8_t integer_key[] = {0xA1, 0x01, 0x02};
+    TEST_ASSERT_EQUAL(-1, log_structured_format_json(integer_key, sizeof(integer_key), text, sizeof(text)));
+}
+
+void structured_writer_receives_records()
+{
+    log_level_set("*", LOG_VERBOSE);
+    log_level_set("quiet", LOG_WARN);
+    s_records.clear();
+    log_set_structured_writer(capture_structured);
+
+    LOGI_FIELDS("net", "connected", log_field_str("ssid", "home"), log_field_int("rssi", -61));
+    LOGI_FIELDS("quiet", "hidden", log_field_int("n", 1));
+    LOGE_FIELDS("quiet", "failed", log_field_uint("code", 7));
+
+    log_set_structured_writer(NULL);
+
+    TEST_ASSERT_EQUAL(2, s_records.size());
+    TEST_ASSERT_EQUAL(LOG_INFO, s_records[0].level);
+    TEST_ASSERT_EQUAL_STRING("net", s_records[0].tag.c_str());
+    std::string json = to_json(s_records[0].record.data(), s_records[0].record.size());
+    TEST_ASSERT_TRUE(json.find("\"level\":3,\"tag\":\"net\",\"msg\":\"connected\",\"ssid\":\"home\",\"rssi\":-61}") != std::string::npos);
+    TEST_ASSERT_EQUAL(LOG_ERROR, s_records[1].level);
+    TEST_ASSERT_EQUAL_STRING("quiet", s_records[1].tag.c_str());
+}
+
+void structured_fields_fall_back_to_json_lines()
+{
+    log_level_set("*", LOG_VERBOSE);
+    vprintf_like_t original = log_set_vprintf(capture_vprintf);
+    s_output.clear();
+
+    LOGW_FIELDS("app", "low memory", log_field_uint("free", 1024));
+
+    log_set_vprintf(original);
+
+    TEST_ASSERT_EQUAL(1, s_output.size());
+    TEST_ASSERT_EQUAL_STRING("{\"ts\":", s_output[0].substr(0, 6).c_str());
+    TEST_ASSERT_TRUE(s_output[0].find(",\"level\":2,\"tag\":\"app\",\"msg\":\"low memory\",\"free\":1024}\n") != std::string::npos);
+}
+
+void run_all_tests()
+{
+    UNITY_BEGIN();
+    RUN_TEST(structured_record_is_cbor);
+    RUN_TEST(structured_record_renders_as_json);
+    RUN_TEST(structured_record_does_not_overflow);
+    RUN_TEST(structured_malformed_records_are_rejected);
+    RUN_TEST(structured_writer_receives_records);
+    RUN_TEST(structured_fields_fall_back_to_json_lines);
+    UNITY_END();
+}
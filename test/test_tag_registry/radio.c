@@ -0,0 +1,14 @@
+#include "log.h"
+
+// a handle defined in C and used from C++ as well
+LOG_TAG_DEFINE(radio);
+
+void radio_log_info(int value)
+{
+    LOGI_TAG(radio, "value %d", value);
+}
+
+const char *radio_tag_name(void)
+{
+    return LOG_TAG_NAME(radio);
+}
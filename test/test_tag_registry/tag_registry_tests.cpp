@@ -0,0 +1,174 @@
+#include <unity.h>
+
+#include "log.h"
+#include <stdarg.h>
+#include <atomic>
+
+void setUp() {}
+void tearDown() {}
+
+void run_all_tests();
+
+#ifdef __cplusplus
+extern "C"
+{
+#endif
+
+#ifdef ESP_PLATFORM
+    void app_main()
+#elif defined(ARDUINO)
+void setup()
+#else
+int main(/*int argc, char * argv[]*/)
+#endif
+    {
+
+        run_all_tests();
+
+#ifdef ESP_PLATFORM
+#elif defined(ARDUINO)
+#else
+    return 0;
+#endif
+    }
+
+#ifdef ARDUINO
+    void loop()
+    {
+    }
+#endif
+#ifdef __cplusplus
+}
+#endif
+
+LOG_TAG_DEFINE(fresh);
+LOG_TAG_DEFINE(wifi);
+LOG_TAG_DEFINE(spi);
+LOG_TAG_DECLARE(radio);
+
+extern "C"
+{
+    // defined in radio.c
+    void radio_log_info(int value);
+    const char *radio_tag_name(void);
+}
+
+static std::atomic<int> s_written(0);
+
+static int count_vprintf(const char *format, va_list args)
+{
+    (void)format;
+    (void)args;
+    s_written++;
+    return 0;
+}
+
+void tag_registry_handle_starts_at_the_default_level()
+{
+    // no log_level_set call so far, the table holds DEFAULT_LOG_LEVEL
+#if CONFIG_LOG_TAG_REGISTRY
+    TEST_ASSERT_EQUAL(LOG_TAG_LEVEL_UNSET, log_tag_fresh.level);
+#endif
+    vprintf_like_t original = log_set_vprintf(count_vprintf);
+    s_written = 0;
+
+    LOGE_TAG(fresh, "first message");
+
+    log_set_vprintf(original);
+    TEST_ASSERT_EQUAL(DEFAULT_LOG_LEVEL >= LOG_ERROR ? 1 : 0, s_written);
+#if CONFIG_LOG_TAG_REGISTRY
+    TEST_ASSERT_EQUAL(DEFAULT_LOG_LEVEL, log_tag_fresh.level);
+#endif
+}
+
+void tag_registry_handles_follow_level_set()
+{
+    log_level_set("*", LOG_INFO);
+    vprintf_like_t original = log_set_vprintf(count_vprintf);
+    s_written = 0;
+
+    LOGD_TAG(wifi, "hidden %d", 1);
+    LOGI_TAG(wifi, "shown %d", 2);
+    TEST_ASSERT_EQUAL(1, s_written);
+
+    log_level_set("wifi", LOG_VERBOSE);
+    LOGV_TAG(wifi, "shown %d", 3);
+    TEST_ASSERT_EQUAL(2, s_written);
+    // the string API sees the same level
+    TEST_ASSERT_TRUE(is_tag_level_visible(LOG_VERBOSE, LOG_TAG_NAME(wifi)));
+    TEST_ASSERT_TRUE(is_tag_level_visible(LOG_VERBOSE, "wifi"));
+
+    log_level_set("*", LOG_WARN);
+    LOGI_TAG(wifi, "hidden %d", 4);
+    LOGW_TAG(wifi, "shown %d", 5);
+    TEST_ASSERT_EQUAL(3, s_written);
+
+    log_level_set("wifi", LOG_NONE);
+    LOGE_TAG(wifi, "hidden %d", 6);
+    TEST_ASSERT_EQUAL(3, s_written);
+
+    log_set_vprintf(original);
+    log_level_set("*", LOG_INFO);
+}
+
+void tag_registry_handle_is_shared_across_files()
+{
+    log_level_set("*", LOG_INFO);
+    vprintf_like_t original = log_set_vprintf(count_vprintf);
+    s_written = 0;
+
+    TEST_ASSERT_TRUE(radio_tag_name() == LOG_TAG_NAME(radio));
+    radio_log_info(1);
+    LOGI_TAG(radio, "value %d", 2);
+    TEST_ASSERT_EQUAL(2, s_written);
+
+    log_level_set("radio", LOG_ERROR);
+    radio_log_info(3);
+    LOGI_TAG(radio, "value %d", 4);
+    TEST_ASSERT_EQUAL(2, s_written);
+
+    log_set_vprintf(original);
+    log_level_set("*", LOG_INFO);
+}
+
+#if CONFIG_LOG_SAMPLING
+void tag_registry_handles_are_sampled()
+{
+    log_level_set("*", LOG_VERBOSE);
+    TEST_ASSERT_TRUE(log_sample_set("spi", LOG_VERBOSE, 100));
+    vprintf_like_t original = log_set_vprintf(count_vprintf);
+    s_written = 0;
+
+    for (int i = 0; i < 100000; i++)
+    {
+        LOGV_TAG(spi, "transfer %d", i);
+    }
+    TEST_ASSERT_TRUE(s_written > 700 && s_written < 1300);
+
+    // other levels are not sampled, the wildcard drops the ratio
+    s_written = 0;
+    LOGD_TAG(spi, "transfer %d", 0);
+    TEST_ASSERT_EQUAL(1, s_written);
+    log_level_set("*", LOG_VERBOSE);
+    for (int i = 0; i < 100; i++)
+    {
+        LOGV_TAG(spi, "transfer %d", i);
+    }
+    TEST_ASSERT_EQUAL(101, s_written);
+
+    log_set_vprintf(original);
+    log_level_set("*", LOG_INFO);
+}
+#endif
+
+void run_all_tests()
+{
+    UNITY_BEGIN();
+    RUN_TEST(tag_registry_handle_starts_at_the_default_level);
+    RUN_TEST(tag_registry_handles_follow_level_set);
+    RUN_TEST(tag_registry_handle_is_shared_across_files);
+#if CONFIG_LOG_SAMPLING
+    RUN_TEST(tag_registry_handles_are_sampled);
+#endif
+    UNITY_END();
+}
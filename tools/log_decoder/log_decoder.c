@@ -0,0 +1,611 @@
+// Copyright 2015-2019 Espressif Systems (Shanghai) PTE LTD
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+/*
+ * Host side decoder for binary log streams, see log_binary.h.
+ *
+ * Usage: log_decoder [-e firmware.elf] [-j jobs] [capture | -]
+ *        log_decoder -b megabytes [-j jobs]
+ *
+ * Strings referenced by address are resolved from the allocated, non
+ * executable sections of the firmware ELF file (.rodata, .flash.rodata).
+ *
+ * Decoding runs in two steps. The input is first split into chunks by
+ * hopping over the record headers, which only touches four bytes per
+ * record, then the chunks are rendered in parallel and written in order.
+ * Regular files are mapped, pipes are read in blocks.
+ */
+
+#define _GNU_SOURCE
+#include <elf.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <pthread.h>
+#include <stdarg.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <time.h>
+#include <unistd.h>
+#include "log_binary.h"
+#include "log_private.h"
+
+#define CHUNK_SIZE (4 * 1024 * 1024)
+#define MAX_JOBS 64
+#define MAX_SECTIONS 64
+
+typedef struct
+{
+    uint64_t address;
+    uint64_t size;
+    const char *data;
+} section_t;
+
+typedef struct
+{
+    section_t sections[MAX_SECTIONS];
+    size_t count;
+} image_t;
+
+typedef struct
+{
+    const uint8_t *data;
+    size_t length;
+    log_binary_stream_t stream;
+    const image_t *image;
+    char *out;
+    size_t out_len;
+    size_t out_size;
+    uint64_t records;
+    uint64_t skipped;
+} chunk_t;
+
+typedef struct
+{
+    const image_t *image;
+    FILE *output;
+    int jobs;
+    log_binary_stream_t stream;
+    uint64_t records;
+    uint64_t skipped;
+} decoder_t;
+
+// streams captured without their header are assumed to come from a 32 bit device
+static const log_binary_stream_t s_default_stream = {
+    .version = LOG_BINARY_VERSION,
+    .pointer_size = 4,
+    .long_size = 4,
+    .size_t_size = 4,
+    .intmax_size = 8,
+    .ptrdiff_size = 4,
+};
+
+static void fail(const char *format, ...)
+{
+    va_list list;
+    va_start(list, format);
+    fprintf(stderr, "log_decoder: ");
+    vfprintf(stderr, format, list);
+    fprintf(stderr, "\n");
+    va_end(list);
+    exit(1);
+}
+
+static void *map_file(const char *path, size_t *length)
+{
+    int fd = open(path, O_RDONLY);
+    if (fd < 0)
+    {
+        fail("%s: %s", path, strerror(errno));
+    }
+    struct stat st;
+    if (fstat(fd, &st) != 0 || !S_ISREG(st.st_mode))
+    {
+        close(fd);
+        return NULL;
+    }
+    *length = st.st_size;
+    void *data = st.st_size ? mmap(NULL, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0) : NULL;
+    close(fd);
+    if (data == MAP_FAILED)
+    {
+        fail("%s: %s", path, strerror(errno));
+    }
+    if (data)
+    {
+        madvise(data, st.st_size, MADV_SEQUENTIAL);
+    }
+    return data;
+}
+
+// ELF
+
+#define ELF_SECTION_LOADER(bits)                                                                        \
+    static void load_sections##bits(const uint8_t *file, size_t length, image_t *image)                 \
+    {                                                                                                   \
+        const Elf##bits##_Ehdr *header = (const Elf##bits##_Ehdr *)file;                                \
+        if (header->e_shoff + (uint64_t)header->e_shnum * sizeof(Elf##bits##_Shdr) > length)            \
+        {                                                                                               \
+            fail("truncated ELF file");                                                                 \
+        }                                                                                               \
+        const Elf##bits##_Shdr *sections = (const Elf##bits##_Shdr *)(file + header->e_shoff);          \
+        for (size_t i = 0; i < header->e_shnum && image->count < MAX_SECTIONS; i++)                     \
+        {                                                                                               \
+            const Elf##bits##_Shdr *section = &sections[i];                                             \
+            if (!(section->sh_flags & SHF_ALLOC) || (section->sh_flags & SHF_EXECINSTR) ||              \
+                section->sh_type == SHT_NOBITS || section->sh_size == 0 ||                              \
+                section->sh_offset + section->sh_size > length)                                         \
+            {                                                                                           \
+                continue;                                                                               \
+            }                                                                                           \
+            image->sections[image->count].address = section->sh_addr;                                   \
+            image->sections[image->count].size = section->sh_size;                                      \
+            image->sections[image->count].data = (const char *)file + section->sh_offset;               \
+            image->count++;                                                                             \
+        }                                                                                               \
+    }
+
+ELF_SECTION_LOADER(32)
+ELF_SECTION_LOADER(64)
+
+static void load_image(const char *path, image_t *image)
+{
+    size_t length;
+    const uint8_t *file = map_file(path, &length);
+    if (!file || length < EI_NIDENT || memcmp(file, ELFMAG, SELFMAG) != 0)
+    {
+        fail("%s: not an ELF file", path);
+    }
+    if (file[EI_DATA] != ELFDATA2LSB)
+    {
+        fail("%s: only little endian images are supported", path);
+    }
+    if (file[EI_CLASS] == ELFCLASS32 && length >= sizeof(Elf32_Ehdr))
+    {
+        load_sections32(file, length, image);
+    }
+    else if (file[EI_CLASS] == ELFCLASS64 && length >= sizeof(Elf64_Ehdr))
+    {
+        load_sections64(file, length, image);
+    }
+    else
+    {
+        fail("%s: unknown ELF class", path);
+    }
+}
+
+static const char *resolve_address(void *context, uint64_t address)
+{
+    const image_t *image = context;
+    for (size_t i = 0; image && i < image->count; i++)
+    {
+        const section_t *section = &image->sections[i];
+        if (address >= section->address && address < section->address + section->size)
+        {
+            const char *string = section->data + (address - section->address);
+            // only strings terminated inside their section
+            return memchr(string, 0, section->address + section->size - address) ? string : NULL;
+        }
+    }
+    return NULL;
+}
+
+// Decoding
+
+typedef enum
+{
+    ITEM_RECORD,
+    ITEM_HEADER,
+    ITEM_GARBAGE,
+    ITEM_INCOMPLETE,
+} item_t;
+
+// classifies the data at the start of buffer, sets the length of the item
+static item_t next_item(const uint8_t *data, size_t length, size_t *item_length)
+{
+    if (data[0] == LOG_BINARY_RECORD_MAGIC)
+    {
+        if (length < LOG_BINARY_RECORD_HEADER_SIZE)
+        {
+            return ITEM_INCOMPLETE;
+        }
+        *item_length = LOG_BINARY_RECORD_HEADER_SIZE + (data[2] | (data[3] << 8));
+        return *item_length <= length ? ITEM_RECORD : ITEM_INCOMPLETE;
+    }
+    if (data[0] == 'C')
+    {
+        if (length < LOG_BINARY_STREAM_HEADER_SIZE)
+        {
+            return memcmp(data, "CLOG", length < 4 ? length : 4) == 0 ? ITEM_INCOMPLETE : ITEM_GARBAGE;
+        }
+        log_binary_stream_t stream;
+        if (log_binary_parse_stream_header(data, length, &stream))
+        {
+            *item_length = LOG_BINARY_STREAM_HEADER_SIZE;
+            return ITEM_HEADER;
+        }
+    }
+    *item_length = 1;
+    return ITEM_GARBAGE;
+}
+
+static void chunk_reserve(chunk_t *chunk, size_t size)
+{
+    if (chunk->out_len + size <= chunk->out_size)
+    {
+        return;
+    }
+    size_t out_size = chunk->out_size ? chunk->out_size : 2 * chunk->length + 4096;
+    while (out_size < chunk->out_len + size)
+    {
+        out_size *= 2;
+    }
+    chunk->out = realloc(chunk->out, out_size);
+    if (!chunk->out)
+    {
+        fail("out of memory");
+    }
+    chunk->out_size = out_size;
+}
+
+static void decode_chunk(chunk_t *chunk)
+{
+    size_t pos = 0;
+    bool in_garbage = false;
+    chunk->out_len = 0;
+    chunk->records = 0;
+    chunk->skipped = 0;
+    while (pos < chunk->length)
+    {
+        size_t item_length = 1;
+        item_t item = next_item(chunk->data + pos, chunk->length - pos, &item_length);
+        log_binary_record_t record;
+        if (item == ITEM_RECORD &&
+            log_binary_parse_record(chunk->data + pos, item_length, &chunk->stream, resolve_address, (void *)chunk->image, &record))
+        {
+            chunk_reserve(chunk, 256);
+            size_t room = chunk->out_size - chunk->out_len;
+            int text_len = log_binary_format(&record, &chunk->stream, resolve_address, (void *)chunk->image, chunk->out + chunk->out_len, room);
+            if ((size_t)text_len >= room && text_len >= 0)
+            {
+                chunk_reserve(chunk, text_len + 1);
+                text_len = log_binary_format(&record, &chunk->stream, resolve_address, (void *)chunk->image, chunk->out + chunk->out_len, text_len + 1);
+            }
+            if (text_len >= 0)
+            {
+                chunk->out_len += text_len;
+                chunk->records++;
+                in_garbage = false;
+                pos += item_length;
+                continue;
+            }
+        }
+        if (item != ITEM_HEADER)
+        {
+            // not a valid record, resynchronize on the next byte
+            chunk->skipped += !in_garbage;
+            in_garbage = true;
+            item_length = 1;
+        }
+        pos += item_length;
+    }
+}
+
+static void *decode_worker(void *argument)
+{
+    decode_chunk(argument);
+    return NULL;
+}
+
+/**
+ * splits data into chunks of whole records, chunks never span a stream header
+ *
+ * @return size_t bytes consumed, the rest needs more data unless final
+ */
+static size_t split_chunks(decoder_t *decoder, const uint8_t *data, size_t length, bool final,
+                           chunk_t *chunks, size_t *count, size_t max_count)
+{
+    size_t pos = 0;
+    bool need_data = false;
+    *count = 0;
+    while (pos < length && *count < max_count && !need_data)
+    {
+        chunk_t *chunk = &chunks[*count];
+        chunk->data = data + pos;
+        size_t start = pos;
+        while (pos < length && pos - start < CHUNK_SIZE)
+        {
+            size_t item_length = 1;
+            item_t item = next_item(data + pos, length - pos, &item_length);
+            if (item == ITEM_INCOMPLETE && !final)
+            {
+                need_data = true;
+                break;
+            }
+            if (item == ITEM_HEADER)
+            {
+                if (pos > start)
+                {
+                    break;
+                }
+                log_binary_parse_stream_header(data + pos, length - pos, &decoder->stream);
+            }
+            pos += item == ITEM_INCOMPLETE ? 1 : item_length;
+        }
+        chunk->stream = decoder->stream;
+        chunk->length = pos - start;
+        *count += chunk->length > 0;
+    }
+    return pos;
+}
+
+static size_t decode_buffer(decoder_t *decoder, const uint8_t *data, size_t length, bool final)
+{
+    static chunk_t chunks[MAX_JOBS];
+    size_t consumed = 0;
+    while (consumed < length)
+    {
+        size_t count;
+        size_t split = split_chunks(decoder, data + consumed, length - consumed, final, chunks, &count, decoder->jobs);
+        if (count == 0)
+        {
+            break;
+        }
+        pthread_t threads[MAX_JOBS];
+        bool started[MAX_JOBS];
+        for (size_t i = 0; i < count; i++)
+        {
+            chunks[i].image = decoder->image;
+            started[i] = count > 1 && pthread_create(&threads[i], NULL, decode_worker, &chunks[i]) == 0;
+            if (!started[i])
+            {
+                decode_chunk(&chunks[i]);
+            }
+        }
+        for (size_t i = 0; i < count; i++)
+        {
+            if (started[i])
+            {
+                pthread_join(threads[i], NULL);
+            }
+            fwrite(chunks[i].out, 1, chunks[i].out_len, decoder->output);
+            decoder->records += chunks[i].records;
+            decoder->skipped += chunks[i].skipped;
+        }
+        consumed += split;
+    }
+    return consumed;
+}
+
+static void decode_stream(decoder_t *decoder, FILE *input)
+{
+    size_t size = (size_t)decoder->jobs * CHUNK_SIZE + 65536;
+    uint8_t *buffer = malloc(size);
+    if (!buffer)
+    {
+        fail("out of memory");
+    }
+    size_t length = 0;
+    bool final = false;
+    while (!final)
+    {
+        size_t read = fread(buffer + length, 1, size - length, input);
+        length += read;
+        final = read == 0;
+        size_t consumed = decode_buffer(decoder, buffer, length, final);
+        memmove(buffer, buffer + consumed, length - consumed);
+        length -= consumed;
+    }
+    free(buffer);
+}
+
+static void decode_file(decoder_t *decoder, const char *path)
+{
+    if (strcmp(path, "-") == 0)
+    {
+        decode_stream(decoder, stdin);
+        return;
+    }
+    size_t length;
+    const uint8_t *data = map_file(path, &length);
+    if (data)
+    {
+        decode_buffer(decoder, data, length, true);
+        munmap((void *)data, length);
+        return;
+    }
+    if (length == 0)
+    {
+        return;
+    }
+    FILE *input = fopen(path, "rb");
+    if (!input)
+    {
+        fail("%s: %s", path, strerror(errno));
+    }
+    decode_stream(decoder, input);
+    fclose(input);
+}
+
+// Benchmark
+
+// log_binary.c is the only file of the logger built in, the strings of the synthetic capture are inline
+bool log_impl_image_address(const void *ptr, uint64_t *address)
+{
+    return false;
+}
+
+static size_t encode(uint8_t *record, size_t size, uint8_t level, const char *tag, const char *format, ...)
+{
+    va_list list;
+    va_start(list, format);
+    size_t length = log_binary_encode(record, size, level, 0, tag, format, list);
+    va_end(list);
+    return length;
+}
+
+// records shaped like the output of the LOGx macros, with colors
+static void generate_capture(const char *path, size_t size)
+{
+    static const char *tags[] = {"wifi", "http_server", "sensor", "main"};
+    const size_t block_size = 4 * 1024 * 1024;
+    uint8_t *block = malloc(block_size);
+    size_t block_len = 0;
+    for (uint32_t i = 0; block_len + 256 < block_size; i++)
+    {
+        const char *tag = tags[i % 4];
+        uint8_t *record = block + block_len;
+        size_t room = block_size - block_len;
+        switch (i % 4)
+        {
+        case 0:
+            block_len += encode(record, room, 3, tag, "\033[0;32mI (%u) %s: %s:%d [%s] connected to %s, rssi %d\033[0m\n",
+                                i, tag, "src/wifi.c", 120, "wifi_event", "access-point", -40 - (int)(i % 50));
+            break;
+        case 1:
+            block_len += encode(record, room, 4, tag, "D (%u) %s: %s:%d [%s] GET %s -> %d (%u bytes)\033[0m\n",
+                                i, tag, "src/http.c", 342, "handle_request", "/index.html", 200, i * 7);
+            break;
+        case 2:
+            block_len += encode(record, room, 2, tag, "\033[0;33mW (%u) %s: %s:%d [%s] temperature %.2f above %d\033[0m\n",
+                                i, tag, "src/sensor.c", 88, "read_sensor", 40.0 + (i % 100) / 10.0, 40);
+            break;
+        default:
+            block_len += encode(record, room, 5, tag, "V (%u) %s: %s:%d [%s] heap %zu, uptime %llu us\033[0m\n",
+                                i, tag, "src/main.c", 57, "app_main", (size_t)200000 - i, (unsigned long long)i * 1000);
+            break;
+        }
+    }
+    FILE *output = fopen(path, "wb");
+    if (!output)
+    {
+        fail("%s: %s", path, strerror(errno));
+    }
+    uint8_t header[LOG_BINARY_STREAM_HEADER_SIZE];
+    fwrite(header, 1, log_binary_stream_header(header), output);
+    for (size_t written = 0; written < size; written += block_len)
+    {
+        if (fwrite(block, 1, block_len, output) != block_len)
+        {
+            fail("%s: %s", path, strerror(errno));
+        }
+    }
+    fclose(output);
+    free(block);
+}
+
+static double now_seconds(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+static void benchmark(size_t megabytes, int jobs)
+{
+    char path[256];
+    const char *directory = getenv("TMPDIR") ? getenv("TMPDIR") : "/tmp";
+    snprintf(path, sizeof(path), "%s/log_decoder_benchmark_%d.bin", directory, (int)getpid());
+    printf("generating %zu MB capture in %s\n", megabytes, path);
+    generate_capture(path, megabytes * 1024 * 1024);
+
+    size_t length;
+    const uint8_t *data = map_file(path, &length);
+    double start = now_seconds();
+    uint64_t sum = 0;
+    for (size_t i = 0; i < length; i += 64)
+    {
+        sum += data[i];
+    }
+    double read_time = now_seconds() - start;
+    munmap((void *)data, length);
+    printf("%-24s %8.1f MB/s (checksum %llu)\n", "read", length / read_time / 1e6, (unsigned long long)sum);
+
+    int job_counts[] = {1, jobs};
+    for (int i = 0; i < (jobs > 1 ? 2 : 1); i++)
+    {
+        decoder_t decoder = {.image = NULL, .jobs = job_counts[i], .stream = s_default_stream};
+        decoder.output = fopen("/dev/null", "w");
+        start = now_seconds();
+        decode_file(&decoder, path);
+        fclose(decoder.output);
+        double decode_time = now_seconds() - start;
+        printf("decode, %2d jobs           %8.1f MB/s %10.0f records/s\n", decoder.jobs,
+               length / decode_time / 1e6, decoder.records / decode_time);
+    }
+    unlink(path);
+}
+
+static void usage(void)
+{
+    fprintf(stderr, "usage: log_decoder [-e firmware.elf] [-j jobs] [capture | -]\n"
+                    "       log_decoder -b megabytes [-j jobs]\n");
+    exit(2);
+}
+
+int main(int argc, char *argv[])
+{
+    static image_t image;
+    const char *elf_path = NULL;
+    long jobs = sysconf(_SC_NPROCESSORS_ONLN);
+    long benchmark_megabytes = 0;
+    int option;
+    while ((option = getopt(argc, argv, "e:j:b:h")) != -1)
+    {
+        switch (option)
+        {
+        case 'e':
+            elf_path = optarg;
+            break;
+        case 'j':
+            jobs = strtol(optarg, NULL, 10);
+            break;
+        case 'b':
+            benchmark_megabytes = strtol(optarg, NULL, 10);
+            break;
+        default:
+            usage();
+        }
+    }
+    jobs = jobs < 1 ? 1 : (jobs > MAX_JOBS ? MAX_JOBS : jobs);
+    if (benchmark_megabytes > 0)
+    {
+        benchmark(benchmark_megabytes, jobs);
+        return 0;
+    }
+    if (optind + 1 < argc)
+    {
+        usage();
+    }
+    if (elf_path)
+    {
+        load_image(elf_path, &image);
+    }
+
+    decoder_t decoder = {.image = elf_path ? &image : NULL, .output = stdout, .jobs = jobs, .stream = s_default_stream};
+    static char output_buffer[1 << 20];
+    setvbuf(stdout, output_buffer, _IOFBF, sizeof(output_buffer));
+    decode_file(&decoder, optind < argc ? argv[optind] : "-");
+    fflush(stdout);
+    if (decoder.skipped)
+    {
+        fprintf(stderr, "log_decoder: %llu records, skipped %llu invalid byte ranges\n",
+                (unsigned long long)decoder.records, (unsigned long long)decoder.skipped);
+    }
+    return 0;
+}